@@ -319,6 +319,7 @@ BookBuildControl::startAnalysis(const std::vector<Move>& moves) {
             bbc.notify(BookBuildControl::Change::PV);
         }
         void notifyStats(S64 nodes, S64 nps, int hashFull, S64 tbHits, S64 time) override {}
+        void notifySearchStats(const std::vector<std::string>& lines) override {}
     private:
         BookBuildControl& bbc;
         Position pos0;
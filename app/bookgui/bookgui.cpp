@@ -26,6 +26,7 @@
 #include "bookgui.hpp"
 #include "moveGen.hpp"
 #include "textio.hpp"
+#include "util/mappedFile.hpp"
 #include <iostream>
 
 int
@@ -861,8 +862,8 @@ BookGui::importPgn() {
     int nGames = 0;
     try {
         Position startPos = TextIO::readFEN(TextIO::startPosFEN);
-        std::ifstream is(pgnImportFilename);
-        PgnReader reader(is);
+        MappedFile pgnData(pgnImportFilename);
+        PgnReader reader(pgnData.data(), pgnData.size());
         GameTree gt;
         while (reader.readPGN(gt)) {
             nGames++;
@@ -219,6 +219,13 @@ EngineMainThread::doSearch() {
         waitForStop = true;
     }
     clearHistory = false;
+    if (waitForStop && SearchStats::enabled) {
+        // Helper threads add their statistics to the totals before they
+        // acknowledge the stop command, so the totals are complete after this.
+        stopHelpers();
+        waitForStop = false;
+        sc->notifySearchStats();
+    }
     while (*ponder || *infinite) {
         // We should not respond until told to do so.
         // Just wait until we are allowed to respond.
@@ -227,25 +234,29 @@ EngineMainThread::doSearch() {
 
     engineControl->finishSearch(pos, m);
 
-    if (waitForStop) {
-        comm->sendStopSearch();
-        class Handler : public Communicator::CommandHandler {
-        public:
-            explicit Handler(Communicator* comm) : comm(comm) {}
-            void stopAck() override { comm->sendStopAck(true); }
-        private:
-            Communicator* comm;
-        };
-        Handler handler(comm.get());
-        comm->sendStopAck(false);
-        while (true) {
-            comm->poll(handler);
-            if (comm->hasStopAck())
-                break;
-            notifierWait();
-        }
-        notifier.notify();
+    if (waitForStop)
+        stopHelpers();
+}
+
+void
+EngineMainThread::stopHelpers() {
+    comm->sendStopSearch();
+    class Handler : public Communicator::CommandHandler {
+    public:
+        explicit Handler(Communicator* comm) : comm(comm) {}
+        void stopAck() override { comm->sendStopAck(true); }
+    private:
+        Communicator* comm;
+    };
+    Handler handler(comm.get());
+    comm->sendStopAck(false);
+    while (true) {
+        comm->poll(handler);
+        if (comm->hasStopAck())
+            break;
+        notifierWait();
     }
+    notifier.notify();
 }
 
 void
@@ -93,6 +93,10 @@ private:
     void doSearch();
     void setOptions();
 
+    /** Tell helper threads to stop searching and wait until they have
+     *  acknowledged the stop command. */
+    void stopHelpers();
+
     /** Wait for notifier. If cluster is enabled, only wait a short period of time
      *  since MPI communication needs polling. */
     void notifierWait();
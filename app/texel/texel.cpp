@@ -30,8 +30,127 @@
 #include "uciprotocol.hpp"
 #include "numa.hpp"
 #include "cluster.hpp"
+#include "search.hpp"
+#include "killerTable.hpp"
+#include "history.hpp"
+#include "textio.hpp"
+#include "util/timeUtil.hpp"
 
 #include <memory>
+#include <vector>
+#include <iostream>
+#include <iomanip>
+
+/** Measure and print the cost of make/unmake, SEE make/unmake and
+ *  copying a Position, for all legal moves in a set of positions. */
+static void
+benchMakeMove(const std::vector<const char*>& fens) {
+    const int nIter = 20000;
+    S64 nMoves = 0;
+    double tMake = 0, tSEE = 0, tCopy = 0;
+    for (const char* fen : fens) {
+        Position pos = TextIO::readFEN(fen);
+        MoveList moves;
+        MoveGen::pseudoLegalMoves(pos, moves);
+        MoveGen::removeIllegal(pos, moves);
+        UndoInfo ui;
+
+        double t0 = currentTime();
+        for (int i = 0; i < nIter; i++) {
+            for (int mi = 0; mi < moves.size; mi++) {
+                pos.makeMove(moves[mi], ui);
+                pos.unMakeMove(moves[mi], ui);
+            }
+        }
+        double t1 = currentTime();
+        for (int i = 0; i < nIter; i++) {
+            for (int mi = 0; mi < moves.size; mi++) {
+                pos.makeSEEMove(moves[mi], ui);
+                pos.unMakeSEEMove(moves[mi], ui);
+            }
+        }
+        double t2 = currentTime();
+        std::vector<Position> copies(64, pos);
+        for (int i = 0; i < nIter * moves.size; i++) {
+            copies[i & 63] = copies[(i + 1) & 63];
+            copies[(i + 1) & 63] = pos;
+        }
+        double t3 = currentTime();
+
+        nMoves += (S64)nIter * moves.size;
+        tMake += t1 - t0;
+        tSEE += t2 - t1;
+        tCopy += t3 - t2;
+    }
+    auto ns = [nMoves](double t) { return t * 1e9 / nMoves; };
+    std::cout << std::fixed << std::setprecision(1)
+              << "sizeof(Position) " << sizeof(Position)
+              << " make/unMake " << ns(tMake) << "ns"
+              << " makeSEE/unMakeSEE " << ns(tSEE) << "ns"
+              << " 2*copy " << ns(tCopy) << "ns" << std::endl;
+}
+
+/** Search a fixed set of positions to a fixed depth using one thread and
+ *  print the number of searched nodes and the search speed. Then print
+ *  the cost of the basic Position operations for the same positions. */
+static void
+bench(int depth) {
+    const std::vector<const char*> fens = {
+        "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+        "r1bqkb1r/pppp1ppp/2n2n2/4p3/2B1P3/5N2/PPPP1PPP/RNBQK2R w KQkq - 4 4",
+        "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+        "r2q1rk1/pp2bppp/2n1pn2/3p4/3P4/2NBPN2/PP3PPP/R2Q1RK1 w - - 0 9",
+        "2rq1rk1/pb1nbppp/1p2pn2/2pp4/2PP4/1P2PN2/PBQNBPPP/R4RK1 w - - 0 11",
+        "r1b2rk1/2q1bppp/p2p1n2/np2p3/3PP3/5N1P/PPBN1PP1/R1BQR1K1 w - - 0 13",
+        "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+        "2r3k1/pp3ppp/2n1b3/3p4/3P4/2P1BN2/P4PPP/3R2K1 b - - 0 22",
+        "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+        "8/8/4kpp1/3p1b2/p6P/2B5/6P1/6K1 b - - 0 47",
+        "6k1/5p2/6p1/8/7p/8/6PP/6K1 b - - 0 1",
+        "8/3k4/8/8/8/4B3/4KB2/2N5 w - - 0 1",
+    };
+#ifdef COPY_MAKE
+    const char* mode = "copy-make";
+#else
+    const char* mode = "make/unmake";
+#endif
+    std::cout << ComputerPlayer::engineName << ", search mode " << mode << std::endl;
+
+    TranspositionTable tt(1024 * 1024);
+    Notifier notifier;
+    ThreadCommunicator comm(nullptr, tt, notifier, false);
+    auto et = Evaluate::getEvalHashTables();
+    std::vector<U64> posHashList(SearchConst::MAX_SEARCH_DEPTH * 2);
+    TreeLogger treeLog;
+    S64 totNodes = 0;
+    double totTime = 0;
+    int posNo = 0;
+    for (const char* fen : fens) {
+        Position pos = TextIO::readFEN(fen);
+        tt.clear();
+        KillerTable kt;
+        History ht;
+        Search::SearchTables st(comm.getCTT(), kt, ht, *et);
+        Search sc(pos, posHashList, 0, st, comm, treeLog);
+        MoveList moves;
+        MoveGen::pseudoLegalMoves(pos, moves);
+        MoveGen::removeIllegal(pos, moves);
+        sc.scoreMoveList(moves, 0);
+        double t0 = currentTime();
+        Move m = sc.iterativeDeepening(moves, depth, -1);
+        double t = currentTime() - t0;
+        S64 nodes = sc.getTotalNodesThisThread();
+        totNodes += nodes;
+        totTime += t;
+        std::cout << std::setw(2) << ++posNo << ' ' << std::setw(6) << TextIO::moveToUCIString(m)
+                  << " nodes " << std::setw(10) << nodes
+                  << " time " << std::setw(6) << (S64)(t * 1000) << std::endl;
+    }
+    std::cout << "Total nodes " << totNodes << " time " << (S64)(totTime * 1000)
+              << " nps " << (S64)(totNodes / std::max(totTime, 1e-3)) << std::endl;
+
+    benchMakeMove(fens);
+}
 
 /** Texel chess engine main function. */
 int main(int argc, char* argv[]) {
@@ -45,6 +164,12 @@ int main(int argc, char* argv[]) {
         game.play();
     } else if ((argc == 3) && (std::string(argv[1]) == "tree")) {
         TreeLoggerReader::main(argv[2]);
+    } else if ((argc >= 2) && (argc <= 3) && (std::string(argv[1]) == "bench")) {
+        int depth = 12;
+        if ((argc == 3) && (!str2Num(argv[2], depth) || (depth <= 0)))
+            std::cerr << "Invalid depth: " << argv[2] << std::endl;
+        else
+            bench(depth);
     } else {
         if ((argc == 2) && (std::string(argv[1]) == "-nonuma"))
             Numa::instance().disable();
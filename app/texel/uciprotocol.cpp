@@ -83,6 +83,12 @@ SearchListener::notifyStats(S64 nodes, S64 nps, int hashFull, S64 tbHits, S64 ti
     os << " time " << time << std::endl;
 }
 
+void
+SearchListener::notifySearchStats(const std::vector<std::string>& lines) {
+    for (const std::string& line : lines)
+        os << "info string stats " << line << std::endl;
+}
+
 void
 SearchListener::notifyPlayedMove(const Move& bestMove, const Move& ponderMove) {
     os << "bestmove " << moveToString(bestMove);
@@ -51,6 +51,8 @@ public:
 
     void notifyStats(S64 nodes, S64 nps, int hashFull, S64 tbHits, S64 time) override;
 
+    void notifySearchStats(const std::vector<std::string>& lines) override;
+
     void notifyPlayedMove(const Move& bestMove, const Move& ponderMove);
 
 private:
@@ -40,6 +40,7 @@
 #include "util/random.hpp"
 
 #include <queue>
+#include <map>
 #include <unordered_set>
 #include <unistd.h>
 #include <stdio.h>
@@ -119,6 +120,20 @@ static std::vector<std::string> splitLines(const std::string& lines) {
     return ret;
 }
 
+void
+splitString(const std::string& line, const std::string& delim, std::vector<std::string>& fields) {
+    size_t start = 0;
+    while (true) {
+        size_t n = line.find(delim, start);
+        if (n == std::string::npos)
+            break;
+        fields.push_back(line.substr(start, n - start));
+        start = n + delim.length();
+    }
+    if (start < line.length())
+        fields.push_back(line.substr(start));
+}
+
 // --------------------------------------------------------------------------------
 
 ChessTool::ChessTool(bool useEntropyErr, bool optMoveOrder, bool useSearchScore)
@@ -158,65 +173,115 @@ ChessTool::readStream(std::istream& is) {
 
 const int UNKNOWN_SCORE = -32767; // Represents unknown static eval score
 
+/** Search object and search tables owned by one worker thread. */
+struct ChessTool::SearchWorker {
+    explicit SearchWorker(U64 ttEntries)
+        : tt(ttEntries), comm(nullptr, tt, notifier, false),
+          et(Evaluate::getEvalHashTables()), st(comm.getCTT(), kt, ht, *et),
+          posHashList(SearchConst::MAX_SEARCH_DEPTH * 2),
+          sc(Position(), posHashList, 0, st, comm, treeLog) {
+    }
+
+    TranspositionTable tt;
+    Notifier notifier;
+    ThreadCommunicator comm;
+    KillerTable kt;
+    History ht;
+    std::unique_ptr<Evaluate::EvalHashTables> et;
+    Search::SearchTables st;
+    TreeLogger treeLog;
+    std::vector<U64> posHashList;
+    Search sc;
+};
+
+int
+ChessTool::nWorkerThreads() {
+    return std::max(1, (int)std::thread::hardware_concurrency());
+}
+
 void
 ChessTool::pgnToFen(std::istream& is, int everyNth) {
-    static std::vector<U64> nullHist(SearchConst::MAX_SEARCH_DEPTH * 2);
-    static TranspositionTable tt(512*1024);
-    Notifier notifier;
-    ThreadCommunicator comm(nullptr, tt, notifier, false);
-    static KillerTable kt;
-    static History ht;
-    static auto et = Evaluate::getEvalHashTables();
-    static Search::SearchTables st(comm.getCTT(), kt, ht, *et);
-    static TreeLogger treeLog;
-    Random rnd;
+    struct FenLine {
+        std::string fen;
+        double rScore;
+        int commentScore;
+        int score;
+        int gameNo; // Game number within the chunk
+        std::string move;
+    };
+    struct Chunk {
+        std::string pgn;
+        U64 seed = 0;
+        int nGames = 0;
+        std::vector<FenLine> lines;
+    };
 
-    Position pos;
-    const int mate0 = SearchConst::MATE0;
-    Search sc(pos, nullHist, 0, st, comm, treeLog);
+    const int nWorkers = nWorkerThreads();
+    std::vector<std::unique_ptr<SearchWorker>> workers(nWorkers);
+    PgnSplitter splitter(is);
+    Random rnd;
+    auto produce = [&splitter,&rnd](Chunk& c) -> bool {
+        const int gamesPerChunk = 100;
+        c.seed = rnd.nextU64();
+        return splitter.readChunk(gamesPerChunk, c.pgn);
+    };
+    auto work = [&workers,everyNth](Chunk& c, int workerNo) {
+        std::unique_ptr<SearchWorker>& w = workers[workerNo];
+        if (!w)
+            w = make_unique<SearchWorker>(512*1024);
+        Search& sc = w->sc;
+        Random rnd(c.seed);
+        const int mate0 = SearchConst::MATE0;
 
-    PgnReader reader(is);
-    GameTree gt;
-    int gameNo = 0;
-    while (reader.readPGN(gt)) {
-        gameNo++;
-        GameTree::Result result = gt.getResult();
-        if (result == GameTree::UNKNOWN)
-            continue;
-        double rScore = 0;
-        switch (result) {
-        case GameTree::WHITE_WIN: rScore = 1.0; break;
-        case GameTree::BLACK_WIN: rScore = 0.0; break;
-        case GameTree::DRAW:      rScore = 0.5; break;
-        default: break;
-        }
-        GameNode gn = gt.getRootNode();
-        while (true) {
-            pos = gn.getPos();
-            std::string fen = TextIO::toFEN(pos);
-            if (gn.nChildren() == 0)
-                break;
-            gn.goForward(0);
-            std::string move = TextIO::moveToUCIString(gn.getMove());
-            std::string comment = gn.getComment();
-            int commentScore;
-            if (!getCommentScore(comment, commentScore))
+        PgnReader reader(c.pgn.data(), c.pgn.size());
+        GameTree gt;
+        while (reader.readPGN(gt)) {
+            c.nGames++;
+            GameTree::Result result = gt.getResult();
+            if (result == GameTree::UNKNOWN)
                 continue;
+            double rScore = 0;
+            switch (result) {
+            case GameTree::WHITE_WIN: rScore = 1.0; break;
+            case GameTree::BLACK_WIN: rScore = 0.0; break;
+            case GameTree::DRAW:      rScore = 0.5; break;
+            default: break;
+            }
+            GameNode gn = gt.getRootNode();
+            while (true) {
+                Position pos = gn.getPos();
+                std::string fen = TextIO::toFEN(pos);
+                if (gn.nChildren() == 0)
+                    break;
+                gn.goForward(0);
+                std::string move = TextIO::moveToUCIString(gn.getMove());
+                std::string comment = gn.getComment();
+                int commentScore;
+                if (!getCommentScore(comment, commentScore))
+                    continue;
 
-            if (everyNth > 1 && rnd.nextInt(everyNth) != 0)
-                continue;
+                if (everyNth > 1 && rnd.nextInt(everyNth) != 0)
+                    continue;
 
-            sc.init(pos, nullHist, 0);
-            sc.q0Eval = UNKNOWN_SCORE;
-            int score = sc.quiesce(-mate0, mate0, 0, 0, MoveGen::inCheck(pos));
-            if (!pos.isWhiteMove()) {
-                score = -score;
-                commentScore = -commentScore;
+                sc.init(pos, w->posHashList, 0);
+                sc.q0Eval = UNKNOWN_SCORE;
+                int score = sc.quiesce(-mate0, mate0, 0, 0, MoveGen::inCheck(pos));
+                if (!pos.isWhiteMove()) {
+                    score = -score;
+                    commentScore = -commentScore;
+                }
+                c.lines.push_back(FenLine{fen, rScore, commentScore, score, c.nGames, move});
             }
-            std::cout << fen << " : " << rScore << " : " << commentScore << " : " << score
-                      << " : " << gameNo << " : " << move << '\n';
         }
-    }
+    };
+    int gameNo = 0;
+    auto consume = [&gameNo](Chunk& c) {
+        for (const FenLine& fl : c.lines)
+            std::cout << fl.fen << " : " << fl.rScore << " : " << fl.commentScore << " : " << fl.score
+                      << " : " << (gameNo + fl.gameNo) << " : " << fl.move << '\n';
+        gameNo += c.nGames;
+    };
+    orderedParallelMap<Chunk>(nWorkers, nWorkers * 4, produce, work, consume);
     std::cout << std::flush;
 }
 
@@ -231,35 +296,59 @@ ChessTool::fenToPgn(std::istream& is) {
 
 void
 ChessTool::movesToFen(std::istream& is) {
-    std::vector<std::string> lines = readStream(is);
-    Position startPos(TextIO::readFEN(TextIO::startPosFEN));
-    std::vector<std::string> words;
-    for (const std::string& line : lines) {
-        Position pos(startPos);
-        UndoInfo ui;
-        words.clear();
-        splitString(line, words);
-        bool inSequence = true;
-        bool fenPrinted = false;
-        for (const std::string& word : words) {
-            if (inSequence) {
-                Move move = TextIO::stringToMove(pos, word);
-                if (move.isEmpty()) {
-                    inSequence = false;
-                    std::cout << TextIO::toFEN(pos);
-                    fenPrinted = true;
-                } else {
-                    pos.makeMove(move, ui);
+    struct Batch {
+        std::vector<std::string> lines;
+    };
+    auto produce = [&is](Batch& b) -> bool {
+        const int batchSize = 1000;
+        std::string line;
+        while ((int)b.lines.size() < batchSize) {
+            std::getline(is, line);
+            if (!is || is.eof())
+                break;
+            b.lines.push_back(line);
+        }
+        return !b.lines.empty();
+    };
+    auto work = [](Batch& b, int workerNo) {
+        Position startPos(TextIO::readFEN(TextIO::startPosFEN));
+        std::vector<std::string> words;
+        for (std::string& line : b.lines) {
+            Position pos(startPos);
+            UndoInfo ui;
+            words.clear();
+            splitString(line, words);
+            std::string out;
+            bool inSequence = true;
+            bool fenPrinted = false;
+            for (const std::string& word : words) {
+                if (inSequence) {
+                    Move move = TextIO::stringToMove(pos, word);
+                    if (move.isEmpty()) {
+                        inSequence = false;
+                        out += TextIO::toFEN(pos);
+                        fenPrinted = true;
+                    } else {
+                        pos.makeMove(move, ui);
+                    }
+                }
+                if (!inSequence) {
+                    out += ' ';
+                    out += word;
                 }
             }
-            if (!inSequence) {
-                std::cout << ' ' << word;
-            }
+            if (!fenPrinted)
+                out += TextIO::toFEN(pos);
+            line = std::move(out);
         }
-        if (!fenPrinted)
-            std::cout << TextIO::toFEN(pos);
-        std::cout << std::endl;
-    }
+    };
+    auto consume = [](Batch& b) {
+        for (const std::string& line : b.lines)
+            std::cout << line << '\n';
+    };
+    const int nWorkers = nWorkerThreads();
+    orderedParallelMap<Batch>(nWorkers, nWorkers * 4, produce, work, consume);
+    std::cout << std::flush;
 }
 
 void
@@ -563,6 +652,124 @@ ChessTool::computeSearchScores(std::istream& is, const std::string& script, int
     }
 }
 
+void
+ChessTool::computeSearchScores(std::istream& is, int maxDepth, S64 maxNodes, int nWorkers) {
+    // The hash table is cleared before each position, so keep it small enough
+    // that clearing is cheap compared to the search itself. For a depth limited
+    // search, assume the tree size grows by about a factor 4 for each ply.
+    U64 ttEntries;
+    if (maxNodes > 0)
+        ttEntries = clamp((U64)maxNodes, (U64)64 * 1024, (U64)4 * 1024 * 1024);
+    else
+        ttEntries = 1ULL << clamp(2 * maxDepth + 8, 12, 22);
+    std::vector<std::unique_ptr<SearchWorker>> workers(nWorkers);
+
+    struct Batch {
+        std::vector<std::string> lines;
+    };
+    auto produce = [&is](Batch& b) -> bool {
+        const int batchSize = 100;
+        std::string line;
+        while ((int)b.lines.size() < batchSize) {
+            std::getline(is, line);
+            if (!is || is.eof())
+                break;
+            b.lines.push_back(line);
+        }
+        return !b.lines.empty();
+    };
+    auto work = [&workers,ttEntries,maxDepth,maxNodes](Batch& b, int workerNo) {
+        std::unique_ptr<SearchWorker>& w = workers[workerNo];
+        if (!w)
+            w = make_unique<SearchWorker>(ttEntries);
+        std::vector<std::string> fields;
+        for (std::string& line : b.lines) {
+            fields.clear();
+            splitString(line, " : ", fields);
+            if ((fields.size() < 4) || (fields.size() > 6))
+                throw ChessParseError("Invalid line: " + line);
+            Position pos = TextIO::readFEN(fields[0]);
+            MoveList legalMoves;
+            MoveGen::pseudoLegalMoves(pos, legalMoves);
+            MoveGen::removeIllegal(pos, legalMoves);
+            int score;
+            if (legalMoves.size == 0) {
+                score = MoveGen::inCheck(pos) ? -SearchConst::MATE0 + 1 : 0;
+            } else {
+                w->tt.clear();
+                w->ht.init();
+                w->sc.init(pos, w->posHashList, 0);
+                int maxPV = 1;
+                bool onlyExact = true;
+                int minProbeDepth = 1;
+                Move bestMove = w->sc.iterativeDeepening(legalMoves, maxDepth, maxNodes, maxPV,
+                                                         onlyExact, minProbeDepth);
+                score = bestMove.score();
+            }
+            if (!pos.isWhiteMove())
+                score = -score;
+            fields[2] = num2Str(score);
+            line = fields[0];
+            for (size_t i = 1; i < fields.size(); i++)
+                line += " : " + fields[i];
+        }
+    };
+    auto consume = [](Batch& b) {
+        for (const std::string& line : b.lines)
+            std::cout << line << '\n';
+        std::cout << std::flush;
+    };
+    orderedParallelMap<Batch>(nWorkers, nWorkers * 4, produce, work, consume);
+}
+
+void
+ChessTool::searchStats(std::istream& is, int maxDepth, S64 maxNodes) {
+    if (!SearchStats::enabled)
+        throw ChessParseError("Search statistics not available, compile with USE_SEARCH_STATS");
+    SearchWorker w(4 * 1024 * 1024);
+    SearchStatsCollector total;
+    std::vector<std::string> fields, lines;
+    std::string line;
+    int nPos = 0;
+    while (true) {
+        std::getline(is, line);
+        if (!is || is.eof())
+            break;
+        fields.clear();
+        splitString(line, " : ", fields);
+        if (fields.empty())
+            continue;
+        Position pos = TextIO::readFEN(fields[0]);
+        MoveList legalMoves;
+        MoveGen::pseudoLegalMoves(pos, legalMoves);
+        MoveGen::removeIllegal(pos, legalMoves);
+        if (legalMoves.size == 0)
+            continue;
+        w.tt.clear();
+        w.ht.init();
+        w.sc.init(pos, w.posHashList, 0);
+        Move bestMove = w.sc.iterativeDeepening(legalMoves, maxDepth, maxNodes);
+
+        SearchStatsCollector stats;
+        w.sc.getSearchStatsTotals(stats);
+        total.add(stats);
+        nPos++;
+        std::cout << fields[0] << " : " << TextIO::moveToUCIString(bestMove)
+                  << ' ' << bestMove.score() << '\n';
+        lines.clear();
+        stats.getLines(lines);
+        for (const std::string& l : lines)
+            std::cout << "  " << l << '\n';
+        std::cout << std::flush;
+    }
+    std::cout << "total " << nPos << " positions\n";
+    lines.clear();
+    total.getLines(lines);
+    for (const std::string& l : lines)
+        std::cout << "  " << l << '\n';
+    std::cout << std::flush;
+}
+
 void
 ChessTool::evalEffect(std::istream& is, const std::vector<ParamValue>& parValues) {
     std::vector<PositionInfo> positions;
@@ -1512,20 +1719,6 @@ ChessTool::getCommentScore(const std::string& comment, int& score) {
     return false;
 }
 
-void
-splitString(const std::string& line, const std::string& delim, std::vector<std::string>& fields) {
-    size_t start = 0;
-    while (true) {
-        size_t n = line.find(delim, start);
-        if (n == std::string::npos)
-            break;
-        fields.push_back(line.substr(start, n - start));
-        start = n + delim.length();
-    }
-    if (start < line.length())
-        fields.push_back(line.substr(start));
-}
-
 void
 ChessTool::readFENFile(std::istream& is, std::vector<PositionInfo>& data) {
     std::vector<std::string> lines = readStream(is);
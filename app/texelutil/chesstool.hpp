@@ -98,7 +98,9 @@ public:
      * Skip positions where searchScore is a mate score. Also skip positions where corresponding
      * game score is unknown. All scores are from white's perspective. gameResult is 0.0, 0.5 or 1.0,
      * also from white's perspective.
-     * If everyNth is larger than one, each position is printed with probability 1/everyNth. */
+     * If everyNth is larger than one, each position is printed with probability 1/everyNth.
+     * Games are parsed and evaluated by several threads, but the output order
+     * matches the input order. */
     void pgnToFen(std::istream& is, int everyNth);
 
     /** Read file with one FEN position per line. Output PGN file using "FEN" and "SetUp" tags. */
@@ -106,7 +108,8 @@ public:
 
     /** Read lines from is and for each line, replace a sequence of moves with the resulting FEN
      * after executing those moves from the initial position. Any remaining words on the line
-     * are copied unmodified to standard output. */
+     * are copied unmodified to standard output. Lines are processed by several threads,
+     * but the output order matches the input order. */
     void movesToFen(std::istream& is);
 
     /** Compute average evaluation error for different pawn advantage values. */
@@ -130,6 +133,17 @@ public:
      *  Use "nWorkers" worker threads. */
     void computeSearchScores(std::istream& is, const std::string& script, int nWorkers);
 
+    /** In a FEN file, update the search score in each line by searching each position
+     *  in-process to a fixed depth and/or node count. Use "nWorkers" worker threads, each
+     *  having its own Search object and search tables. The input is processed in batches
+     *  and output lines are written in the same order as the input lines. */
+    void computeSearchScores(std::istream& is, int maxDepth, S64 maxNodes, int nWorkers);
+
+    /** Search each position in a FEN file to a fixed depth and/or node count and
+     *  print search event counters for each position and for all positions.
+     *  Requires texel to be compiled with SEARCH_STATS defined. */
+    void searchStats(std::istream& is, int maxDepth, S64 maxNodes);
+
     /** Print how much position evaluation improves when parValues are applied to evaluation function.
      * Positions with no change are not printed. */
     void evalEffect(std::istream& is, const std::vector<ParamValue>& parValues);
@@ -169,6 +183,11 @@ public:
     static void probeDTZ(const std::string& fen);
 
 private:
+    struct SearchWorker;
+
+    /** Number of worker threads to use for parallel processing of input data. */
+    static int nWorkerThreads();
+
     /** Read score from a PGN comment, assuming cutechess-cli comment format.
      * Does not handle mate scores. */
     static bool getCommentScore(const std::string& comment, int& score);
@@ -33,6 +33,7 @@
 #include "textio.hpp"
 #include "gametree.hpp"
 #include "clustertt.hpp"
+#include "util/mappedFile.hpp"
 #include <unordered_set>
 #include <random>
 
@@ -153,8 +154,8 @@ MatchBookCreator::evaluateBookLines(std::vector<BookLine>& lines, int searchTime
 
 void
 MatchBookCreator::countUniq(const std::string& pgnFile, std::ostream& os) {
-    std::ifstream is(pgnFile);
-    PgnReader reader(is);
+    MappedFile pgnData(pgnFile);
+    PgnReader reader(pgnData.data(), pgnData.size(), true);
     std::vector<std::unordered_set<U64>> uniqPositions;
     GameTree gt;
     int nGames = 0;
@@ -292,8 +293,8 @@ MatchBookCreator::pgnStat(const std::string& pgnFile, bool pairMode, std::ostrea
     std::vector<PlayerInfo> players;
     std::vector<GameInfo> games;
 
-    std::ifstream is(pgnFile);
-    PgnReader reader(is);
+    MappedFile pgnData(pgnFile);
+    PgnReader reader(pgnData.data(), pgnData.size(), true);
     GameTree gt;
     int nGames = 0;
     int nMoves = 0;
@@ -27,6 +27,7 @@
 #include "posgen.hpp"
 #include "spsa.hpp"
 #include "bookbuild.hpp"
+#include "bookworker.hpp"
 #include "proofgame.hpp"
 #include "matchbookcreator.hpp"
 #include "tbgen.hpp"
@@ -38,6 +39,8 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <thread>
+#include <csignal>
 
 void
 parseParValues(const std::string& fname, std::vector<ParamValue>& parValues) {
@@ -89,6 +92,14 @@ usage() {
     std::cerr << "                                     -m treat bishop and knight as same type\n";
     std::cerr << " search script nWorkers: Update search score in FEN file by running script\n";
     std::cerr << "                         on all lines. Run nWorkers scripts in parallel\n";
+    std::cerr << " search -d depth nWorkers : Update search score in FEN file by searching each\n";
+    std::cerr << "                            position to a fixed depth, using nWorkers threads\n";
+    std::cerr << " search -n nodes nWorkers : Update search score in FEN file by searching each\n";
+    std::cerr << "                            position a fixed number of nodes, using nWorkers threads\n";
+    std::cerr << " searchstats -d depth : Print search statistics when searching each position in\n";
+    std::cerr << "                        FEN file to a fixed depth\n";
+    std::cerr << " searchstats -n nodes : Print search statistics when searching each position in\n";
+    std::cerr << "                        FEN file a fixed number of nodes\n";
     std::cerr << " outliers threshold  : Print positions with unexpected game result\n";
     std::cerr << " evaleffect evalfile : Print eval improvement when parameters are changed\n";
     std::cerr << " pawnadv  : Compute evaluation error for different pawn advantage\n";
@@ -126,8 +137,16 @@ usage() {
     std::cerr << " tbgen wq wr wb wn bq br bb bn : Generate pawn-less tablebase in memory\n";
     std::cerr << " tbgentest type1 [type2 ...]   : Compare pawnless tablebase against GTB\n";
     std::cerr << "\n";
-    std::cerr << " book improve bookFile searchTime nThreads \"startmoves\" [c1 c2 c3]\n";
+    std::cerr << " book improve bookFile searchTime nThreads \"startmoves\" [c1 c2 c3] [-w worker]...\n";
     std::cerr << "                                            : Improve opening book\n";
+    std::cerr << "           -w worker : Also search using a worker process. worker is either\n";
+    std::cerr << "                       tcp:host:port or a command, such as \"ssh host texelutil book worker\"\n";
+    std::cerr << " book worker [-port p] [-hash mb] [-bind addr] [-maxconn n]\n";
+    std::cerr << "                                            : Search positions for book improve,\n";
+    std::cerr << "                                            : using stdin/stdout or TCP port p\n";
+    std::cerr << "           -bind addr : Local address to listen on, default 127.0.0.1.\n";
+    std::cerr << "                        There is no authentication, only use trusted networks.\n";
+    std::cerr << "           -maxconn n : Max simultaneous connections, each using its own hash table\n";
     std::cerr << " book import bookFile pgnFile [maxPly]      : Import moves from PGN file\n";
     std::cerr << " book export bookFile polyglotFile maxErrSelf errOtherExpConst \\\n";
     std::cerr << "             [noleaf] [-e excludeFile.pgn]\n";
@@ -140,7 +159,7 @@ usage() {
     std::cerr << " pgnstat pgnFile [-p] : Print statistics for games in a PGN file.\n";
     std::cerr << "           -p : Consider game pairs when computing standard deviation.\n";
     std::cerr << "\n";
-    std::cerr << " proofgame [-w a:b] [-i \"initFen\"] \"goalFen\"\n";
+    std::cerr << " proofgame [-w a:b] [-t threads] [-i \"initFen\"] \"goalFen\"\n";
     std::cerr << std::flush;
     ::exit(2);
 }
@@ -267,8 +286,62 @@ doFilterCmd(int argc, char* argv[], ChessTool& chessTool) {
         usage();
 }
 
+static void
+doBookWorkerCmd(int argc, char* argv[]) {
+    int port = -1;
+    int hashSizeMB = 1024;
+    std::string bindAddr = "127.0.0.1";
+    int maxConnections = std::max(1, (int)std::thread::hardware_concurrency());
+    for (int i = 3; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-port" && i + 1 < argc) {
+            if (!str2Num(argv[i+1], port) || port <= 0 || port > 65535)
+                usage();
+            i++;
+        } else if (arg == "-hash" && i + 1 < argc) {
+            if (!str2Num(argv[i+1], hashSizeMB) || hashSizeMB <= 0)
+                usage();
+            i++;
+        } else if (arg == "-bind" && i + 1 < argc) {
+            bindAddr = argv[i+1];
+            i++;
+        } else if (arg == "-maxconn" && i + 1 < argc) {
+            if (!str2Num(argv[i+1], maxConnections) || maxConnections <= 0)
+                usage();
+            i++;
+        } else
+            usage();
+    }
+    ChessTool::setupTB();
+    if (port > 0) {
+        BookBuild::BookWorker::serve(bindAddr, port, hashSizeMB, maxConnections);
+    } else {
+        BookBuild::FdConnection conn(0, 1, false);
+        TranspositionTable tt((U64)hashSizeMB * (1 << 20) / sizeof(TranspositionTable::TTEntry));
+        BookBuild::BookWorker::run(conn, tt);
+    }
+}
+
 static void
 doBookCmd(int argc, char* argv[]) {
+    if ((argc >= 3) && (std::string(argv[2]) == "worker")) {
+        doBookWorkerCmd(argc, argv);
+        return;
+    }
+
+    // Extract remote worker options
+    std::vector<std::string> workers;
+    std::vector<char*> args;
+    for (int i = 0; i < argc; i++) {
+        if (i >= 3 && std::string(argv[i]) == "-w" && i + 1 < argc) {
+            workers.push_back(argv[i+1]);
+            i++;
+        } else
+            args.push_back(argv[i]);
+    }
+    argc = args.size();
+    argv = args.data();
+
     if (argc < 4)
         usage();
     std::string bookCmd = argv[2];
@@ -283,7 +356,8 @@ doBookCmd(int argc, char* argv[]) {
             startMoves = argv[6];
         int searchTime, numThreads;
         if (!str2Num(argv[4], searchTime) || (searchTime <= 0) ||
-            !str2Num(argv[5], numThreads) || (numThreads <= 0))
+            !str2Num(argv[5], numThreads) || (numThreads < 0) ||
+            (numThreads == 0 && workers.empty()))
             usage();
         std::shared_ptr<BookBuild::Book> book;
         if (argc == 10) {
@@ -297,6 +371,7 @@ doBookCmd(int argc, char* argv[]) {
         } else {
             book = std::make_shared<BookBuild::Book>(logFile);
         }
+        book->setRemoteWorkers(workers);
         book->improve(bookFile, searchTime, numThreads, startMoves);
     } else if (bookCmd == "import") {
         if (argc < 5 || argc > 6)
@@ -353,6 +428,10 @@ doBookCmd(int argc, char* argv[]) {
 int
 main(int argc, char* argv[]) {
     std::ios::sync_with_stdio(false);
+#ifndef _WIN32
+    // Report write errors to book worker processes instead of terminating
+    signal(SIGPIPE, SIG_IGN);
+#endif
 
     try {
         ComputerPlayer::initEngine();
@@ -403,13 +482,34 @@ main(int argc, char* argv[]) {
         } else if (cmd == "filter") {
             doFilterCmd(argc, argv, chessTool);
         } else if (cmd == "search") {
-            if (argc != 4)
+            if ((argc == 5) && (std::string(argv[2]) == "-d" || std::string(argv[2]) == "-n")) {
+                int maxDepth = -1;
+                S64 maxNodes = -1;
+                int nWorkers;
+                bool ok = (std::string(argv[2]) == "-d") ? str2Num(argv[3], maxDepth) && (maxDepth > 0)
+                                                         : str2Num(argv[3], maxNodes) && (maxNodes > 0);
+                if (!ok || !str2Num(argv[4], nWorkers) || (nWorkers < 1))
+                    usage();
+                chessTool.computeSearchScores(std::cin, maxDepth, maxNodes, nWorkers);
+            } else {
+                if (argc != 4)
+                    usage();
+                std::string script = argv[2];
+                int nWorkers;
+                if (!str2Num(argv[3], nWorkers))
+                    usage();
+                chessTool.computeSearchScores(std::cin, script, nWorkers);
+            }
+        } else if (cmd == "searchstats") {
+            if ((argc != 4) || (std::string(argv[2]) != "-d" && std::string(argv[2]) != "-n"))
                 usage();
-            std::string script = argv[2];
-            int nWorkers;
-            if (!str2Num(argv[3], nWorkers))
+            int maxDepth = -1;
+            S64 maxNodes = -1;
+            bool ok = (std::string(argv[2]) == "-d") ? str2Num(argv[3], maxDepth) && (maxDepth > 0)
+                                                     : str2Num(argv[3], maxNodes) && (maxNodes > 0);
+            if (!ok)
                 usage();
-            chessTool.computeSearchScores(std::cin, script, nWorkers);
+            chessTool.searchStats(std::cin, maxDepth, maxNodes);
         } else if (cmd == "outliers") {
             int threshold;
             if ((argc < 3) || !str2Num(argv[2], threshold))
@@ -650,6 +750,7 @@ main(int argc, char* argv[]) {
         } else if (cmd == "proofgame") {
             std::string initFen, goalFen;
             int a = 1, b = 1;
+            int nThreads = 1;
             int arg = 2;
             if (argc >= arg+2 && argv[arg] == std::string("-w")) {
                 std::string s(argv[arg+1]);
@@ -660,6 +761,11 @@ main(int argc, char* argv[]) {
                     usage();
                 arg += 2;
             }
+            if (argc >= arg+2 && argv[arg] == std::string("-t")) {
+                if (!str2Num(argv[arg+1], nThreads) || nThreads < 1)
+                    usage();
+                arg += 2;
+            }
             if (argc >= arg+2 && argv[arg] == std::string("-i")) {
                 initFen = argv[arg+1];
                 arg += 2;
@@ -671,7 +777,7 @@ main(int argc, char* argv[]) {
             goalFen = argv[arg];
             ProofGame ps(goalFen, a, b);
             std::vector<Move> movePath;
-            ps.search(initFen, movePath);
+            ps.search(initFen, movePath, nThreads);
         } else {
             usage();
         }
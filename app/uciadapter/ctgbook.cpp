@@ -28,26 +28,41 @@
 #include "textio.hpp"
 
 #include <cassert>
+#include <cstring>
+#include <unordered_map>
 
 
 Random CtgBook::rndGen;
 
 
+/** A position encoded in CTG format. */
+struct EncodedPos {
+    static const int MAX_LEN = 32;
+    U8 data[MAX_LEN];
+    int len = 0;
+};
+
 class BitVector {
 public:
+    BitVector() { memset(buf, 0, sizeof(buf)); }
+
     void addBit(bool value);
     void addBits(int mask, int numBits);
 
     /** Number of bits left in current byte. */
     int padBits();
 
-    const std::vector<U8>& getBytes() const;
+    const U8* getBytes() const;
 
     int getLength() const;
 
+    /** True if more bits than fit in the buffer have been added. */
+    bool overflow() const { return overflowed; }
+
 private:
-    std::vector<U8> buf;
+    U8 buf[EncodedPos::MAX_LEN];
     int length = 0;
+    bool overflowed = false;
 };
 
 struct BookEntry {
@@ -57,7 +72,8 @@ struct BookEntry {
 
 class PositionData {
 public:
-    void setFromPageBuf(const std::vector<U8>& pageBuf, int offs);
+    /** Copy position data starting at "data", which is at least "len" bytes long. */
+    bool setFromPageBuf(const U8* data, int len);
 
     Position pos;
     bool mirrorColor = false;
@@ -94,54 +110,85 @@ private:
 
 class CtbFile {
 public:
-    explicit CtbFile(std::fstream& f);
+    explicit CtbFile(const MappedFile& f);
     int lowerPageBound;
     int upperPageBound;
 };
 
 class CtoFile {
 public:
-    explicit CtoFile(std::fstream& f);
+    explicit CtoFile(const MappedFile& f);
 
-    static void getHashIndices(const std::vector<U8>& encodedPos, const CtbFile& ctb,
-                               std::vector<int>& indices);
+    /** Call func(hashIndex) for all hash indices that can contain encodedPos,
+     *  until func returns true. Return true if func returned true. */
+    template <typename Func>
+    static bool forEachHashIndex(const EncodedPos& encodedPos, const CtbFile& ctb,
+                                 Func func);
 
-    int getPage(int hashIndex);
+    /** Return the ctg page for a hash index, or -1 if there is no such page. */
+    int getPage(int hashIndex) const;
 
 private:
-    static int getHashValue(const std::vector<U8>& encodedPos);
+    static int getHashValue(const EncodedPos& encodedPos);
 
-    std::fstream& f;
+    const MappedFile& f;
     static const int tbl[];
 };
 
 class CtgFile {
 public:
-    CtgFile(std::fstream& f, CtbFile& ctb, CtoFile& cto);
+    CtgFile(const MappedFile& f, const CtbFile& ctb, const CtoFile& cto);
 
     bool getPositionData(const Position& pos, PositionData& pd);
 
 private:
-    bool findInPage(int page, const std::vector<U8>& encodedPos, PositionData& pd);
+    /** Decoded page header. Contains the offsets of all positions in a page. */
+    struct PageIndex {
+        int nBytes = 0;
+        std::vector<U16> posOffs;
+    };
+
+    /** Get page index, decoding the page header if it is not in the cache. */
+    const PageIndex& getPageIndex(int page);
+
+    bool findInPage(int page, const EncodedPos& encodedPos, PositionData& pd);
 
-    std::fstream& f;
-    CtbFile& ctb;
-    CtoFile& cto;
+    /** Return pointer to page data, or null if the page is not in the file. */
+    const U8* getPageData(int page) const;
+
+    static const int PAGE_SIZE = 4096;
+    static const size_t MAX_CACHED_PAGES = 4096;
+
+    const MappedFile& f;
+    const CtbFile& ctb;
+    const CtoFile& cto;
+    std::unordered_map<int, PageIndex> pageCache;
 };
 
 // ---------------------------------------------------------------------------
 
 namespace {
 
-/** Read len bytes from offs in file f. */
-void
-readBytes(std::fstream& f, long offs, int len, std::vector<U8>& buf) {
-    buf.resize(len);
-    f.seekg(offs, std::ios_base::beg);
-    f.read((char*)&buf[0], len);
-    if (!f)
-        for (int i = 0; i < len; i++)
-            buf[i] = 0;
+/** Convert len bytes starting at offs in file f to an integer.
+ *  Return 0 if the data is not inside the file. */
+int
+extractInt(const MappedFile& f, size_t offs, int len) {
+    if (offs + len > f.size())
+        return 0;
+    const U8* data = (const U8*)f.data() + offs;
+    int val = 0;
+    for (int i = 0; i < len; i++)
+        val = (val << 8) + data[i];
+    return val;
+}
+
+/** Convert len bytes starting at data to an integer. */
+int
+extractInt(const U8* data, int len) {
+    int val = 0;
+    for (int i = 0; i < len; i++)
+        val = (val << 8) + data[i];
+    return val;
 }
 
 /** Convert len bytes starting at offs in buf to an integer. */
@@ -232,9 +279,11 @@ mirrorPosColor(Position& pos) {
     }
 }
 
-/** Converts a position to a byte array. */
-void
-positionToByteArray(Position& pos, std::vector<U8>& encodedPos) {
+/** Converts a position to a byte array. Return false if the encoded position
+ *  is too long for the CTG format, which can happen for positions having
+ *  more than 32 pieces. */
+bool
+positionToByteArray(Position& pos, EncodedPos& encodedPos) {
     BitVector bits;
     bits.addBits(0, 8); // Header byte
     for (int x = 0; x < 8; x++) {
@@ -277,13 +326,19 @@ positionToByteArray(Position& pos, std::vector<U8>& encodedPos) {
         bits.addBit(pos.a1Castle());
     }
 
+    // The length is stored in the 5 low bits of the header byte
+    if (bits.overflow() || bits.getLength() / 8 > 0x1f)
+        return false;
+
     assert((bits.getLength() & 7) == 0);
     int header = bits.getLength() / 8;
     if (ep) header |= 0x20;
     if (cs) header |= 0x40;
 
-    encodedPos = bits.getBytes();
-    encodedPos[0] = (U8)header;
+    encodedPos.len = bits.getLength() / 8;
+    memcpy(encodedPos.data, bits.getBytes(), encodedPos.len);
+    encodedPos.data[0] = (U8)header;
+    return true;
 }
 
 }
@@ -292,10 +347,13 @@ positionToByteArray(Position& pos, std::vector<U8>& encodedPos) {
 
 void
 BitVector::addBit(bool value) {
+    if (length >= EncodedPos::MAX_LEN * 8) {
+        overflowed = true; // Only count the bit, so padBits() stays correct
+        length++;
+        return;
+    }
     int byteIdx = length / 8;
     int bitIdx = 7 - (length & 7);
-    while ((int)buf.size() <= byteIdx)
-        buf.push_back(0);
     if (value)
         buf[byteIdx] |= 1 << bitIdx;
     length++;
@@ -315,7 +373,7 @@ BitVector::padBits() {
     return (bitIdx == 0) ? 0 : 8 - bitIdx;
 }
 
-const std::vector<U8>&
+const U8*
 BitVector::getBytes() const {
     return buf;
 }
@@ -500,14 +558,17 @@ PositionData::staticInitialize() {
     moveInfo[0xfe] = { Piece::WQUEEN , 1, -3, +3 };
 }
 
-void
-PositionData::setFromPageBuf(const std::vector<U8>& pageBuf, int offs) {
-    posLen = pageBuf.at(offs) & 0x1f;
-    moveBytes = extractInt(pageBuf, offs + posLen, 1);
+bool
+PositionData::setFromPageBuf(const U8* data, int len) {
+    posLen = data[0] & 0x1f;
+    if (posLen >= len)
+        return false;
+    moveBytes = data[posLen];
     int bufLen = posLen + moveBytes + posInfoBytes;
-    buf.clear();
-    for (int i = 0; i < bufLen; i++)
-        buf.push_back(pageBuf.at(offs + i));
+    if (bufLen > len)
+        return false;
+    buf.assign(data, data + bufLen);
+    return true;
 }
 
 void
@@ -587,39 +648,39 @@ PositionData::decodeMove(const Position& pos, int moveCode) {
 
 // --------------------------------------------------------------------------------
 
-CtbFile::CtbFile(std::fstream& f) {
-    std::vector<U8> buf;
-    readBytes(f, 4, 8, buf);
-    lowerPageBound = extractInt(buf, 0, 4);
-    upperPageBound = extractInt(buf, 4, 4);
+CtbFile::CtbFile(const MappedFile& f) {
+    lowerPageBound = extractInt(f, 4, 4);
+    upperPageBound = extractInt(f, 8, 4);
 }
 
 // --------------------------------------------------------------------------------
 
-CtoFile::CtoFile(std::fstream& f0)
+CtoFile::CtoFile(const MappedFile& f0)
     : f(f0) {
 }
 
-void
-CtoFile::getHashIndices(const std::vector<U8>& encodedPos, const CtbFile& ctb,
-                        std::vector<int>& indices) {
+template <typename Func>
+bool
+CtoFile::forEachHashIndex(const EncodedPos& encodedPos, const CtbFile& ctb, Func func) {
     int hash = getHashValue(encodedPos);
     for (int n = 0; n < 0x7fffffff; n = 2*n + 1) {
         int c = (hash & n) + n;
         if (c < ctb.lowerPageBound)
             continue;
-        indices.push_back(c);
+        if (func(c))
+            return true;
         if (c >= ctb.upperPageBound)
             break;
     }
+    return false;
 }
 
 int
-CtoFile::getPage(int hashIndex) {
-    std::vector<U8> buf;
-    readBytes(f, 16 + 4 * hashIndex, 4, buf);
-    int page = extractInt(buf, 0, 4);
-    return page;
+CtoFile::getPage(int hashIndex) const {
+    size_t offs = 16 + 4 * (size_t)hashIndex;
+    if (offs + 4 > f.size())
+        return -1;
+    return extractInt(f, offs, 4);
 }
 
 const int
@@ -643,11 +704,11 @@ CtoFile::tbl[] = {
 };
 
 int
-CtoFile::getHashValue(const std::vector<U8>& encodedPos) {
+CtoFile::getHashValue(const EncodedPos& encodedPos) {
     int hash = 0;
     int tmp = 0;
-    for (int i = 0; i < (int)encodedPos.size(); i++) {
-        U8 ch = encodedPos[i];
+    for (int i = 0; i < encodedPos.len; i++) {
+        U8 ch = encodedPos.data[i];
         tmp += ((0x0f - (ch & 0x0f)) << 2) + 1;
         hash += tbl[tmp & 0x3f];
         tmp += ((0xf0 - (ch & 0xf0)) >> 2) + 1;
@@ -658,7 +719,7 @@ CtoFile::getHashValue(const std::vector<U8>& encodedPos) {
 
 // --------------------------------------------------------------------------------
 
-CtgFile::CtgFile(std::fstream& f0, CtbFile& ctb0, CtoFile& cto0)
+CtgFile::CtgFile(const MappedFile& f0, const CtbFile& ctb0, const CtoFile& cto0)
     : f(f0), ctb(ctb0), cto(cto0) {
 }
 
@@ -675,71 +736,97 @@ CtgFile::getPositionData(const Position& pos0, PositionData& pd) {
         mirrorLeftRight = true;
     }
 
-    std::vector<U8> encodedPos;
-    positionToByteArray(pos, encodedPos);
-    std::vector<int> hashIdxList;
-    CtoFile::getHashIndices(encodedPos, ctb, hashIdxList);
+    EncodedPos encodedPos;
+    if (!positionToByteArray(pos, encodedPos))
+        return false;
 
-    for (int i = 0; i < (int)hashIdxList.size(); i++) {
-        int page = cto.getPage(hashIdxList[i]);
+    return CtoFile::forEachHashIndex(encodedPos, ctb, [&](int hashIndex) {
+        int page = cto.getPage(hashIndex);
         if (page < 0)
-            continue;
-        if (findInPage(page, encodedPos, pd)) {
-            pd.pos = pos;
-            pd.mirrorColor = mirrorColor;
-            pd.mirrorLeftRight = mirrorLeftRight;
-            return true;
-        }
+            return false;
+        if (!findInPage(page, encodedPos, pd))
+            return false;
+        pd.pos = pos;
+        pd.mirrorColor = mirrorColor;
+        pd.mirrorLeftRight = mirrorLeftRight;
+        return true;
+    });
+}
+
+const U8*
+CtgFile::getPageData(int page) const {
+    size_t offs = (page + 1) * (size_t)PAGE_SIZE;
+    if (offs + PAGE_SIZE > f.size())
+        return nullptr;
+    return (const U8*)f.data() + offs;
+}
+
+const CtgFile::PageIndex&
+CtgFile::getPageIndex(int page) {
+    auto it = pageCache.find(page);
+    if (it != pageCache.end())
+        return it->second;
+
+    if (pageCache.size() >= MAX_CACHED_PAGES)
+        pageCache.clear();
+    PageIndex& pi = pageCache[page];
+    const U8* pageData = getPageData(page);
+    if (!pageData)
+        return pi;
+
+    int nPos = extractInt(pageData, 2);
+    pi.nBytes = std::min(extractInt(pageData + 2, 2), (int)PAGE_SIZE);
+    int offs = 4;
+    for (int p = 0; p < nPos; p++) {
+        // Ignore corrupt book file entries
+        if (offs >= pi.nBytes)
+            break;
+        int posLen = pageData[offs] & 0x1f;
+        if (offs + posLen >= pi.nBytes)
+            break;
+        int moveBytes = pageData[offs + posLen];
+        int next = offs + posLen + moveBytes + PositionData::posInfoBytes;
+        if (next > pi.nBytes)
+            break;
+        pi.posOffs.push_back(offs);
+        offs = next;
     }
-    return false;
+    return pi;
 }
 
 bool
-CtgFile::findInPage(int page, const std::vector<U8>& encodedPos, PositionData& pd) {
-    std::vector<U8> pageBuf;
-    readBytes(f, (page+1)*4096L, 4096, pageBuf);
-    try {
-        int nPos = extractInt(pageBuf, 0, 2);
-        int nBytes = extractInt(pageBuf, 2, 2);
-        for (int i = nBytes; i < 4096; i++)
-            pageBuf.at(i) = 0; // Don't depend on trailing garbage
-        int offs = 4;
-        for (int p = 0; p < nPos; p++) {
-            bool match = true;
-            for (int i = 0; i < (int)encodedPos.size(); i++)
-                if (encodedPos[i] != pageBuf.at(offs+i)) {
-                    match = false;
-                    break;
-                }
-            if (match) {
-                pd.setFromPageBuf(pageBuf, offs);
-                return true;
-            }
-
-            int posLen = pageBuf.at(offs) & 0x1f;
-            offs += posLen;
-            int moveBytes = extractInt(pageBuf, offs, 1);
-            offs += moveBytes;
-            offs += PositionData::posInfoBytes;
-        }
+CtgFile::findInPage(int page, const EncodedPos& encodedPos, PositionData& pd) {
+    const PageIndex& pi = getPageIndex(page);
+    if (pi.posOffs.empty())
         return false;
-    } catch (const std::out_of_range& ex) {
-        return false; // Ignore corrupt book file entries
+    const U8* pageData = getPageData(page);
+    for (int offs : pi.posOffs) {
+        if ((offs + encodedPos.len <= pi.nBytes) &&
+            (memcmp(pageData + offs, encodedPos.data, encodedPos.len) == 0))
+            return pd.setFromPageBuf(pageData + offs, pi.nBytes - offs);
     }
+    return false;
 }
 
 // --------------------------------------------------------------------------------
 
 CtgBook::CtgBook(const std::string& fileName, bool tournament, bool preferMain)
-    : tournamentMode(tournament), preferMainLines(preferMain) {
-    int len = fileName.length();
-    std::string ctgFile = fileName.substr(0, len-1) + "g";
-    std::string ctbFile = fileName.substr(0, len-1) + "b";
-    std::string ctoFile = fileName.substr(0, len-1) + "o";
+    : ctgF(fileWithExt(fileName, 'g')),
+      ctbF(fileWithExt(fileName, 'b')),
+      ctoF(fileWithExt(fileName, 'o')),
+      ctb(make_unique<CtbFile>(ctbF)),
+      cto(make_unique<CtoFile>(ctoF)),
+      ctg(make_unique<CtgFile>(ctgF, *ctb, *cto)),
+      tournamentMode(tournament), preferMainLines(preferMain) {
+}
 
-    ctgF.open(ctgFile, std::ios_base::in | std::ios_base::binary);
-    ctbF.open(ctbFile, std::ios_base::in | std::ios_base::binary);
-    ctoF.open(ctoFile, std::ios_base::in | std::ios_base::binary);
+CtgBook::~CtgBook() {
+}
+
+std::string
+CtgBook::fileWithExt(const std::string& fileName, char ext) {
+    int len = fileName.length();
+    return fileName.substr(0, len-1) + ext;
 }
 
 bool
@@ -802,19 +889,15 @@ CtgBook::getBookMove(Position& pos, Move& out) {
 
 void
 CtgBook::getBookEntries(const Position& pos, std::vector<BookEntry>& bookMoves) {
-    CtbFile ctb(ctbF);
-    CtoFile cto(ctoF);
-    CtgFile ctg(ctgF, ctb, cto);
-
     PositionData pd, movePd;
-    if (ctg.getPositionData(pos, pd)) {
+    if (ctg->getPositionData(pos, pd)) {
         bool mirrorColor = pd.mirrorColor;
         bool mirrorLeftRight = pd.mirrorLeftRight;
         pd.getBookMoves(bookMoves);
         UndoInfo ui;
         for (BookEntry& be : bookMoves) {
             pd.pos.makeMove(be.move, ui);
-            bool haveMovePd = ctg.getPositionData(pd.pos, movePd);
+            bool haveMovePd = ctg->getPositionData(pd.pos, movePd);
             pd.pos.unMakeMove(be.move, ui);
             float weight = be.weight;
             if (!haveMovePd) {
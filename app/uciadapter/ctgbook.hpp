@@ -30,16 +30,22 @@
 #include "util/random.hpp"
 #include "position.hpp"
 
+#include "util/mappedFile.hpp"
+
 #include <vector>
-#include <fstream>
+#include <memory>
 
 
 struct BookEntry;
+class CtbFile;
+class CtoFile;
+class CtgFile;
 
 class CtgBook {
 public:
-    /** Constructor. */
+    /** Constructor. The ctg, ctb and cto files are memory mapped. */
     CtgBook(const std::string& fileName, bool tournament, bool preferMain);
+    ~CtgBook();
 
     /** Get a random book move for a position.
      * @return true if a book move was found, false otherwise. */
@@ -48,9 +54,15 @@ public:
 private:
     void getBookEntries(const Position& pos, std::vector<BookEntry>& bookMoves);
 
-    std::fstream ctgF;
-    std::fstream ctbF;
-    std::fstream ctoF;
+    /** Return fileName with the last character replaced by "ext". */
+    static std::string fileWithExt(const std::string& fileName, char ext);
+
+    MappedFile ctgF;
+    MappedFile ctbF;
+    MappedFile ctoF;
+    std::unique_ptr<CtbFile> ctb;
+    std::unique_ptr<CtoFile> cto;
+    std::unique_ptr<CtgFile> ctg;
 
     bool tournamentMode;
     bool preferMainLines;
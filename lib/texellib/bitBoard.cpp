@@ -25,6 +25,7 @@
 
 #include "bitBoard.hpp"
 #include "position.hpp"
+#include "util/cpuInfo.hpp"
 #include <cassert>
 #include <iostream>
 
@@ -206,67 +207,39 @@ static U64 addBishopRays(int x, int y, U64 occupied, bool inner) {
 
 static StaticInitializer<BitBoard> bbInit;
 
-void
-BitBoard::staticInitialize() {
-
-    for (int f = 0; f < 8; f++) {
-        U64 m = 0;
-        if (f > 0) m |= 1ULL << Square::getSquare(f-1, 3);
-        if (f < 7) m |= 1ULL << Square::getSquare(f+1, 3);
-        epMaskW[f] = m;
-
-        m = 0;
-        if (f > 0) m |= 1ULL << Square::getSquare(f-1, 4);
-        if (f < 7) m |= 1ULL << Square::getSquare(f+1, 4);
-        epMaskB[f] = m;
-    }
-
-    // Compute king attacks
-    for (int sq = 0; sq < 64; sq++) {
-        U64 m = 1ULL << sq;
-        U64 mask = (((m >> 1) | (m << 7) | (m >> 9)) & maskAToGFiles) |
-                   (((m << 1) | (m << 9) | (m >> 7)) & maskBToHFiles) |
-                    (m << 8) | (m >> 8);
-        kingAttacksTable[sq] = mask;
-    }
-
-    // Compute knight attacks
-    for (int sq = 0; sq < 64; sq++) {
-        U64 m = 1ULL << sq;
-        U64 mask = (((m <<  6) | (m >> 10)) & maskAToFFiles) |
-                   (((m << 15) | (m >> 17)) & maskAToGFiles) |
-                   (((m << 17) | (m >> 15)) & maskBToHFiles) |
-                   (((m << 10) | (m >>  6)) & maskCToHFiles);
-        knightAttacksTable[sq] = mask;
-    }
-
-    // Compute pawn attacks
-    for (int sq = 0; sq < 64; sq++) {
-        U64 m = 1ULL << sq;
-        U64 mask = ((m << 7) & maskAToGFiles) | ((m << 9) & maskBToHFiles);
-        wPawnAttacksTable[sq] = mask;
-        mask = ((m >> 9) & maskAToGFiles) | ((m >> 7) & maskBToHFiles);
-        bPawnAttacksTable[sq] = mask;
-
-        int x = Square::getX(sq);
-        int y = Square::getY(sq);
-        m = 0;
-        for (int y2 = y+1; y2 < 8; y2++) {
-            if (x > 0) m |= 1ULL << Square::getSquare(x-1, y2);
-                       m |= 1ULL << Square::getSquare(x  , y2);
-            if (x < 7) m |= 1ULL << Square::getSquare(x+1, y2);
-        }
-        wPawnBlockerMaskTable[sq] = m;
-        m = 0;
-        for (int y2 = y-1; y2 >= 0; y2--) {
-            if (x > 0) m |= 1ULL << Square::getSquare(x-1, y2);
-                       m |= 1ULL << Square::getSquare(x  , y2);
-            if (x < 7) m |= 1ULL << Square::getSquare(x+1, y2);
-        }
-        bPawnBlockerMaskTable[sq] = m;
-    }
+#ifdef HAS_CPU_DISPATCH
+bool BitBoard::usePopcnt = false;
+bool BitBoard::usePext = false;
+#endif
 
+std::string
+BitBoard::cpuFeatures() {
+#ifdef HAS_CPU_DISPATCH
+    const CpuInfo& cpu = CpuInfo::instance();
+    const bool popcnt = cpu.hasPopcnt();
+    const bool pext = cpu.hasFastPext();
+#else
+#ifdef HAS_POPCNT
+    const bool popcnt = true;
+#else
+    const bool popcnt = false;
+#endif
 #ifdef HAS_BMI2
+    const bool pext = true;
+#else
+    const bool pext = false;
+#endif
+#endif
+    std::string ret;
+    if (popcnt)
+        ret += "popcnt";
+    if (pext)
+        ret += ret.empty() ? "pext" : " pext";
+    return ret;
+}
+
+void
+BitBoard::initPextTables() {
     int tdSize = 0;
     for (int sq = 0; sq < 64; sq++) {
         int x = Square::getX(sq);
@@ -306,7 +279,10 @@ BitBoard::staticInitialize() {
         }
         bTables[sq] = table;
     }
-#else
+}
+
+void
+BitBoard::initMagicTables() {
     int rTableSize = 0;
     for (int sq = 0; sq < 64; sq++)
         rTableSize += 1 << (64 - rBits[sq]);
@@ -363,6 +339,80 @@ BitBoard::staticInitialize() {
         }
         bTables[sq] = table;
     }
+}
+
+void
+BitBoard::staticInitialize() {
+
+    for (int f = 0; f < 8; f++) {
+        U64 m = 0;
+        if (f > 0) m |= 1ULL << Square::getSquare(f-1, 3);
+        if (f < 7) m |= 1ULL << Square::getSquare(f+1, 3);
+        epMaskW[f] = m;
+
+        m = 0;
+        if (f > 0) m |= 1ULL << Square::getSquare(f-1, 4);
+        if (f < 7) m |= 1ULL << Square::getSquare(f+1, 4);
+        epMaskB[f] = m;
+    }
+
+    // Compute king attacks
+    for (int sq = 0; sq < 64; sq++) {
+        U64 m = 1ULL << sq;
+        U64 mask = (((m >> 1) | (m << 7) | (m >> 9)) & maskAToGFiles) |
+                   (((m << 1) | (m << 9) | (m >> 7)) & maskBToHFiles) |
+                    (m << 8) | (m >> 8);
+        kingAttacksTable[sq] = mask;
+    }
+
+    // Compute knight attacks
+    for (int sq = 0; sq < 64; sq++) {
+        U64 m = 1ULL << sq;
+        U64 mask = (((m <<  6) | (m >> 10)) & maskAToFFiles) |
+                   (((m << 15) | (m >> 17)) & maskAToGFiles) |
+                   (((m << 17) | (m >> 15)) & maskBToHFiles) |
+                   (((m << 10) | (m >>  6)) & maskCToHFiles);
+        knightAttacksTable[sq] = mask;
+    }
+
+    // Compute pawn attacks
+    for (int sq = 0; sq < 64; sq++) {
+        U64 m = 1ULL << sq;
+        U64 mask = ((m << 7) & maskAToGFiles) | ((m << 9) & maskBToHFiles);
+        wPawnAttacksTable[sq] = mask;
+        mask = ((m >> 9) & maskAToGFiles) | ((m >> 7) & maskBToHFiles);
+        bPawnAttacksTable[sq] = mask;
+
+        int x = Square::getX(sq);
+        int y = Square::getY(sq);
+        m = 0;
+        for (int y2 = y+1; y2 < 8; y2++) {
+            if (x > 0) m |= 1ULL << Square::getSquare(x-1, y2);
+                       m |= 1ULL << Square::getSquare(x  , y2);
+            if (x < 7) m |= 1ULL << Square::getSquare(x+1, y2);
+        }
+        wPawnBlockerMaskTable[sq] = m;
+        m = 0;
+        for (int y2 = y-1; y2 >= 0; y2--) {
+            if (x > 0) m |= 1ULL << Square::getSquare(x-1, y2);
+                       m |= 1ULL << Square::getSquare(x  , y2);
+            if (x < 7) m |= 1ULL << Square::getSquare(x+1, y2);
+        }
+        bPawnBlockerMaskTable[sq] = m;
+    }
+
+#ifdef HAS_CPU_DISPATCH
+    const CpuInfo& cpu = CpuInfo::instance();
+    usePopcnt = cpu.hasPopcnt();
+    usePext = cpu.hasFastPext();
+    if (usePext)
+        initPextTables();
+    else
+        initMagicTables();
+#elif defined(HAS_BMI2)
+    initPextTables();
+#else
+    initMagicTables();
 #endif
 
     // squaresBetween
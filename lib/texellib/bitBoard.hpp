@@ -45,6 +45,30 @@
 inline U64 pext(U64 value, U64 mask) {
     return _pext_u64(value, mask);
 }
+#elif defined(HAS_CPU_DISPATCH)
+// The instructions are emitted without enabling them for the whole
+// program, and are only executed if the CPU supports them.
+#if _MSC_VER
+#include <intrin.h>
+#include <immintrin.h>
+inline U64 pext(U64 value, U64 mask) {
+    return _pext_u64(value, mask);
+}
+inline int popcnt(U64 mask) {
+    return (int)__popcnt64(mask);
+}
+#else
+inline U64 pext(U64 value, U64 mask) {
+    U64 ret;
+    asm("pextq %2, %1, %0" : "=r" (ret) : "r" (value), "rm" (mask));
+    return ret;
+}
+inline int popcnt(U64 mask) {
+    U64 ret;
+    asm("popcntq %1, %0" : "=r" (ret) : "rm" (mask));
+    return (int)ret;
+}
+#endif
 #endif
 
 class BitBoard {
@@ -135,10 +159,23 @@ public:
     /** Return number of 1 bits in mask. */
     static int bitCount(U64 mask);
 
+    /** Return a string describing the CPU specific instructions used
+     *  by the bitboard functions, for example "popcnt pext". */
+    static std::string cpuFeatures();
+
     /** Initialize static data. */
     static void staticInitialize();
 
 private:
+    /** Create slider attack tables indexed using PEXT or magic multiplication. */
+    static void initPextTables();
+    static void initMagicTables();
+
+#ifdef HAS_CPU_DISPATCH
+    static bool usePopcnt; // True if the POPCNT instruction is used
+    static bool usePext;   // True if slider attack tables are indexed using PEXT
+#endif
+
     /** Squares attacked by a king on a given square. */
     static U64 kingAttacksTable[64];
     static U64 knightAttacksTable[64];
@@ -192,6 +229,10 @@ BitBoard::mirrorY(U64 mask) {
 
 inline U64
 BitBoard::bishopAttacks(int sq, U64 occupied) {
+#ifdef HAS_CPU_DISPATCH
+    if (usePext)
+        return bTables[sq][pext(occupied, bMasks[sq])];
+#endif
 #ifdef HAS_BMI2
     return bTables[sq][pext(occupied, bMasks[sq])];
 #else
@@ -201,6 +242,10 @@ BitBoard::bishopAttacks(int sq, U64 occupied) {
 
 inline U64
 BitBoard::rookAttacks(int sq, U64 occupied) {
+#ifdef HAS_CPU_DISPATCH
+    if (usePext)
+        return rTables[sq][pext(occupied, rMasks[sq])];
+#endif
 #ifdef HAS_BMI2
     return rTables[sq][pext(occupied, rMasks[sq])];
 #else
@@ -282,6 +327,10 @@ BitBoard::extractSquare(U64& mask) {
 
 inline int
 BitBoard::bitCount(U64 mask) {
+#ifdef HAS_CPU_DISPATCH
+    if (usePopcnt)
+        return popcnt(mask);
+#endif
 #ifdef HAS_POPCNT
 #if _MSC_VER
     return _mm_popcnt_u64(mask);
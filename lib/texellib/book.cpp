@@ -41,6 +41,9 @@ Random Book::rndGen;
 
 int Book::numBookMoves = -1;
 
+std::shared_ptr<const PolyglotBookFile> Book::pgBookFile;
+std::mutex Book::pgBookMutex;
+
 
 void
 Book::getBookMove(Position& pos, Move& out) {
@@ -106,51 +109,12 @@ void
 Book::getBookEntries(const Position& pos, std::vector<BookEntry>& bookMoves) const {
     bool pgBook = !UciParams::bookFile->getStringPar().empty();
     if (pgBook) {
-        std::string filename = UciParams::bookFile->getStringPar();
-        std::fstream fs(filename.c_str(), std::ios_base::in | std::ios_base::binary);
-        fs.seekg(0, std::ios_base::end);
-        S64 fileLen = fs.tellg();
-        const int entSize = 16;
-        int numEntries = fileLen / entSize;
-
-        auto readEntry = [&fs,entSize](int entNo, PolyglotBook::PGEntry& ent) {
-            S64 offs = entNo * entSize;
-            fs.seekg(offs, std::ios_base::beg);
-            fs.read((char*)ent.data, entSize);
-            if (!fs)
-                for (int i = 0; i < entSize; i++)
-                    ent.data[i] = 0;
-        };
-
-        const U64 key = PolyglotBook::getHashKey(pos);
-        PolyglotBook::PGEntry ent;
-        U64 entHash;
-        U16 entMove, entWeight;
-
-        // Find first entry with hash key >= wantedKey
-        int lo = -1;
-        int hi = numEntries;
-        // ent[lo] < key <= ent[hi]
-        while (hi - lo > 1) {
-            int mid = (lo + hi) / 2;
-            readEntry(mid, ent);
-            PolyglotBook::deSerialize(ent, entHash, entMove, entWeight);
-            if (entHash < key) {
-                lo = mid;
-            } else {
-                hi = mid;
-            }
-        }
-
-        // Read all entries with matching hash key
-        for (int entNo = hi; entNo < numEntries; entNo++) {
-            readEntry(entNo, ent);
-            PolyglotBook::deSerialize(ent, entHash, entMove, entWeight);
-            if (entHash != key)
-                break;
+        auto bookFile = getBookFile(UciParams::bookFile->getStringPar());
+        bookFile->forEachEntry(PolyglotBook::getHashKey(pos),
+                               [&pos,&bookMoves](U16 entMove, U16 entWeight) {
             Move m = PolyglotBook::getMove(pos, entMove);
             bookMoves.push_back(BookEntry(m, entWeight));
-        }
+        });
     } else {
         BookMap::iterator it = bookMap.find(pos.zobristHash());
         if (it != bookMap.end())
@@ -158,6 +122,23 @@ Book::getBookEntries(const Position& pos, std::vector<BookEntry>& bookMoves) con
     }
 }
 
+void
+Book::setBookFile(const std::string& fileName) {
+    std::shared_ptr<const PolyglotBookFile> bf;
+    if (!fileName.empty())
+        bf = std::make_shared<PolyglotBookFile>(fileName);
+    std::lock_guard<std::mutex> L(pgBookMutex);
+    pgBookFile = bf;
+}
+
+std::shared_ptr<const PolyglotBookFile>
+Book::getBookFile(const std::string& fileName) {
+    std::lock_guard<std::mutex> L(pgBookMutex);
+    if (!pgBookFile || !pgBookFile->isValid() || pgBookFile->getFileName() != fileName)
+        pgBookFile = std::make_shared<PolyglotBookFile>(fileName);
+    return pgBookFile;
+}
+
 void
 Book::initBook() {
     if (numBookMoves >= 0)
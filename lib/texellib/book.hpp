@@ -32,9 +32,12 @@
 
 #include <map>
 #include <vector>
+#include <memory>
+#include <mutex>
 #include <cmath>
 
 class Position;
+class PolyglotBookFile;
 
 /**
  * Implements an opening book.
@@ -50,7 +53,17 @@ public:
     /** Return a string describing all book moves. */
     std::string getAllBookMoves(const Position& pos);
 
+    /** Open and memory map a polyglot book file. Called when the BookFile
+     *  UCI option is set, so that no file access is needed when probing
+     *  the book. The file is always reopened, so setting the option again
+     *  reloads a book file that has changed on disk. An empty file name
+     *  closes the current book file. */
+    static void setBookFile(const std::string& fileName);
+
 private:
+    /** Get the polyglot book file with a given name, opening it if needed.
+     *  A file that could not be opened or was invalid is opened again. */
+    static std::shared_ptr<const PolyglotBookFile> getBookFile(const std::string& fileName);
 
     void initBook();
 
@@ -85,6 +98,9 @@ private:
     static int numBookMoves;
     bool verbose;
 
+    static std::shared_ptr<const PolyglotBookFile> pgBookFile;
+    static std::mutex pgBookMutex;
+
     static const char* bookLines[];
 };
 
@@ -26,9 +26,11 @@
 #include "cluster.hpp"
 #include "clustertt.hpp"
 #include "numa.hpp"
+#include "treeLogger.hpp"
 #include "util/logger.hpp"
 #include <thread>
 #include <iostream>
+#include <cstdlib>
 
 
 Cluster&
@@ -52,6 +54,54 @@ Cluster::createLocalTTReceiver(TranspositionTable& tt) {
 Cluster::Cluster() {
 }
 
+#ifdef CLUSTER_SOCKETS
+
+void
+Cluster::init(int* argc, char*** argv) {
+    std::string configFile;
+    int nodeNo = -1;
+    char** args = *argv;
+    for (int i = 1; i + 2 < *argc; i++) {
+        if (std::string(args[i]) == "-cluster") {
+            configFile = args[i+1];
+            str2Num(args[i+2], nodeNo);
+            for (int j = i; j + 3 <= *argc; j++)
+                args[j] = args[j + 3];
+            *argc -= 3;
+            break;
+        }
+    }
+    if (configFile.empty())
+        return;
+
+    try {
+        std::vector<std::string> addresses;
+        SocketConnection::readConfig(configFile, addresses);
+        if (nodeNo < 0 || nodeNo >= (int)addresses.size())
+            throw std::ios_base::failure("Invalid cluster node number");
+        rank = nodeNo;
+        size = addresses.size();
+        computeNeighbors();
+        SocketConnection::connectNodes(addresses, rank, parent, children,
+                                       parentConn, childConns);
+    } catch (const std::exception& ex) {
+        std::cerr << "Cluster initialization failed: " << ex.what() << std::endl;
+        std::exit(1);
+    }
+
+    computeConcurrency();
+}
+
+void
+Cluster::finalize() {
+    clusterParent.reset();
+    clusterChildren.clear();
+    parentConn.reset();
+    childConns.clear();
+}
+
+#else
+
 void
 Cluster::init(int* argc, char*** argv) {
     int provided;
@@ -63,6 +113,10 @@ Cluster::init(int* argc, char*** argv) {
     MPI_Comm_size(MPI_COMM_WORLD, &size);
 
     computeNeighbors();
+    if (parent != -1)
+        parentConn = make_unique<MPIConnection>(parent);
+    for (int c : children)
+        childConns.push_back(make_unique<MPIConnection>(c));
     computeConcurrency();
 }
 
@@ -71,6 +125,8 @@ Cluster::finalize() {
     MPI_Finalize();
 }
 
+#endif
+
 void
 Cluster::computeNeighbors() {
     const int maxChildren = 4;
@@ -90,25 +146,24 @@ Cluster::computeConcurrency() {
 
     const int nChild = children.size();
     int nChildLevels = 0;
+    std::array<U8,SearchConst::MAX_CLUSTER_BUF_SIZE> buf;
+    const int entSize = 2 * sizeof(int);
     for (int c = 0; c < nChild; c++) {
-        MPI_Status status;
-        MPI_Probe(children[c], 0, MPI_COMM_WORLD, &status);
-        int count;
-        MPI_Get_count(&status, MPI_INT, &count);
-        std::vector<int> buf(count);
-        MPI_Recv(&buf[0], count, MPI_INT, children[c], 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        int count = childConns[c]->recv(&buf[0], buf.size());
         std::vector<Concurrency> childConcur;
-        int nLev = count / 2;
-        for (int i = 0; i < nLev; i++)
-            childConcur.emplace_back(buf[2*i], buf[2*i+1]);
+        int nLev = count / entSize;
+        const U8* ptr = &buf[0];
+        for (int i = 0; i < nLev; i++) {
+            int nc, nt;
+            ptr = Serializer::deSerialize<entSize>(ptr, nc, nt);
+            childConcur.emplace_back(nc, nt);
+        }
         childConcurrency.push_back(std::move(childConcur));
         nChildLevels = std::max(nChildLevels, nLev);
     }
     if (parent != -1) {
-        int count = (nChildLevels + 1) * 2;
-        std::vector<int> buf(count);
-        buf[0] = thisConcurrency.cores;
-        buf[1] = thisConcurrency.threads;
+        U8* ptr = &buf[0];
+        ptr = Serializer::serialize<entSize>(ptr, thisConcurrency.cores, thisConcurrency.threads);
         for (int lev = 0; lev < nChildLevels; lev++) {
             int nc = 0, nt = 0;
             for (int c = 0; c < nChild; c++) {
@@ -117,10 +172,9 @@ Cluster::computeConcurrency() {
                     nt += childConcurrency[c][lev].threads;
                 }
             }
-            buf[2*lev+2] = nc;
-            buf[2*lev+3] = nt;
+            ptr = Serializer::serialize<entSize>(ptr, nc, nt);
         }
-        MPI_Send(&buf[0], count, MPI_INT, parent, 0, MPI_COMM_WORLD);
+        parentConn->send(&buf[0], (int)(ptr - &buf[0]));
     }
     if (getNodeNumber() == 0) {
         int nc = thisConcurrency.cores;
@@ -145,17 +199,15 @@ Communicator*
 Cluster::createParentCommunicator(TranspositionTable& tt) {
     if (getParentNode() == -1)
         return nullptr;
-    clusterParent = make_unique<MPICommunicator>(nullptr, tt, getNodeNumber(), getParentNode(), -1);
+    clusterParent = make_unique<ClusterCommunicator>(nullptr, tt, *parentConn, -1);
     return clusterParent.get();
 }
 
 void
 Cluster::createChildCommunicators(Communicator* mainThreadComm, TranspositionTable& tt) {
-    std::vector<int> childRanks = getChildNodes();
-    int n = childRanks.size();
+    int n = childConns.size();
     for (int i = 0; i < n; i++) {
-        int peerRank = childRanks[i];
-        auto comm = make_unique<MPICommunicator>(mainThreadComm, tt, getNodeNumber(), peerRank, i);
+        auto comm = make_unique<ClusterCommunicator>(mainThreadComm, tt, *childConns[i], i);
         clusterChildren.push_back(std::move(comm));
     }
 }
@@ -269,35 +321,35 @@ Cluster::assignThreads(int numThreads, int& threadsThisNode, std::vector<int>& t
 
 // ----------------------------------------------------------------------------
 
-MPICommunicator::MPICommunicator(Communicator* parent, TranspositionTable& tt,
-                                 int myRank, int peerRank, int childNo)
-    : Communicator(parent, tt), myRank(myRank), peerRank(peerRank), childNo(childNo),
-      ttReceiver(make_unique<ClusterTTReceiver>(CommandType::TT_DATA, peerRank, getCTT())) {
+ClusterCommunicator::ClusterCommunicator(Communicator* parent, TranspositionTable& tt,
+                                         ClusterConnection& conn, int childNo)
+    : Communicator(parent, tt), conn(conn), childNo(childNo),
+      ttReceiver(make_unique<ClusterTTReceiver>(CommandType::TT_DATA, getCTT())) {
 }
 
 TTReceiver*
-MPICommunicator::getTTReceiver() {
+ClusterCommunicator::getTTReceiver() {
     return ttReceiver.get();
 }
 
 void
-MPICommunicator::doSendAssignThreads(int nThreads, int firstThreadNo) {
+ClusterCommunicator::doSendAssignThreads(int nThreads, int firstThreadNo) {
     ttReceiver->setDisabled(nThreads == 0);
     cmdQueue.push_back(std::make_shared<AssignThreadsCommand>(nThreads, firstThreadNo));
-    mpiSend();
+    sendCommands();
 }
 
 void
-MPICommunicator::doSendInitSearch(const Position& pos,
+ClusterCommunicator::doSendInitSearch(const Position& pos,
                                   const std::vector<U64>& posHashList, int posHashListSize,
                                   bool clearHistory, int whiteContempt) {
     cmdQueue.push_back(std::make_shared<InitSearchCommand>(pos, posHashList, posHashListSize,
                                                            clearHistory, whiteContempt));
-    mpiSend();
+    sendCommands();
 }
 
 void
-MPICommunicator::doSendStartSearch(int jobId, const SearchTreeInfo& sti,
+ClusterCommunicator::doSendStartSearch(int jobId, const SearchTreeInfo& sti,
                                    int alpha, int beta, int depth) {
     cmdQueue.erase(std::remove_if(cmdQueue.begin(), cmdQueue.end(),
                                   [](const std::shared_ptr<Command>& cmd) {
@@ -307,11 +359,11 @@ MPICommunicator::doSendStartSearch(int jobId, const SearchTreeInfo& sti,
                                   }),
                    cmdQueue.end());
     cmdQueue.push_back(std::make_shared<StartSearchCommand>(jobId, sti, alpha, beta, depth));
-    mpiSend();
+    sendCommands();
 }
 
 void
-MPICommunicator::doSendStopSearch() {
+ClusterCommunicator::doSendStopSearch() {
     cmdQueue.erase(std::remove_if(cmdQueue.begin(), cmdQueue.end(),
                                   [](const std::shared_ptr<Command>& cmd) {
                                       return cmd->type == CommandType::START_SEARCH ||
@@ -320,32 +372,32 @@ MPICommunicator::doSendStopSearch() {
                                   }),
                    cmdQueue.end());
     cmdQueue.push_back(std::make_shared<Command>(CommandType::STOP_SEARCH));
-    mpiSend();
+    sendCommands();
 }
 
 void
-MPICommunicator::doSendSetParam(const std::string& name, const std::string& value) {
+ClusterCommunicator::doSendSetParam(const std::string& name, const std::string& value) {
     int s = name.length() + value.length() + 2 * sizeof(int);
     if (s + sizeof(Communicator::Command) < SearchConst::MAX_CLUSTER_BUF_SIZE) {
         cmdQueue.push_back(std::make_shared<SetParamCommand>(name, value));
-        mpiSend();
+        sendCommands();
     }
 }
 
 void
-MPICommunicator::doSendQuit() {
+ClusterCommunicator::doSendQuit() {
     cmdQueue.push_back(std::make_shared<Command>(CommandType::QUIT));
-    mpiSend();
+    sendCommands();
 }
 
 void
-MPICommunicator::doSendReportResult(int jobId, int score) {
+ClusterCommunicator::doSendReportResult(Communicator& child, int jobId, int score) {
     cmdQueue.push_back(std::make_shared<Command>(CommandType::REPORT_RESULT, jobId, score));
-    mpiSend();
+    sendCommands();
 }
 
 void
-MPICommunicator::doSendReportStats(S64 nodesSearched, S64 tbHits) {
+ClusterCommunicator::doSendReportStats(S64 nodesSearched, S64 tbHits) {
     bool done = false;
     for (std::shared_ptr<Command>& c : cmdQueue) {
         if (c->type == CommandType::REPORT_STATS) {
@@ -358,69 +410,59 @@ MPICommunicator::doSendReportStats(S64 nodesSearched, S64 tbHits) {
     }
     if (!done)
         cmdQueue.push_back(std::make_shared<ReportStatsCommand>(nodesSearched, tbHits));
-    mpiSend();
+    sendCommands();
 }
 
 void
-MPICommunicator::retrieveStats(S64& nodesSearched, S64& tbHits) {
+ClusterCommunicator::retrieveStats(S64& nodesSearched, S64& tbHits) {
     assert(false); // Not used
 }
 
 void
-MPICommunicator::doSendStopAck() {
+ClusterCommunicator::doSendStopAck(Communicator& child) {
     cmdQueue.push_back(std::make_shared<Command>(CommandType::STOP_ACK));
-    mpiSend();
+    sendCommands();
 }
 
 void
-MPICommunicator::doSendQuitAck() {
+ClusterCommunicator::doSendQuitAck(Communicator& child) {
     cmdQueue.push_back(std::make_shared<Command>(CommandType::QUIT_ACK));
-    mpiSend();
+    sendCommands();
 }
 
 void
-MPICommunicator::mpiSend() {
+ClusterCommunicator::sendCommands() {
     for (int loop = 0; loop < 100; loop++) {
-        if (sendBusy) {
-            int flag;
-            MPI_Test(&sendReq, &flag, MPI_STATUS_IGNORE);
-            if (!flag)
-                break;
-            sendBusy = false;
-        }
+        if (!conn.testSend())
+            return;
         if (cmdQueue.empty())
             break;
         std::shared_ptr<Command> cmd = cmdQueue.front();
         cmdQueue.pop_front();
         U8* buf = cmd->toByteBuf(&sendBuf[0]);
         int count = (int)(buf - &sendBuf[0]);
-        MPI_Isend(&sendBuf[0], count, MPI_BYTE, peerRank, 0, MPI_COMM_WORLD, &sendReq);
-        sendBusy = true;
+        conn.startSend(&sendBuf[0], count);
     }
 
-    if (!sendBusy) {
-        if (ttReceiver->sendBuffer(sendReq))
-            sendBusy = true;
-    }
+    if (conn.testSend())
+        ttReceiver->sendBuffer(conn);
 }
 
 void
-MPICommunicator::doPoll(int pass) {
+ClusterCommunicator::doPoll(int pass) {
     if (pass == 0)
-        mpiRecv();
+        receiveCommands();
     if (pass == 1)
-        mpiSend();
+        sendCommands();
 }
 
 void
-MPICommunicator::mpiRecv() {
+ClusterCommunicator::receiveCommands() {
     int nTTReceives = 0;
     for (int loop = 0; loop < 100; loop++) {
         if (recvBusy) {
-            int flag;
-            MPI_Status status;
-            MPI_Test(&recvReq, &flag, &status);
-            if (flag) {
+            int count;
+            if (conn.testRecv(count)) {
                 std::unique_ptr<Command> cmd = Command::createFromByteBuf(&recvBuf[0]);
                 switch (cmd->type) {
                 case CommandType::ASSIGN_THREADS: {
@@ -469,8 +511,6 @@ MPICommunicator::mpiRecv() {
                     break;
                 }
                 case CommandType::TT_DATA: {
-                    int count;
-                    MPI_Get_count(&status, MPI_BYTE, &count);
                     ttReceiver->receiveBuffer(&recvBuf[0], count);
                     nTTReceives++;
                     break;
@@ -485,8 +525,7 @@ MPICommunicator::mpiRecv() {
         if (recvBusy || quitFlag)
             break;
         if (!recvBusy) {
-            MPI_Irecv(&recvBuf[0], SearchConst::MAX_CLUSTER_BUF_SIZE,
-                      MPI_BYTE, peerRank, 0, MPI_COMM_WORLD, &recvReq);
+            conn.startRecv(&recvBuf[0], SearchConst::MAX_CLUSTER_BUF_SIZE);
             recvBusy = true;
         }
     }
@@ -495,7 +534,7 @@ MPICommunicator::mpiRecv() {
 }
 
 void
-MPICommunicator::notifyThread() {
+ClusterCommunicator::notifyThread() {
 }
 
 #endif // CLUSTER
@@ -28,7 +28,7 @@
 
 #include "parallel.hpp"
 #ifdef CLUSTER
-#include <mpi.h>
+#include "clusterconn.hpp"
 #endif
 
 #include <vector>
@@ -44,7 +44,9 @@ public:
     /** Get the singleton instance. */
     static Cluster& instance();
 
-    /** Initialize cluster processes. */
+    /** Initialize cluster processes. When using the socket transport,
+     *  the command line arguments "-cluster <configFile> <nodeNo>"
+     *  specify the cluster configuration and are removed from argv. */
     void init(int* argc, char*** argv);
 
     /** Terminate cluster processes. */
@@ -115,6 +117,9 @@ private:
     int parent = -1;
     std::vector<int> children;
 
+    std::unique_ptr<ClusterConnection> parentConn;
+    std::vector<std::unique_ptr<ClusterConnection>> childConns;
+
     std::unique_ptr<Communicator> clusterParent;
     std::vector<std::unique_ptr<Communicator>> clusterChildren;
 
@@ -122,10 +127,11 @@ private:
     std::vector<std::vector<Concurrency>> childConcurrency;  // [childNo][level]
 };
 
-class MPICommunicator : public Communicator {
+/** Communicator sending commands to another cluster node. */
+class ClusterCommunicator : public Communicator {
 public:
-    MPICommunicator(Communicator* parent, TranspositionTable& tt,
-                    int myRank, int peerRank, int childNo);
+    ClusterCommunicator(Communicator* parent, TranspositionTable& tt,
+                        ClusterConnection& conn, int childNo);
 
     TTReceiver* getTTReceiver() override;
 
@@ -141,35 +147,34 @@ public:
     void doSendSetParam(const std::string& name, const std::string& value) override;
     void doSendQuit() override;
 
-    void doSendReportResult(int jobId, int score) override;
+    void doSendReportResult(Communicator& child, int jobId, int score) override;
     void doSendReportStats(S64 nodesSearched, S64 tbHits) override;
     void retrieveStats(S64& nodesSearched, S64& tbHits) override;
-    void doSendStopAck() override;
-    void doSendQuitAck() override;
+    void doSendStopAck(Communicator& child) override;
+    void doSendQuitAck(Communicator& child) override;
 
-    void mpiSend();
+    /** Send queued commands and TT data to the peer node. */
+    void sendCommands();
 
     void doPoll(int pass) override;
 
     void notifyThread() override;
 
 private:
-    void mpiRecv();
+    /** Receive and handle commands and TT data from the peer node. */
+    void receiveCommands();
 
-    const int myRank;
-    const int peerRank;
+    ClusterConnection& conn;
     const int childNo;
 
-    bool sendBusy = false;
-    MPI_Request sendReq;
-
     bool recvBusy = false;
-    MPI_Request recvReq;
 
     std::unique_ptr<ClusterTTReceiver> ttReceiver;
 
     bool quitFlag = false;
 
+    std::deque<std::shared_ptr<Command>> cmdQueue; // Commands waiting to be sent
+
     std::array<U8,SearchConst::MAX_CLUSTER_BUF_SIZE> sendBuf;
     std::array<U8,SearchConst::MAX_CLUSTER_BUF_SIZE> recvBuf;
 };
@@ -215,7 +220,7 @@ Cluster::getChildNodes() const {
 }
 
 inline int
-MPICommunicator::clusterChildNo() const {
+ClusterCommunicator::clusterChildNo() const {
     return childNo;
 }
 
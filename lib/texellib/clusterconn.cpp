@@ -0,0 +1,455 @@
+/*
+    Texel - A UCI chess engine.
+    Copyright (C) 2026  Peter Österlund, peterosterlund2@gmail.com
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * clusterconn.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: petero
+ */
+
+#include "clusterconn.hpp"
+#include "treeLogger.hpp"
+#include "util/timeUtil.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <ios>
+#include <thread>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+
+#if defined(CLUSTER) && !defined(CLUSTER_SOCKETS)
+
+MPIConnection::MPIConnection(int peerRank)
+    : peerRank(peerRank) {
+}
+
+void
+MPIConnection::send(const U8* buf, int len) {
+    MPI_Send(const_cast<U8*>(buf), len, MPI_BYTE, peerRank, 0, MPI_COMM_WORLD);
+}
+
+int
+MPIConnection::recv(U8* buf, int maxLen) {
+    MPI_Status status;
+    MPI_Recv(buf, maxLen, MPI_BYTE, peerRank, 0, MPI_COMM_WORLD, &status);
+    int count;
+    MPI_Get_count(&status, MPI_BYTE, &count);
+    return count;
+}
+
+void
+MPIConnection::startSend(const U8* buf, int len) {
+    MPI_Isend(const_cast<U8*>(buf), len, MPI_BYTE, peerRank, 0, MPI_COMM_WORLD, &sendReq);
+    sendBusy = true;
+}
+
+bool
+MPIConnection::testSend() {
+    if (sendBusy) {
+        int flag;
+        MPI_Test(&sendReq, &flag, MPI_STATUS_IGNORE);
+        if (flag)
+            sendBusy = false;
+    }
+    return !sendBusy;
+}
+
+void
+MPIConnection::startRecv(U8* buf, int maxLen) {
+    MPI_Irecv(buf, maxLen, MPI_BYTE, peerRank, 0, MPI_COMM_WORLD, &recvReq);
+    recvBusy = true;
+}
+
+bool
+MPIConnection::testRecv(int& len) {
+    if (!recvBusy)
+        return false;
+    int flag;
+    MPI_Status status;
+    MPI_Test(&recvReq, &flag, &status);
+    if (!flag)
+        return false;
+    MPI_Get_count(&status, MPI_BYTE, &len);
+    recvBusy = false;
+    return true;
+}
+
+#endif
+
+#ifndef _WIN32
+
+#ifdef MSG_NOSIGNAL
+static const int sendFlags = MSG_NOSIGNAL;
+#else
+static const int sendFlags = 0;
+#endif
+
+static void
+throwSocketError(const std::string& msg) {
+    throw std::ios_base::failure(msg + ": " + strerror(errno));
+}
+
+SocketConnection::SocketConnection(int fd)
+    : fd(fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        ::close(fd);
+        throwSocketError("Cannot set non-blocking mode");
+    }
+}
+
+SocketConnection::~SocketConnection() {
+    ::close(fd);
+}
+
+void
+SocketConnection::send(const U8* buf, int len) {
+    startSend(buf, len);
+    while (!testSend())
+        waitReady(true);
+}
+
+int
+SocketConnection::recv(U8* buf, int maxLen) {
+    startRecv(buf, maxLen);
+    int len;
+    while (!testRecv(len)) {
+        if (closed)
+            throw std::ios_base::failure("Cluster connection closed");
+        waitReady(false);
+    }
+    return len;
+}
+
+void
+SocketConnection::startSend(const U8* buf, int len) {
+    Serializer::serialize<sizeof(sendHeader)>(sendHeader, len);
+    sendData = buf;
+    sendLen = sizeof(sendHeader) + len;
+    sendPos = 0;
+    testSend();
+}
+
+bool
+SocketConnection::testSend() {
+    const int hdrLen = sizeof(sendHeader);
+    while (sendPos < sendLen) {
+        struct iovec iov[2];
+        int nIov = 0;
+        if (sendPos < hdrLen) {
+            iov[nIov].iov_base = &sendHeader[sendPos];
+            iov[nIov++].iov_len = hdrLen - sendPos;
+            iov[nIov].iov_base = const_cast<U8*>(sendData);
+            iov[nIov++].iov_len = sendLen - hdrLen;
+        } else {
+            iov[nIov].iov_base = const_cast<U8*>(sendData + sendPos - hdrLen);
+            iov[nIov++].iov_len = sendLen - sendPos;
+        }
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = nIov;
+        ssize_t n = ::sendmsg(fd, &msg, sendFlags);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return false;
+            if (errno == EPIPE || errno == ECONNRESET) {
+                closed = true;
+                sendPos = sendLen;
+                break;
+            }
+            throwSocketError("Cluster send failed");
+        }
+        sendPos += n;
+    }
+    return true;
+}
+
+void
+SocketConnection::startRecv(U8* buf, int maxLen) {
+    recvData = buf;
+    recvMaxLen = maxLen;
+    recvLen = -1;
+    recvPos = 0;
+    recvBusy = true;
+}
+
+bool
+SocketConnection::testRecv(int& len) {
+    if (!recvBusy || closed)
+        return false;
+    const int hdrLen = sizeof(recvHeader);
+    while (true) {
+        if (recvLen >= 0 && recvPos - hdrLen >= recvLen) {
+            len = recvLen;
+            recvBusy = false;
+            return true;
+        }
+        ssize_t n;
+        if (recvLen < 0)
+            n = ::recv(fd, &recvHeader[recvPos], hdrLen - recvPos, 0);
+        else
+            n = ::recv(fd, recvData + recvPos - hdrLen, recvLen - (recvPos - hdrLen), 0);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return false;
+            if (errno != ECONNRESET)
+                throwSocketError("Cluster receive failed");
+            n = 0;
+        }
+        if (n == 0) {
+            closed = true;
+            return false;
+        }
+        recvPos += n;
+        if (recvLen < 0 && recvPos == hdrLen) {
+            int msgLen;
+            Serializer::deSerialize<sizeof(recvHeader)>(recvHeader, msgLen);
+            if (msgLen < 0 || msgLen > recvMaxLen)
+                throw std::ios_base::failure("Invalid cluster message length");
+            recvLen = msgLen;
+        }
+    }
+}
+
+void
+SocketConnection::waitReady(bool write) {
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = write ? POLLOUT : POLLIN;
+    pfd.revents = 0;
+    if (::poll(&pfd, 1, -1) < 0 && errno != EINTR)
+        throwSocketError("Cluster poll failed");
+}
+
+void
+SocketConnection::readConfig(const std::string& fileName, std::vector<std::string>& addresses) {
+    std::ifstream is(fileName);
+    if (!is)
+        throw std::ios_base::failure("Cannot open cluster configuration file: " + fileName);
+    addresses.clear();
+    std::string line;
+    while (std::getline(is, line)) {
+        line = trim(line);
+        if (line.empty() || line[0] == '#')
+            continue;
+        addresses.push_back(line);
+    }
+}
+
+namespace {
+
+/** Socket address corresponding to a cluster node address string. */
+struct SockAddr {
+    explicit SockAddr(const std::string& addr);
+    ~SockAddr();
+    SockAddr(const SockAddr&) = delete;
+    SockAddr& operator=(const SockAddr&) = delete;
+
+    bool isUnix;
+    struct sockaddr_un unixAddr;
+    struct addrinfo* tcpAddrs = nullptr;
+};
+
+SockAddr::SockAddr(const std::string& addr)
+    : isUnix(startsWith(addr, "unix:")) {
+    if (isUnix) {
+        std::string path = addr.substr(5);
+        memset(&unixAddr, 0, sizeof(unixAddr));
+        unixAddr.sun_family = AF_UNIX;
+        if (path.empty() || path.length() >= sizeof(unixAddr.sun_path))
+            throw std::ios_base::failure("Invalid Unix socket path: " + path);
+        strncpy(unixAddr.sun_path, path.c_str(), sizeof(unixAddr.sun_path) - 1);
+    } else {
+        size_t idx = addr.rfind(':');
+        if (idx == std::string::npos)
+            throw std::ios_base::failure("Invalid cluster node address: " + addr);
+        std::string host = addr.substr(0, idx);
+        std::string port = addr.substr(idx + 1);
+        struct addrinfo hints;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = AI_PASSIVE;
+        const char* hostPtr = (host.empty() || host == "*") ? nullptr : host.c_str();
+        if (getaddrinfo(hostPtr, port.c_str(), &hints, &tcpAddrs) != 0 || !tcpAddrs)
+            throw std::ios_base::failure("Cannot resolve cluster node address: " + addr);
+    }
+}
+
+SockAddr::~SockAddr() {
+    if (tcpAddrs)
+        freeaddrinfo(tcpAddrs);
+}
+
+/** Create a socket listening on the given address. */
+int
+listenOn(const SockAddr& sa) {
+    int fd;
+    if (sa.isUnix) {
+        fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0)
+            throwSocketError("Cannot create socket");
+        ::unlink(sa.unixAddr.sun_path);
+        if (::bind(fd, (const struct sockaddr*)&sa.unixAddr, sizeof(sa.unixAddr)) < 0) {
+            ::close(fd);
+            throwSocketError("Cannot bind socket");
+        }
+    } else {
+        const struct addrinfo* ai = sa.tcpAddrs;
+        fd = ::socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0)
+            throwSocketError("Cannot create socket");
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (::bind(fd, ai->ai_addr, ai->ai_addrlen) < 0) {
+            ::close(fd);
+            throwSocketError("Cannot bind socket");
+        }
+    }
+    if (::listen(fd, 16) < 0) {
+        ::close(fd);
+        throwSocketError("Cannot listen on socket");
+    }
+    return fd;
+}
+
+/** Try to connect to the given address. Return the socket, or -1 on failure. */
+int
+tryConnect(const SockAddr& sa) {
+    if (sa.isUnix) {
+        int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0)
+            throwSocketError("Cannot create socket");
+        if (::connect(fd, (const struct sockaddr*)&sa.unixAddr, sizeof(sa.unixAddr)) == 0)
+            return fd;
+        ::close(fd);
+        return -1;
+    }
+    for (const struct addrinfo* ai = sa.tcpAddrs; ai; ai = ai->ai_next) {
+        int fd = ::socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0)
+            continue;
+        if (::connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            return fd;
+        }
+        ::close(fd);
+    }
+    return -1;
+}
+
+}
+
+void
+SocketConnection::connectNodes(const std::vector<std::string>& addresses, int myNode,
+                               int parentNode, const std::vector<int>& childNodes,
+                               std::unique_ptr<ClusterConnection>& parentConn,
+                               std::vector<std::unique_ptr<ClusterConnection>>& childConns,
+                               int timeoutMillis) {
+    const S64 deadline = currentTimeMillis() + timeoutMillis;
+    auto checkTimeout = [deadline]() {
+        if (currentTimeMillis() >= deadline)
+            throw std::ios_base::failure("Timeout connecting cluster nodes");
+    };
+
+    // Listen before connecting to the parent, so that child nodes can
+    // connect while this node waits for its parent node.
+    int listenFd = -1;
+    std::unique_ptr<SockAddr> listenAddr;
+    if (!childNodes.empty()) {
+        listenAddr = make_unique<SockAddr>(addresses.at(myNode));
+        listenFd = listenOn(*listenAddr);
+    }
+
+    parentConn.reset();
+    if (parentNode >= 0) {
+        SockAddr sa(addresses.at(parentNode));
+        int fd;
+        while ((fd = tryConnect(sa)) < 0) {
+            checkTimeout();
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        parentConn = make_unique<SocketConnection>(fd);
+        U8 buf[sizeof(int)];
+        Serializer::serialize<sizeof(buf)>(buf, myNode);
+        parentConn->send(buf, sizeof(buf));
+    }
+
+    const int nChild = childNodes.size();
+    childConns.clear();
+    childConns.resize(nChild);
+    for (int i = 0; i < nChild; i++) {
+        int fd;
+        while (true) {
+            struct pollfd pfd;
+            pfd.fd = listenFd;
+            pfd.events = POLLIN;
+            pfd.revents = 0;
+            int remaining = (int)std::max<S64>(deadline - currentTimeMillis(), 0);
+            if (::poll(&pfd, 1, remaining) > 0) {
+                fd = ::accept(listenFd, nullptr, nullptr);
+                if (fd >= 0)
+                    break;
+            }
+            checkTimeout();
+        }
+        if (!listenAddr->isUnix) {
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        }
+        auto conn = make_unique<SocketConnection>(fd);
+        U8 buf[sizeof(int)];
+        int node = -1;
+        if (conn->recv(buf, sizeof(buf)) == sizeof(buf))
+            Serializer::deSerialize<sizeof(buf)>(buf, node);
+        auto it = std::find(childNodes.begin(), childNodes.end(), node);
+        if (it == childNodes.end() || childConns[it - childNodes.begin()])
+            throw std::ios_base::failure("Unexpected cluster node connection: " + num2Str(node));
+        childConns[it - childNodes.begin()] = std::move(conn);
+    }
+
+    if (listenFd >= 0) {
+        ::close(listenFd);
+        if (listenAddr->isUnix)
+            ::unlink(listenAddr->unixAddr.sun_path);
+    }
+}
+
+#endif
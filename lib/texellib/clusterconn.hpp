@@ -0,0 +1,154 @@
+/*
+    Texel - A UCI chess engine.
+    Copyright (C) 2026  Peter Österlund, peterosterlund2@gmail.com
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * clusterconn.hpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: petero
+ */
+
+#ifndef CLUSTERCONN_HPP_
+#define CLUSTERCONN_HPP_
+
+#include "util/util.hpp"
+
+#if defined(CLUSTER) && !defined(CLUSTER_SOCKETS)
+#include <mpi.h>
+#endif
+
+#include <memory>
+#include <string>
+#include <vector>
+
+
+/** A message channel between two neighboring cluster nodes. A message is
+ *  at most SearchConst::MAX_CLUSTER_BUF_SIZE bytes long. At most one
+ *  non-blocking send and one non-blocking receive can be in progress at
+ *  the same time. */
+class ClusterConnection {
+public:
+    virtual ~ClusterConnection() {}
+
+    /** Send a message. Blocks until the message has been sent. */
+    virtual void send(const U8* buf, int len) = 0;
+
+    /** Receive a message. Blocks until a message has arrived.
+     *  @return The message length. */
+    virtual int recv(U8* buf, int maxLen) = 0;
+
+    /** Start sending a message. The buffer must not be modified
+     *  until testSend() returns true. */
+    virtual void startSend(const U8* buf, int len) = 0;
+
+    /** Return true if there is no send in progress. */
+    virtual bool testSend() = 0;
+
+    /** Start receiving a message into buf. */
+    virtual void startRecv(U8* buf, int maxLen) = 0;
+
+    /** Return true if the message requested by startRecv() has arrived.
+     *  In that case len is set to the message length. */
+    virtual bool testRecv(int& len) = 0;
+};
+
+#if defined(CLUSTER) && !defined(CLUSTER_SOCKETS)
+/** Cluster connection using MPI point to point communication. */
+class MPIConnection : public ClusterConnection {
+public:
+    explicit MPIConnection(int peerRank);
+
+    void send(const U8* buf, int len) override;
+    int recv(U8* buf, int maxLen) override;
+    void startSend(const U8* buf, int len) override;
+    bool testSend() override;
+    void startRecv(U8* buf, int maxLen) override;
+    bool testRecv(int& len) override;
+
+private:
+    const int peerRank;
+
+    bool sendBusy = false;
+    MPI_Request sendReq;
+
+    bool recvBusy = false;
+    MPI_Request recvReq;
+};
+#endif
+
+#ifndef _WIN32
+/** Cluster connection using a TCP or Unix domain stream socket.
+ *  Each message is preceded by its length as a 4 byte integer.
+ *  If the peer closes the connection, messages sent after that are
+ *  discarded and non-blocking receives never complete. */
+class SocketConnection : public ClusterConnection {
+public:
+    /** Constructor. Takes ownership of the connected socket "fd". */
+    explicit SocketConnection(int fd);
+    ~SocketConnection();
+
+    SocketConnection(const SocketConnection&) = delete;
+    SocketConnection& operator=(const SocketConnection&) = delete;
+
+    void send(const U8* buf, int len) override;
+    int recv(U8* buf, int maxLen) override;
+    void startSend(const U8* buf, int len) override;
+    bool testSend() override;
+    void startRecv(U8* buf, int maxLen) override;
+    bool testRecv(int& len) override;
+
+    /** Create connections between cluster nodes. "addresses" contains
+     *  one address for each node, either "host:port" for TCP or
+     *  "unix:path" for a Unix domain socket. A node listens on its own
+     *  address if it has children, and connects to the address of its
+     *  parent node if it has a parent. Throws std::ios_base::failure if
+     *  the connections cannot be established within "timeoutMillis". */
+    static void connectNodes(const std::vector<std::string>& addresses, int myNode,
+                             int parentNode, const std::vector<int>& childNodes,
+                             std::unique_ptr<ClusterConnection>& parentConn,
+                             std::vector<std::unique_ptr<ClusterConnection>>& childConns,
+                             int timeoutMillis = 60000);
+
+    /** Read cluster node addresses from a configuration file. Empty lines
+     *  and lines starting with '#' are ignored. Line N, counting from 0,
+     *  contains the address of cluster node N. */
+    static void readConfig(const std::string& fileName, std::vector<std::string>& addresses);
+
+private:
+    /** Wait until the socket is readable or writable. */
+    void waitReady(bool write);
+
+    int fd;
+
+    U8 sendHeader[4];
+    const U8* sendData = nullptr;
+    int sendLen = 0;   // Length of data including header
+    int sendPos = 0;   // Number of bytes sent
+
+    U8 recvHeader[4];
+    U8* recvData = nullptr;
+    int recvMaxLen = 0;
+    int recvLen = -1;  // Message length, or -1 if header not yet received
+    int recvPos = 0;   // Number of bytes received, including header
+    bool recvBusy = false;
+
+    bool closed = false; // True if the peer has closed the connection
+};
+#endif
+
+#endif /* CLUSTERCONN_HPP_ */
@@ -25,6 +25,7 @@
 
 #include "clustertt.hpp"
 #include "cluster.hpp"
+#include "clusterconn.hpp"
 #include "util/logger.hpp"
 #include "treeLogger.hpp"
 
@@ -128,8 +129,8 @@ LocalTTReceiver::applyChunk(const ChangeBatch& changes) {
 
 // ----------------------------------------------------------------------------
 
-ClusterTTReceiver::ClusterTTReceiver(int cmdType, int peerRank, ClusterTT& ctt)
-    : cmdType(cmdType), peerRank(peerRank), ctt(ctt), currBuf(&buffer[0]) {
+ClusterTTReceiver::ClusterTTReceiver(int cmdType, ClusterTT& ctt)
+    : cmdType(cmdType), ctt(ctt), currBuf(&buffer[0]) {
     initBuf();
 }
 
@@ -165,7 +166,7 @@ ClusterTTReceiver::initBuf() {
 }
 
 bool
-ClusterTTReceiver::sendBuffer(MPI_Request& sendReq) {
+ClusterTTReceiver::sendBuffer(ClusterConnection& conn) {
     if (nSendSlots <= 0)
         return false;
 
@@ -182,7 +183,7 @@ ClusterTTReceiver::sendBuffer(MPI_Request& sendReq) {
     if (count == sizeof(int))
         return false;
 
-    MPI_Isend(&sendBuf->data[0], count, MPI_BYTE, peerRank, 0, MPI_COMM_WORLD, &sendReq);
+    conn.startSend(&sendBuf->data[0], count);
     nSendSlots--;
     return true;
 }
@@ -30,7 +30,8 @@
 
 #include <mutex>
 #ifdef CLUSTER
-#include <mpi.h>
+
+class ClusterConnection;
 
 /** A receiver of transposition table changes. */
 class TTReceiver {
@@ -99,7 +100,7 @@ private:
 /** Forwards transposition table changes to neighboring cluster node. */
 class ClusterTTReceiver : public TTReceiver {
 public:
-    ClusterTTReceiver(int cmdType, int peerRank, ClusterTT& ctt);
+    ClusterTTReceiver(int cmdType, ClusterTT& ctt);
 
     /** Set/clear disabled status. */
     void setDisabled(bool d);
@@ -109,7 +110,7 @@ public:
 
     /** Initiate a send request if there is any data to send.
      *  @return True if a send request was initiated, false otherwise. */
-    bool sendBuffer(MPI_Request& sendReq);
+    bool sendBuffer(ClusterConnection& conn);
 
     /** Process received data. */
     void receiveBuffer(const U8* buf, int len);
@@ -121,7 +122,6 @@ private:
     void initBuf();
 
     const int cmdType;
-    const int peerRank;
     ClusterTT& ctt;
 
     std::mutex mutex;
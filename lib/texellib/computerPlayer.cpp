@@ -44,6 +44,9 @@ ComputerPlayer::staticInitialize() {
     std::string name = "Texel 1.08a18";
     if (sizeof(char*) == 4)
         name += " 32-bit";
+    std::string cpuFeatures = BitBoard::cpuFeatures();
+    if (!cpuFeatures.empty())
+        name += " " + cpuFeatures;
     engineName = name;
 }
 
@@ -60,6 +63,10 @@ ComputerPlayer::initEngine() {
     UciParams::gtbCache->addListener(tbInit, false);
     UciParams::rtbPath->addListener(tbInit, false);
 
+    UciParams::bookFile->addListener([]() {
+        Book::setBookFile(UciParams::bookFile->getStringPar());
+    });
+
     knightMobScore.addListener(Evaluate::updateEvalParams);
     castleFactor.addListener(Evaluate::updateEvalParams, false);
 //    bV.addListener([]() { Parameters::instance().set("KnightValue", num2Str((int)bV)); });
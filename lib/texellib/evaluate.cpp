@@ -148,20 +148,28 @@ Evaluate::Evaluate(EvalHashTables& et)
 
 int
 Evaluate::evalPos(const Position& pos) {
-    return evalPos<false>(pos);
+    bool exact;
+    return evalPos<false,false>(pos, 0, 0, exact);
+}
+
+int
+Evaluate::evalPosLazy(const Position& pos, int alpha, int beta, bool& exact) {
+    return evalPos<false,true>(pos, alpha, beta, exact);
 }
 
 int
 Evaluate::evalPosPrint(const Position& pos) {
-    return evalPos<true>(pos);
+    bool exact;
+    return evalPos<true,false>(pos, 0, 0, exact);
 }
 
-template <bool print>
+template <bool print, bool lazy>
 inline int
-Evaluate::evalPos(const Position& pos) {
+Evaluate::evalPos(const Position& pos, int alpha, int beta, bool& exact) {
     const bool useHashTable = !print;
     EvalHashData* ehd = nullptr;
     U64 key = pos.historyHash();
+    exact = true;
     if (useHashTable) {
         ehd = &getEvalHashEntry(key);
         if ((ehd->data ^ key) < (1 << 16))
@@ -187,6 +195,14 @@ Evaluate::evalPos(const Position& pos) {
     score += castleBonus(pos);
     if (print) std::cout << "info string eval castle :" << score << std::endl;
 
+    if (lazy && !mhd->endGame) {
+        int lazyScore = finalScore<false>(pos, score);
+        if ((lazyScore - lazyEvalMargin >= beta) || (lazyScore + lazyEvalMargin <= alpha)) {
+            exact = false;
+            return lazyScore;
+        }
+    }
+
     score += rookBonus(pos);
     if (print) std::cout << "info string eval rook   :" << score << std::endl;
     score += bishopEval(pos, score);
@@ -202,6 +218,17 @@ Evaluate::evalPos(const Position& pos) {
     if (mhd->endGame)
         score = EndGameEval::endGameEval<true>(pos, phd->passedPawns, score);
     if (print) std::cout << "info string eval endgame:" << score << std::endl;
+    score = finalScore<print>(pos, score);
+
+    if (useHashTable)
+        ehd->data = (key & 0xffffffffffff0000ULL) + (score + (1 << 15));
+
+    return score;
+}
+
+template <bool print>
+inline int
+Evaluate::finalScore(const Position& pos, int score) {
     if ((whiteContempt != 0) && !mhd->endGame) {
         int mtrlPawns = pos.wMtrlPawns() + pos.bMtrlPawns();
         int mtrl = pos.wMtrl() + pos.bMtrl();
@@ -229,10 +256,6 @@ Evaluate::evalPos(const Position& pos) {
 
     // Tempo bonus
     score += interpolate(tempoBonusEG, tempoBonusMG, mhd->kingSafetyIPF);
-
-    if (useHashTable)
-        ehd->data = (key & 0xffffffffffff0000ULL) + (score + (1 << 15));
-
     return score;
 }
 
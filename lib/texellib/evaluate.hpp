@@ -114,6 +114,16 @@ public:
     int evalPos(const Position& pos);
     int evalPosPrint(const Position& pos);
 
+    /**
+     * Like evalPos(), but first computes a cheap score from material, piece
+     * square tables, pawn structure and castling. If that score is at least
+     * lazyEvalMargin above beta or below alpha, the cheap score is returned
+     * and the expensive terms are not computed.
+     * @param exact Set to false if the cheap score was returned. Such scores
+     *              are not stored in the evaluation hash table.
+     */
+    int evalPosLazy(const Position& pos, int alpha, int beta, bool& exact);
+
     void setWhiteContempt(int contempt);
     int getWhiteContempt() const;
 
@@ -140,7 +150,11 @@ public:
     static void updateEvalParams();
 
 private:
-    template <bool print> int evalPos(const Position& pos);
+    template <bool print, bool lazy> int evalPos(const Position& pos, int alpha, int beta, bool& exact);
+
+    /** Apply contempt and scale factors to a score from white's point of view.
+     *  Return score from the point of view of the side to move, including tempo bonus. */
+    template <bool print> int finalScore(const Position& pos, int score);
 
     EvalHashData& getEvalHashEntry(U64 key);
 
@@ -27,6 +27,7 @@
 
 const int History::maxSum;
 const int History::maxVal;
+const int History::nPieceSquares;
 
 int History::depthTable[] = {
     0, 1, 6, 19, 42, 56
@@ -38,15 +39,38 @@ History::init() {
         for (int sq = 0; sq < 64; sq++) {
             ht[p][sq].nValues = 0;
             ht[p][sq].scaledScore = 0;
+            for (int c = 0; c < Piece::nPieceTypes; c++) {
+                captHist[p][sq][c].nValues = 0;
+                captHist[p][sq][c].scaledScore = 0;
+            }
         }
     }
+    for (int i = 0; i < nPieceSquares; i++)
+        counterMoves[i] = 0;
+    if (!contHist.empty()) {
+        contHist.clear();
+        allocContHist();
+    }
+}
+
+void
+History::allocContHist() {
+    HTEntry empty;
+    empty.nValues = 0;
+    empty.scaledScore = 0;
+    contHist.assign(2 * nPieceSquares * nPieceSquares, empty);
 }
 
 void
 History::reScale() {
     for (int p = 0; p < Piece::nPieceTypes; p++)
-        for (int sq = 0; sq < 64; sq++)
+        for (int sq = 0; sq < 64; sq++) {
             ht[p][sq].nValues >>= 2;
+            for (int c = 0; c < Piece::nPieceTypes; c++)
+                captHist[p][sq][c].nValues >>= 2;
+        }
+    for (HTEntry& e : contHist)
+        e.nValues >>= 2;
 }
 
 void
@@ -29,13 +29,28 @@
 #include "piece.hpp"
 #include "position.hpp"
 
+#include <vector>
+
 /**
- * Implements the relative history heuristic.
+ * Implements the relative history heuristic. In addition to the [piece][to]
+ * history table, counter moves indexed by the previous move and continuation
+ * history indexed by the moves one and two plies earlier are also kept.
+ * Captures use a separate [piece][to][captured piece] history table.
  */
 class History {
 public:
     History();
 
+    /** Identifies the moves leading to the current position. */
+    struct Context {
+        int prev1 = -1; // piece * 64 + toSquare for move one ply ago, or -1
+        int prev2 = -1; // piece * 64 + toSquare for move two plies ago, or -1
+    };
+
+    /** Compute context for a position, given the moves that were made
+     *  one and two plies earlier. Null moves and empty moves are ignored. */
+    static Context getContext(const Position& pos, const Move& prev1, const Move& prev2);
+
     /** Clear all history information. */
     void init();
 
@@ -51,6 +66,29 @@ public:
     /** Get a score between 0 and 49, depending of the success/fail ratio of the move. */
     int getHistScore(const Position& pos, const Move& m) const;
 
+    /** Record move as a success. Also updates the counter move and
+     *  continuation history tables. */
+    void addSuccess(const Position& pos, const Move& m, int depth, const Context& ctx);
+
+    /** Record move as a failure. Also updates the continuation history tables. */
+    void addFail(const Position& pos, const Move& m, int depth, const Context& ctx);
+
+    /** Get a score between 0 and 49 from the continuation history tables,
+     *  or -1 if there is no continuation history information for the move. */
+    int getContHistScore(const Position& pos, const Move& m, const Context& ctx) const;
+
+    /** Return true if m is the counter move for the previous move. */
+    bool isCounterMove(const Move& m, const Context& ctx) const;
+
+    /** Record capture or promotion as a success. */
+    void addCaptureSuccess(const Position& pos, const Move& m, int depth);
+
+    /** Record capture or promotion as a failure. */
+    void addCaptureFail(const Position& pos, const Move& m, int depth);
+
+    /** Get a score between 0 and 49, depending of the success/fail ratio of the capture. */
+    int getCaptureHistScore(const Position& pos, const Move& m) const;
+
     /** Print all history tables. */
     void print() const;
 
@@ -68,7 +106,27 @@ private:
         U16 nValues;     // nSuccess + nFail
         U16 scaledScore; // histScore * scale
     };
+
+    /** Update entry for a success or failure with weight cnt. */
+    static void update(HTEntry& e, int cnt, bool success);
+
+    /** Allocate continuation history tables if not already allocated. */
+    void allocContHist();
+
+    /** Continuation history entry for move m made by piece p,
+     *  after the previous move identified by prevIdx. */
+    HTEntry& contEntry(int nPly, int prevIdx, int p, int to);
+    const HTEntry& contEntry(int nPly, int prevIdx, int p, int to) const;
+
+    static const int nPieceSquares = Piece::nPieceTypes * 64;
+
     HTEntry ht[Piece::nPieceTypes][64];
+    HTEntry captHist[Piece::nPieceTypes][64][Piece::nPieceTypes]; // [piece][to][captured]
+    U16 counterMoves[nPieceSquares];  // Compressed moves, indexed by Context::prev1
+
+    /** Continuation history, indexed by [nPly-1][prevIdx][piece * 64 + to].
+     *  Allocated when first updated, to avoid the memory cost when not used. */
+    std::vector<HTEntry> contHist;
 };
 
 
@@ -82,18 +140,48 @@ History::depthWeight(int depth) {
     return depthTable[clamp(depth, 0, (int)COUNT_OF(depthTable)-1)];
 }
 
+inline void
+History::update(HTEntry& e, int cnt, bool success) {
+    int fpHistVal = e.scaledScore;
+    int sum = e.nValues;
+    if (success)
+        fpHistVal = (fpHistVal * sum + (maxVal * scale - 1) * cnt) / (sum + cnt);
+    else
+        fpHistVal = fpHistVal * sum / (sum + cnt);
+    sum = std::min(sum + cnt, maxSum);
+    e.nValues = sum;
+    e.scaledScore = fpHistVal;
+}
+
+inline History::HTEntry&
+History::contEntry(int nPly, int prevIdx, int p, int to) {
+    return contHist[((nPly - 1) * nPieceSquares + prevIdx) * nPieceSquares + p * 64 + to];
+}
+
+inline const History::HTEntry&
+History::contEntry(int nPly, int prevIdx, int p, int to) const {
+    return contHist[((nPly - 1) * nPieceSquares + prevIdx) * nPieceSquares + p * 64 + to];
+}
+
+inline History::Context
+History::getContext(const Position& pos, const Move& prev1, const Move& prev2) {
+    Context ctx;
+    if (prev1.from() != prev1.to())
+        ctx.prev1 = pos.getPiece(prev1.to()) * 64 + prev1.to();
+    if (prev2.from() != prev2.to() && prev2.to() != prev1.to()) {
+        int p = pos.getPiece(prev2.to());
+        if (p != Piece::EMPTY)
+            ctx.prev2 = p * 64 + prev2.to();
+    }
+    return ctx;
+}
+
 inline void
 History::addSuccess(const Position& pos, const Move& m, int depth) {
     int cnt = depthWeight(depth);
     if (cnt != 0) {
         int p = pos.getPiece(m.from());
-        HTEntry& e = ht[p][m.to()];
-        int fpHistVal = e.scaledScore;
-        int sum = e.nValues;
-        fpHistVal = (fpHistVal * sum + (maxVal * scale - 1) * cnt) / (sum + cnt);
-        sum = std::min(sum + cnt, maxSum);
-        e.nValues = sum;
-        e.scaledScore = fpHistVal;
+        update(ht[p][m.to()], cnt, true);
     }
 }
 
@@ -102,13 +190,7 @@ History::addFail(const Position& pos, const Move& m, int depth) {
     int cnt = depthWeight(depth);
     if (cnt != 0) {
         int p = pos.getPiece(m.from());
-        HTEntry& e = ht[p][m.to()];
-        int fpHistVal = e.scaledScore;
-        int sum = e.nValues;
-        fpHistVal = fpHistVal * sum / (sum + cnt);
-        sum = std::min(sum + cnt, maxSum);
-        e.nValues = sum;
-        e.scaledScore = fpHistVal;
+        update(ht[p][m.to()], cnt, false);
     }
 }
 
@@ -118,4 +200,89 @@ History::getHistScore(const Position& pos, const Move& m) const {
     return ht[p][m.to()].scaledScore >> log2Scale;
 }
 
+inline void
+History::addSuccess(const Position& pos, const Move& m, int depth, const Context& ctx) {
+    if (ctx.prev1 >= 0)
+        counterMoves[ctx.prev1] = m.getCompressedMove();
+    if ((ctx.prev1 >= 0 || ctx.prev2 >= 0) && contHist.empty())
+        allocContHist();
+    int cnt = depthWeight(depth);
+    if (cnt != 0) {
+        int p = pos.getPiece(m.from());
+        update(ht[p][m.to()], cnt, true);
+        if (ctx.prev1 >= 0)
+            update(contEntry(1, ctx.prev1, p, m.to()), cnt, true);
+        if (ctx.prev2 >= 0)
+            update(contEntry(2, ctx.prev2, p, m.to()), cnt, true);
+    }
+}
+
+inline void
+History::addFail(const Position& pos, const Move& m, int depth, const Context& ctx) {
+    if ((ctx.prev1 >= 0 || ctx.prev2 >= 0) && contHist.empty())
+        allocContHist();
+    int cnt = depthWeight(depth);
+    if (cnt != 0) {
+        int p = pos.getPiece(m.from());
+        update(ht[p][m.to()], cnt, false);
+        if (ctx.prev1 >= 0)
+            update(contEntry(1, ctx.prev1, p, m.to()), cnt, false);
+        if (ctx.prev2 >= 0)
+            update(contEntry(2, ctx.prev2, p, m.to()), cnt, false);
+    }
+}
+
+inline int
+History::getContHistScore(const Position& pos, const Move& m, const Context& ctx) const {
+    if (contHist.empty())
+        return -1;
+    int p = pos.getPiece(m.from());
+    int sum = 0;
+    int n = 0;
+    if (ctx.prev1 >= 0) {
+        const HTEntry& e = contEntry(1, ctx.prev1, p, m.to());
+        if (e.nValues > 0) {
+            sum += e.scaledScore;
+            n++;
+        }
+    }
+    if (ctx.prev2 >= 0) {
+        const HTEntry& e = contEntry(2, ctx.prev2, p, m.to());
+        if (e.nValues > 0) {
+            sum += e.scaledScore;
+            n++;
+        }
+    }
+    return n > 0 ? (sum / n) >> log2Scale : -1;
+}
+
+inline bool
+History::isCounterMove(const Move& m, const Context& ctx) const {
+    return ctx.prev1 >= 0 && counterMoves[ctx.prev1] == m.getCompressedMove();
+}
+
+inline void
+History::addCaptureSuccess(const Position& pos, const Move& m, int depth) {
+    int cnt = depthWeight(depth);
+    if (cnt != 0) {
+        int p = pos.getPiece(m.from());
+        update(captHist[p][m.to()][pos.getPiece(m.to())], cnt, true);
+    }
+}
+
+inline void
+History::addCaptureFail(const Position& pos, const Move& m, int depth) {
+    int cnt = depthWeight(depth);
+    if (cnt != 0) {
+        int p = pos.getPiece(m.from());
+        update(captHist[p][m.to()][pos.getPiece(m.to())], cnt, false);
+    }
+}
+
+inline int
+History::getCaptureHistScore(const Position& pos, const Move& m) const {
+    int p = pos.getPiece(m.from());
+    return captHist[p][m.to()][pos.getPiece(m.to())].scaledScore >> log2Scale;
+}
+
 #endif /* HISTORY_HPP_ */
@@ -303,3 +303,35 @@ Numa::bindThread(int threadNo) const {
 #endif
 #endif
 }
+
+void
+Numa::getThreadNodes(std::vector<int>& nodes) const {
+    nodes.clear();
+    for (int node : threadToNode)
+        if (std::find(nodes.begin(), nodes.end(), node) == nodes.end())
+            nodes.push_back(node);
+}
+
+std::shared_ptr<void>
+Numa::allocBytes(size_t numBytes) const {
+#if defined(NUMA) && !defined(_WIN32)
+    if (numa_available() != -1) {
+        void* mem = numa_alloc(numBytes);
+        if (mem) {
+            auto deleter = [numBytes](void* mem) {
+                numa_free(mem, numBytes);
+            };
+            return std::shared_ptr<void>(mem, deleter);
+        }
+    }
+#endif
+    return nullptr;
+}
+
+void
+Numa::bindMemory(void* addr, size_t numBytes, int node) const {
+#if defined(NUMA) && !defined(_WIN32)
+    if (node >= 0 && numBytes > 0 && numa_available() != -1)
+        numa_tonode_memory(addr, numBytes, node);
+#endif
+}
@@ -28,6 +28,7 @@
 
 #include <vector>
 #include <map>
+#include <memory>
 
 
 /** Bind search threads to suitable NUMA nodes. */
@@ -47,6 +48,19 @@ public:
     /** Bind current thread to NUMA node determined by nodeForThread(). */
     void bindThread(int threadNo) const;
 
+    /** Get the NUMA nodes used by search threads, in the order they are
+     *  assigned to threads. Empty if NUMA awareness is not available. */
+    void getThreadNodes(std::vector<int>& nodes) const;
+
+    /** Allocate page aligned memory that has not yet been touched, so that
+     *  bindMemory() can decide where it is placed. Return nullptr if not
+     *  supported. The memory is zero initialized. */
+    std::shared_ptr<void> allocBytes(size_t numBytes) const;
+
+    /** Place memory pages in a range on a given NUMA node. Only has an effect
+     *  for pages that have not yet been touched. "addr" should be page aligned. */
+    void bindMemory(void* addr, size_t numBytes, int node) const;
+
 private:
     Numa();
 
@@ -41,24 +41,28 @@
 
 void
 Notifier::notify() {
-    {
+    notified.store(true);
+    if (sleeping.load()) {
         std::lock_guard<std::mutex> L(mutex);
-        notified = true;
+        cv.notify_all();
     }
-    cv.notify_all();
 }
 
 void
 Notifier::wait(int timeOutMs) {
+    if (notified.exchange(false))
+        return;
     std::unique_lock<std::mutex> L(mutex);
+    sleeping.store(true);
     if (timeOutMs == -1) {
-        while (!notified)
+        while (!notified.load())
             cv.wait(L);
     } else {
-        if (!notified)
+        if (!notified.load())
             cv.wait_for(L, std::chrono::milliseconds(timeOutMs));
     }
-    notified = false;
+    sleeping.store(false);
+    notified.store(false);
 }
 
 // ----------------------------------------------------------------------------
@@ -67,6 +71,8 @@ Communicator::Communicator(Communicator* parent, TranspositionTable& tt)
     : parent(parent), ctt(make_unique<ClusterTT>(tt)) {
     if (parent)
         parent->addChild(this);
+    else
+        threadStats = make_unique<ThreadStats>();
 }
 
 Communicator::~Communicator() {
@@ -79,6 +85,22 @@ Communicator::getCTT() {
     return *ctt;
 }
 
+SearchStats::Totals&
+Communicator::getSearchStatsTotals() {
+    Communicator* c = this;
+    while (c->parent)
+        c = c->parent;
+    return c->searchStatsTotals;
+}
+
+ThreadStats&
+Communicator::getThreadStats() {
+    Communicator* c = this;
+    while (c->parent)
+        c = c->parent;
+    return *c->threadStats;
+}
+
 void
 Communicator::addChild(Communicator* child) {
     std::lock_guard<std::mutex> L(mutex);
@@ -161,7 +183,7 @@ Communicator::sendQuit() {
 void
 Communicator::sendReportResult(int jobId, int score) {
     if (parent)
-        parent->doSendReportResult(jobId, score);
+        parent->doSendReportResult(*this, jobId, score);
 }
 
 void
@@ -184,26 +206,26 @@ Communicator::sendStopAck(bool child) {
         stopAckWaitSelf = false;
     }
     if (hasStopAck() && parent)
-        parent->doSendStopAck();
+        parent->doSendStopAck(*this);
 }
 
 void
 Communicator::forwardStopAck() {
     if (parent)
-        parent->doSendStopAck();
+        parent->doSendStopAck(*this);
 }
 
 void
 Communicator::sendQuitAck() {
     quitAckWaitChildren--;
     if (parent && hasQuitAck())
-        parent->doSendQuitAck();
+        parent->doSendQuitAck(*this);
 }
 
 void
 Communicator::forwardQuitAck() {
     if (parent)
-        parent->doSendQuitAck();
+        parent->doSendQuitAck(*this);
 }
 
 void
@@ -215,59 +237,63 @@ Communicator::poll(CommandHandler& handler) {
             c->doPoll(pass);
     }
 
-    while (true) {
-        std::unique_lock<std::mutex> L(mutex);
-        if (cmdQueue.empty())
-            break;
-        std::shared_ptr<Command> cmd = cmdQueue.front();
-        cmdQueue.pop_front();
-        L.unlock();
-
-        switch (cmd->type) {
-        case CommandType::ASSIGN_THREADS: {
-            const AssignThreadsCommand* aCmd = static_cast<const AssignThreadsCommand*>(cmd.get());
-            handler.assignThreads(aCmd->nThreads, aCmd->firstThreadNo);
-            break;
-        }
-        case CommandType::INIT_SEARCH: {
-            const InitSearchCommand* iCmd = static_cast<const InitSearchCommand*>(cmd.get());
-            Position pos;
-            pos.deSerialize(iCmd->posData);
-            handler.initSearch(pos, iCmd->posHashList, iCmd->posHashListSize, iCmd->clearHistory,
-                               iCmd->whiteContempt);
-            break;
-        }
-        case CommandType::START_SEARCH: {
-            const StartSearchCommand*  sCmd = static_cast<const StartSearchCommand*>(cmd.get());
-            handler.startSearch(sCmd->jobId, sCmd->sti, sCmd->alpha, sCmd->beta, sCmd->depth);
-            break;
-        }
-        case CommandType::STOP_SEARCH:
-            handler.stopSearch();
-            break;
-        case CommandType::SET_PARAM: {
-            const SetParamCommand* spCmd = static_cast<const SetParamCommand*>(cmd.get());
-            handler.setParam(spCmd->name, spCmd->value);
-            break;
-        }
-        case CommandType::QUIT:
-            handler.quit();
-            break;
-        case CommandType::REPORT_RESULT:
-            handler.reportResult(cmd->jobId, cmd->resultScore);
-            break;
-        case CommandType::STOP_ACK:
-            handler.stopAck();
-            break;
-        case CommandType::QUIT_ACK:
-            handler.quitAck();
-            break;
-        case CommandType::REPORT_STATS:
-            break;
-        case CommandType::TT_DATA:
-        case CommandType::TT_ACK:
-            assert(false);
-        }
+    auto handle = [this,&handler](const CommandRecord& rec) {
+        if (!isStale(rec))
+            handleCommand(rec.get(), handler);
+    };
+    if (!fromParent.empty())
+        fromParent.receive(handle);
+    for (auto& c : children)
+        if (!c->toParent.empty())
+            c->toParent.receive(handle);
+}
+
+void
+Communicator::handleCommand(const Command& cmd, CommandHandler& handler) {
+    switch (cmd.type) {
+    case CommandType::ASSIGN_THREADS: {
+        const AssignThreadsCommand& aCmd = static_cast<const AssignThreadsCommand&>(cmd);
+        handler.assignThreads(aCmd.nThreads, aCmd.firstThreadNo);
+        break;
+    }
+    case CommandType::INIT_SEARCH: {
+        const InitSearchCommand& iCmd = static_cast<const InitSearchCommand&>(cmd);
+        Position pos;
+        pos.deSerialize(iCmd.posData);
+        handler.initSearch(pos, iCmd.posHashList, iCmd.posHashListSize, iCmd.clearHistory,
+                           iCmd.whiteContempt);
+        break;
+    }
+    case CommandType::START_SEARCH: {
+        const StartSearchCommand& sCmd = static_cast<const StartSearchCommand&>(cmd);
+        handler.startSearch(sCmd.jobId, sCmd.sti, sCmd.alpha, sCmd.beta, sCmd.depth);
+        break;
+    }
+    case CommandType::STOP_SEARCH:
+        handler.stopSearch();
+        break;
+    case CommandType::SET_PARAM: {
+        const SetParamCommand& spCmd = static_cast<const SetParamCommand&>(cmd);
+        handler.setParam(spCmd.name, spCmd.value);
+        break;
+    }
+    case CommandType::QUIT:
+        handler.quit();
+        break;
+    case CommandType::REPORT_RESULT:
+        handler.reportResult(cmd.jobId, cmd.resultScore);
+        break;
+    case CommandType::STOP_ACK:
+        handler.stopAck();
+        break;
+    case CommandType::QUIT_ACK:
+        handler.quitAck();
+        break;
+    case CommandType::REPORT_STATS:
+        break;
+    case CommandType::TT_DATA:
+    case CommandType::TT_ACK:
+        assert(false);
     }
 }
 
@@ -449,71 +475,101 @@ ThreadCommunicator::setNotifier(Notifier& notifier) {
     this->notifier = &notifier;
 }
 
+template <typename Func>
 void
-ThreadCommunicator::doSendAssignThreads(int nThreads, int firstThreadNo) {
-    std::lock_guard<std::mutex> L(mutex);
-    cmdQueue.push_back(std::make_shared<AssignThreadsCommand>(nThreads, firstThreadNo));
+ThreadCommunicator::sendFromParent(bool newSearch, Func fill) {
+    U32 gen = newSearch ? searchGen.fetch_add(1) + 1 : searchGen.load();
+    fromParent.send([&](CommandRecord& rec) {
+        fill(rec);
+        rec.searchGen = gen;
+    });
     notifier->notify();
 }
 
+template <typename Func>
+void
+ThreadCommunicator::sendFromChild(Communicator& child, Func fill) {
+    U32 gen = searchGen.load();
+    childChannel(child).send([&](CommandRecord& rec) {
+        fill(rec);
+        rec.searchGen = gen;
+    });
+    notifier->notify();
+}
+
+void
+ThreadCommunicator::doSendAssignThreads(int nThreads, int firstThreadNo) {
+    sendFromParent(false, [&](CommandRecord& rec) {
+        rec.type = ASSIGN_THREADS;
+        rec.assignThreads.type = ASSIGN_THREADS;
+        rec.assignThreads.nThreads = nThreads;
+        rec.assignThreads.firstThreadNo = firstThreadNo;
+    });
+}
+
 void
 ThreadCommunicator::doSendInitSearch(const Position& pos,
                                      const std::vector<U64>& posHashList, int posHashListSize,
                                      bool clearHistory, int whiteContempt) {
-    std::lock_guard<std::mutex> L(mutex);
-    cmdQueue.push_back(std::make_shared<InitSearchCommand>(pos, posHashList, posHashListSize,
-                                                           clearHistory, whiteContempt));
-    notifier->notify();
+    sendFromParent(false, [&](CommandRecord& rec) {
+        rec.type = INIT_SEARCH;
+        rec.initSearch.type = INIT_SEARCH;
+        InitSearchCommand& iCmd = rec.initSearch;
+        iCmd.clearHistory = clearHistory;
+        pos.serialize(iCmd.posData);
+        iCmd.posHashList.assign(posHashList.begin(), posHashList.end());
+        iCmd.posHashListSize = posHashListSize;
+        iCmd.whiteContempt = whiteContempt;
+    });
 }
 
 void
 ThreadCommunicator::doSendStartSearch(int jobId, const SearchTreeInfo& sti,
                                       int alpha, int beta, int depth) {
-    std::lock_guard<std::mutex> L(mutex);
-    cmdQueue.erase(std::remove_if(cmdQueue.begin(), cmdQueue.end(),
-                                  [](const std::shared_ptr<Command>& cmd) {
-                                      return cmd->type == CommandType::START_SEARCH ||
-                                             cmd->type == CommandType::STOP_SEARCH ||
-                                             cmd->type == CommandType::REPORT_RESULT;
-                                  }),
-                   cmdQueue.end());
-    cmdQueue.push_back(std::make_shared<StartSearchCommand>(jobId, sti, alpha, beta, depth));
-    notifier->notify();
+    sendFromParent(true, [&](CommandRecord& rec) {
+        rec.type = START_SEARCH;
+        rec.startSearch.type = START_SEARCH;
+        StartSearchCommand& sCmd = rec.startSearch;
+        sCmd.jobId = jobId;
+        sCmd.sti = sti;
+        sCmd.alpha = alpha;
+        sCmd.beta = beta;
+        sCmd.depth = depth;
+    });
 }
 
 void
 ThreadCommunicator::doSendStopSearch() {
-    std::lock_guard<std::mutex> L(mutex);
-    cmdQueue.erase(std::remove_if(cmdQueue.begin(), cmdQueue.end(),
-                                  [](const std::shared_ptr<Command>& cmd) {
-                                      return cmd->type == CommandType::START_SEARCH ||
-                                             cmd->type == CommandType::STOP_SEARCH ||
-                                             cmd->type == CommandType::REPORT_RESULT;
-                                  }),
-                   cmdQueue.end());
-    cmdQueue.push_back(std::make_shared<Command>(CommandType::STOP_SEARCH));
-    notifier->notify();
+    sendFromParent(true, [&](CommandRecord& rec) {
+        rec.type = STOP_SEARCH;
+        rec.cmd = Command(STOP_SEARCH);
+    });
 }
 
 void
 ThreadCommunicator::doSendSetParam(const std::string& name, const std::string& value) {
-    std::lock_guard<std::mutex> L(mutex);
-    cmdQueue.push_back(std::make_shared<SetParamCommand>(name, value));
-    notifier->notify();
+    sendFromParent(false, [&](CommandRecord& rec) {
+        rec.type = SET_PARAM;
+        rec.setParam.type = SET_PARAM;
+        rec.setParam.name = name;
+        rec.setParam.value = value;
+    });
 }
 
 void
 ThreadCommunicator::doSendQuit() {
-    std::lock_guard<std::mutex> L(mutex);
-    cmdQueue.push_back(std::make_shared<Command>(CommandType::QUIT));
-    notifier->notify();
+    sendFromParent(false, [&](CommandRecord& rec) {
+        rec.type = QUIT;
+        rec.cmd = Command(QUIT);
+    });
 }
 
 void
-ThreadCommunicator::doSendReportResult(int jobId, int score) {
-    std::lock_guard<std::mutex> L(mutex);
-    cmdQueue.push_back(std::make_shared<Command>(CommandType::REPORT_RESULT, jobId, score));
-    notifier->notify();
+ThreadCommunicator::doSendReportResult(Communicator& child, int jobId, int score) {
+    sendFromChild(child, [&](CommandRecord& rec) {
+        rec.type = REPORT_RESULT;
+        rec.cmd = Command(REPORT_RESULT, jobId, score);
+    });
 }
 
 void
@@ -533,17 +589,19 @@ ThreadCommunicator::retrieveStats(S64& nodesSearched, S64& tbHits) {
 }
 
 void
-ThreadCommunicator::doSendStopAck() {
-    std::lock_guard<std::mutex> L(mutex);
-    cmdQueue.push_back(std::make_shared<Command>(CommandType::STOP_ACK));
-    notifier->notify();
+ThreadCommunicator::doSendStopAck(Communicator& child) {
+    sendFromChild(child, [&](CommandRecord& rec) {
+        rec.type = STOP_ACK;
+        rec.cmd = Command(STOP_ACK);
+    });
 }
 
 void
-ThreadCommunicator::doSendQuitAck() {
-    std::lock_guard<std::mutex> L(mutex);
-    cmdQueue.push_back(std::make_shared<Command>(CommandType::QUIT_ACK));
-    notifier->notify();
+ThreadCommunicator::doSendQuitAck(Communicator& child) {
+    sendFromChild(child, [&](CommandRecord& rec) {
+        rec.type = QUIT_ACK;
+        rec.cmd = Command(QUIT_ACK);
+    });
 }
 
 void
@@ -552,6 +610,39 @@ ThreadCommunicator::notifyThread() {
 }
 
 
+// ----------------------------------------------------------------------------
+
+ThreadStats::ThreadStats()
+    : mem((MAX_ENTRIES + 1) * CACHE_LINE_SIZE) {
+    static_assert(sizeof(Entry) <= CACHE_LINE_SIZE, "Entry too large");
+    size_t offs = (CACHE_LINE_SIZE - (size_t)&mem[0] % CACHE_LINE_SIZE) % CACHE_LINE_SIZE;
+    entries = &mem[offs];
+    for (int i = 0; i < MAX_ENTRIES; i++)
+        new (entries + i * CACHE_LINE_SIZE) Entry;
+}
+
+void
+ThreadStats::clear() {
+    int n = nUsed.load();
+    for (int i = 0; i < n; i++) {
+        Entry& e = entry(i);
+        e.nodes.store(0, std::memory_order_relaxed);
+        e.tbHits.store(0, std::memory_order_relaxed);
+    }
+}
+
+void
+ThreadStats::getTotals(S64& nodes, S64& tbHits) const {
+    nodes = 0;
+    tbHits = 0;
+    int n = nUsed.load();
+    for (int i = 0; i < n; i++) {
+        const Entry& e = entry(i);
+        nodes += e.nodes.load(std::memory_order_relaxed);
+        tbHits += e.tbHits.load(std::memory_order_relaxed);
+    }
+}
+
 // ----------------------------------------------------------------------------
 
 WorkerThread::WorkerThread(int threadNo, Communicator* parentComm,
@@ -655,6 +746,12 @@ void
 WorkerThread::CommHandler::initSearch(const Position& pos,
                                       const std::vector<U64>& posHashList, int posHashListSize,
                                       bool clearHistory, int whiteContempt) {
+    if (wt.threadNo == 0) {
+        // Thread 0 on a cluster child node is the root of its thread tree
+        wt.comm->getThreadStats().clear();
+        wt.lastHelperNodes = 0;
+        wt.lastHelperTbHits = 0;
+    }
     wt.comm->sendInitSearch(pos, posHashList, posHashListSize, clearHistory, whiteContempt);
     wt.pos = pos;
     wt.posHashList = posHashList;
@@ -662,7 +759,8 @@ WorkerThread::CommHandler::initSearch(const Position& pos,
     wt.whiteContempt = whiteContempt;
     wt.jobId = -1;
 
-    wt.logFile = make_unique<TreeLogger>();
+    if (!wt.logFile)
+        wt.logFile = make_unique<TreeLogger>();
     wt.logFile->open("/home/petero/treelog.dmp", wt.threadNo);
     wt.rootNodeIdx = wt.logFile->logPosition(pos);
     if (wt.kt)
@@ -731,20 +829,38 @@ WorkerThread::sendReportResult(int jobId, int score) {
 
 void
 WorkerThread::sendReportStats(S64 nodesSearched, S64 tbHits) {
-    comm->sendReportStats(nodesSearched, tbHits, true);
+    if (threadNo != 0) {
+        comm->getThreadStats().add(threadNo, nodesSearched, tbHits);
+        return;
+    }
+
+    // Thread 0 on a cluster child node. Include the local helper threads
+    // in the counts sent to the cluster parent.
+    S64 helperNodes, helperTbHits;
+    comm->getThreadStats().getTotals(helperNodes, helperTbHits);
+    nodesSearched += helperNodes - lastHelperNodes;
+    tbHits += helperTbHits - lastHelperTbHits;
+    lastHelperNodes = helperNodes;
+    lastHelperTbHits = helperTbHits;
+    if (nodesSearched != 0 || tbHits != 0)
+        comm->sendReportStats(nodesSearched, tbHits, true);
 }
 
 class ThreadStopHandler : public Search::StopHandler {
 public:
-    ThreadStopHandler(WorkerThread& wt, int jobId, const Search& sc,
+    ThreadStopHandler(WorkerThread& wt, const Search& sc,
                       Communicator::CommandHandler& commHandler);
 
-    /** Destructor. Report searched nodes to parent communicator. */
-    ~ThreadStopHandler();
-
     ThreadStopHandler(const ThreadStopHandler&) = delete;
     ThreadStopHandler& operator=(const ThreadStopHandler&) = delete;
 
+    /** Prepare for a new search of job "jobId". The node counters
+     *  in the Search object must have been reset. */
+    void startJob(int jobId);
+
+    /** Report searched nodes to parent communicator. */
+    void finishJob();
+
     bool shouldStop() override;
 
 private:
@@ -752,7 +868,7 @@ private:
     void reportNodes();
 
     WorkerThread& wt;
-    const int jobId;
+    int jobId = -1;
     const Search& sc;
     Communicator::CommandHandler& commHandler;
     int counter;             // Counts number of calls to shouldStop
@@ -760,13 +876,22 @@ private:
     S64 lastReportedTbHits;
 };
 
-ThreadStopHandler::ThreadStopHandler(WorkerThread& wt, int jobId, const Search& sc,
+ThreadStopHandler::ThreadStopHandler(WorkerThread& wt, const Search& sc,
                                      Communicator::CommandHandler& commHandler)
-    : wt(wt), jobId(jobId), sc(sc), commHandler(commHandler), counter(0),
+    : wt(wt), sc(sc), commHandler(commHandler), counter(0),
       lastReportedNodes(0), lastReportedTbHits(0) {
 }
 
-ThreadStopHandler::~ThreadStopHandler() {
+void
+ThreadStopHandler::startJob(int jobId) {
+    this->jobId = jobId;
+    counter = 0;
+    lastReportedNodes = 0;
+    lastReportedTbHits = 0;
+}
+
+void
+ThreadStopHandler::finishJob() {
     reportNodes();
 }
 
@@ -776,8 +901,10 @@ ThreadStopHandler::shouldStop() {
     if (wt.shouldStop(jobId))
         return true;
 
+    // Helper thread statistics are cheap to update. Thread 0 on a cluster
+    // child node sends a message, so it reports less often.
     counter++;
-    if (counter >= 100) {
+    if (wt.getThreadNo() != 0 || counter >= 100) {
         counter = 0;
         reportNodes();
     }
@@ -808,43 +935,53 @@ WorkerThread::doSearch(CommHandler& commHandler) {
         ht = make_unique<History>();
 
     using namespace SearchConst;
+    if (!sc) {
+        Search::SearchTables st(comm->getCTT(), *kt, *ht, *et);
+        sc = make_unique<Search>(pos, posHashList, posHashListSize, st, *comm, *logFile);
+        sc->setThreadNo(threadNo);
+        auto sh = make_unique<ThreadStopHandler>(*this, *sc, commHandler);
+        stopHandler = sh.get();
+        sc->setStopHandler(std::move(sh));
+    }
+    sc->startSearchStats(false);
+
     int initExtraDepth = 0;
     for (int extraDepth = initExtraDepth; ; extraDepth++) {
-        Search::SearchTables st(comm->getCTT(), *kt, *ht, *et);
         Position pos(this->pos);
 
         UndoInfo ui;
         pos.makeMove(sti.currentMove, ui);
 
         posHashList[posHashListSize++] = pos.zobristHash();
-        Search sc(pos, posHashList, posHashListSize, st, *comm, *logFile);
+        sc->init(pos, posHashList, posHashListSize);
         posHashListSize--;
-        sc.setThreadNo(threadNo);
-        sc.setWhiteContempt(whiteContempt);
-        sc.initSearchTreeInfo();
+        sc->setWhiteContempt(whiteContempt);
+        sc->initSearchTreeInfo();
         const int minProbeDepth = TBProbe::tbEnabled() ? UciParams::minProbeDepth->getIntPar() : MAX_SEARCH_DEPTH;
-        sc.setMinProbeDepth(minProbeDepth);
-
-        auto stopHandler = make_unique<ThreadStopHandler>(*this, jobId, sc, commHandler);
-        sc.setStopHandler(std::move(stopHandler));
+        sc->setMinProbeDepth(minProbeDepth);
+        stopHandler->startJob(jobId);
 
         int ply = 1;
-        sc.setSearchTreeInfo(ply-1, sti, rootNodeIdx);
+        sc->setSearchTreeInfo(ply-1, sti, rootNodeIdx);
         bool inCheck = MoveGen::inCheck(pos);
         U64 nodeIdx = logFile->peekNextNodeIdx();
         try {
             int searchDepth = std::min(depth + extraDepth, MAX_SEARCH_DEPTH);
             int captSquare = -1;
-            int score = sc.negaScout(true, alpha, beta, ply, searchDepth, captSquare, inCheck);
+            int score = sc->negaScout(true, alpha, beta, ply, searchDepth, captSquare, inCheck);
+            stopHandler->finishJob();
             sendReportResult(jobId, score);
             if (searchDepth >= MAX_SEARCH_DEPTH) {
                 jobId = -1;
                 break;
             }
         } catch (const Search::StopSearch&) {
+            stopHandler->finishJob();
             logFile->logNodeEnd(nodeIdx, UNKNOWN_SCORE, TType::T_EMPTY,
                                 UNKNOWN_SCORE, this->pos.historyHash());
             break;
         }
     }
+    // Done before the stop command is acknowledged, see Search::notifySearchStats()
+    sc->flushSearchStats();
 }
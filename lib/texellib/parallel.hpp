@@ -28,6 +28,7 @@
 
 #include "evaluate.hpp"
 #include "searchUtil.hpp"
+#include "searchStats.hpp"
 #include "constants.hpp"
 #include "util/timeUtil.hpp"
 
@@ -46,11 +47,16 @@ class KillerTable;
 class TranspositionTable;
 class ClusterTT;
 class TTReceiver;
+class Search;
+class ThreadStopHandler;
+class ThreadStats;
 
 
 class Notifier {
 public:
-    /** Set the condition. This method can be called by multiple threads. */
+    /** Set the condition. This method can be called by multiple threads.
+     *  The mutex and condition variable are only used if the waiting
+     *  thread is sleeping. */
     void notify();
 
     /** Wait until notify has been called at least once since the last call
@@ -61,7 +67,39 @@ public:
 private:
     std::mutex mutex;
     std::condition_variable cv;
-    bool notified = false;
+    std::atomic<bool> notified{false};
+    std::atomic<bool> sleeping{false};
+};
+
+
+/** A fixed size lock-free queue for one producer thread and one consumer thread.
+ *  The elements are allocated once and reused. More than one thread can act as
+ *  producer (or consumer), as long as a change of thread is synchronized by
+ *  other means. */
+template <typename T, int N>
+class SPSCRing {
+public:
+    /** Return the element to fill in, or null if the ring is full. Producer only. */
+    T* back();
+    /** Make the element returned by back() available to the consumer. */
+    void push();
+
+    /** Return the oldest element, or null if the ring is empty. Consumer only. */
+    T* front();
+    /** Remove the element returned by front(). */
+    void pop();
+
+    /** Return true if the ring is empty. */
+    bool empty() const;
+
+private:
+    static_assert((N & (N - 1)) == 0, "N must be a power of 2");
+
+    std::atomic<U32> head{0}; // Index of next element to read. Written by consumer.
+    char pad1[64];
+    std::atomic<U32> tail{0}; // Index of next element to write. Written by producer.
+    char pad2[64];
+    T elems[N];
 };
 
 
@@ -154,6 +192,14 @@ public:
     S64 getNumSearchedNodes() const;
     S64 getTbHits() const;
 
+    /** Get the search statistics totals for the thread tree this
+     *  communicator belongs to. The totals are owned by the root communicator. */
+    SearchStats::Totals& getSearchStatsTotals();
+
+    /** Get the helper thread node counters for the thread tree this
+     *  communicator belongs to. The counters are owned by the root communicator. */
+    ThreadStats& getThreadStats();
+
 protected:
     virtual void doSendAssignThreads(int nThreads, int firstThreadNo) = 0;
     virtual void doSendInitSearch(const Position& pos,
@@ -165,11 +211,12 @@ protected:
     virtual void doSendSetParam(const std::string& name, const std::string& value) = 0;
     virtual void doSendQuit() = 0;
 
-    virtual void doSendReportResult(int jobId, int score) = 0;
+    // "child" is the child communicator that sends the command
+    virtual void doSendReportResult(Communicator& child, int jobId, int score) = 0;
     virtual void doSendReportStats(S64 nodesSearched, S64 tbHits) = 0;
     virtual void retrieveStats(S64& nodesSearched, S64& tbHits) = 0;
-    virtual void doSendStopAck() = 0;
-    virtual void doSendQuitAck() = 0;
+    virtual void doSendStopAck(Communicator& child) = 0;
+    virtual void doSendQuitAck(Communicator& child) = 0;
 
     virtual void doPoll(int pass) = 0;
     /** Notify corresponding search thread that something has happened. */
@@ -272,7 +319,63 @@ protected:
         S64 nodesSearched = 0;
         S64 tbHits = 0;
     };
-    std::deque<std::shared_ptr<Command>> cmdQueue;
+
+    /** A preallocated command. Holds one command of each kind, and the
+     *  "type" field tells which one is valid. */
+    struct CommandRecord {
+        CommandType type { QUIT };
+        U32 searchGen = 0;   // Receiver searchGen when the command was sent
+        Command cmd;
+        AssignThreadsCommand assignThreads;
+        InitSearchCommand initSearch;
+        StartSearchCommand startSearch;
+        SetParamCommand setParam;
+
+        /** Return the valid command. */
+        const Command& get() const;
+    };
+
+    /** Commands sent in one direction over one parent/child edge. Commands are
+     *  normally passed through a preallocated SPSC ring. If the ring is full,
+     *  commands are stored in an overflow queue until the consumer catches up. */
+    class CommandChannel {
+    public:
+        /** Fill in a record by calling fill(CommandRecord&) and queue it.
+         *  Only called by the sending thread. */
+        template <typename Func> void send(Func fill);
+
+        /** Call func(const CommandRecord&) for all queued records, in the
+         *  order they were sent. Only called by the receiving thread. */
+        template <typename Func> void receive(Func func);
+
+        /** Return true if no commands are queued. Can be called by any thread. */
+        bool empty() const;
+
+    private:
+        SPSCRing<CommandRecord, 8> ring;
+        std::atomic<int> nOverflow{0};
+        std::mutex overflowMutex;
+        std::deque<std::unique_ptr<CommandRecord>> overflow;
+    };
+
+    /** Return the channel used by "child" to send commands to its parent. */
+    static CommandChannel& childChannel(Communicator& child) { return child.toParent; }
+
+    /** Return true if a command should be ignored because a later start
+     *  or stop search command has been sent to this communicator. */
+    bool isStale(const CommandRecord& rec) const;
+
+    /** Handle a received command. */
+    static void handleCommand(const Command& cmd, CommandHandler& handler);
+
+    /** Commands from the parent to this communicator. */
+    CommandChannel fromParent;
+    /** Commands from this communicator to the parent. */
+    CommandChannel toParent;
+
+    /** Incremented when a start or stop search command is sent to this communicator.
+     *  Start/stop/report result commands sent before the last increment are ignored. */
+    std::atomic<U32> searchGen{0};
 
     std::mutex mutex;
 
@@ -283,6 +386,8 @@ private:
     Communicator* const parent;
     std::vector<Communicator*> children;
     std::unique_ptr<ClusterTT> ctt;
+    SearchStats::Totals searchStatsTotals; // Only used in the root communicator
+    std::unique_ptr<ThreadStats> threadStats; // Only created in the root communicator
 
     bool stopAckWaitSelf = false;
     int stopAckWaitChildren = 0;
@@ -314,21 +419,64 @@ protected:
     void doSendSetParam(const std::string& name, const std::string& value) override;
     void doSendQuit() override;
 
-    void doSendReportResult(int jobId, int score) override;
+    void doSendReportResult(Communicator& child, int jobId, int score) override;
     void doSendReportStats(S64 nodesSearched, S64 tbHits) override;
     void retrieveStats(S64& nodesSearched, S64& tbHits) override;
-    void doSendStopAck() override;
-    void doSendQuitAck() override;
+    void doSendStopAck(Communicator& child) override;
+    void doSendQuitAck(Communicator& child) override;
 
     void doPoll(int pass) override {}
     void notifyThread() override;
 
 private:
+    /** Queue a command from the parent and notify the search thread. If "newSearch"
+     *  is true, earlier start/stop/report result commands become stale. */
+    template <typename Func> void sendFromParent(bool newSearch, Func fill);
+
+    /** Queue a command from a child and notify the search thread. */
+    template <typename Func> void sendFromChild(Communicator& child, Func fill);
+
     Notifier* notifier;
     std::unique_ptr<TTReceiver> ttReceiver;
 };
 
 
+/** Search statistics for the helper threads in a thread tree. Each thread adds
+ *  to its own cache line sized entry, so no messages are needed to report node
+ *  counts, and any thread can compute the totals when needed. */
+class ThreadStats {
+public:
+    ThreadStats();
+    ThreadStats(const ThreadStats&) = delete;
+    ThreadStats& operator=(const ThreadStats&) = delete;
+
+    /** Set all counters to zero. Must not be called while a thread
+     *  can add to the counters. */
+    void clear();
+
+    /** Add searched nodes and tablebase hits for thread "threadNo". */
+    void add(int threadNo, S64 nodes, S64 tbHits);
+
+    /** Get the sum of all counters. */
+    void getTotals(S64& nodes, S64& tbHits) const;
+
+private:
+
+    struct Entry {
+        std::atomic<S64> nodes{0};
+        std::atomic<S64> tbHits{0};
+    };
+    static const int CACHE_LINE_SIZE = 64;
+    static const int MAX_ENTRIES = 512; // Threads share entries if there are more threads
+
+    Entry& entry(int idx) const;
+
+    std::vector<U8> mem;            // Memory for cache line aligned entries
+    U8* entries;                    // First entry
+    std::atomic<int> nUsed{0};      // Number of entries that have been used
+};
+
+
 /** Handles communication between search threads. */
 class WorkerThread {
 public:
@@ -418,6 +566,10 @@ private:
     TranspositionTable& tt;
 
     std::unique_ptr<TreeLogger> logFile;
+
+    // Search object reused for all jobs. Created on first use.
+    std::unique_ptr<Search> sc;
+    ThreadStopHandler* stopHandler = nullptr; // Owned by sc
     U64 rootNodeIdx = 0;
     Position pos;
     SearchTreeInfo sti;
@@ -430,9 +582,123 @@ private:
     int depth = -1;
 
     bool hasResult = false;
+
+    // Helper thread totals last reported to the cluster parent in the current
+    // search. Only used by thread 0.
+    S64 lastHelperNodes = 0;
+    S64 lastHelperTbHits = 0;
 };
 
 
+template <typename T, int N>
+inline T*
+SPSCRing<T,N>::back() {
+    U32 t = tail.load(std::memory_order_relaxed);
+    if (t - head.load(std::memory_order_acquire) >= (U32)N)
+        return nullptr;
+    return &elems[t & (N - 1)];
+}
+
+template <typename T, int N>
+inline void
+SPSCRing<T,N>::push() {
+    tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+template <typename T, int N>
+inline T*
+SPSCRing<T,N>::front() {
+    U32 h = head.load(std::memory_order_relaxed);
+    if (h == tail.load(std::memory_order_acquire))
+        return nullptr;
+    return &elems[h & (N - 1)];
+}
+
+template <typename T, int N>
+inline void
+SPSCRing<T,N>::pop() {
+    head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+template <typename T, int N>
+inline bool
+SPSCRing<T,N>::empty() const {
+    return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+}
+
+inline const Communicator::Command&
+Communicator::CommandRecord::get() const {
+    switch (type) {
+    case ASSIGN_THREADS: return assignThreads;
+    case INIT_SEARCH:    return initSearch;
+    case START_SEARCH:   return startSearch;
+    case SET_PARAM:      return setParam;
+    default:             return cmd;
+    }
+}
+
+template <typename Func>
+inline void
+Communicator::CommandChannel::send(Func fill) {
+    if (nOverflow.load() == 0) {
+        CommandRecord* rec = ring.back();
+        if (rec) {
+            fill(*rec);
+            ring.push();
+            return;
+        }
+    }
+    auto rec = make_unique<CommandRecord>();
+    fill(*rec);
+    std::lock_guard<std::mutex> L(overflowMutex);
+    overflow.push_back(std::move(rec));
+    nOverflow.store(overflow.size());
+}
+
+template <typename Func>
+inline void
+Communicator::CommandChannel::receive(Func func) {
+    while (true) {
+        while (CommandRecord* rec = ring.front()) {
+            func(*rec);
+            ring.pop();
+        }
+        if (nOverflow.load() == 0)
+            break;
+        // The sender does not use the ring while the overflow queue is non-empty,
+        // so records in the ring are older than records in the overflow queue.
+        while (CommandRecord* rec = ring.front()) {
+            func(*rec);
+            ring.pop();
+        }
+        std::deque<std::unique_ptr<CommandRecord>> recs;
+        {
+            std::lock_guard<std::mutex> L(overflowMutex);
+            recs.swap(overflow);
+            nOverflow.store(0);
+        }
+        for (auto& rec : recs)
+            func(*rec);
+    }
+}
+
+inline bool
+Communicator::CommandChannel::empty() const {
+    return ring.empty() && nOverflow.load() == 0;
+}
+
+inline bool
+Communicator::isStale(const CommandRecord& rec) const {
+    switch (rec.type) {
+    case START_SEARCH:
+    case STOP_SEARCH:
+    case REPORT_RESULT:
+        return rec.searchGen != searchGen.load();
+    default:
+        return false;
+    }
+}
+
 inline bool
 Communicator::hasStopAck() const {
     return stopAckWaitChildren == 0 && !stopAckWaitSelf;
@@ -453,6 +719,24 @@ Communicator::getTbHits() const {
     return tbHits;
 }
 
+inline ThreadStats::Entry&
+ThreadStats::entry(int idx) const {
+    return *reinterpret_cast<Entry*>(entries + idx * CACHE_LINE_SIZE);
+}
+
+inline void
+ThreadStats::add(int threadNo, S64 nodes, S64 tbHits) {
+    int idx = threadNo & (MAX_ENTRIES - 1);
+    if (idx >= nUsed.load(std::memory_order_relaxed)) {
+        int n = nUsed.load();
+        while (n <= idx && !nUsed.compare_exchange_weak(n, idx + 1))
+            ;
+    }
+    Entry& e = entry(idx);
+    e.nodes.fetch_add(nodes, std::memory_order_relaxed);
+    e.tbHits.fetch_add(tbHits, std::memory_order_relaxed);
+}
+
 inline int
 ThreadCommunicator::clusterChildNo() const {
     return -1;
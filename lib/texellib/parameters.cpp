@@ -172,8 +172,19 @@ DEFINE_PARAM(lmpMoveCountLimit4);
 DEFINE_PARAM(lmrMoveCountLimit1);
 DEFINE_PARAM(lmrMoveCountLimit2);
 
+DEFINE_PARAM(probCutMinDepth);
+DEFINE_PARAM(probCutMargin);
+DEFINE_PARAM(probCutReduction);
+
+DEFINE_PARAM(contHistWeight);
+DEFINE_PARAM(counterMoveBonus);
+DEFINE_PARAM(captHistWeight);
+DEFINE_PARAM(captHistSkipSEE);
+DEFINE_PARAM(upcomingRepetition);
+
 DEFINE_PARAM(quiesceMaxSortMoves);
 DEFINE_PARAM(deltaPruningMargin);
+DEFINE_PARAM(lazyEvalMargin);
 
 DEFINE_PARAM(timeMaxRemainingMoves);
 DEFINE_PARAM(bufferTime);
@@ -815,8 +826,19 @@ Parameters::Parameters() {
     REGISTER_PARAM(lmrMoveCountLimit1, "LMRMoveCountLimit1");
     REGISTER_PARAM(lmrMoveCountLimit2, "LMRMoveCountLimit2");
 
+    REGISTER_PARAM(probCutMinDepth, "ProbCutMinDepth");
+    REGISTER_PARAM(probCutMargin, "ProbCutMargin");
+    REGISTER_PARAM(probCutReduction, "ProbCutReduction");
+
+    REGISTER_PARAM(contHistWeight, "ContHistWeight");
+    REGISTER_PARAM(counterMoveBonus, "CounterMoveBonus");
+    REGISTER_PARAM(captHistWeight, "CaptHistWeight");
+    REGISTER_PARAM(captHistSkipSEE, "CaptHistSkipSEE");
+    REGISTER_PARAM(upcomingRepetition, "UpcomingRepetition");
+
     REGISTER_PARAM(quiesceMaxSortMoves, "QuiesceMaxSortMoves");
     REGISTER_PARAM(deltaPruningMargin, "DeltaPruningMargin");
+    REGISTER_PARAM(lazyEvalMargin, "LazyEvalMargin");
 
     // Time management parameters
     REGISTER_PARAM(timeMaxRemainingMoves, "TimeMaxRemainingMoves");
@@ -547,8 +547,19 @@ DECLARE_PARAM(lmpMoveCountLimit4, 24, 1, 256, useUciParam);
 DECLARE_PARAM(lmrMoveCountLimit1,  3, 1, 256, useUciParam);
 DECLARE_PARAM(lmrMoveCountLimit2, 12, 1, 256, useUciParam);
 
+DECLARE_PARAM(probCutMinDepth,    5, 2, 100, useUciParam);
+DECLARE_PARAM(probCutMargin,    100, 0, 1000, useUciParam);
+DECLARE_PARAM(probCutReduction,   4, 2, 10, useUciParam);
+
+DECLARE_PARAM(contHistWeight,    0, 0, 64, useUciParam);
+DECLARE_PARAM(counterMoveBonus,  0, 0, 49, useUciParam);
+DECLARE_PARAM(captHistWeight,    8, 0, 64, useUciParam);
+DECLARE_PARAM(captHistSkipSEE,   0, 0, 49, useUciParam);
+DECLARE_PARAM(upcomingRepetition, 0, 0, 1, useUciParam);
+
 DECLARE_PARAM(quiesceMaxSortMoves, 8, 0, 256, useUciParam);
 DECLARE_PARAM(deltaPruningMargin, 152, 0, 1000, useUciParam);
+DECLARE_PARAM(lazyEvalMargin, 300, 0, 2000, useUciParam);
 
 
 // Time management parameters
@@ -25,6 +25,8 @@
 
 #include "polyglot.hpp"
 
+#include <algorithm>
+
 
 U64
 PolyglotBook::getHashKey(const Position& pos) {
@@ -170,6 +172,49 @@ PolyglotBook::deSerialize(const PGEntry& ent, U64& hash, U16& move, U16& weight)
         weight = (weight << 8) | ent.data[10+i];
 }
 
+// ----------------------------------------------------------------------------
+
+PolyglotBookFile::PolyglotBookFile(const std::string& fileName0)
+    : fileName(fileName0), file(fileName0),
+      entries((const PolyglotBook::PGEntry*)file.data()),
+      nEntries(file.size() / sizeof(PolyglotBook::PGEntry)),
+      valid(file.isOpen()) {
+    index.reserve((nEntries >> INDEX_SHIFT) + 1);
+    U64 prevKey = 0;
+    for (size_t i = 0; i < nEntries; i++) {
+        U64 key = getKey(i);
+        if (key < prevKey) {
+            valid = false;
+            break;
+        }
+        prevKey = key;
+        if ((i & ((1 << INDEX_SHIFT) - 1)) == 0)
+            index.push_back(key);
+    }
+    if (!valid) {
+        nEntries = 0;
+        index.clear();
+    }
+}
+
+size_t
+PolyglotBookFile::findFirst(U64 hashKey) const {
+    // Use the index to find a range of at most 2^INDEX_SHIFT entries
+    size_t j = std::lower_bound(index.begin(), index.end(), hashKey) - index.begin();
+    size_t lo = j > 0 ? ((j - 1) << INDEX_SHIFT) + 1 : 0;
+    size_t hi = j < index.size() ? (j << INDEX_SHIFT) : nEntries;
+
+    // getKey(lo-1) < hashKey <= getKey(hi)
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (getKey(mid) < hashKey)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
 U64
 PolyglotBook::hashRandoms[] = {
     0x9D39247E33776D41ULL, 0x2AF7398005AAA5C7ULL, 0x44DB015024623547ULL, 0x9C15F73E62A76AE2ULL,
@@ -27,6 +27,9 @@
 #define POLYGLOT_HPP_
 
 #include "position.hpp"
+#include "util/mappedFile.hpp"
+
+#include <vector>
 
 /**
  * Utility methods for handling of polyglot book entries.
@@ -56,4 +59,69 @@ private:
     static U64 hashRandoms[];
 };
 
+/** A read-only polyglot book file. The file is memory mapped and the entries
+ *  are read in place. An in-memory copy of every 2^INDEX_SHIFT:th hash key is
+ *  used to quickly find the part of the file that contains a position. */
+class PolyglotBookFile {
+public:
+    /** Open and map a book file. */
+    explicit PolyglotBookFile(const std::string& fileName);
+
+    PolyglotBookFile(const PolyglotBookFile&) = delete;
+    PolyglotBookFile& operator=(const PolyglotBookFile&) = delete;
+
+    /** Return true if the file could be opened and the entries are sorted. */
+    bool isValid() const { return valid; }
+
+    const std::string& getFileName() const { return fileName; }
+
+    /** Number of entries in the book file. */
+    size_t numEntries() const { return nEntries; }
+
+    /** Call func(U16 move, U16 weight) for all entries having a given hash key. */
+    template <typename Func>
+    void forEachEntry(U64 hashKey, Func func) const;
+
+private:
+    /** Return index of first entry with hash key >= hashKey. */
+    size_t findFirst(U64 hashKey) const;
+
+    /** Return the hash key of entry "idx". */
+    U64 getKey(size_t idx) const;
+
+    const std::string fileName;
+    MappedFile file;
+    const PolyglotBook::PGEntry* entries;
+    size_t nEntries;
+    bool valid;
+
+    static const int INDEX_SHIFT = 6;
+    std::vector<U64> index; // index[i] = getKey(i << INDEX_SHIFT)
+};
+
+
+template <typename Func>
+inline void
+PolyglotBookFile::forEachEntry(U64 hashKey, Func func) const {
+    if (!valid)
+        return;
+    for (size_t i = findFirst(hashKey); i < nEntries; i++) {
+        U64 hash;
+        U16 move, weight;
+        PolyglotBook::deSerialize(entries[i], hash, move, weight);
+        if (hash != hashKey)
+            break;
+        func(move, weight);
+    }
+}
+
+inline U64
+PolyglotBookFile::getKey(size_t idx) const {
+    const U8* data = entries[idx].data;
+    U64 hash = 0;
+    for (int i = 0; i < 8; i++)
+        hash = (hash << 8) | data[i];
+    return hash;
+}
+
 #endif /* POLYGLOT_HPP_ */
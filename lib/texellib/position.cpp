@@ -35,6 +35,10 @@ const U64 hashEmpty = 0x5fd230cc43568439ULL;
 
 U8 Position::castleSqMask[64];
 
+const int Position::cuckooSize;
+U64 Position::cuckooKeys[cuckooSize];
+U16 Position::cuckooMoves[cuckooSize];
+
 static StaticInitializer<Position> posInit;
 
 void
@@ -48,6 +52,45 @@ Position::staticInitialize() {
     castleSqMask[A8] &= ~(1 << A8_CASTLE);
     castleSqMask[E8] &= ~((1 << A8_CASTLE) | (1 << H8_CASTLE));
     castleSqMask[H8] &= ~(1 << H8_CASTLE);
+
+    // Insert all non-pawn moves possible on an empty board in the cuckoo tables
+    for (int i = 0; i < cuckooSize; i++) {
+        cuckooKeys[i] = 0;
+        cuckooMoves[i] = 0;
+    }
+    for (int p = Piece::WKING; p <= Piece::BKNIGHT; p++) {
+        if (p == Piece::WPAWN || p == Piece::BPAWN)
+            continue;
+        const int pType = Piece::makeWhite(p);
+        for (int sq1 = 0; sq1 < 64; sq1++) {
+            for (int sq2 = sq1 + 1; sq2 < 64; sq2++) {
+                int dx = std::abs(Square::getX(sq2) - Square::getX(sq1));
+                int dy = std::abs(Square::getY(sq2) - Square::getY(sq1));
+                bool diag = dx == dy;
+                bool straight = dx == 0 || dy == 0;
+                bool ok;
+                switch (pType) {
+                case Piece::WKING:   ok = std::max(dx, dy) == 1; break;
+                case Piece::WQUEEN:  ok = diag || straight;      break;
+                case Piece::WROOK:   ok = straight;              break;
+                case Piece::WBISHOP: ok = diag;                  break;
+                default:             ok = dx * dy == 2;          break;
+                }
+                if (!ok)
+                    continue;
+                U64 key = psHashKeys[p][sq1] ^ psHashKeys[p][sq2] ^ whiteHashKey;
+                U16 move = sq1 + 64 * sq2;
+                int i = cuckooH1(key);
+                while (true) {
+                    std::swap(cuckooKeys[i], key);
+                    std::swap(cuckooMoves[i], move);
+                    if (move == 0)
+                        break;
+                    i = (i == cuckooH1(key)) ? cuckooH2(key) : cuckooH1(key);
+                }
+            }
+        }
+    }
 }
 
 Position::Position() {
@@ -195,6 +195,12 @@ public:
     /** Get hash key for a piece at a square. */
     static U64 getHashKey(int piece, int square);
 
+    /** Return true if keyDiff is the Zobrist hash difference caused by a
+     *  non-pawn piece moving between sq1 and sq2, including the side to
+     *  move change. sq1 and sq2 are then set to the move squares. Only
+     *  moves possible on an empty board are considered. */
+    static bool getReversibleMove(U64 keyDiff, int& sq1, int& sq2);
+
 
     /** Serialization. Used by tree logging code. */
     struct SerializeData {
@@ -209,22 +215,28 @@ private:
     void movePieceNotPawnB(int from, int to);
 
 
-    int wMtrl_;              // Total value of all white pieces and pawns
-    int bMtrl_;              // Total value of all black pieces and pawns
-    int wMtrlPawns_;         // Total value of all white pawns
-    int bMtrlPawns_;         // Total value of all black pawns
+    // The fields are ordered so that the bitboards and hash keys, which
+    // are used the most during search, share the first cache lines.
 
-    int squares[64];
+    // Bitboards
+    U64 pieceTypeBB_[Piece::nPieceTypes];
+    U64 whiteBB_, blackBB_;
+
+    U64 hashKey;           // Cached Zobrist hash key
+    U64 pHashKey;          // Cached Zobrist pawn hash key
+
+    U8 squares[64];
 
     // Piece square table scores
     short psScore1_[Piece::nPieceTypes];
     short psScore2_[Piece::nPieceTypes];
 
-    // Bitboards
-    U64 pieceTypeBB_[Piece::nPieceTypes];
-    U64 whiteBB_, blackBB_;
+    int wMtrl_;              // Total value of all white pieces and pawns
+    int bMtrl_;              // Total value of all black pieces and pawns
+    int wMtrlPawns_;         // Total value of all white pawns
+    int bMtrlPawns_;         // Total value of all black pawns
 
-    bool whiteMove;
+    MatId matId;           // Cached material identifier
 
     /** Number of half-moves since last 50-move reset. */
     int halfMoveClock;
@@ -232,12 +244,9 @@ private:
     /** Game move number, starting from 1. */
     int fullMoveCounter;
 
-    int castleMask;
-    int epSquare;
-
-    U64 hashKey;           // Cached Zobrist hash key
-    U64 pHashKey;          // Cached Zobrist pawn hash key
-    MatId matId;           // Cached material identifier
+    U8 castleMask;
+    S8 epSquare;
+    bool whiteMove;
 
     static U8 castleSqMask[64]; // Castle masks retained for each square
 
@@ -247,8 +256,18 @@ private:
     const static U64 castleHashKeys[16];   // [castleMask]
     const static U64 epHashKeys[9];        // [epFile + 1] (epFile==-1 for no ep)
     const static U64 moveCntKeys[101];     // [min(halfMoveClock, 100)]
+
+    /** Cuckoo hash tables of all reversible non-pawn moves, indexed by the
+     *  Zobrist hash difference the move causes. */
+    static const int cuckooSize = 8192;
+    static U64 cuckooKeys[cuckooSize];
+    static U16 cuckooMoves[cuckooSize];   // from + 64 * to
+    static int cuckooH1(U64 key) { return key & (cuckooSize - 1); }
+    static int cuckooH2(U64 key) { return (key >> 16) & (cuckooSize - 1); }
 };
 
+static_assert(sizeof(Position) <= 288, "Position should fit in 4.5 cache lines");
+
 /** For debugging. */
 std::ostream& operator<<(std::ostream& os, const Position& pos);
 
@@ -279,6 +298,19 @@ Position::pawnZobristHash() const {
     return pHashKey;
 }
 
+inline bool
+Position::getReversibleMove(U64 keyDiff, int& sq1, int& sq2) {
+    int i = cuckooH1(keyDiff);
+    if (cuckooKeys[i] != keyDiff) {
+        i = cuckooH2(keyDiff);
+        if (cuckooKeys[i] != keyDiff)
+            return false;
+    }
+    sq1 = cuckooMoves[i] & 63;
+    sq2 = cuckooMoves[i] >> 6;
+    return true;
+}
+
 inline U64
 Position::kingZobristHash() const {
     return psHashKeys[Piece::WKING][wKingSq()] ^
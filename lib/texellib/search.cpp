@@ -48,6 +48,11 @@ Search::Search(const Position& pos0, const std::vector<U64>& posHashList0,
                TreeLogger& logFile)
     : eval(st.et), kt(st.kt), ht(st.ht), tt(st.tt), comm(comm), threadNo(0),
       logFile(logFile) {
+#ifdef COPY_MAKE
+    posStack.resize(MAX_SEARCH_DEPTH * 2 + 1);
+#else
+    posStack.resize(1);
+#endif
     stopHandler = make_unique<DefaultStopHandler>(*this);
     init(pos0, posHashList0, posHashListSize0);
 }
@@ -55,7 +60,8 @@ Search::Search(const Position& pos0, const std::vector<U64>& posHashList0,
 void
 Search::init(const Position& pos0, const std::vector<U64>& posHashList0,
              int posHashListSize0) {
-    pos = pos0;
+    posStack[0] = pos0;
+    curPos = &posStack[0];
     posHashList = posHashList0;
     posHashListSize = posHashListSize0;
     posHashFirstNew = posHashListSize;
@@ -104,10 +110,12 @@ Search::iterativeDeepening(const MoveList& scMovesIn,
                            int maxDepth, S64 initialMaxNodes,
                            int maxPV, bool onlyExact,
                            int minProbeDepth, bool clearHistory) {
+    Position& pos = *curPos;
     tStart = currentTimeMillis();
     totalNodes = 0;
     tbHits = 0;
     nodesToGo = 0;
+    startSearchStats(true);
     if (scMovesIn.size <= 0)
         return Move(); // No moves to search
 
@@ -123,7 +131,9 @@ Search::iterativeDeepening(const MoveList& scMovesIn,
     std::vector<MoveInfo> rootMoves;
     getRootMoves(scMovesIn, rootMoves, maxDepth);
 
+#ifndef COPY_MAKE
     Position origPos(pos);
+#endif
     bool firstIteration = true;
     Move bestMove = rootMoves[0].move; // bestMove is != rootMoves[0].move when there is an unresolved fail high
     Move bestExactMove = rootMoves[0].move; // Only updated when new best move has exact score
@@ -133,6 +143,7 @@ Search::iterativeDeepening(const MoveList& scMovesIn,
     const int evalScore = eval.evalPos(pos);
     initSearchTreeInfo();
     ht.reScale();
+    comm.getThreadStats().clear();
     comm.sendInitSearch(pos, posHashList, posHashListSize, clearHistory,
                         eval.getWhiteContempt());
 
@@ -177,7 +188,7 @@ Search::iterativeDeepening(const MoveList& scMovesIn,
                 !givesCheck && !passedPawnPush(pos, m) && (mi >= rootLMRMoveCount + maxPV)) {
                 lmrS = 1;
             }
-            pos.makeMove(m, ui);
+            makeMove(m, ui);
             totalNodes++;
             nodesToGo--;
             SearchTreeInfo& sti = searchTreeInfo[0];
@@ -190,7 +201,7 @@ Search::iterativeDeepening(const MoveList& scMovesIn,
                 score = -negaScoutRoot(true, -beta, -alpha, 1, depth - 1, givesCheck);
             nodesThisMove += totalNodes;
             posHashListSize--;
-            pos.unMakeMove(m, ui);
+            unMakeMove(m, ui);
             storeSearchResult(rootMoves, mi, depth, alpha, beta, score);
             if ((mi < maxPV) || (score > rootMoves[maxPV-1].score()))
                 notifyPV(rootMoves, mi, maxPV);
@@ -220,13 +231,13 @@ Search::iterativeDeepening(const MoveList& scMovesIn,
                     needMoreTime = searchNeedMoreTime = true;
                     hardFactor = std::max(hardFactor, 2.0);
                 }
-                pos.makeMove(m, ui);
+                makeMove(m, ui);
                 totalNodes++;
                 nodesToGo--;
                 score = -negaScoutRoot(true, -beta, -alpha, 1, depth - 1, givesCheck);
                 nodesThisMove += totalNodes;
                 posHashListSize--;
-                pos.unMakeMove(m, ui);
+                unMakeMove(m, ui);
                 storeSearchResult(rootMoves, mi, depth, alpha, beta, score);
                 notifyPV(rootMoves, mi, maxPV);
             }
@@ -294,9 +305,14 @@ Search::iterativeDeepening(const MoveList& scMovesIn,
         }
     }
     } catch (const StopSearch&) {
+#ifdef COPY_MAKE
+        curPos = &pos;
+#else
         pos = origPos;
+#endif
     }
     notifyStats();
+    flushSearchStats();
 
     logFile.close();
     return onlyExact ? bestExactMove : bestMove;
@@ -313,18 +329,25 @@ private:
 int
 Search::negaScoutRoot(bool tb, int alpha, int beta, int ply, int depth,
                       const bool inCheck) {
+    Position& pos = *curPos;
     SearchTreeInfo sti = searchTreeInfo[ply-1];
     jobId++;
     comm.sendStartSearch(jobId, sti, alpha, beta, depth);
     U64 nodeIdx = logFile.peekNextNodeIdx();
+#ifndef COPY_MAKE
     Position pos0(pos);
+#endif
     int posHashListSize0 = posHashListSize;
     try {
         return negaScout(tb, alpha, beta, ply, depth, -1, inCheck);
     } catch (const HelperThreadResult& res) {
         initSearchTreeInfo();
         searchTreeInfo[ply-1] = sti;
+#ifdef COPY_MAKE
+        curPos = &pos;
+#else
         pos = pos0;
+#endif
         posHashListSize = posHashListSize0;
 
         const U64 hKey = pos.historyHash();
@@ -339,6 +362,7 @@ Search::negaScoutRoot(bool tb, int alpha, int beta, int ply, int depth,
 void
 Search::storeSearchResult(std::vector<MoveInfo>& scMoves, int mi, int depth,
                           int alpha, int beta, int score) {
+    Position& pos = *curPos;
 //    std::cout << "d:" << depth << " mi:" << mi << " a:" << alpha
 //              << " b:" << beta << " s:" << score << std::endl;
     scMoves[mi].depth = depth;
@@ -423,6 +447,18 @@ Search::notifyStats() {
     tLastStats = tNow;
 }
 
+void
+Search::notifySearchStats() {
+    flushSearchStats();
+    if (SearchStats::enabled && listener) {
+        SearchStatsCollector totals;
+        getSearchStatsTotals(totals);
+        std::vector<std::string> lines;
+        totals.getLines(lines);
+        listener->notifySearchStats(lines);
+    }
+}
+
 bool
 Search::shouldStop() {
     class Handler : public Communicator::CommandHandler {
@@ -465,6 +501,7 @@ template <bool tb>
 int
 Search::negaScout(int alpha, int beta, int ply, int depth, int recaptureSquare,
                   const bool inCheck) {
+    Position& pos = *curPos;
     // Mate distance pruning
     beta = std::min(beta, MATE0-ply-1);
     if (alpha >= beta)
@@ -485,6 +522,7 @@ Search::negaScout(int alpha, int beta, int ply, int depth, int recaptureSquare,
     SearchTreeInfo& sti = searchTreeInfo[ply];
     sti.currentMove = emptyMove;
     sti.currentMoveNo = -1;
+    stats.incNode(ply, depth <= 0);
 
     // Draw tests
     if (canClaimDraw50(pos)) {
@@ -506,6 +544,11 @@ Search::negaScout(int alpha, int beta, int ply, int depth, int recaptureSquare,
         return 0;            // No need to test for mate here, since it would have been
                              // discovered the first time the position came up.
     }
+    if (upcomingRepetition && (beta <= 0) && (ply > 0) && sti.singularMove.isEmpty() &&
+            hasUpcomingRepetition(pos, posHashList, posHashListSize, posHashFirstNew)) {
+        logFile.logNodeEnd(searchTreeInfo[ply].nodeIdx, 0, TType::T_GE, UNKNOWN_SCORE, hKey);
+        return 0;
+    }
 
     // Check transposition table
     int evalScore = UNKNOWN_SCORE;
@@ -525,6 +568,7 @@ Search::negaScout(int alpha, int beta, int ply, int depth, int recaptureSquare,
                         kt.addKiller(ply, hashMove);
             }
             sti.bestMove = hashMove;
+            stats.inc(SearchStatsCollector::TT_CUTOFF, depth);
             logFile.logNodeEnd(sti.nodeIdx, score, ent.getType(), evalScore, hKey);
             return score;
         }
@@ -626,6 +670,7 @@ Search::negaScout(int alpha, int beta, int ply, int depth, int recaptureSquare,
             q0Eval = evalScore;
             int score = quiesce(alpha-razorMargin, beta-razorMargin, ply, 0, inCheck);
             if (score <= alpha-razorMargin) {
+                stats.inc(SearchStatsCollector::RAZOR, depth);
                 emptyMove.setScore(score);
                 if (useTT) tt.insert(hKey, emptyMove, TType::T_LE, ply, depth, q0Eval);
                 logFile.logNodeEnd(sti.nodeIdx, score, TType::T_LE, q0Eval, hKey);
@@ -648,9 +693,21 @@ Search::negaScout(int alpha, int beta, int ply, int depth, int recaptureSquare,
             else if (depth <= 2) margin = reverseFutilityMargin2;
             else if (depth <= 3) margin = reverseFutilityMargin3;
             else                 margin = reverseFutilityMargin4;
-            if (evalScore == UNKNOWN_SCORE)
-                evalScore = eval.evalPos(pos);
+            if (evalScore == UNKNOWN_SCORE) {
+                bool exact;
+                int score = eval.evalPosLazy(pos, -MATE0, beta + margin, exact);
+                if (!exact) {
+                    stats.inc(SearchStatsCollector::REVERSE_FUTILITY, depth);
+                    score -= margin;
+                    emptyMove.setScore(score);
+                    if (useTT) tt.insert(hKey, emptyMove, TType::T_GE, ply, depth, UNKNOWN_SCORE);
+                    logFile.logNodeEnd(sti.nodeIdx, score, TType::T_GE, UNKNOWN_SCORE, hKey);
+                    return score;
+                }
+                evalScore = score;
+            }
             if (evalScore - margin >= beta) {
+                stats.inc(SearchStatsCollector::REVERSE_FUTILITY, depth);
                 emptyMove.setScore(evalScore - margin);
                 if (useTT) tt.insert(hKey, emptyMove, TType::T_GE, ply, depth, evalScore);
                 logFile.logNodeEnd(sti.nodeIdx, evalScore - margin, TType::T_GE, evalScore, hKey);
@@ -681,6 +738,7 @@ Search::negaScout(int alpha, int beta, int ply, int depth, int recaptureSquare,
                 nullOk = false;
         }
         if (nullOk) {
+            stats.inc(SearchStatsCollector::NULL_MOVE_TRY, depth);
             int score;
             {
                 pos.setWhiteMove(!pos.isWhiteMove());
@@ -724,6 +782,53 @@ Search::negaScout(int alpha, int beta, int ply, int depth, int recaptureSquare,
                 logFile.logNodeEnd(sti.nodeIdx, score, TType::T_GE, evalScore, hKey);
                 return score;
             }
+            stats.inc(SearchStatsCollector::NULL_MOVE_FAIL, depth);
+        }
+    }
+
+    // ProbCut
+    if ((depth >= probCutMinDepth) && (beta == alpha + 1) && !inCheck && normalBound &&
+            !singularSearch) {
+        const int pcBeta = beta + probCutMargin;
+        bool pcOk = !isWinScore(pcBeta);
+        if (pcOk && ((ent.getType() == TType::T_EXACT) || (ent.getType() == TType::T_LE)) &&
+                (ent.getDepth() >= depth - probCutReduction) && (ent.getScore(ply) < pcBeta))
+            pcOk = false;
+        if (pcOk) {
+            if (evalScore == UNKNOWN_SCORE)
+                evalScore = eval.evalPos(pos);
+            const int seeThreshold = std::max(0, pcBeta - evalScore);
+            MoveList moves;
+            MoveGen::pseudoLegalCaptures(pos, moves);
+            scoreMoveListMvvLva(moves);
+            UndoInfo ui;
+            for (int mi = 0; mi < moves.size; mi++) {
+                selectBest(moves, mi);
+                Move& m = moves[mi];
+                if (SEE(m, seeThreshold - 1, seeThreshold) < seeThreshold)
+                    continue;
+                if (!MoveGen::isLegal(pos, m, inCheck))
+                    continue;
+                bool givesCheck = MoveGen::givesCheck(pos, m);
+                posHashList[posHashListSize++] = pos.zobristHash();
+                makeMove(m, ui);
+                totalNodes++;
+                nodesToGo--;
+                sti.currentMove = m;
+                sti.currentMoveNo = mi;
+                int score = -negaScout(tb, -pcBeta, -(pcBeta - 1), ply + 1,
+                                       depth - probCutReduction, -1, givesCheck);
+                posHashListSize--;
+                unMakeMove(m, ui);
+                if (score >= pcBeta) {
+                    stats.inc(SearchStatsCollector::PROBCUT, depth);
+                    score -= probCutMargin;
+                    m.setScore(score);
+                    if (useTT) tt.insert(hKey, m, TType::T_GE, ply, depth - probCutReduction + 1, evalScore);
+                    logFile.logNodeEnd(sti.nodeIdx, score, TType::T_GE, evalScore, hKey);
+                    return score;
+                }
+            }
         }
     }
 
@@ -808,8 +913,10 @@ Search::negaScout(int alpha, int beta, int ply, int depth, int recaptureSquare,
         sti2.currentMove = savedMove;
         sti2.currentMoveNo = savedMoveNo;
         sti2.nodeIdx = savedNodeIdx2;
-        if (singScore <= newBeta-1)
+        if (singScore <= newBeta-1) {
             singularExtend = true;
+            stats.inc(SearchStatsCollector::SINGULAR_EXT, depth);
+        }
     }
 
     sti.evalScore = evalScore;
@@ -874,14 +981,17 @@ Search::negaScout(int alpha, int beta, int ply, int depth, int recaptureSquare,
             bool givesCheck = MoveGen::givesCheck(pos, m);
             bool doFutility = false;
             if ((pass == 0) && mayReduce && haveLegalMoves && !givesCheck && !passedPawnPush(pos, m)) {
-                if (normalBound && !isLoseScore(bestScore) && (mi >= lmpMoveCountLimit))
+                if (normalBound && !isLoseScore(bestScore) && (mi >= lmpMoveCountLimit)) {
+                    stats.inc(SearchStatsCollector::LMP, depth);
                     continue; // Late move pruning
+                }
                 if (futilityPrune)
                     doFutility = true;
             }
             int score = illegalScore;
             if (doFutility) {
                 score = futilityScore;
+                stats.inc(SearchStatsCollector::FUTILITY, depth);
             } else {
 #ifdef HAS_PREFETCH
                 U64 nextHash = pos.hashAfterMove(m);
@@ -942,7 +1052,7 @@ Search::negaScout(int alpha, int beta, int ply, int depth, int recaptureSquare,
                     }
                 }
                 posHashList[posHashListSize++] = pos.zobristHash();
-                pos.makeMove(m, ui);
+                makeMove(m, ui);
                 totalNodes++;
                 nodesToGo--;
                 sti.currentMove = m;
@@ -956,17 +1066,19 @@ Search::negaScout(int alpha, int beta, int ply, int depth, int recaptureSquare,
                     m.setScore(BUSY - lmr);
                     allDone = false;
                     posHashListSize--;
-                    pos.unMakeMove(m, ui);
+                    unMakeMove(m, ui);
                     continue;
                 }
                 if (((lmr > 0) && (score > alpha)) ||
                         ((score > alpha) && (score < beta) && (b != beta))) {
+                    if (lmr > 0)
+                        stats.inc(SearchStatsCollector::LMR_RESEARCH, depth);
                     newDepth += lmr;
                     score = -negaScout(tb, -beta, -alpha, ply + 1, newDepth, newCaptureSquare, givesCheck);
                 }
 
                 posHashListSize--;
-                pos.unMakeMove(m, ui);
+                unMakeMove(m, ui);
             }
 
             if (weak && haveLegalMoves)
@@ -983,14 +1095,28 @@ Search::negaScout(int alpha, int beta, int ply, int depth, int recaptureSquare,
                 sti.bestMove.setMove(m.from(), m.to(), m.promoteTo(), sti.bestMove.score());
             }
             if (alpha >= beta) {
+                stats.inc(SearchStatsCollector::FAIL_HIGH, depth);
+                if ((mi == 0) && (pass == 0))
+                    stats.inc(SearchStatsCollector::FAIL_HIGH_FIRST, depth);
                 if (pos.getPiece(m.to()) == Piece::EMPTY) {
                     kt.addKiller(ply, m);
-                    ht.addSuccess(pos, m, depth);
+                    const History::Context hCtx = getHistContext(ply);
+                    ht.addSuccess(pos, m, depth, hCtx);
                     for (int mi2 = mi - 1; mi2 >= 0; mi2--) {
                         Move m2 = moves[mi2];
                         if (pos.getPiece(m2.to()) == Piece::EMPTY)
                             if (m2.score() > BUSY)
-                                ht.addFail(pos, m2, depth);
+                                ht.addFail(pos, m2, depth, hCtx);
+                    }
+                }
+                if (useCaptureHistory()) {
+                    if ((pos.getPiece(m.to()) != Piece::EMPTY) || (m.promoteTo() != Piece::EMPTY))
+                        ht.addCaptureSuccess(pos, m, depth);
+                    for (int mi2 = mi - 1; mi2 >= 0; mi2--) {
+                        Move m2 = moves[mi2];
+                        if ((pos.getPiece(m2.to()) != Piece::EMPTY) || (m2.promoteTo() != Piece::EMPTY))
+                            if (m2.score() > BUSY)
+                                ht.addCaptureFail(pos, m2, depth);
                     }
                 }
                 if (((ent.getType() == TType::T_EXACT || ent.getType() == TType::T_LE)) &&
@@ -1044,8 +1170,32 @@ Search::negaScout(int alpha, int beta, int ply, int depth, int recaptureSquare,
     return bestScore;
 }
 
+bool
+Search::hasUpcomingRepetition(const Position& pos, const std::vector<U64>& posHashList,
+                              int posHashListSize, int posHashFirstNew) {
+    const int end = std::min(pos.getHalfMoveClock(), posHashListSize - posHashFirstNew);
+    if (end < 3)
+        return false;
+    const U64 key = pos.zobristHash();
+    const U64 occupied = pos.occupiedBB();
+    const U64 own = pos.isWhiteMove() ? pos.whiteBB() : pos.blackBB();
+    for (int i = 3; i <= end; i += 2) {
+        int sq1, sq2;
+        if (!Position::getReversibleMove(key ^ posHashList[posHashListSize - i], sq1, sq2))
+            continue;
+        if (BitBoard::squaresBetween(sq1, sq2) & occupied)
+            continue;
+        // The piece must belong to the side to move and the target square must be empty
+        U64 m = occupied & ((1ULL << sq1) | (1ULL << sq2));
+        if (((m & (m - 1)) == 0) && (m & own))
+            return true;
+    }
+    return false;
+}
+
 int
 Search::getMoveExtend(const Move& m, int recaptureSquare) {
+    const Position& pos = *curPos;
     if ((m.to() == recaptureSquare)) {
         int tVal = ::pieceValue[pos.getPiece(m.to())];
         int a = tVal - pV / 2;
@@ -1072,6 +1222,7 @@ void
 Search::getRootMoves(const MoveList& rootMovesIn,
                      std::vector<MoveInfo>& rootMovesOut,
                      int maxDepth) {
+    Position& pos = *curPos;
     MoveList rootMoves(rootMovesIn);
     if ((maxTimeMillis >= 0) || (maxNodes >= 0) || (maxDepth >= 0)) {
         MoveList legalMoves;
@@ -1181,6 +1332,9 @@ Search::defenseMove(const Position& pos, const Move& m) {
 
 int
 Search::quiesce(int alpha, int beta, int ply, int depth, const bool inCheck) {
+    Position& pos = *curPos;
+    if (depth < 0)
+        stats.incNode(ply, true);
     int score;
     if (inCheck) {
         score = -(MATE0 - (ply+1));
@@ -1188,8 +1342,9 @@ Search::quiesce(int alpha, int beta, int ply, int depth, const bool inCheck) {
         if ((depth == 0) && (q0Eval != UNKNOWN_SCORE)) {
             score = q0Eval;
         } else {
-            score = eval.evalPos(pos);
-            if (depth == 0)
+            bool exact;
+            score = eval.evalPosLazy(pos, alpha, beta, exact);
+            if (exact && (depth == 0))
                 q0Eval = score;
         }
     }
@@ -1216,6 +1371,8 @@ Search::quiesce(int alpha, int beta, int ply, int depth, const bool inCheck) {
         realInCheck = inCheck;
     }
     scoreMoveListMvvLva(moves);
+    const bool captHist = useCaptureHistory();
+    U64 searchedCaptures = 0; // Bit i set if capture moves[i] has been searched
     UndoInfo ui;
     for (int mi = 0; mi < moves.size; mi++) {
         if (mi < quiesceMaxSortMoves) {
@@ -1240,7 +1397,9 @@ Search::quiesce(int alpha, int beta, int ply, int depth, const bool inCheck) {
                 if (negSEE(m)) // Needed because m.score() is not computed for non-captures
                     continue;
             } else {
-                if (negSEE(m))
+                bool skipSEE = (captHistSkipSEE > 0) &&
+                               (ht.getCaptureHistScore(pos, m) >= captHistSkipSEE);
+                if (!skipSEE && negSEE(m))
                     continue;
                 int capt = ::pieceValue[pos.getPiece(m.to())];
                 int prom = ::pieceValue[m.promoteTo()];
@@ -1274,11 +1433,11 @@ Search::quiesce(int alpha, int beta, int ply, int depth, const bool inCheck) {
             givesCheck = MoveGen::givesCheck(pos, m);
         const bool nextInCheck = (depth - 1) > -2 ? givesCheck : false;
 
-        pos.makeMove(m, ui);
+        makeMove(m, ui);
         totalNodes++;
         nodesToGo--;
         score = -quiesce(-beta, -alpha, ply + 1, depth - 1, nextInCheck);
-        pos.unMakeMove(m, ui);
+        unMakeMove(m, ui);
         if (score > bestScore) {
             bestScore = score;
             if (score > alpha) {
@@ -1287,10 +1446,16 @@ Search::quiesce(int alpha, int beta, int ply, int depth, const bool inCheck) {
                     sti.bestMove.setMove(m.from(), m.to(), m.promoteTo(), score);
                 }
                 alpha = score;
-                if (alpha >= beta)
+                if (alpha >= beta) {
+                    if (captHist)
+                        updateQuiesceCaptureHistory(moves, mi, searchedCaptures);
                     return alpha;
+                }
             }
         }
+        if (captHist && (mi < 64))
+            if ((pos.getPiece(m.to()) != Piece::EMPTY) || (m.promoteTo() != Piece::EMPTY))
+                searchedCaptures |= 1ULL << mi;
     }
     return bestScore;
 }
@@ -1407,8 +1572,22 @@ Search::SEE(Position& pos, const Move& m, int alpha, int beta) {
     return captures[0] - score;
 }
 
+void
+Search::updateQuiesceCaptureHistory(const MoveList& moves, int cutoffIdx, U64 searchedCaptures) {
+    const Position& pos = *curPos;
+    const Move& m = moves[cutoffIdx];
+    if ((pos.getPiece(m.to()) != Piece::EMPTY) || (m.promoteTo() != Piece::EMPTY))
+        ht.addCaptureSuccess(pos, m, 1);
+    while (searchedCaptures != 0) {
+        int mi = BitBoard::extractSquare(searchedCaptures);
+        ht.addCaptureFail(pos, moves[mi], 1);
+    }
+}
+
 void
 Search::scoreMoveList(MoveList& moves, int ply, int startIdx) {
+    const Position& pos = *curPos;
+    const History::Context hCtx = getHistContext(ply);
     for (int i = startIdx; i < moves.size; i++) {
         Move& m = moves[i];
         bool isCapture = (pos.getPiece(m.to()) != Piece::EMPTY) || (m.promoteTo() != Piece::EMPTY);
@@ -1431,6 +1610,13 @@ Search::scoreMoveList(MoveList& moves, int ply, int startIdx) {
                 score += ks + 50;
             } else {
                 int hs = ht.getHistScore(pos, m);
+                if (contHistWeight > 0) {
+                    int cs = ht.getContHistScore(pos, m, hCtx);
+                    if (cs >= 0)
+                        hs = (hs * (64 - contHistWeight) + cs * contHistWeight) / 64;
+                }
+                if (counterMoveBonus > 0 && ht.isCounterMove(m, hCtx))
+                    hs = std::min(hs + counterMoveBonus, 49);
                 score += hs;
             }
         }
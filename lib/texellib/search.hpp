@@ -29,7 +29,9 @@
 #include "constants.hpp"
 #include "position.hpp"
 #include "evaluate.hpp"
+#include "history.hpp"
 #include "moveGen.hpp"
+#include "searchStats.hpp"
 #include "searchUtil.hpp"
 #include "parallel.hpp"
 #include "parameters.hpp"
@@ -43,7 +45,6 @@ class SearchTest;
 class ChessTool;
 class PosGenerator;
 class ClusterTT;
-class History;
 class KillerTable;
 
 
@@ -85,6 +86,9 @@ public:
                               const std::vector<Move>& pv, int multiPVIndex,
                               S64 tbHits) = 0;
         virtual void notifyStats(S64 nodes, S64 nps, int hashFull, S64 tbHits, S64 time) = 0;
+        /** Report search event counters, one text line per counter group.
+         *  Only called if texel is compiled with SEARCH_STATS defined. */
+        virtual void notifySearchStats(const std::vector<std::string>& lines) = 0;
     };
 
     void setListener(Listener& listener);
@@ -104,6 +108,22 @@ public:
     /** Set which thread is owning this Search object. */
     void setThreadNo(int tNo);
 
+    /** Clear the search event counters for this thread. If "clearTotals" is true,
+     *  also clear the totals for the thread tree, see SearchStatsTotals. */
+    void startSearchStats(bool clearTotals);
+
+    /** Add the search event counters for this thread to the thread tree totals. */
+    void flushSearchStats();
+
+    /** Get the search event totals for the thread tree. */
+    void getSearchStatsTotals(SearchStatsCollector& totals);
+
+    /** Report the search event totals for the thread tree to the listener.
+     *  Helper threads add their counters when they stop searching, so this
+     *  should be called after all helper threads have acknowledged the stop
+     *  command. iterativeDeepening() only adds the counters for this thread. */
+    void notifySearchStats();
+
     void timeLimit(int minTimeLimit, int maxTimeLimit, int earlyStopPercent = -1);
 
     void setStrength(int strength, U64 randomSeed, int maxNPS);
@@ -136,6 +156,12 @@ public:
     static bool canClaimDrawRep(const Position& pos, const std::vector<U64>& posHashList,
                                 int posHashListSize, int posHashFirstNew);
 
+    /** Return true if the side to move can make a reversible move that
+     *  repeats a position searched earlier in the current search path.
+     *  Such a position can be claimed as a draw, so the score is at least 0. */
+    static bool hasUpcomingRepetition(const Position& pos, const std::vector<U64>& posHashList,
+                                      int posHashListSize, int posHashFirstNew);
+
     /**
      * Compute scores for each move in a move list, using SEE, killer and history information.
      * @param moves  List of moves to score.
@@ -157,10 +183,12 @@ public:
      */
     static int SEE(Position& pos, const Move& m, int alpha, int beta);
 
-private:
+    /** Reset per-search state so the object can be reused for a new search. */
     void init(const Position& pos0, const std::vector<U64>& posHashList0,
               int posHashListSize0);
 
+private:
+
     int negaScoutRoot(bool tb, int alpha, int beta, int ply, int depth,
                       const bool inCheck);
 
@@ -192,6 +220,12 @@ private:
     void storeSearchResult(std::vector<MoveInfo>& scMoves, int mi, int depth,
                            int alpha, int beta, int score);
 
+    /** Make a move in the search position. If texel is compiled with COPY_MAKE
+     *  defined, the move is made in a copy of the position stored in the next
+     *  posStack entry, and unMakeMove() only returns to the previous entry. */
+    void makeMove(const Move& m, UndoInfo& ui);
+    void unMakeMove(const Move& m, const UndoInfo& ui);
+
     /** Report PV information to listener. */
     void notifyPV(const std::vector<MoveInfo>& moveInfo, int mi, int maxPV);
     void notifyPV(const MoveInfo& info, int multiPVIndex);
@@ -237,9 +271,21 @@ private:
     /** Return true if SEE(m) < 0. */
     bool negSEE(const Move& m);
 
-    /** Score move list according to most valuable victim / least valuable attacker. */
+    /** Score move list according to most valuable victim / least valuable attacker.
+     *  Captures with equal MVV/LVA score are ordered by capture history. */
     void scoreMoveListMvvLva(MoveList& moves) const;
 
+    /** Update capture history after a quiesce cutoff caused by moves[cutoffIdx].
+     *  Bit i in searchedCaptures is set if capture moves[i] was searched
+     *  without causing a cutoff. */
+    void updateQuiesceCaptureHistory(const MoveList& moves, int cutoffIdx, U64 searchedCaptures);
+
+    /** Return true if the capture history table is used by the search. */
+    static bool useCaptureHistory();
+
+    /** Get history context from the moves leading to the position at ply. */
+    History::Context getHistContext(int ply) const;
+
     /** Find move with highest score and move it to the front of the list. */
     static void selectBest(MoveList& moves, int startIdx);
 
@@ -258,7 +304,11 @@ private:
     bool shouldStop();
 
 
-    Position pos;
+    /** Search positions. Without COPY_MAKE, only posStack[0] is used and it is
+     *  updated by makeMove() and unMakeMove(). With COPY_MAKE, posStack[i] is
+     *  the position after i moves from the root position. */
+    std::vector<Position> posStack;
+    Position* curPos;             // Current search position, an element in posStack
     Evaluate eval;
     KillerTable& kt;
     History& ht;
@@ -299,6 +349,8 @@ private:
     S64 totalNodes;
     S64 tbHits;
     S64 tLastStats;        // Time when notifyStats was last called
+    SearchStats stats;     // Search event counters for this thread
+    U64 statsGeneration = 0; // SearchStatsTotals generation "stats" belongs to
 
     int q0Eval; // Static eval score at first level of quiescence search
 };
@@ -314,6 +366,47 @@ Search::setListener(Listener& listener) {
     this->listener = &listener;
 }
 
+inline void
+Search::makeMove(const Move& m, UndoInfo& ui) {
+#ifdef COPY_MAKE
+    Position* next = curPos + 1;
+    assert(next < &posStack[0] + posStack.size());
+    *next = *curPos;
+    next->makeMove(m, ui);
+    curPos = next;
+#else
+    curPos->makeMove(m, ui);
+#endif
+}
+
+inline void
+Search::unMakeMove(const Move& m, const UndoInfo& ui) {
+#ifdef COPY_MAKE
+    curPos--;
+#else
+    curPos->unMakeMove(m, ui);
+#endif
+}
+
+inline void
+Search::startSearchStats(bool clearTotals) {
+    stats.clear();
+    SearchStats::Totals& totals = comm.getSearchStatsTotals();
+    if (clearTotals)
+        totals.clear();
+    statsGeneration = totals.getGeneration();
+}
+
+inline void
+Search::flushSearchStats() {
+    comm.getSearchStatsTotals().add(stats, statsGeneration);
+}
+
+inline void
+Search::getSearchStatsTotals(SearchStatsCollector& totals) {
+    comm.getSearchStatsTotals().get(totals);
+}
+
 inline void
 Search::setStopHandler(std::unique_ptr<StopHandler> stopHandler) {
     this->stopHandler = std::move(stopHandler);
@@ -368,11 +461,12 @@ Search::isExpectedCutNode(int ply) const {
 
 inline int
 Search::SEE(const Move& m, int alpha, int beta) {
-    return SEE(pos, m, alpha, beta);
+    return SEE(*curPos, m, alpha, beta);
 }
 
 inline int
 Search::signSEE(const Move& m) {
+    const Position& pos = *curPos;
     int p0 = ::pieceValue[pos.getPiece(m.from())];
     int p1 = ::pieceValue[pos.getPiece(m.to())];
     if (p0 < p1)
@@ -382,6 +476,7 @@ Search::signSEE(const Move& m) {
 
 inline bool
 Search::negSEE(const Move& m) {
+    const Position& pos = *curPos;
     int p0 = ::pieceValue[pos.getPiece(m.from())];
     int p1 = ::pieceValue[pos.getPiece(m.to())];
     if (p1 >= p0)
@@ -391,14 +486,32 @@ Search::negSEE(const Move& m) {
 
 inline void
 Search::scoreMoveListMvvLva(MoveList& moves) const {
+    const Position& pos = *curPos;
     for (int i = 0; i < moves.size; i++) {
         Move& m = moves[i];
         int v = pos.getPiece(m.to());
         int a = pos.getPiece(m.from());
-        m.setScore(Evaluate::pieceValueOrder[v] * 8 - Evaluate::pieceValueOrder[a]);
+        int score = (Evaluate::pieceValueOrder[v] * 8 - Evaluate::pieceValueOrder[a]) * 64;
+        if (captHistWeight > 0 && ((v != Piece::EMPTY) || (m.promoteTo() != Piece::EMPTY)))
+            score += ht.getCaptureHistScore(pos, m) * captHistWeight / 8;
+        m.setScore(score);
     }
 }
 
+inline bool
+Search::useCaptureHistory() {
+    return captHistWeight > 0 || captHistSkipSEE > 0;
+}
+
+inline History::Context
+Search::getHistContext(int ply) const {
+    if (ply < 1 || (contHistWeight == 0 && counterMoveBonus == 0))
+        return History::Context();
+    const Move& prev1 = searchTreeInfo[ply-1].currentMove;
+    const Move& prev2 = ply >= 2 ? searchTreeInfo[ply-2].currentMove : emptyMove;
+    return History::getContext(*curPos, prev1, prev2);
+}
+
 inline void
 Search::selectBest(MoveList& moves, int startIdx) {
     int bestIdx = startIdx;
@@ -438,7 +551,9 @@ Search::canClaimDraw50(const Position& pos) {
 
 inline S64
 Search::getTotalNodes() const {
-    return totalNodes + comm.getNumSearchedNodes();
+    S64 helperNodes, helperTbHits;
+    comm.getThreadStats().getTotals(helperNodes, helperTbHits);
+    return totalNodes + comm.getNumSearchedNodes() + helperNodes;
 }
 
 inline S64
@@ -448,7 +563,9 @@ Search::getTotalNodesThisThread() const {
 
 inline S64
 Search::getTbHits() const {
-    return tbHits + comm.getTbHits();
+    S64 helperNodes, helperTbHits;
+    comm.getThreadStats().getTotals(helperNodes, helperTbHits);
+    return tbHits + comm.getTbHits() + helperTbHits;
 }
 
 inline S64
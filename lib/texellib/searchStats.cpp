@@ -0,0 +1,154 @@
+/*
+    Texel - A UCI chess engine.
+    Copyright (C) 2026  Peter Österlund, peterosterlund2@gmail.com
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * searchStats.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: petero
+ */
+
+#include "searchStats.hpp"
+
+#include <mutex>
+#include <sstream>
+#include <iomanip>
+
+constexpr bool SearchStatsCollector::enabled;
+constexpr bool SearchStatsDummy::enabled;
+
+SearchStatsCollector::SearchStatsCollector() {
+    clear();
+}
+
+void
+SearchStatsCollector::clear() {
+    nodes = 0;
+    qNodes = 0;
+    for (int i = 0; i < MAX_PLY; i++)
+        plyNodes[i] = 0;
+    for (int c = 0; c < N_COUNTERS; c++)
+        for (int d = 0; d < MAX_DEPTH; d++)
+            counts[c][d] = 0;
+}
+
+void
+SearchStatsCollector::add(const SearchStatsCollector& other) {
+    nodes += other.nodes;
+    qNodes += other.qNodes;
+    for (int i = 0; i < MAX_PLY; i++)
+        plyNodes[i] += other.plyNodes[i];
+    for (int c = 0; c < N_COUNTERS; c++)
+        for (int d = 0; d < MAX_DEPTH; d++)
+            counts[c][d] += other.counts[c][d];
+}
+
+S64
+SearchStatsCollector::getCount(Counter c, int depth) const {
+    if (depth >= 0)
+        return counts[c][depth];
+    S64 sum = 0;
+    for (int d = 0; d < MAX_DEPTH; d++)
+        sum += counts[c][d];
+    return sum;
+}
+
+const char*
+SearchStatsCollector::counterName(Counter c) {
+    switch (c) {
+    case TT_CUTOFF:        return "ttcut";
+    case NULL_MOVE_TRY:    return "nulltry";
+    case NULL_MOVE_FAIL:   return "nullfail";
+    case RAZOR:            return "razor";
+    case REVERSE_FUTILITY: return "revfutility";
+    case PROBCUT:          return "probcut";
+    case FUTILITY:         return "futility";
+    case LMP:              return "lmp";
+    case LMR_RESEARCH:     return "lmrresearch";
+    case SINGULAR_EXT:     return "singular";
+    case FAIL_HIGH:        return "failhigh";
+    case FAIL_HIGH_FIRST:  return "failhighfirst";
+    default:               return "unknown";
+    }
+}
+
+static double
+percent(S64 num, S64 den) {
+    return den > 0 ? num * 100.0 / den : 0.0;
+}
+
+void
+SearchStatsCollector::getLines(std::vector<std::string>& lines) const {
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(1);
+    S64 failHigh = getCount(FAIL_HIGH);
+    ss << "nodes " << nodes << " qnodes " << qNodes
+       << " qshare " << percent(qNodes, nodes) << '%'
+       << " failhigh " << failHigh
+       << " firstmove " << percent(getCount(FAIL_HIGH_FIRST), failHigh) << '%';
+    lines.push_back(ss.str());
+
+    int maxPly = MAX_PLY;
+    while (maxPly > 0 && plyNodes[maxPly - 1] == 0)
+        maxPly--;
+    ss.str("");
+    ss << "plynodes";
+    for (int i = 0; i < maxPly; i++)
+        ss << ' ' << i << ':' << plyNodes[i];
+    lines.push_back(ss.str());
+
+    for (int c = 0; c < N_COUNTERS; c++) {
+        ss.str("");
+        ss << counterName((Counter)c) << ' ' << getCount((Counter)c);
+        for (int d = 0; d < MAX_DEPTH; d++)
+            if (counts[c][d] != 0)
+                ss << " d" << d << ':' << counts[c][d];
+        lines.push_back(ss.str());
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+void
+SearchStatsTotals::clear() {
+    std::lock_guard<std::mutex> L(mutex);
+    totals.clear();
+    generation++;
+}
+
+U64
+SearchStatsTotals::getGeneration() const {
+    std::lock_guard<std::mutex> L(mutex);
+    return generation;
+}
+
+void
+SearchStatsTotals::add(SearchStatsCollector& stats, U64 gen) {
+    {
+        std::lock_guard<std::mutex> L(mutex);
+        if (gen == generation)
+            totals.add(stats);
+    }
+    stats.clear();
+}
+
+void
+SearchStatsTotals::get(SearchStatsCollector& ret) const {
+    std::lock_guard<std::mutex> L(mutex);
+    ret = totals;
+}
@@ -0,0 +1,192 @@
+/*
+    Texel - A UCI chess engine.
+    Copyright (C) 2026  Peter Österlund, peterosterlund2@gmail.com
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * searchStats.hpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: petero
+ */
+
+#ifndef SEARCHSTATS_HPP_
+#define SEARCHSTATS_HPP_
+
+#include "util/util.hpp"
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+class SearchStatsCollector;
+class SearchStatsDummy;
+class SearchStatsTotals;
+class SearchStatsTotalsDummy;
+
+/** Search statistics are only collected if texel is compiled with SEARCH_STATS
+ *  defined, see the USE_SEARCH_STATS cmake option. */
+#ifdef SEARCH_STATS
+using SearchStats = SearchStatsCollector;
+#else
+using SearchStats = SearchStatsDummy;
+#endif
+
+
+/**
+ * Counts search events, such as cutoffs, pruning decisions and re-searches,
+ * to make it possible to see where the search spends its effort.
+ * Each search thread has its own collector. The per-thread counts are added
+ * to the Totals object of the search thread tree when a thread has finished
+ * searching.
+ */
+class SearchStatsCollector {
+public:
+    static constexpr bool enabled = true;
+    using Totals = SearchStatsTotals;
+
+    /** Counted search events. */
+    enum Counter {
+        TT_CUTOFF,        // Node score taken from the transposition table
+        NULL_MOVE_TRY,    // Null move search performed
+        NULL_MOVE_FAIL,   // Null move search did not cause a cutoff
+        RAZOR,            // Node pruned by razoring
+        REVERSE_FUTILITY, // Node pruned by reverse futility pruning
+        PROBCUT,          // Node pruned by ProbCut
+        FUTILITY,         // Move pruned by futility pruning
+        LMP,              // Move pruned by late move pruning
+        LMR_RESEARCH,     // Reduced move searched again at full depth
+        SINGULAR_EXT,     // Hash move extended by singular extension
+        FAIL_HIGH,        // Beta cutoff in the move loop
+        FAIL_HIGH_FIRST,  // Beta cutoff caused by the first move
+        N_COUNTERS
+    };
+
+    static const int MAX_PLY = 64;    // Nodes at larger ply counted at MAX_PLY-1
+    static const int MAX_DEPTH = 32;  // Events at larger depth counted at MAX_DEPTH-1
+
+    /** Constructor. */
+    SearchStatsCollector();
+
+    /** Set all counters to zero. */
+    void clear();
+
+    /** Count a search node. "qSearch" is true for quiescence search nodes. */
+    void incNode(int ply, bool qSearch);
+
+    /** Count an event in a node having remaining depth "depth". */
+    void inc(Counter c, int depth);
+
+    /** Add all counters in "other" to this object. */
+    void add(const SearchStatsCollector& other);
+
+    /** Get number of nodes, or quiescence search nodes if "qSearch" is true. */
+    S64 getNodes(bool qSearch) const;
+
+    /** Get number of nodes at a given ply. */
+    S64 getPlyNodes(int ply) const;
+
+    /** Get number of counted events, either at a given depth or, if
+     *  depth is negative, at all depths. */
+    S64 getCount(Counter c, int depth = -1) const;
+
+    /** Convert statistics to a sequence of text lines. */
+    void getLines(std::vector<std::string>& lines) const;
+
+    /** Name of a counter. */
+    static const char* counterName(Counter c);
+
+private:
+    S64 nodes;
+    S64 qNodes;
+    S64 plyNodes[MAX_PLY];
+    S64 counts[N_COUNTERS][MAX_DEPTH];
+};
+
+/** Dummy version of SearchStatsCollector. */
+class SearchStatsDummy {
+public:
+    static constexpr bool enabled = false;
+    using Totals = SearchStatsTotalsDummy;
+
+    void clear() { }
+    void incNode(int ply, bool qSearch) { }
+    void inc(SearchStatsCollector::Counter c, int depth) { }
+};
+
+/**
+ * Sum of the search statistics for all threads in a search thread tree.
+ * The root Communicator of the tree owns the object, so concurrent searches
+ * using different thread trees do not affect each other. Each clear() starts
+ * a new generation. Counts from a thread that started searching in an earlier
+ * generation are discarded, so they do not leak into the next search.
+ */
+class SearchStatsTotals {
+public:
+    /** Set the totals to zero and start a new generation. */
+    void clear();
+
+    /** Get the current generation. */
+    U64 getGeneration() const;
+
+    /** Add "stats" to the totals if "generation" is the current generation.
+     *  "stats" is cleared in both cases. */
+    void add(SearchStatsCollector& stats, U64 generation);
+
+    /** Get the totals. */
+    void get(SearchStatsCollector& totals) const;
+
+private:
+    mutable std::mutex mutex;
+    U64 generation = 0;
+    SearchStatsCollector totals;
+};
+
+/** Dummy version of SearchStatsTotals. */
+class SearchStatsTotalsDummy {
+public:
+    void clear() { }
+    U64 getGeneration() const { return 0; }
+    void add(SearchStatsDummy& stats, U64 generation) { }
+    void get(SearchStatsCollector& totals) const { }
+};
+
+
+inline void
+SearchStatsCollector::incNode(int ply, bool qSearch) {
+    nodes++;
+    if (qSearch)
+        qNodes++;
+    plyNodes[std::min(ply, MAX_PLY - 1)]++;
+}
+
+inline void
+SearchStatsCollector::inc(Counter c, int depth) {
+    counts[c][clamp(depth, 0, MAX_DEPTH - 1)]++;
+}
+
+inline S64
+SearchStatsCollector::getNodes(bool qSearch) const {
+    return qSearch ? qNodes : nodes;
+}
+
+inline S64
+SearchStatsCollector::getPlyNodes(int ply) const {
+    return plyNodes[ply];
+}
+
+#endif /* SEARCHSTATS_HPP_ */
@@ -31,6 +31,7 @@
 #include "moveGen.hpp"
 #include "constants.hpp"
 #include <unordered_map>
+#include <limits>
 #include <cassert>
 
 #include "util/timeUtil.hpp"
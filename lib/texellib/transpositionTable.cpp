@@ -28,6 +28,7 @@
 #include "moveGen.hpp"
 #include "textio.hpp"
 #include "largePageAlloc.hpp"
+#include "numa.hpp"
 
 #include <iostream>
 #include <iomanip>
@@ -50,6 +51,13 @@ TranspositionTable::reSize(U64 numEntries) {
     tableSize = 0;
 
     tableLP = LargePageAlloc::allocate<TTEntryStorage>(numEntries);
+#ifdef NUMA_TT
+    std::vector<int> nodes;
+    Numa::instance().getThreadNodes(nodes);
+    if (nodes.size() > 1 && !tableLP)
+        tableLP = std::static_pointer_cast<TTEntryStorage, void>(
+            Numa::instance().allocBytes(numEntries * sizeof(TTEntryStorage)));
+#endif
     if (tableLP) {
         table = tableLP.get();
     } else {
@@ -60,10 +68,35 @@ TranspositionTable::reSize(U64 numEntries) {
 
     generation = 0;
     setUsedSize(tableSize);
+#ifdef NUMA_TT
+    if (nodes.size() > 1 && tableLP)
+        bindShards(nodes);
+#endif
     tbGen.reset();
     notUsedCnt = 0;
 }
 
+void
+TranspositionTable::bindShards(const std::vector<int>& nodes) {
+    // getIndex() maps the most significant key bits linearly to the index
+    // range [0, usedSizeTopBits << usedSizeShift), so each shard holds the
+    // entries for one range of hash keys. Entries after that range are not
+    // used by the search and are placed in the last shard.
+    const size_t pageSize = 2 * 1024 * 1024;
+    const size_t usedBytes = ((U64)usedSizeTopBits << usedSizeShift) * sizeof(TTEntryStorage);
+    const size_t numBytes = tableSize * sizeof(TTEntryStorage);
+    const int nShards = nodes.size();
+    size_t begin = 0;
+    for (int i = 0; i < nShards; i++) {
+        size_t end = numBytes;
+        if (i < nShards - 1)
+            end = usedBytes / nShards * (i + 1) / pageSize * pageSize;
+        if (end > begin)
+            Numa::instance().bindMemory((char*)table + begin, end - begin, nodes[i]);
+        begin = std::max(begin, end);
+    }
+}
+
 void TranspositionTable::setUsedSize(U64 s) {
     usedSize = s;
     usedSizeShift = 0;
@@ -205,6 +205,10 @@ public:
     U64 byteSize() const;
 
 private:
+    /** Place one part of the used table memory on each NUMA node in "nodes".
+     *  Must be called after setUsedSize() and before the memory is touched. */
+    void bindShards(const std::vector<int>& nodes);
+
     /** Set how much of the hash table to use. */
     void setUsedSize(U64 s);
 
@@ -224,7 +228,7 @@ private:
     U64 tableSize = 0;     // Number of entries
 
     vector_aligned<TTEntryStorage> tableV;
-    std::shared_ptr<TTEntryStorage> tableLP; // Large page allocation if used
+    std::shared_ptr<TTEntryStorage> tableLP; // Large page or NUMA allocation if used
 
     // On-demand TB generation
     TTStorage ttStorage;
@@ -31,10 +31,13 @@
 
 #include <iostream>
 #include <iomanip>
+#include <limits>
 #include <cassert>
 
 void
 TreeLoggerWriter::open(const std::string& filename, int threadNo0) {
+    close();
+    nextIndex = 0;
     auto fn = filename + std::string(".") + num2Str(threadNo0);
     os.open(fn.c_str(), std::ios_base::out |
                         std::ios_base::binary |
@@ -0,0 +1,85 @@
+/*
+    Texel - A UCI chess engine.
+    Copyright (C) 2026  Peter Österlund, peterosterlund2@gmail.com
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * cpuInfo.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: petero
+ */
+
+#include "cpuInfo.hpp"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define CPUINFO_X86
+#if _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+#ifdef CPUINFO_X86
+/** Execute the cpuid instruction. regs = {eax, ebx, ecx, edx}. */
+static void
+cpuid(unsigned int leaf, unsigned int subLeaf, unsigned int regs[4]) {
+#if _MSC_VER
+    int r[4];
+    __cpuidex(r, (int)leaf, (int)subLeaf);
+    for (int i = 0; i < 4; i++)
+        regs[i] = (unsigned int)r[i];
+#else
+    __cpuid_count(leaf, subLeaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+#endif
+
+const CpuInfo&
+CpuInfo::instance() {
+    static CpuInfo inst;
+    return inst;
+}
+
+CpuInfo::CpuInfo() {
+#ifdef CPUINFO_X86
+    unsigned int regs[4];
+    cpuid(0, 0, regs);
+    const unsigned int maxLeaf = regs[0];
+    char vendor[13];
+    memcpy(&vendor[0], &regs[1], 4);
+    memcpy(&vendor[4], &regs[3], 4);
+    memcpy(&vendor[8], &regs[2], 4);
+    vendor[12] = 0;
+
+    if (maxLeaf >= 1) {
+        cpuid(1, 0, regs);
+        popcnt = (regs[2] & (1 << 23)) != 0;
+        unsigned int family = (regs[0] >> 8) & 0xf;
+        if (family == 0xf)
+            family += (regs[0] >> 20) & 0xff;
+        if (strcmp(vendor, "AuthenticAMD") == 0 && family < 0x19)
+            slowPext = true;
+    }
+    if (maxLeaf >= 7) {
+        cpuid(7, 0, regs);
+        bmi2 = (regs[1] & (1 << 8)) != 0;
+    }
+#endif
+}
@@ -0,0 +1,55 @@
+/*
+    Texel - A UCI chess engine.
+    Copyright (C) 2026  Peter Österlund, peterosterlund2@gmail.com
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * cpuInfo.hpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: petero
+ */
+
+#ifndef CPUINFO_HPP_
+#define CPUINFO_HPP_
+
+/** Instruction set extensions supported by the CPU the program runs on.
+ *  All features are reported as unsupported on non-x86 CPUs. */
+class CpuInfo {
+public:
+    /** Get the singleton instance. The CPU is queried the first time
+     *  this function is called. */
+    static const CpuInfo& instance();
+
+    /** True if the POPCNT instruction is supported. */
+    bool hasPopcnt() const { return popcnt; }
+
+    /** True if the BMI2 instructions, including PEXT, are supported. */
+    bool hasBmi2() const { return bmi2; }
+
+    /** True if PEXT is fast. AMD CPUs before Zen 3 implement PEXT in
+     *  microcode, which makes it slower than magic bitboard lookups. */
+    bool hasFastPext() const { return bmi2 && !slowPext; }
+
+private:
+    CpuInfo();
+
+    bool popcnt = false;
+    bool bmi2 = false;
+    bool slowPext = false;
+};
+
+#endif /* CPUINFO_HPP_ */
@@ -0,0 +1,107 @@
+/*
+    Texel - A UCI chess engine.
+    Copyright (C) 2026  Peter Österlund, peterosterlund2@gmail.com
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * mappedFile.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: petero
+ */
+
+#include "mappedFile.hpp"
+
+#include <fstream>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string& fileName) {
+#ifdef _WIN32
+    HANDLE fh = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (fh != INVALID_HANDLE_VALUE) {
+        LARGE_INTEGER fileSize;
+        if (GetFileSizeEx(fh, &fileSize) && fileSize.QuadPart > 0) {
+            HANDLE mh = CreateFileMapping(fh, NULL, PAGE_READONLY, 0, 0, NULL);
+            if (mh != NULL) {
+                void* p = MapViewOfFile(mh, FILE_MAP_READ, 0, 0, 0);
+                if (p) {
+                    mapping = p;
+                    mapHandle = mh;
+                    len = (size_t)fileSize.QuadPart;
+                } else {
+                    CloseHandle(mh);
+                }
+            }
+        }
+        CloseHandle(fh);
+    }
+#else
+    int fd = ::open(fileName.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        struct stat st;
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+            void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                mapping = p;
+                len = st.st_size;
+            }
+        }
+        ::close(fd);
+    }
+#endif
+    if (mapping) {
+        open = true;
+        ptr = (const char*)mapping;
+        return;
+    }
+
+    // Memory mapping not possible, for example for empty files or pipes
+    std::ifstream is(fileName, std::ios::binary);
+    if (!is)
+        return;
+    open = true;
+    const size_t blockSize = 1024 * 1024;
+    while (true) {
+        size_t oldSize = buf.size();
+        buf.resize(oldSize + blockSize);
+        is.read(&buf[oldSize], blockSize);
+        buf.resize(oldSize + is.gcount());
+        if (!is)
+            break;
+    }
+    ptr = buf.data();
+    len = buf.size();
+}
+
+MappedFile::~MappedFile() {
+    if (!mapping)
+        return;
+#ifdef _WIN32
+    UnmapViewOfFile(mapping);
+    CloseHandle(mapHandle);
+#else
+    munmap(mapping, len);
+#endif
+}
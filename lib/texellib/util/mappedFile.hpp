@@ -0,0 +1,79 @@
+/*
+    Texel - A UCI chess engine.
+    Copyright (C) 2026  Peter Österlund, peterosterlund2@gmail.com
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * mappedFile.hpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: petero
+ */
+
+#ifndef MAPPEDFILE_HPP_
+#define MAPPEDFILE_HPP_
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+/** Read-only view of the contents of a file. The file is memory mapped if
+ *  possible, otherwise the file contents are read into memory. */
+class MappedFile {
+public:
+    /** Open and map file "fileName". If the file can not be opened,
+     *  isOpen() returns false and the file is treated as empty. */
+    explicit MappedFile(const std::string& fileName);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /** Return true if the file could be opened. */
+    bool isOpen() const;
+
+    /** Pointer to the file data. The data is valid during the lifetime of this object. */
+    const char* data() const;
+
+    /** Size of the file in bytes. */
+    size_t size() const;
+
+private:
+    bool open = false;
+    const char* ptr = nullptr;
+    size_t len = 0;
+    void* mapping = nullptr;   // Start of memory mapped region, or null if not mapped
+    void* mapHandle = nullptr; // Windows file mapping handle
+    std::vector<char> buf;     // File contents if memory mapping failed
+};
+
+
+inline bool
+MappedFile::isOpen() const {
+    return open;
+}
+
+inline const char*
+MappedFile::data() const {
+    return ptr;
+}
+
+inline size_t
+MappedFile::size() const {
+    return len;
+}
+
+#endif /* MAPPEDFILE_HPP_ */
@@ -24,13 +24,24 @@
  */
 
 #include "bookbuild.hpp"
+#include "bookworker.hpp"
 #include "polyglot.hpp"
 #include "gametreeutil.hpp"
 #include "moveGen.hpp"
 #include "search.hpp"
 #include "util/histogram.hpp"
+#include "util/mappedFile.hpp"
+#include "util/random.hpp"
 #include "textio.hpp"
 #include <random>
+#include <stdexcept>
+#include <queue>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
 
 namespace BookBuild {
 
@@ -54,15 +65,15 @@ BookNode::updateScores(const BookData& bookData) {
         if (!updateThis && (node->negaMaxScore != INVALID_SCORE))
             return;
         if (updateChildren) {
-            for (auto& e : node->children)
+            for (const auto& e : node->getChildren())
                 updateNegaMax(e.second, false, true, false);
         }
         bool propagate = node->computeNegaMax(bookData);
         if (propagate)
-            for (auto& e : node->children)
+            for (const auto& e : node->getChildren())
                 toUpdate.insert(e.second);
         if (updateParents && (propagate || node == startNode)) {
-            for (auto& e : node->parents) {
+            for (const auto& e : node->getParents()) {
                 BookNode* parent = e.parent;
                 assert(parent);
                 updateNegaMax(parent, true, false, true);
@@ -75,7 +86,7 @@ BookNode::updateScores(const BookData& bookData) {
         [&updatePathErrors,&bookData](BookNode* node) {
         bool modified = node->computePathError(bookData);
         if (modified)
-            for (auto& e : node->children)
+            for (const auto& e : node->getChildren())
                 updatePathErrors(e.second);
     };
     for (BookNode* n : toUpdate)
@@ -89,14 +100,14 @@ BookNode::computeNegaMax(const BookData& bookData) {
     const int oldEB = expansionCostBlack;
 
     negaMaxScore = searchScore;
-    auto it = children.find(bestNonBookMove.getCompressedMove());
-    if (it != children.end()) {
+    const BookNode* bestChild = getChild(bestNonBookMove);
+    if (bestChild) {
         // Ignore searchScore if a child node contains information about the same move
-        if (it->second->getNegaMaxScore() != INVALID_SCORE)
+        if (bestChild->getNegaMaxScore() != INVALID_SCORE)
             negaMaxScore = IGNORE_SCORE;
     }
     if (negaMaxScore != INVALID_SCORE)
-        for (const auto& e : children)
+        for (const auto& e : getChildren())
             negaMaxScore = std::max(negaMaxScore, negateScore(e.second->negaMaxScore));
 
     expansionCostWhite = IGNORE_SCORE;
@@ -110,14 +121,14 @@ BookNode::computeNegaMax(const BookData& bookData) {
             expansionCostBlack = getExpansionCost(bookData, nullptr, false);
         }
     }
-    for (const auto& e : children) {
+    for (const auto& e : getChildren()) {
         if (e.second->expansionCostWhite == INVALID_SCORE)
             expansionCostWhite = INVALID_SCORE;
         if (e.second->expansionCostBlack == INVALID_SCORE)
             expansionCostBlack = INVALID_SCORE;
     }
 
-    for (const auto& e : children) {
+    for (const auto& e : getChildren()) {
         BookNode* child = e.second;
         if ((expansionCostWhite != INVALID_SCORE) &&
             (child->expansionCostWhite != IGNORE_SCORE)) {
@@ -153,7 +164,7 @@ BookNode::getExpansionCost(const BookData& bookData, const BookNode* child,
             cost += bookData.bookDepthCost() + moveError * (wtm == white ? ownCost : otherCost);
         return cost;
     } else {
-        if (children.find(bestNonBookMove.getCompressedMove()) != children.end()) {
+        if (getChild(bestNonBookMove)) {
             return -10000; // bestNonBookMove is obsoleted by a child node
         } else {
             int moveError = negaMaxScore - searchScore;
@@ -177,7 +188,7 @@ BookNode::computePathError(const BookData& bookData) {
 
     pathErrorWhite = INT_MAX;
     pathErrorBlack = INT_MAX;
-    for (auto& e : parents) {
+    for (const auto& e : getParents()) {
         BookNode* parent = e.parent;
         assert(parent);
         int errW = parent->getPathErrorWhite();
@@ -217,7 +228,7 @@ BookNode::negateScore(int score) {
 void
 BookNode::setSearchResult(const BookData& bookData,
                           const Move& bestMove, int score, int time) {
-    bestNonBookMove = bestMove;
+    bestNonBookMove = bestMove.getCompressedMove();
     searchScore = score;
     searchTime = time;
     updateScores(bookData);
@@ -226,7 +237,7 @@ BookNode::setSearchResult(const BookData& bookData,
 void
 BookNode::updateDepth() {
     bool updated = false;
-    for (auto& e : parents) {
+    for (const auto& e : getParents()) {
         BookNode* parent = e.parent;
         assert(parent);
         if (parent->depth == INT_MAX)
@@ -241,17 +252,562 @@ BookNode::updateDepth() {
         }
     }
     if (updated)
-        for (auto& e : children)
+        for (const auto& e : getChildren())
             e.second->updateDepth();
 }
 
 // ----------------------------------------------------------------------------
 
+BookNodeTable::BookNodeTable() {
+    clear();
+}
+
+BookNode*
+BookNodeTable::add(U64 hashKey, bool rootNode) {
+    assert(!get(hashKey));
+    if ((nodes.size() + 1) * 2 > slots.size())
+        rehash(slots.size() * 2);
+    nodes.emplace_back(*this, nodes.size(), hashKey, rootNode);
+    size_t i = hashKey & mask;
+    while (slots[i] != 0)
+        i = (i + 1) & mask;
+    slots[i] = nodes.size();
+    return &nodes.back();
+}
+
+void
+BookNodeTable::clear() {
+    nodes.clear();
+    slots.assign(16, 0);
+    mask = slots.size() - 1;
+    clearEdges();
+}
+
+void
+BookNodeTable::clearEdges() {
+    for (BookNode& node : nodes)
+        node.clearEdges();
+    edgeNodes.clear();
+    edgeMoves.clear();
+    for (auto& fb : freeBlocks)
+        fb.clear();
+}
+
+void
+BookNodeTable::insertEdge(BookNode::EdgeList& list, U32 pos, U16 move, U32 node) {
+    assert(pos <= list.size);
+    U32 cap = list.capLog ? 1U << (list.capLog - 1) : 0;
+    if (list.size == cap)
+        moveEdges(list, list.capLog + 1);
+    U32 b = list.begin;
+    for (U32 i = list.size; i > pos; i--) {
+        edgeNodes[b + i] = edgeNodes[b + i - 1];
+        edgeMoves[b + i] = edgeMoves[b + i - 1];
+    }
+    edgeNodes[b + pos] = node;
+    edgeMoves[b + pos] = move;
+    list.size++;
+}
+
+void
+BookNodeTable::reserveEdges(BookNode::EdgeList& list, U32 n) {
+    int capLog = list.capLog;
+    while ((capLog ? 1U << (capLog - 1) : 0) < n)
+        capLog++;
+    if (capLog != list.capLog)
+        moveEdges(list, capLog);
+}
+
+void
+BookNodeTable::moveEdges(BookNode::EdgeList& list, int capLog) {
+    if (capLog > maxCapLog)
+        throw std::length_error("Too many book edges for one position");
+    std::vector<U32>& fb = freeBlocks[capLog];
+    U32 b;
+    if (!fb.empty()) {
+        b = fb.back();
+        fb.pop_back();
+    } else {
+        b = edgeNodes.size();
+        edgeNodes.resize(b + (1U << (capLog - 1)));
+        edgeMoves.resize(b + (1U << (capLog - 1)));
+    }
+    for (U32 i = 0; i < list.size; i++) {
+        edgeNodes[b + i] = edgeNodes[list.begin + i];
+        edgeMoves[b + i] = edgeMoves[list.begin + i];
+    }
+    if (list.capLog)
+        freeBlocks[list.capLog].push_back(list.begin);
+    list.begin = b;
+    list.capLog = capLog;
+}
+
+void
+BookNodeTable::rehash(size_t newSize) {
+    slots.assign(newSize, 0);
+    mask = newSize - 1;
+    for (size_t idx = 0; idx < nodes.size(); idx++) {
+        size_t i = nodes[idx].getHashKey() & mask;
+        while (slots[i] != 0)
+            i = (i + 1) & mask;
+        slots[i] = idx + 1;
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+ParentTable::ParentTable() {
+    clear();
+}
+
+void
+ParentTable::add(U64 childHash, U32 parentIdx) {
+    if ((used + 1) * 4 > entries.size() * 3)
+        rehash(entries.size() * 2);
+    const U32 k = key(childHash);
+    size_t i = k & mask;
+    while (entries[i].parentIdx != 0) {
+        if (entries[i].childKey == k && entries[i].parentIdx == parentIdx + 1)
+            return;
+        i = (i + 1) & mask;
+    }
+    entries[i].childKey = k;
+    entries[i].parentIdx = parentIdx + 1;
+    used++;
+}
+
+void
+ParentTable::remove(U64 childHash, U32 parentIdx) {
+    const U32 k = key(childHash);
+    size_t i = k & mask;
+    while (entries[i].childKey != k || entries[i].parentIdx != parentIdx + 1) {
+        if (entries[i].parentIdx == 0)
+            return;
+        i = (i + 1) & mask;
+    }
+
+    // Move later entries in the probe sequence back, so no empty slot
+    // separates an entry from its home slot
+    size_t j = i;
+    while (true) {
+        j = (j + 1) & mask;
+        if (entries[j].parentIdx == 0)
+            break;
+        size_t home = entries[j].childKey & mask;
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            entries[i] = entries[j];
+            i = j;
+        }
+    }
+    entries[i] = Entry{0, 0};
+    used--;
+}
+
+void
+ParentTable::clear() {
+    entries.assign(16, Entry{0, 0});
+    mask = entries.size() - 1;
+    used = 0;
+}
+
+void
+ParentTable::rehash(size_t newSize) {
+    std::vector<Entry> old(newSize, Entry{0, 0});
+    old.swap(entries);
+    mask = newSize - 1;
+    for (const Entry& e : old) {
+        if (e.parentIdx == 0)
+            continue;
+        size_t i = e.childKey & mask;
+        while (entries[i].parentIdx != 0)
+            i = (i + 1) & mask;
+        entries[i] = e;
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+BackupWriter::BackupWriter(const std::string& fileName0)
+    : fileName(fileName0) {
+    thread = std::thread([this]{ writerLoop(); });
+}
+
+BackupWriter::~BackupWriter() {
+    {
+        std::lock_guard<std::mutex> L(mutex);
+        stopped = true;
+    }
+    writeCv.notify_all();
+    thread.join();
+}
+
+void
+BackupWriter::setFlushParams(int maxPending0, int flushIntervalMs, bool sync0) {
+    std::lock_guard<std::mutex> L(mutex);
+    maxPending = std::max(1, maxPending0);
+    flushInterval = std::chrono::milliseconds(std::max(0, flushIntervalMs));
+    sync = sync0;
+    writeCv.notify_all();
+}
+
+void
+BackupWriter::append(const BookNode::BookSerializeData& bsd) {
+    std::lock_guard<std::mutex> L(mutex);
+    checkError();
+    if (ops.empty() || ops.back().type != Op::APPEND)
+        ops.push_back(Op{Op::APPEND, {}, {}});
+    ops.back().data.push_back(bsd);
+    nAppended++;
+    if (nPending++ == 0) {
+        // Make the writer thread wait for the time or size threshold
+        firstPendingTime = std::chrono::steady_clock::now();
+        writeCv.notify_all();
+    } else if ((int)nPending == maxPending)
+        writeCv.notify_all();
+}
+
+void
+BackupWriter::replace(std::vector<BookNode::BookSerializeData>&& contents,
+                      std::vector<BookNode::BookSerializeData>&& edges) {
+    std::lock_guard<std::mutex> L(mutex);
+    checkError();
+    // Data queued before the replacement does not have to be written
+    nPending = 0;
+    ops.clear();
+    ops.push_back(Op{Op::REPLACE, std::move(contents), std::move(edges)});
+    nAppended = 0;
+    writeNow = true;
+    writeCv.notify_all();
+}
+
+void
+BackupWriter::compact() {
+    std::lock_guard<std::mutex> L(mutex);
+    checkError();
+    ops.push_back(Op{Op::COMPACT, {}, {}});
+    nAppended = 0;
+    writeNow = true;
+    writeCv.notify_all();
+}
+
+void
+BackupWriter::flush() {
+    std::unique_lock<std::mutex> L(mutex);
+    writeNow = true;
+    writeCv.notify_all();
+    while ((!ops.empty() || writing) && !error)
+        doneCv.wait(L);
+    checkError();
+}
+
+U64
+BackupWriter::getNumAppended() const {
+    std::lock_guard<std::mutex> L(mutex);
+    return nAppended;
+}
+
+void
+BackupWriter::checkError() {
+    if (error) {
+        std::exception_ptr ex = error;
+        error = nullptr;
+        std::rethrow_exception(ex);
+    }
+}
+
+void
+BackupWriter::writerLoop() {
+    std::unique_lock<std::mutex> L(mutex);
+    while (true) {
+        if (ops.empty()) {
+            if (stopped)
+                break;
+            writeCv.wait(L);
+            continue;
+        }
+        if (!stopped && !writeNow && (int)nPending < maxPending) {
+            auto deadline = firstPendingTime + flushInterval;
+            if (std::chrono::steady_clock::now() < deadline) {
+                writeCv.wait_until(L, deadline);
+                continue;
+            }
+        }
+
+        std::deque<Op> toWrite;
+        toWrite.swap(ops);
+        nPending = 0;
+        writeNow = false;
+        writing = true;
+        const bool doSync = sync;
+        L.unlock();
+        std::exception_ptr ex;
+        try {
+            for (const Op& op : toWrite)
+                writeOp(op, doSync);
+            if (file && (fflush(file) != 0 || (doSync && !syncFile(file))))
+                throw std::ios_base::failure("Failed to write file: " + fileName);
+        } catch (...) {
+            ex = std::current_exception();
+            if (file) {
+                fclose(file);
+                file = nullptr;
+            }
+        }
+        L.lock();
+        writing = false;
+        if (ex)
+            error = ex;
+        doneCv.notify_all();
+    }
+    if (file) {
+        fclose(file);
+        file = nullptr;
+    }
+}
+
+void
+BackupWriter::writeOp(const Op& op, bool doSync) {
+    const size_t recSize = sizeof(BookNode::BookSerializeData);
+    const size_t n = op.data.size();
+    if (op.type == Op::COMPACT) {
+        compactFile(doSync);
+    } else if (op.type == Op::REPLACE) {
+        if (file) {
+            fclose(file);
+            file = nullptr;
+        }
+        // A stale edge file is detected by its node checksum, so the book is
+        // still readable if a crash happens between the two replacements.
+        replaceFile(fileName, op.data, doSync);
+        const std::string edgeName = Book::edgeFileName(fileName);
+        if (op.edges.empty())
+            remove(edgeName.c_str());
+        else
+            replaceFile(edgeName, op.edges, doSync);
+    } else {
+        if (!file) {
+            file = fopen(fileName.c_str(), "ab");
+            if (!file)
+                throw std::ios_base::failure("Failed to open file: " + fileName);
+        }
+        if (fwrite(op.data.data(), recSize, n, file) != n)
+            throw std::ios_base::failure("Failed to write file: " + fileName);
+    }
+}
+
+void
+BackupWriter::compactFile(bool doSync) {
+    if (file) {
+        if (fclose(file) != 0) {
+            file = nullptr;
+            throw std::ios_base::failure("Failed to write file: " + fileName);
+        }
+        file = nullptr;
+    }
+
+    std::vector<BookNode::BookSerializeData> data;
+    {
+        MappedFile mf(fileName);
+        const size_t recSize = sizeof(BookNode::BookSerializeData);
+        const BookNode::BookSerializeData* records =
+            (const BookNode::BookSerializeData*)mf.data();
+        data.assign(records, records + mf.size() / recSize);
+    }
+
+    // Find the first and last record for each hash key
+    const size_t n = data.size();
+    std::vector<std::pair<U64,U32>> keys(n); // Hash key, record index
+    for (size_t i = 0; i < n; i++) {
+        U64 hashKey;
+        Serializer::deSerialize<sizeof(data[i].data)>(data[i].data, hashKey);
+        keys[i] = std::make_pair(hashKey, (U32)i);
+    }
+    std::sort(keys.begin(), keys.end());
+    std::vector<bool> keep(n);
+    for (size_t i = 0; i < n; ) {
+        size_t j = i + 1;
+        while (j < n && keys[j].first == keys[i].first)
+            j++;
+        U32 first = keys[i].second;
+        data[first] = data[keys[j - 1].second];
+        keep[first] = true;
+        i = j;
+    }
+
+    size_t nKept = 0;
+    for (size_t i = 0; i < n; i++)
+        if (keep[i])
+            data[nKept++] = data[i];
+    data.resize(nKept);
+    replaceFile(fileName, data, doSync);
+}
+
+void
+BackupWriter::replaceFile(const std::string& name,
+                          const std::vector<BookNode::BookSerializeData>& data,
+                          bool doSync) {
+    const size_t recSize = sizeof(BookNode::BookSerializeData);
+    const size_t n = data.size();
+    std::string tmpName = name + ".tmp";
+    FILE* f = fopen(tmpName.c_str(), "wb");
+    if (!f)
+        throw std::ios_base::failure("Failed to create file: " + tmpName);
+    bool ok = fwrite(data.data(), recSize, n, f) == n;
+    ok = (fflush(f) == 0) && ok;
+    if (ok && doSync)
+        ok = syncFile(f);
+    ok = (fclose(f) == 0) && ok;
+#ifdef _WIN32
+    if (ok)
+        remove(name.c_str());
+#endif
+    if (!ok || rename(tmpName.c_str(), name.c_str()) != 0)
+        throw std::ios_base::failure("Failed to write file: " + name);
+}
+
+bool
+BackupWriter::syncFile(FILE* f) {
+#ifdef _WIN32
+    return _commit(_fileno(f)) == 0;
+#else
+    return fsync(fileno(f)) == 0;
+#endif
+}
+
+// ----------------------------------------------------------------------------
+
+PolyglotExporter::PolyglotExporter(const std::string& polyglotFile0,
+                                   size_t maxBufferedEntries)
+    : polyglotFile(polyglotFile0), maxBuffered(std::max((size_t)1, maxBufferedEntries)) {
+}
+
+PolyglotExporter::~PolyglotExporter() {
+    for (const std::string& f : runFiles)
+        std::remove(f.c_str());
+}
+
+void
+PolyglotExporter::addMove(U64 pgHash, U16 pgMove, double weight) {
+    assert(weight >= 0.0);
+    if (weight == 0.0)
+        weight = 1e-30; // Happens when best move has path error > maxErrSelf
+    buffer.push_back(Entry{pgHash, pgMove, weight});
+    if (buffer.size() >= maxBuffered)
+        writeRun();
+}
+
+void
+PolyglotExporter::writeRun() {
+    std::sort(buffer.begin(), buffer.end());
+    std::string fileName = polyglotFile + ".run" + num2Str(runFiles.size()) + ".tmp";
+    runFiles.push_back(fileName);
+    std::ofstream os;
+    os.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+    os.open(fileName.c_str(), std::ios_base::out |
+                              std::ios_base::binary |
+                              std::ios_base::trunc);
+    os.write((const char*)buffer.data(), buffer.size() * sizeof(Entry));
+    os.close();
+    buffer.clear();
+}
+
+void
+PolyglotExporter::write() {
+    std::ofstream os;
+    os.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+    os.open(polyglotFile.c_str(), std::ios_base::out |
+                                  std::ios_base::binary |
+                                  std::ios_base::trunc);
+
+    std::vector<Entry> posEntries;
+    auto addEntry = [&os,&posEntries](const Entry& e) {
+        if (!posEntries.empty() && posEntries.back().hash != e.hash)
+            writePosition(os, posEntries);
+        if (!posEntries.empty() && posEntries.back().move == e.move)
+            posEntries.back().weight += e.weight;
+        else
+            posEntries.push_back(e);
+    };
+
+    if (runFiles.empty()) {
+        std::sort(buffer.begin(), buffer.end());
+        for (const Entry& e : buffer)
+            addEntry(e);
+    } else {
+        if (!buffer.empty())
+            writeRun();
+        std::vector<Entry>().swap(buffer);
+
+        // Merge all runs, reading each run in blocks
+        struct Run {
+            std::ifstream is;
+            std::vector<Entry> buf;
+            size_t idx = 0;
+            bool fill() {
+                buf.resize(4096);
+                is.read((char*)buf.data(), buf.size() * sizeof(Entry));
+                if (is.bad())
+                    throw std::ios_base::failure("Failed to read temporary file");
+                buf.resize(is.gcount() / sizeof(Entry));
+                idx = 0;
+                return !buf.empty();
+            }
+        };
+        const int nRuns = runFiles.size();
+        std::vector<Run> runs(nRuns);
+        using QItem = std::pair<Entry,int>;
+        auto cmp = [](const QItem& a, const QItem& b) {
+            if (b.first < a.first) return true;
+            if (a.first < b.first) return false;
+            return a.second > b.second;
+        };
+        std::priority_queue<QItem, std::vector<QItem>, decltype(cmp)> queue(cmp);
+        for (int r = 0; r < nRuns; r++) {
+            runs[r].is.open(runFiles[r].c_str(), std::ios_base::in | std::ios_base::binary);
+            if (!runs[r].is)
+                throw std::ios_base::failure("Failed to open file: " + runFiles[r]);
+            if (runs[r].fill())
+                queue.push(QItem(runs[r].buf[0], r));
+        }
+        while (!queue.empty()) {
+            QItem item = queue.top();
+            queue.pop();
+            addEntry(item.first);
+            Run& run = runs[item.second];
+            if (++run.idx < run.buf.size() || run.fill())
+                queue.push(QItem(run.buf[run.idx], item.second));
+        }
+    }
+    if (!posEntries.empty())
+        writePosition(os, posEntries);
+    os.close();
+}
+
+void
+PolyglotExporter::writePosition(std::ostream& os, std::vector<Entry>& posEntries) {
+    double maxW = 0;
+    for (const Entry& e : posEntries)
+        maxW = std::max(maxW, e.weight);
+    const int maxAllowedW = 0xffff;
+    PolyglotBook::PGEntry ent;
+    for (const Entry& e : posEntries) {
+        double w = e.weight * maxAllowedW / maxW;
+        U16 weight = (U16)clamp((int)w, 1, maxAllowedW);
+        PolyglotBook::serialize(e.hash, e.move, weight, ent);
+        os.write((const char*)&ent.data[0], sizeof(ent.data));
+    }
+    posEntries.clear();
+}
+
+// ----------------------------------------------------------------------------
+
 Book::Book(const std::string& backupFile0, int bookDepthCost,
            int ownPathErrorCost, int otherPathErrorCost)
     : startPosHash(TextIO::readFEN(TextIO::startPosFEN).bookHash()),
       backupFile(backupFile0),
       bookData(bookDepthCost, ownPathErrorCost, otherPathErrorCost) {
+    if (!backupFile.empty())
+        backupWriter = make_unique<BackupWriter>(backupFile);
     addRootNode();
     if (!backupFile.empty())
         writeToFile(backupFile);
@@ -290,7 +846,7 @@ public:
             ptr = goodChildren[0];
         }
         move = ptr->getBestNonBookMove();
-        if (ptr->getChildren().find(move.getCompressedMove()) != ptr->getChildren().end())
+        if (ptr->getChild(move.getCompressedMove()))
             move = Move();
         std::vector<Move> moveList;
         book.getPosition(ptr->getHashKey(), pos, moveList);
@@ -351,8 +907,8 @@ Book::importPGN(const std::string& bookFile, const std::string& pgnFile,
     readFromFile(bookFile);
 
     // Create book nodes for all positions in the PGN file
-    std::ifstream is(pgnFile);
-    PgnReader reader(is);
+    MappedFile pgnData(pgnFile);
+    PgnReader reader(pgnData.data(), pgnData.size());
     GameTree gt;
     int nGames = 0;
     int nAdded = 0;
@@ -400,8 +956,8 @@ getExcludedMoves(const std::string& pgnFile) {
     if (pgnFile.empty())
         return ret;
 
-    std::ifstream is(pgnFile);
-    PgnReader reader(is);
+    MappedFile pgnData(pgnFile);
+    PgnReader reader(pgnData.data(), pgnData.size());
     GameTreeUtil::iteratePgn(reader, [&](const Position& parentPos, const GameNode& node) {
         const int POOR_MOVE = 2;
         if (node.getNode()->getNag() == POOR_MOVE)
@@ -422,44 +978,7 @@ Book::exportPolyglot(const std::string& bookFile, const std::string& polyglotFil
     WeightInfo weights;
     computeWeights(maxErrSelf, errOtherExpConst, weights);
 
-    class BookMoves {
-    public:
-        void addMove(U16 m, double w) {
-            assert(w >= 0.0);
-            if (w == 0.0)
-                w = 1e-30; // Happens when best move has path error > maxErrSelf
-            for (size_t i = 0; i < vec.size(); i++)
-                if (vec[i].move == m) {
-                    vec[i].weight += w;
-                    return;
-                }
-            vec.push_back(MoveWeight(m, w));
-        }
-
-        void scaleWeights() {
-            double maxW = 0;
-            for (size_t i = 0; i < vec.size(); i++)
-                maxW = std::max(maxW, vec[i].weight);
-            const int maxAllowedW = 0xffff;
-            for (size_t i = 0; i < vec.size(); i++) {
-                double w = vec[i].weight * maxAllowedW / maxW;
-                vec[i].weight = clamp((int)w, 1, maxAllowedW);
-            }
-        }
-
-        int nMoves() const { return vec.size(); }
-        U16 getMove(int i) const { return vec[i].move; }
-        U16 getWeight(int i) const { return (U16)vec[i].weight; }
-
-    private:
-        struct MoveWeight {
-            MoveWeight(U16 m, double w) : move(m), weight(w) {}
-            U16 move;
-            double weight;
-        };
-        std::vector<MoveWeight> vec;
-    };
-    std::map<U64, BookMoves> pgBook;
+    PolyglotExporter pgBook(polyglotFile);
 
     std::vector<ExcludedMove> excludedMoves = getExcludedMoves(excludeFile);
     std::cout << "nExcluded:" << excludedMoves.size() << std::endl;
@@ -472,8 +991,8 @@ Book::exportPolyglot(const std::string& bookFile, const std::string& polyglotFil
 
     Position pos;
     std::vector<Move> moveList;
-    for (auto& e : bookNodes) {
-        const BookNode* node = e.second.get();
+    for (const BookNode& n : bookNodes) {
+        const BookNode* node = &n;
         moveList.clear();
         if (!getPosition(node->getHashKey(), pos, moveList))
             assert(false);
@@ -483,8 +1002,8 @@ Book::exportPolyglot(const std::string& bookFile, const std::string& polyglotFil
             continue;
 
         const bool wtm = pos.isWhiteMove();
-        BookMoves& bm = pgBook[PolyglotBook::getHashKey(pos)];
-        for (auto& c : node->getChildren()) {
+        const U64 pgHash = PolyglotBook::getHashKey(pos);
+        for (const auto& c : node->getChildren()) {
             U16 cMove = c.first;
             BookNode* child = c.second;
             if (bookMoveOk(*node, cMove, maxErrSelf)) {
@@ -492,10 +1011,9 @@ Book::exportPolyglot(const std::string& bookFile, const std::string& polyglotFil
                 move.setFromCompressed(cMove);
                 if (!isExcluded(pos, move)) {
                     U16 pgMove = PolyglotBook::getPGMove(pos, move);
-                    auto wi = weights.find(child->getHashKey());
-                    assert(wi != weights.end());
-                    double w = wtm ? wi->second.weightWhite : wi->second.weightBlack;
-                    bm.addMove(pgMove, w);
+                    const BookWeight& bw = weights[child->getIndex()];
+                    double w = wtm ? bw.weightWhite : bw.weightBlack;
+                    pgBook.addMove(pgHash, pgMove, w);
                 }
             }
         }
@@ -512,27 +1030,13 @@ Book::exportPolyglot(const std::string& bookFile, const std::string& polyglotFil
                     wB = errB <= maxErrSelf ? exp(-errW / errOtherExpConst) : 0.0;
                 }
                 double w = wtm ? wW : wB;
-                bm.addMove(pgMove, w);
+                pgBook.addMove(pgHash, pgMove, w);
             }
         }
     }
 
-    std::ofstream os;
-    os.open(polyglotFile.c_str(), std::ios_base::out |
-                                  std::ios_base::binary |
-                                  std::ios_base::trunc);
-    os.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-    PolyglotBook::PGEntry ent;
-    for (auto& e : pgBook) {
-        U64 pgHash = e.first;
-        BookMoves& bm = e.second;
-        bm.scaleWeights();
-        for (int i = 0; i < bm.nMoves(); i++) {
-            assert(bm.getWeight(i) > 0);
-            PolyglotBook::serialize(pgHash, bm.getMove(i), bm.getWeight(i), ent);
-            os.write((const char*)&ent.data[0], sizeof(ent.data));
-        }
-    }
+    WeightInfo().swap(weights);
+    pgBook.write();
 }
 
 void
@@ -670,8 +1174,8 @@ Book::statistics(const std::string& bookFile) {
     readFromFile(bookFile);
     const int maxPly = 1000;
     Histogram<0, maxPly> hist;
-    for (auto& bn : bookNodes)
-        hist.add(bn.second->getDepth());
+    for (const BookNode& bn : bookNodes)
+        hist.add(bn.getDepth());
 
     int maxNonZero = 0;
     for (int i = 1; i < maxPly; i++)
@@ -687,9 +1191,8 @@ Book::statistics(const std::string& bookFile) {
 void
 Book::addRootNode() {
     if (!getBookNode(startPosHash)) {
-        auto rootNode(std::make_shared<BookNode>(startPosHash, true));
+        BookNode* rootNode = bookNodes.add(startPosHash, true);
         rootNode->setState(BookNode::INITIALIZED);
-        bookNodes[startPosHash] = rootNode;
         Position pos = TextIO::readFEN(TextIO::startPosFEN);
         setChildRefs(pos);
         writeBackup(*rootNode);
@@ -698,37 +1201,73 @@ Book::addRootNode() {
 
 void
 Book::readFromFile(const std::string& filename) {
+    flushBackup();
     bookNodes.clear();
     hashToParent.clear();
+    parentTableValid = true;
     bookData.clearPending();
 
     // Read all book entries
-    std::ifstream is;
-    is.open(filename.c_str(), std::ios_base::in |
-                              std::ios_base::binary);
+    MappedFile bookFile(filename);
+    const size_t recSize = sizeof(BookNode::BookSerializeData);
+    const size_t nRecords = bookFile.size() / recSize;
+    const BookNode::BookSerializeData* records =
+        (const BookNode::BookSerializeData*)bookFile.data();
+
+    // Read parent/child relations, if there is a matching edge file
+    MappedFile edgeFile(edgeFileName(filename));
+    const size_t nEdgeRecords = edgeFile.size() / recSize;
+    const BookNode::BookSerializeData* edgeRecords =
+        (const BookNode::BookSerializeData*)edgeFile.data();
+    U32 nEdges = 0, nNodes = 0;
+    bool hasEdges = false;
+    if (nEdgeRecords >= 2) {
+        U64 key, checksum;
+        Serializer::deSerialize<recSize>(edgeRecords[0].data, key, nEdges, nNodes);
+        Serializer::deSerialize<recSize>(edgeRecords[1].data, checksum);
+        hasEdges = key == BookNode::EDGE_SECTION_KEY &&
+                   nEdgeRecords == 2 + (size_t)nEdges &&
+                   nNodes <= nRecords &&
+                   checksum == nodeChecksum(records, nNodes);
+    }
 
     std::set<U64> zeroTime;
-    while (true) {
+    std::vector<BookNode*> fileNodes;  // Nodes covered by the edge file
+    for (size_t r = 0; r < nRecords; r++) {
         BookNode::BookSerializeData bsd;
-        is.read((char*)&bsd.data[0], sizeof(bsd.data));
-        if (!is)
-            break;
-        auto bn(std::make_shared<BookNode>(0));
-        bn->deSerialize(bsd);
-        if (bn->getSearchTime() == 0) {
-            zeroTime.insert(bn->getHashKey());
+        memcpy(&bsd, &records[r], recSize);
+        U64 hashKey;
+        U16 bestMove;
+        S16 searchScore;
+        U32 searchTime;
+        Serializer::deSerialize<recSize>(bsd.data, hashKey, bestMove, searchScore, searchTime);
+        if (searchTime == 0) {
+            zeroTime.insert(hashKey);
         } else {
-            zeroTime.erase(bn->getHashKey());
+            zeroTime.erase(hashKey);
         }
-        if (bn->getHashKey() == startPosHash)
+        BookNode* bn = getBookNode(hashKey);
+        if (!bn)
+            bn = bookNodes.add(hashKey);
+        bn->deSerialize(bsd);
+        if (hashKey == startPosHash)
             bn->setRootNode();
-        bookNodes[bn->getHashKey()] = bn;
+        if (r < nNodes)
+            fileNodes.push_back(bn);
     }
-    is.close();
 
-    // Find positions for all book entries by exploring moves from the starting position
-    Position pos = TextIO::readFEN(TextIO::startPosFEN);
-    initPositions(pos);
+    // The edges only describe the whole book if the covered records are
+    // distinct and no new nodes have been appended to the book file.
+    if (hasEdges && bookNodes.size() == nNodes &&
+        linkFromEdges(fileNodes, std::vector<BookNode::BookSerializeData>(
+                          &edgeRecords[2], &edgeRecords[2 + nEdges]))) {
+        // Parent/child relations are known, so only compute hashToParent
+        // if new positions are added to the book.
+        parentTableValid = false;
+    } else {
+        // Find positions for all book entries by exploring moves from the starting position
+        initPositions();
+    }
     addRootNode();
 
     // Initialize all negamax scores
@@ -743,20 +1282,89 @@ Book::readFromFile(const std::string& filename) {
 void
 Book::writeToFile(const std::string& filename) {
     std::lock_guard<std::mutex> L(mutex);
-    std::ofstream os;
-    os.open(filename.c_str(), std::ios_base::out |
+    std::vector<BookNode::BookSerializeData> data, edges;
+    serialize(data, edges);
+    if (backupWriter && filename == backupFile) {
+        backupWriter->replace(std::move(data), std::move(edges));
+        backupWriter->flush();
+        return;
+    }
+
+    auto write = [](const std::string& name,
+                    const std::vector<BookNode::BookSerializeData>& data) {
+        std::ofstream os;
+        os.open(name.c_str(), std::ios_base::out |
                               std::ios_base::binary |
                               std::ios_base::trunc);
-    os.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+        os.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+        os.write((const char*)data.data(), data.size() * sizeof(BookNode::BookSerializeData));
+    };
+    write(filename, data);
+    write(edgeFileName(filename), edges);
+}
 
-    for (const auto& e : bookNodes) {
-        auto& node = e.second;
+std::string
+Book::edgeFileName(const std::string& bookFile) {
+    return bookFile + ".edges";
+}
+
+void
+Book::serialize(std::vector<BookNode::BookSerializeData>& data,
+                std::vector<BookNode::BookSerializeData>& edges) const {
+    data.clear();
+    U32 nNodes = 0;
+    U32 nEdges = 0;
+    for (const BookNode& node : bookNodes) {
         BookNode::BookSerializeData bsd;
-        node->serialize(bsd);
-        os.write((const char*)&bsd.data[0], sizeof(bsd.data));
+        node.serialize(bsd);
+        data.push_back(bsd);
+        nNodes++;
+        nEdges += node.getParents().size();
+    }
+
+    edges.clear();
+    BookNode::BookSerializeData bsd {};
+    Serializer::serialize<sizeof(bsd.data)>(bsd.data, BookNode::EDGE_SECTION_KEY, nEdges, nNodes);
+    edges.push_back(bsd);
+    bsd = BookNode::BookSerializeData {};
+    Serializer::serialize<sizeof(bsd.data)>(bsd.data, nodeChecksum(data.data(), nNodes));
+    edges.push_back(bsd);
+    U32 childIdx = 0;
+    for (const BookNode& node : bookNodes) {
+        for (const auto& p : node.getParents()) {
+            U32 parentIdx = bookNodes.getIndex(p.parent->getHashKey());
+            BookNode::BookSerializeData ebsd {};
+            Serializer::serialize<sizeof(ebsd.data)>(ebsd.data, childIdx, parentIdx,
+                                                     p.compressedMove);
+            edges.push_back(ebsd);
+        }
+        childIdx++;
     }
 }
 
+U64
+Book::nodeChecksum(const BookNode::BookSerializeData* data, size_t nNodes) {
+    U64 checksum = nNodes;
+    for (size_t i = 0; i < nNodes; i++) {
+        U64 hashKey;
+        Serializer::deSerialize<sizeof(data[i].data)>(data[i].data, hashKey);
+        checksum = hashU64(checksum + hashKey);
+    }
+    return checksum;
+}
+
+void
+Book::setBackupParams(int maxPending, int flushIntervalMs, bool sync) {
+    if (backupWriter)
+        backupWriter->setFlushParams(maxPending, flushIntervalMs, sync);
+}
+
+void
+Book::flushBackup() {
+    if (backupWriter)
+        backupWriter->flush();
+}
+
 void
 Book::extendBook(PositionSelector& selector, int searchTime, int numThreads,
                  TranspositionTable& tt) {
@@ -769,17 +1377,22 @@ Book::extendBook(PositionSelector& selector, int searchTime, int numThreads,
             auto sr = make_unique<SearchRunner>(i, tt);
             scheduler->addWorker(std::move(sr));
         }
+        for (size_t i = 0; i < remoteWorkers.size(); i++) {
+            auto rw = make_unique<RemoteSearchWorker>(numThreads + i,
+                                                      openWorkerConnection(remoteWorkers[i]));
+            scheduler->addWorker(std::move(rw));
+        }
     }
     scheduler->startWorkers(listener.get());
 
     int numPending = 0;
-    const int desiredQueueLen = numThreads + 1;
+    const int desiredQueueLen = numThreads + remoteWorkers.size() + 1;
     int workId = 0;   // Work unit ID number
     int commitId = 0; // Next work unit to be stored in opening book
     std::set<SearchScheduler::WorkUnit> completed; // Completed but not yet committed to book
     while (true) {
         bool workAdded = false;
-        if (numPending < desiredQueueLen) {
+        if (numPending < desiredQueueLen && scheduler->hasWorkers()) {
             Position pos;
             Move move;
             if (selector.getNextPosition(pos, move)) {
@@ -827,7 +1440,7 @@ Book::extendBook(PositionSelector& selector, int searchTime, int numThreads,
                 commitId++;
                 workRemoved = true;
                 removePending(wu.hashKey);
-                if (!scheduler->isAborting()) {
+                if (!scheduler->isAborting() && !wu.failed) {
                     auto bn = getBookNode(wu.hashKey);
                     assert(bn);
                     bn->setSearchResult(bookData,
@@ -842,8 +1455,11 @@ Book::extendBook(PositionSelector& selector, int searchTime, int numThreads,
             }
         }
     }
+    flushBackup();
     if (listener)
         listener->queueSizeChanged(0);
+    if (!scheduler->hasWorkers())
+        throw ChessParseError("All search workers failed");
 }
 
 std::vector<Move>
@@ -891,27 +1507,25 @@ void
 Book::addPosToBook(Position& pos, const Move& move, std::vector<U64>& toSearch) {
     assert(getBookNode(pos.bookHash()));
 
+    if (!parentTableValid)
+        initPositions();
+
     UndoInfo ui;
     pos.makeMove(move, ui);
     U64 childHash = pos.bookHash();
     assert(!getBookNode(childHash));
-    auto childNode = std::make_shared<BookNode>(childHash);
-
-    bookNodes[childHash] = childNode;
+    BookNode* childNode = bookNodes.add(childHash);
 
     toSearch.push_back(pos.bookHash());
 
-    std::size_t bucket = hashToParent.bucket(H2P(childHash, 0));
-    auto b = hashToParent.begin(bucket);
-    auto e = hashToParent.end(bucket);
+    std::vector<U32> parentCandidates;
+    hashToParent.forEachParent(childHash, [&parentCandidates](U32 parentIdx) {
+        parentCandidates.push_back(parentIdx);
+    });
     int nParents = 0;
-    for (auto p = b; p != e; ++p) {
-        if (p->childHash != childHash)
-            continue;
-        U64 parentHash = p->parentHash;
-        BookNode* parent = getBookNode(parentHash);
-        assert(parent);
-        nParents++;
+    for (U32 parentIdx : parentCandidates) {
+        BookNode* parent = &bookNodes[parentIdx];
+        U64 parentHash = parent->getHashKey();
 
         Position pos2;
         std::vector<Move> dummyMoves;
@@ -933,9 +1547,12 @@ Book::addPosToBook(Position& pos, const Move& move, std::vector<U64>& toSearch)
             }
             pos2.unMakeMove(moves[i], ui2);
         }
-        assert(found);
+        if (!found)
+            continue; // False match in hashToParent
+        nParents++;
+        hashToParent.remove(childHash, parentIdx);
 
-        parent->addChild(move2.getCompressedMove(), childNode.get());
+        parent->addChild(move2.getCompressedMove(), childNode);
         childNode->addParent(move2.getCompressedMove(), parent);
         toSearch.push_back(parent->getHashKey());
     }
@@ -1016,31 +1633,226 @@ Book::getBookPV(U64 hashKey, Position& pos,
 
 BookNode*
 Book::getBookNode(U64 hashKey) const {
-    auto it = bookNodes.find(hashKey);
-    if (it == bookNodes.end())
-        return nullptr;
-    return it->second.get();
+    return bookNodes.get(hashKey);
+}
+
+/** Call func(threadNo, nThreads) in nThreads threads and wait for all calls to finish. */
+template <typename Func>
+static void
+runParallel(int nThreads, Func func) {
+    std::vector<std::thread> threads;
+    for (int t = 1; t < nThreads; t++)
+        threads.emplace_back([&func,t,nThreads]() { func(t, nThreads); });
+    func(0, nThreads);
+    for (auto& t : threads)
+        t.join();
 }
 
 void
-Book::initPositions(Position& pos) {
-    const U64 hash = pos.bookHash();
-    BookNode* node = getBookNode(hash);
-    if (!node)
+Book::initPositions() {
+    BookNode* root = getBookNode(startPosHash);
+    if (!root)
         return;
 
-    setChildRefs(pos);
-    for (auto& e : node->getChildren()) {
-        if (e.second->getState() == BookNode::DESERIALIZED) {
+    struct Link {
+        BookNode* parent;
+        U16 move;
+        BookNode* child;
+        Position childPos;
+    };
+    struct ThreadData {
+        std::vector<std::pair<U64,U32>> parentRefs; // Child hash, parent node index
+        std::vector<Link> links;
+    };
+
+    const int nThreads = std::max(1, (int)std::thread::hardware_concurrency());
+    std::vector<bool> visited(bookNodes.size());
+    std::vector<std::pair<BookNode*,Position>> level;
+    level.emplace_back(root, TextIO::readFEN(TextIO::startPosFEN));
+    visited[bookNodes.getIndex(startPosHash)] = true;
+    while (!level.empty()) {
+        std::vector<ThreadData> td(nThreads);
+        runParallel(nThreads, [this,&level,&td](int threadNo, int nThreads) {
+            ThreadData& data = td[threadNo];
             UndoInfo ui;
-            Move m;
-            m.setFromCompressed(e.first);
-            pos.makeMove(m, ui);
-            initPositions(pos);
-            pos.unMakeMove(m, ui);
+            for (size_t i = threadNo; i < level.size(); i += nThreads) {
+                BookNode* node = level[i].first;
+                Position& pos = level[i].second;
+                const U32 nodeIdx = bookNodes.getIndex(node->getHashKey());
+                MoveList moves;
+                MoveGen::pseudoLegalMoves(pos, moves);
+                MoveGen::removeIllegal(pos, moves);
+                for (int mi = 0; mi < moves.size; mi++) {
+                    pos.makeMove(moves[mi], ui);
+                    U64 childHash = pos.bookHash();
+                    BookNode* child = getBookNode(childHash);
+                    if (child)
+                        data.links.push_back(Link{node, moves[mi].getCompressedMove(),
+                                                  child, pos});
+                    else
+                        data.parentRefs.emplace_back(childHash, nodeIdx);
+                    pos.unMakeMove(moves[mi], ui);
+                }
+            }
+        });
+
+        std::vector<std::pair<BookNode*,Position>> nextLevel;
+        for (ThreadData& data : td) {
+            for (const auto& pr : data.parentRefs)
+                hashToParent.add(pr.first, pr.second);
+            for (Link& l : data.links) {
+                l.parent->addChild(l.move, l.child);
+                l.child->addParent(l.move, l.parent, false);
+                U32 childIdx = bookNodes.getIndex(l.child->getHashKey());
+                if (!visited[childIdx]) {
+                    visited[childIdx] = true;
+                    nextLevel.emplace_back(l.child, l.childPos);
+                }
+            }
+        }
+        level.swap(nextLevel);
+    }
+    parentTableValid = true;
+    initDepths();
+}
+
+bool
+Book::linkFromEdges(const std::vector<BookNode*>& fileNodes,
+                    const std::vector<BookNode::BookSerializeData>& edges) {
+    struct Edge {
+        U32 child;  // Node index in bookNodes
+        U32 parent; // Node index in bookNodes
+        U16 move;
+    };
+    const U32 nNodes = fileNodes.size();
+    std::vector<Edge> decoded;
+    decoded.reserve(edges.size());
+    std::vector<U32> nChildren(bookNodes.size()), nParents(bookNodes.size());
+    for (const auto& e : edges) {
+        U32 childIdx, parentIdx;
+        U16 move;
+        Serializer::deSerialize<sizeof(e.data)>(e.data, childIdx, parentIdx, move);
+        if (childIdx >= nNodes || parentIdx >= nNodes)
+            return false;
+        Edge edge { fileNodes[childIdx]->getIndex(), fileNodes[parentIdx]->getIndex(), move };
+        nChildren[edge.parent]++;
+        nParents[edge.child]++;
+        decoded.push_back(edge);
+    }
+
+    // Reserve room for all edges first, so that the edge storage is not
+    // reallocated while edges are inserted by several threads.
+    for (U32 i = 0; i < bookNodes.size(); i++) {
+        bookNodes[i].reserveChildren(nChildren[i]);
+        bookNodes[i].reserveParents(nParents[i]);
+    }
+
+    // Each thread owns the children lists of some nodes and the parent lists
+    // of some nodes, so no locking is needed. The edges are bucketed by owner
+    // thread, so that each thread only visits the edges it inserts.
+    const int nThreads = std::max(1, (int)std::thread::hardware_concurrency());
+    auto bucketEdges = [&decoded,nThreads](bool byParent, std::vector<U32>& order,
+                                           std::vector<size_t>& start) {
+        start.assign(nThreads + 1, 0);
+        for (const Edge& e : decoded)
+            start[(byParent ? e.parent : e.child) % nThreads + 1]++;
+        for (int t = 0; t < nThreads; t++)
+            start[t + 1] += start[t];
+        std::vector<size_t> pos(start.begin(), start.end() - 1);
+        order.resize(decoded.size());
+        for (U32 i = 0; i < decoded.size(); i++) {
+            const Edge& e = decoded[i];
+            order[pos[(byParent ? e.parent : e.child) % nThreads]++] = i;
+        }
+    };
+    std::vector<U32> childOrder, parentOrder;
+    std::vector<size_t> childStart, parentStart;
+    bucketEdges(true, childOrder, childStart);
+    bucketEdges(false, parentOrder, parentStart);
+
+    runParallel(nThreads, [this,&decoded,&childOrder,&childStart,&parentOrder,
+                           &parentStart](int threadNo, int nThreads) {
+        for (size_t i = childStart[threadNo]; i < childStart[threadNo + 1]; i++) {
+            const Edge& e = decoded[childOrder[i]];
+            bookNodes[e.parent].addChild(e.move, &bookNodes[e.child]);
+        }
+        for (size_t i = parentStart[threadNo]; i < parentStart[threadNo + 1]; i++) {
+            const Edge& e = decoded[parentOrder[i]];
+            bookNodes[e.child].addParent(e.move, &bookNodes[e.parent], false);
+        }
+    });
+
+    if (!verifyEdges()) {
+        bookNodes.clearEdges();
+        return false;
+    }
+    initDepths();
+    return true;
+}
+
+bool
+Book::verifyEdges() const {
+    const BookNode* root = getBookNode(startPosHash);
+    if (!root)
+        return true;
+    const int nPaths = 1000;
+    const int maxPly = 100;
+    std::mt19937 rndGen(17);
+    UndoInfo ui;
+    for (int p = 0; p < nPaths; p++) {
+        Position pos = TextIO::readFEN(TextIO::startPosFEN);
+        const BookNode* node = root;
+        for (int ply = 0; ply < maxPly; ply++) {
+            auto children = node->getChildren();
+            if (children.empty())
+                break;
+            const auto e = children[rndGen() % children.size()];
+            MoveList moves;
+            MoveGen::pseudoLegalMoves(pos, moves);
+            MoveGen::removeIllegal(pos, moves);
+            int mi = 0;
+            while (mi < moves.size && moves[mi].getCompressedMove() != e.first)
+                mi++;
+            if (mi == moves.size)
+                return false;
+            pos.makeMove(moves[mi], ui);
+            const BookNode* child = e.second;
+            if (pos.bookHash() != child->getHashKey())
+                return false;
+            bool parentFound = false;
+            for (const auto& pe : child->getParents())
+                if (pe.parent == node && pe.compressedMove == e.first)
+                    parentFound = true;
+            if (!parentFound)
+                return false;
+            node = child;
         }
     }
-    node->setState(BookNode::INITIALIZED);
+    return true;
+}
+
+void
+Book::initDepths() {
+    BookNode* root = getBookNode(startPosHash);
+    if (!root)
+        return;
+    std::vector<BookNode*> level { root };
+    int depth = 0;
+    while (!level.empty()) {
+        std::vector<BookNode*> nextLevel;
+        for (BookNode* node : level) {
+            node->setState(BookNode::INITIALIZED);
+            for (const auto& e : node->getChildren()) {
+                BookNode* child = e.second;
+                if (child->getState() != BookNode::INITIALIZED && child->getDepth() > depth + 1) {
+                    child->setDepth(depth + 1);
+                    nextLevel.push_back(child);
+                }
+            }
+        }
+        level.swap(nextLevel);
+        depth++;
+    }
 }
 
 void
@@ -1048,6 +1860,7 @@ Book::setChildRefs(Position& pos) {
     const U64 hash = pos.bookHash();
     BookNode* node = getBookNode(hash);
     assert(node);
+    const U32 nodeIdx = bookNodes.getIndex(hash);
 
     MoveList moves;
     MoveGen::pseudoLegalMoves(pos, moves);
@@ -1056,11 +1869,12 @@ Book::setChildRefs(Position& pos) {
     for (int i = 0; i < moves.size; i++) {
         pos.makeMove(moves[i], ui);
         U64 childHash = pos.bookHash();
-        hashToParent.insert(H2P(childHash, hash));
         BookNode* child = getBookNode(childHash);
         if (child) {
             node->addChild(moves[i].getCompressedMove(), child);
             child->addParent(moves[i].getCompressedMove(), node);
+        } else {
+            hashToParent.add(childHash, nodeIdx);
         }
         pos.unMakeMove(moves[i], ui);
     }
@@ -1068,32 +1882,34 @@ Book::setChildRefs(Position& pos) {
 
 void
 Book::writeBackup(const BookNode& bookNode) {
-    if (backupFile.empty())
+    if (!backupWriter)
         return;
-    std::ofstream os;
-    os.open(backupFile.c_str(), std::ios_base::out |
-                                std::ios_base::binary |
-                                std::ios_base::app);
-    os.exceptions(std::ifstream::failbit | std::ifstream::badbit);
     BookNode::BookSerializeData bsd;
     bookNode.serialize(bsd);
-    os.write((const char*)&bsd.data[0], sizeof(bsd.data));
+    backupWriter->append(bsd);
+
+    // Replace the backup file with a compacted version when most records in
+    // the file are obsolete. The compacted file is created by the writer thread
+    // from the records it has written, so the book does not have to be
+    // serialized while the book mutex is held.
+    const U64 nRecords = bookNodes.size();
+    if (backupWriter->getNumAppended() > std::max(nRecords * 2, (U64)100000))
+        backupWriter->compact();
 }
 
 void
 Book::computeWeights(int maxErrSelf, double errOtherExpConst, WeightInfo& weights) {
-    weights.clear();
-
-    std::function<void(const BookNode*,WeightInfo&,int,int)> propagateWeights =
+    // Weights for one leaf node, indexed by node index
+    using LeafWeights = std::unordered_map<U32,BookWeight>;
+    std::function<void(const BookNode*,LeafWeights&,int,int)> propagateWeights =
         [&propagateWeights,maxErrSelf,errOtherExpConst]
-        (const BookNode* node, WeightInfo& w, int errW, int errB) {
-        const double oldWW = w[node->getHashKey()].weightWhite;
-        const double oldWB = w[node->getHashKey()].weightBlack;
-        double wW = std::max(oldWW, errW <= maxErrSelf ? exp(-errB / errOtherExpConst) : 0.0);
-        double wB = std::max(oldWB, errB <= maxErrSelf ? exp(-errW / errOtherExpConst) : 0.0);
-        if (wW == oldWW && wB == oldWB)
+        (const BookNode* node, LeafWeights& w, int errW, int errB) {
+        BookWeight& old = w[node->getIndex()];
+        double wW = std::max(old.weightWhite, errW <= maxErrSelf ? exp(-errB / errOtherExpConst) : 0.0);
+        double wB = std::max(old.weightBlack, errB <= maxErrSelf ? exp(-errW / errOtherExpConst) : 0.0);
+        if (wW == old.weightWhite && wB == old.weightBlack)
             return;
-        w[node->getHashKey()] = BookWeight(wW, wB);
+        old = BookWeight(wW, wB);
 
         for (const auto& p : node->getParents()) {
             BookNode* parent = p.parent;
@@ -1104,30 +1920,53 @@ Book::computeWeights(int maxErrSelf, double errOtherExpConst, WeightInfo& weight
         }
     };
 
-    WeightInfo w;
-    for (const auto& e : bookNodes) {
-        const BookNode* node = e.second.get();
-        auto it = node->getChildren().find(node->getBestNonBookMove().getCompressedMove());
-        if ((it != node->getChildren().end()) &&
-            (it->second->getNegaMaxScore() != INVALID_SCORE))
+    struct Leaf {
+        const BookNode* node;
+        int errW, errB;
+    };
+    std::vector<Leaf> leaves;
+    for (const BookNode& n : bookNodes) {
+        const BookNode* node = &n;
+        const BookNode* bestChild = node->getChild(node->getBestNonBookMove().getCompressedMove());
+        if (bestChild && (bestChild->getNegaMaxScore() != INVALID_SCORE))
             continue;
 
         int errW, errB;
         getDropoutPathErrors(*node, errW, errB);
         if (errW == INVALID_SCORE || errB == INVALID_SCORE)
             continue;
-
-        w.clear();
-        propagateWeights(node, w, errW, errB);
-
-        for (const auto& e2 : w)
-            weights[e2.first] += e2.second;
+        leaves.push_back(Leaf{node, errW, errB});
     }
 
-    for (const auto& e : bookNodes) {
-        const U64 hKey = e.first;
-        if (weights.find(hKey) == weights.end())
-            weights.insert(std::make_pair(hKey, BookWeight(0, 0)));
+    // The leaf nodes are split in blocks of fixed size. Each block is summed
+    // by one thread into a sparse map containing only the affected nodes.
+    // The block sums are added to the result in block order, so memory use is
+    // bounded by nThreads block maps and the sum order does not depend on the
+    // number of threads.
+    weights.assign(bookNodes.size(), BookWeight());
+    const size_t blockSize = 1024;
+    const size_t nBlocks = (leaves.size() + blockSize - 1) / blockSize;
+    const int nThreads = clamp((int)nBlocks, 1,
+                               std::max(1, (int)std::thread::hardware_concurrency()));
+    std::vector<LeafWeights> blockWeights(nThreads);
+    for (size_t firstBlock = 0; firstBlock < nBlocks; firstBlock += nThreads) {
+        runParallel(nThreads, [&](int threadNo, int nThreads) {
+            LeafWeights& bw = blockWeights[threadNo];
+            bw.clear();
+            const size_t block = firstBlock + threadNo;
+            const size_t beg = block * blockSize;
+            const size_t end = std::min(beg + blockSize, leaves.size());
+            LeafWeights w;
+            for (size_t i = beg; i < end; i++) {
+                w.clear();
+                propagateWeights(leaves[i].node, w, leaves[i].errW, leaves[i].errB);
+                for (const auto& e2 : w)
+                    bw[e2.first] += e2.second;
+            }
+        });
+        for (int t = 0; t < nThreads; t++)
+            for (const auto& e2 : blockWeights[t])
+                weights[e2.first] += e2.second;
     }
 }
 
@@ -1140,7 +1979,7 @@ Book::getDropoutPathErrors(const BookNode& node, int& errW, int& errB) {
         return;
 
     U16 cMove = node.getBestNonBookMove().getCompressedMove();
-    if (node.getChildren().find(cMove) != node.getChildren().end())
+    if (node.getChild(cMove))
         return;
 
     errW = node.getPathErrorWhite();
@@ -1170,15 +2009,13 @@ Book::bookMoveOk(const BookNode& node, U16 cMove, int maxErrSelf) const {
         if (node.getSearchScore() == INVALID_SCORE ||
             node.getSearchScore() == IGNORE_SCORE)
             return false;
-        auto it = node.getChildren().find(node.getBestNonBookMove().getCompressedMove());
-        if ((it != node.getChildren().end()) &&
-            (it->second->getNegaMaxScore() != INVALID_SCORE))
+        const BookNode* bestChild = node.getChild(node.getBestNonBookMove().getCompressedMove());
+        if (bestChild && (bestChild->getNegaMaxScore() != INVALID_SCORE))
             return false;
         delta = node.getNegaMaxScore() - node.getSearchScore();
     } else {
-        auto it = node.getChildren().find(cMove);
-        assert(it != node.getChildren().end());
-        auto child = it->second;
+        const BookNode* child = node.getChild(cMove);
+        assert(child);
         if (child->getNegaMaxScore() == INVALID_SCORE)
             return false;
         delta = node.getNegaMaxScore() - BookNode::negateScore(child->getNegaMaxScore());
@@ -1249,16 +2086,14 @@ Book::printBookInfo(Position& pos, const std::vector<Move>& movePath,
     getOrderedChildMoves(*node, childMoves);
     for (size_t mi = 0; mi < childMoves.size(); mi++) {
         const Move& childMove = childMoves[mi];
-        auto it = node->getChildren().find(childMove.getCompressedMove());
-        assert(it != node->getChildren().end());
-        const BookNode* child = it->second;
+        const BookNode* child = node->getChild(childMove.getCompressedMove());
+        assert(child);
         int negaMaxScore = child->getNegaMaxScore();
         if (pos.isWhiteMove())
             negaMaxScore = BookNode::negateScore(negaMaxScore);
         int expandCostW = node->getExpansionCost(bookData, child, true);
         int expandCostB = node->getExpansionCost(bookData, child, false);
-        auto wi = weights.find(child->getHashKey());
-        assert(wi != weights.end());
+        const BookWeight& bw = weights[child->getIndex()];
         std::cout << std::setw(2) << mi << ' '
                   << std::setw(6) << TextIO::moveToString(pos, childMove, false) << ' '
                   << std::setw(6) << negaMaxScore << ' '
@@ -1266,8 +2101,8 @@ Book::printBookInfo(Position& pos, const std::vector<Move>& movePath,
                   << std::setw(6) << child->getPathErrorBlack() << ' '
                   << std::setw(6) << expandCostW << ' '
                   << std::setw(6) << expandCostB << ' '
-                  << std::setw(10) << d2Str(wi->second.weightWhite) << ' '
-                  << std::setw(10) << d2Str(wi->second.weightBlack) << ' '
+                  << std::setw(10) << d2Str(bw.weightWhite) << ' '
+                  << std::setw(10) << d2Str(bw.weightBlack) << ' '
                   << std::endl;
     }
 
@@ -1334,9 +2169,8 @@ Book::getTreeData(const Position& pos, TreeData& treeData) const {
     getOrderedChildMoves(*node, childMoves);
     for (size_t mi = 0; mi < childMoves.size(); mi++) {
         const Move& childMove = childMoves[mi];
-        auto it = node->getChildren().find(childMove.getCompressedMove());
-        assert(it != node->getChildren().end());
-        const BookNode* child = it->second;
+        const BookNode* child = node->getChild(childMove.getCompressedMove());
+        assert(child);
         int negaMaxScore = child->getNegaMaxScore();
         if (pos.isWhiteMove())
             negaMaxScore = BookNode::negateScore(negaMaxScore);
@@ -1410,7 +2244,7 @@ Book::getQueueData(QueueData& queueData) const {
 // ----------------------------------------------------------------------------
 
 SearchRunner::SearchRunner(int instanceNo0, TranspositionTable& tt0)
-    : instanceNo(instanceNo0), tt(tt0),
+    : SearchWorker(instanceNo0), tt(tt0),
       comm(nullptr, tt, notifier, false), aborted(false) {
 }
 
@@ -1482,7 +2316,7 @@ SearchRunner::abort() {
 }
 
 SearchScheduler::SearchScheduler()
-    : stopped(false) {
+    : stopped(false), nAlive(0) {
 }
 
 SearchScheduler::~SearchScheduler() {
@@ -1491,16 +2325,20 @@ SearchScheduler::~SearchScheduler() {
 }
 
 void
-SearchScheduler::addWorker(std::unique_ptr<SearchRunner> sr) {
-    workers.push_back(std::move(sr));
+SearchScheduler::addWorker(std::unique_ptr<SearchWorker> sw) {
+    workers.push_back(std::move(sw));
 }
 
 void
 SearchScheduler::startWorkers(Book::Listener* listener) {
+    {
+        std::lock_guard<std::mutex> L(mutex);
+        nAlive = workers.size();
+    }
     for (auto& w : workers) {
-        SearchRunner& sr = *w;
-        auto thread = make_unique<std::thread>([this,&sr,listener]() {
-            workerLoop(sr, listener);
+        SearchWorker& sw = *w;
+        auto thread = make_unique<std::thread>([this,&sw,listener]() {
+            workerLoop(sw, listener);
         });
         threads.push_back(std::move(thread));
     }
@@ -1521,6 +2359,12 @@ SearchScheduler::isAborting() const {
     return stopped;
 }
 
+bool
+SearchScheduler::hasWorkers() const {
+    std::lock_guard<std::mutex> L(mutex);
+    return nAlive > 0;
+}
+
 void
 SearchScheduler::waitWorkers() {
     for (auto& t : threads) {
@@ -1532,12 +2376,26 @@ SearchScheduler::waitWorkers() {
 void
 SearchScheduler::addWorkUnit(const WorkUnit& wu) {
     std::lock_guard<std::mutex> L(mutex);
+    if (nAlive == 0) {
+        WorkUnit failedWu(wu);
+        failedWu.failed = true;
+        completeWorkUnit(failedWu);
+        return;
+    }
     bool empty = pending.empty();
     pending.push_back(wu);
     if (empty)
         pendingCv.notify_all();
 }
 
+void
+SearchScheduler::completeWorkUnit(const WorkUnit& wu) {
+    bool empty = complete.empty();
+    complete.push_back(wu);
+    if (empty)
+        completeCv.notify_all();
+}
+
 void
 SearchScheduler::getResult(WorkUnit& wu) {
     std::unique_lock<std::mutex> L(mutex);
@@ -1592,7 +2450,7 @@ SearchScheduler::reportResult(const WorkUnit& wu) const {
 }
 
 void
-SearchScheduler::workerLoop(SearchRunner& sr, Book::Listener* listener) {
+SearchScheduler::workerLoop(SearchWorker& sw, Book::Listener* listener) {
     while (true) {
         WorkUnit wu;
         QueueItem item;
@@ -1608,20 +2466,45 @@ SearchScheduler::workerLoop(SearchRunner& sr, Book::Listener* listener) {
             item.hashKey = wu.hashKey;
             item.startTime = std::chrono::system_clock::now();
             item.completed = false;
-            runningItems[sr.instNo()] = item;
+            runningItems[sw.instNo()] = item;
             if (listener)
                 listener->queueChanged();
         }
-        wu.bestMove = sr.analyze(wu.gameMoves, wu.movesToSearch, wu.searchTime);
-        wu.instNo = sr.instNo();
+        try {
+            wu.bestMove = sw.analyze(wu.gameMoves, wu.movesToSearch, wu.searchTime);
+        } catch (const WorkUnitError& ex) {
+            std::cerr << "Search worker " << sw.instNo() << " failed to search work unit "
+                      << wu.id << ": " << ex.what() << std::endl;
+            wu.bestMove = Move();
+            wu.failed = true;
+        } catch (const std::exception& ex) {
+            std::cerr << "Search worker " << sw.instNo() << " failed: "
+                      << ex.what() << std::endl;
+            std::lock_guard<std::mutex> L(mutex);
+            runningItems.erase(sw.instNo());
+            if (--nAlive > 0) {
+                pending.push_front(wu);
+                pendingCv.notify_all();
+            } else {
+                std::cerr << "No search workers left" << std::endl;
+                wu.failed = true;
+                completeWorkUnit(wu);
+                for (WorkUnit& p : pending) {
+                    p.failed = true;
+                    completeWorkUnit(p);
+                }
+                pending.clear();
+            }
+            if (listener)
+                listener->queueChanged();
+            return;
+        }
+        wu.instNo = sw.instNo();
         {
             std::lock_guard<std::mutex> L(mutex);
-            bool empty = complete.empty();
-            complete.push_back(wu);
-            if (empty)
-                completeCv.notify_all();
+            completeWorkUnit(wu);
 
-            runningItems.erase(sr.instNo());
+            runningItems.erase(sw.instNo());
             if (listener)
                 listener->queueChanged();
             item.completed = true;
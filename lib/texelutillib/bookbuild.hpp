@@ -35,6 +35,7 @@
 #include "history.hpp"
 #include "evaluate.hpp"
 #include "parallel.hpp"
+#include "chessParseError.hpp"
 
 #include <memory>
 #include <atomic>
@@ -45,10 +46,13 @@
 #include <set>
 #include <map>
 #include <climits>
+#include <algorithm>
 #include <chrono>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <exception>
+#include <cstdio>
 
 class BookBuildTest;
 class GameNode;
@@ -57,6 +61,7 @@ class Search;
 namespace BookBuild {
 
 class SearchScheduler;
+class BookNodeTable;
 
 // Node is temporarily ignored because it is currently being searched
 const int IGNORE_SCORE = SearchConst::UNKNOWN_SCORE + 1;
@@ -145,8 +150,9 @@ private:
  */
 class BookNode {
 public:
-    /** Create an empty node. */
-    BookNode(U64 hashKey, bool rootNode = false);
+    /** Create an empty node. Nodes are created by BookNodeTable::add(), which
+     *  also provides the storage for the child and parent lists. */
+    BookNode(BookNodeTable& table, U32 index, U64 hashKey, bool rootNode = false);
 
     BookNode(const BookNode& other) = delete;
     BookNode& operator=(const BookNode& other) = delete;
@@ -154,6 +160,9 @@ public:
     /** Return book hash key. */
     U64 getHashKey() const;
 
+    /** Return index of this node in its BookNodeTable. */
+    U32 getIndex() const;
+
     /** Return shortest distance to the root node. */
     int getDepth() const;
 
@@ -176,14 +185,35 @@ public:
         U8 data[16];
     };
 
+    /** Hash key of the first record in an edge file, see Book::edgeFileName().
+     *  The first record also contains the number of edges and the number of nodes
+     *  "n". The second record contains a checksum of the hash keys of the first
+     *  "n" records in the book file. The remaining records contain one record for
+     *  each parent/child relation between those nodes. This makes it possible to
+     *  link the nodes without move generation. The book file format is not
+     *  affected, so programs not knowing about edge files can still read it. */
+    static const U64 EDGE_SECTION_KEY = 0x45646765536563ULL;
+
     /** Serialize/deserialize object. */
     void serialize(BookSerializeData& bsd) const;
     void deSerialize(const BookSerializeData& bsd);
     void setRootNode();
 
-    /** Add a parent/child relationship. */
+    /** Add a parent/child relationship. If updDepth is false, the depth of this
+     *  node is not updated and must be set later using setDepth(). */
     void addChild(U16 move, BookNode* child);
-    void addParent(U16 move, BookNode* parent);
+    void addParent(U16 move, BookNode* parent, bool updDepth = true);
+
+    /** Make room for at least "n" children/parents, see BookNodeTable::reserveEdges(). */
+    void reserveChildren(U32 n);
+    void reserveParents(U32 n);
+
+    /** Remove all children and parents. The edge storage is released by
+     *  BookNodeTable::clearEdges(). */
+    void clearEdges();
+
+    /** Set the shortest distance to the root node. */
+    void setDepth(int d);
 
     /** Set search result data. */
     void setSearchResult(const BookData& bookData,
@@ -202,28 +232,64 @@ public:
      *  of this node and all children and parents. */
     void updateScores(const BookData& bookData);
 
-    /** Get all children. */
-    const std::map<U16, BookNode*>& getChildren() const { return children; }
+    using ChildInfo = std::pair<U16, BookNode*>; // Compressed move, child node
 
     struct ParentInfo {
         ParentInfo(U16 cMove, BookNode* p = nullptr)
             : compressedMove(cMove), parent(p) {}
 
-        bool operator<(const ParentInfo& other) const {
-            if (compressedMove != other.compressedMove)
-                return compressedMove < other.compressedMove;
-            std::less<BookNode*> ol;
-            return ol(parent, other.parent);
-        }
-
         U16 compressedMove;
         BookNode* parent;
     };
 
-    /** Get all parents. */
-    const std::set<ParentInfo>& getParents() const { return parents; }
+    /** Location of a child or parent list in the edge storage of a BookNodeTable. */
+    struct EdgeList {
+        U32 begin = 0;  // Index of first edge
+        U16 size = 0;   // Number of edges
+        U8 capLog = 0;  // Capacity is 1 << (capLog - 1), or 0 if capLog is 0
+    };
+
+    /** A sequence of child or parent edges. Elements are created on the fly
+     *  from the node indices and moves stored in the BookNodeTable. */
+    template <typename Info>
+    class EdgeRange {
+    public:
+        EdgeRange(const BookNodeTable& table, const EdgeList& list)
+            : table(table), begin_(list.begin), size_(list.size) {}
+
+        class iterator {
+        public:
+            iterator(const BookNodeTable& table, U32 idx) : table(&table), idx(idx) {}
+            Info operator*() const;
+            iterator& operator++() { idx++; return *this; }
+            bool operator!=(const iterator& other) const { return idx != other.idx; }
+        private:
+            const BookNodeTable* table;
+            U32 idx;
+        };
+
+        size_t size() const { return size_; }
+        bool empty() const { return size_ == 0; }
+        Info operator[](size_t i) const { return *iterator(table, begin_ + i); }
+        iterator begin() const { return iterator(table, begin_); }
+        iterator end() const { return iterator(table, begin_ + size_); }
+
+    private:
+        const BookNodeTable& table;
+        U32 begin_;
+        U32 size_;
+    };
+
+    /** Get all children, sorted by move. */
+    EdgeRange<ChildInfo> getChildren() const;
 
-    const Move& getBestNonBookMove() const;
+    /** Get the child corresponding to a compressed move, or null if there is no such child. */
+    BookNode* getChild(U16 move) const;
+
+    /** Get all parents, sorted by move and parent node index. */
+    EdgeRange<ParentInfo> getParents() const;
+
+    Move getBestNonBookMove() const;
     const S16 getSearchScore() const;
     const U32 getSearchTime() const;
 
@@ -247,7 +313,7 @@ private:
     U64 hashKey;
     int depth;              // Length of shortest path to the root node
 
-    Move bestNonBookMove;   // Best non-book move. Empty if all legal moves are
+    U16 bestNonBookMove;    // Best non-book move, compressed. Empty if all legal moves are
                             // included in the book.
     S16 searchScore;        // Score for best non-book move.
                             // IGNORE_SCORE, -MATE0 or 0 (stalemate) if no non-book move.
@@ -260,9 +326,269 @@ private:
     int pathErrorWhite;     // Smallest path error for white from root to this node
     int pathErrorBlack;     // Smallest path error for black from root to this node
 
-    std::map<U16, BookNode*> children; // Compressed move -> BookNode
-    std::set<ParentInfo> parents;      // Compressed move -> BookNode
-    State state;
+    BookNodeTable* table;   // Table containing this node and its edges
+    U32 index;              // Index of this node in the table
+    EdgeList children;      // Compressed move -> child node, sorted by move
+    EdgeList parents;       // Compressed move -> parent node, sorted by move and node
+    U8 state;
+};
+
+/** Storage for all nodes in a book. The nodes are allocated in an arena where
+ *  they are never moved, so BookNode pointers stay valid until clear() is called.
+ *  Nodes are found from their hash key using an open addressing hash table
+ *  containing 32-bit node indices.
+ *  The child and parent lists of all nodes are stored in two shared flat arrays,
+ *  one for 32-bit node indices and one for compressed moves. Each list occupies
+ *  a block whose size is a power of two. When a list outgrows its block, it is
+ *  moved to a block twice as large and the old block is reused by other lists. */
+class BookNodeTable {
+public:
+    BookNodeTable();
+
+    BookNodeTable(const BookNodeTable& other) = delete;
+    BookNodeTable& operator=(const BookNodeTable& other) = delete;
+
+    /** Return the node for a hash key, or null if there is no such node. */
+    BookNode* get(U64 hashKey) const;
+
+    /** Create a node for a hash key that is not already in the table. */
+    BookNode* add(U64 hashKey, bool rootNode = false);
+
+    /** Return the index of the node for a hash key. The node must exist. */
+    U32 getIndex(U64 hashKey) const;
+
+    /** Return the node with a given index. */
+    BookNode& operator[](U32 idx) { return nodes[idx]; }
+    const BookNode& operator[](U32 idx) const { return nodes[idx]; }
+
+    /** Number of nodes in the table. */
+    size_t size() const { return nodes.size(); }
+
+    /** Remove all nodes. */
+    void clear();
+
+    using iterator = std::deque<BookNode>::iterator;
+    using const_iterator = std::deque<BookNode>::const_iterator;
+    iterator begin() { return nodes.begin(); }
+    iterator end() { return nodes.end(); }
+    const_iterator begin() const { return nodes.begin(); }
+    const_iterator end() const { return nodes.end(); }
+
+    /** Node index and compressed move for an edge. */
+    U32 edgeNode(U32 e) const { return edgeNodes[e]; }
+    U16 edgeMove(U32 e) const { return edgeMoves[e]; }
+
+    /** Insert an edge at position "pos" in a list, moving the list to a larger
+     *  block if needed. */
+    void insertEdge(BookNode::EdgeList& list, U32 pos, U16 move, U32 node);
+
+    /** Make sure a list has room for at least "n" edges. After reserving room,
+     *  edges can be inserted in different lists concurrently from different
+     *  threads, as long as no list becomes larger than its reserved size. */
+    void reserveEdges(BookNode::EdgeList& list, U32 n);
+
+    /** Remove all children and parents from all nodes. */
+    void clearEdges();
+
+private:
+    /** Resize the hash table and re-insert all nodes. */
+    void rehash(size_t newSize);
+
+    /** Move a list to a block with capacity 1 << (capLog - 1). */
+    void moveEdges(BookNode::EdgeList& list, int capLog);
+
+    std::deque<BookNode> nodes;
+    std::vector<U32> slots; // Node index + 1, or 0 for an empty slot
+    size_t mask;            // slots.size() - 1
+
+    std::vector<U32> edgeNodes; // Node index for each edge
+    std::vector<U16> edgeMoves; // Compressed move for each edge
+    static const int maxCapLog = 16;
+    std::vector<U32> freeBlocks[maxCapLog + 1]; // Unused blocks for each capLog
+};
+
+/** Multimap from the hash key of a position that is not in the book, to the
+ *  indices of all book positions that have a legal move leading to the position.
+ *  Relations to positions that are in the book are not needed, since those
+ *  are stored as book node edges, so they are not kept in the table.
+ *  Only 32 bits of the hash key are stored, so lookups can return false matches
+ *  that must be rejected by the caller. */
+class ParentTable {
+public:
+    ParentTable();
+
+    /** Add a child hash key to parent node index relation. Duplicates are ignored. */
+    void add(U64 childHash, U32 parentIdx);
+
+    /** Remove a child hash key to parent node index relation, if present. */
+    void remove(U64 childHash, U32 parentIdx);
+
+    /** Call func(U32 parentIdx) for all parents that may correspond to childHash. */
+    template <typename Func>
+    void forEachParent(U64 childHash, Func func) const;
+
+    /** Remove all relations. */
+    void clear();
+
+private:
+    static U32 key(U64 hash) { return (U32)(hash >> 32); }
+
+    void rehash(size_t newSize);
+
+    struct Entry {
+        U32 childKey;
+        U32 parentIdx; // Parent node index + 1, or 0 for an empty entry
+    };
+    std::vector<Entry> entries;
+    size_t mask;
+    size_t used;
+};
+
+/** Writes book node records to the backup file in a background thread.
+ *  Records are collected in memory and appended to the file in batches, when
+ *  enough records are pending or when the oldest pending record is older than
+ *  a time limit. The whole file can also be replaced or compacted. The new
+ *  contents are first written to a temporary file and then renamed, so the backup
+ *  file is a valid book file at all times. After a crash, at most the last
+ *  batch of records is lost, and the file can be read by Book::readFromFile(). */
+class BackupWriter {
+public:
+    /** Constructor. Starts the writer thread. */
+    explicit BackupWriter(const std::string& fileName);
+    /** Destructor. Writes all pending data and stops the writer thread. */
+    ~BackupWriter();
+
+    BackupWriter(const BackupWriter& other) = delete;
+    BackupWriter& operator=(const BackupWriter& other) = delete;
+
+    /** Pending records are written when there are at least "maxPending" of them,
+     *  or when the oldest pending record is "flushIntervalMs" milliseconds old.
+     *  If "sync" is true, written data is also flushed to stable storage. */
+    void setFlushParams(int maxPending, int flushIntervalMs, bool sync);
+
+    /** Queue a record to be appended to the file. */
+    void append(const BookNode::BookSerializeData& bsd);
+
+    /** Queue a replacement of the file contents and of the corresponding edge
+     *  file. If "edges" is empty, the edge file is removed. Records appended
+     *  after this call are appended to the new file. */
+    void replace(std::vector<BookNode::BookSerializeData>&& contents,
+                 std::vector<BookNode::BookSerializeData>&& edges);
+
+    /** Queue a compaction of the file. The writer thread reads back the file and
+     *  keeps only the last record for each hash key, stored at the position of
+     *  the first record for that key. The compacted file therefore starts with
+     *  the same keys in the same order as before, so the edge file stays valid
+     *  and is not modified. Records appended after this call are appended to
+     *  the compacted file. */
+    void compact();
+
+    /** Wait until all queued data has been written to the file. */
+    void flush();
+
+    /** Return number of records appended since the file contents were last replaced. */
+    U64 getNumAppended() const;
+
+private:
+    struct Op {
+        enum Type { APPEND, REPLACE, COMPACT };
+        Type type;
+        std::vector<BookNode::BookSerializeData> data;  // Data to append or replace with
+        std::vector<BookNode::BookSerializeData> edges; // Edge file contents if REPLACE
+    };
+
+    void writerLoop();
+
+    /** Write data to the file. Called by the writer thread. */
+    void writeOp(const Op& op, bool doSync);
+
+    /** Replace the file with a compacted version. Called by the writer thread. */
+    void compactFile(bool doSync);
+
+    /** Replace the contents of "name" with "data", by first writing a temporary
+     *  file and then renaming it. */
+    static void replaceFile(const std::string& name,
+                            const std::vector<BookNode::BookSerializeData>& data,
+                            bool doSync);
+
+    /** Flush "f" to stable storage. Return false on failure. */
+    static bool syncFile(FILE* f);
+
+    /** Rethrow an exception from the writer thread, if there is one. */
+    void checkError();
+
+    const std::string fileName;
+    FILE* file = nullptr;  // Open in append mode. Only used by the writer thread.
+
+    mutable std::mutex mutex;
+    std::condition_variable writeCv;  // Notifies the writer thread
+    std::condition_variable doneCv;   // Notifies threads waiting in flush()
+
+    int maxPending = 4096;
+    std::chrono::milliseconds flushInterval { 1000 };
+    bool sync = false;
+
+    std::deque<Op> ops;                // Data not yet given to the writer thread
+    size_t nPending = 0;               // Number of records in "ops"
+    std::chrono::steady_clock::time_point firstPendingTime;
+    bool writeNow = false;             // True if "ops" should be written without delay
+    bool writing = false;              // True while the writer thread writes data
+    bool stopped = false;
+    U64 nAppended = 0;
+    std::exception_ptr error;
+
+    std::thread thread;
+};
+
+/** Collects polyglot book entries and writes them as a sorted polyglot file,
+ *  using a bounded amount of memory. Entries are buffered in memory, and when
+ *  the buffer is full they are sorted and written to a temporary run file.
+ *  When the polyglot file is written, all runs are merged. Weights for the same
+ *  position and move are added, and the weights for each position are scaled
+ *  to the polyglot weight range. */
+class PolyglotExporter {
+public:
+    /** Constructor. At most "maxBufferedEntries" entries are kept in memory.
+     *  Temporary files are created next to "polyglotFile". */
+    explicit PolyglotExporter(const std::string& polyglotFile,
+                              size_t maxBufferedEntries = 1 << 22);
+    /** Destructor. Removes temporary files. */
+    ~PolyglotExporter();
+
+    PolyglotExporter(const PolyglotExporter& other) = delete;
+    PolyglotExporter& operator=(const PolyglotExporter& other) = delete;
+
+    /** Add a move with a non-negative weight for a polyglot position key. */
+    void addMove(U64 pgHash, U16 pgMove, double weight);
+
+    /** Merge all entries and write the polyglot file. */
+    void write();
+
+    /** Number of temporary run files created so far. */
+    int getNumRuns() const { return runFiles.size(); }
+
+private:
+    struct Entry {
+        U64 hash;
+        U16 move;
+        double weight;
+        bool operator<(const Entry& e) const {
+            if (hash != e.hash)
+                return hash < e.hash;
+            return move < e.move;
+        }
+    };
+
+    /** Sort buffered entries and write them to a new run file. */
+    void writeRun();
+
+    /** Write entries for one position to the polyglot file. */
+    static void writePosition(std::ostream& os, std::vector<Entry>& posEntries);
+
+    const std::string polyglotFile;
+    const size_t maxBuffered;
+    std::vector<Entry> buffer;
+    std::vector<std::string> runFiles;
 };
 
 /** Represents an opening book and methods that can improve the book
@@ -287,10 +613,18 @@ public:
     };
     void setListener(std::unique_ptr<Listener> listener);
 
+    /** Use worker processes in addition to the local search threads when extending
+     *  the book. Each element is either "tcp:host:port", to connect to a worker
+     *  started by "texelutil book worker -port N", or a shell command that starts
+     *  a worker communicating using stdin/stdout, such as
+     *  "numactl -N 1 texelutil book worker" or "ssh host texelutil book worker". */
+    void setRemoteWorkers(const std::vector<std::string>& workerSpecs);
+
     /** Improve the opening book. If startMoves is a non-empty string, only improve the part
      * of the book rooted at the position obtained after playing those moves.
      * This function does not return until no more book moves can be added, which in
-     * practice never happens unless startMoves leads to a position not in the book. */
+     * practice never happens unless startMoves leads to a position not in the book.
+     * Throws ChessParseError if all search workers fail. */
     void improve(const std::string& bookFile, int searchTime, int numThreads,
                  const std::string& startMoves);
 
@@ -327,9 +661,20 @@ public:
     /** Read opening book from file. */
     void readFromFile(const std::string& filename);
 
-    /** Write opening book to file. */
+    /** Write opening book to file. The parent/child relations are written
+     *  to the corresponding edge file. */
     void writeToFile(const std::string& filename);
 
+    /** Name of the file storing parent/child relations for a book file. */
+    static std::string edgeFileName(const std::string& bookFile);
+
+    /** Set parameters controlling how often the backup file is written.
+     *  See BackupWriter::setFlushParams(). */
+    void setBackupParams(int maxPending, int flushIntervalMs, bool sync);
+
+    /** Wait until all changes have been written to the backup file. */
+    void flushBackup();
+
 
     /** Given a hash key, retrieve the corresponding book position,
      * the best moves leading to the position, and the best continuation
@@ -388,7 +733,8 @@ private:
     /** Add root node if not already present. */
     void addRootNode();
 
-    /** Extend book using positions provided by the selector. */
+    /** Extend book using positions provided by the selector.
+     *  Throws ChessParseError if all search workers fail. */
     void extendBook(PositionSelector& selector, int searchTime, int numThreads,
                     TranspositionTable& tt);
 
@@ -417,16 +763,44 @@ private:
      * Return null if there is no matching node in the book. */
     BookNode* getBookNode(U64 hashKey) const;
 
-    /** Initialize parent/child relations in all book nodes
-     *  by following legal moves from pos. */
-    void initPositions(Position& pos);
+    /** Initialize parent/child relations in all book nodes, and the hashToParent
+     *  table, by following legal moves from the starting position. The book is
+     *  processed one ply at a time, using several threads for each ply. */
+    void initPositions();
+
+    /** Link nodes using parent/child relations stored in the edge file.
+     *  "fileNodes" contains the nodes in the order they are stored in the book file.
+     *  Return false, and leave all nodes unlinked, if an edge refers to an
+     *  invalid node or if the sampled verification in verifyEdges() fails. */
+    bool linkFromEdges(const std::vector<BookNode*>& fileNodes,
+                       const std::vector<BookNode::BookSerializeData>& edges);
+
+    /** Check a sample of the child edges against the move generator, by
+     *  following random paths from the root node. Return false if a move is
+     *  illegal, leads to a different position than the child node, or if the
+     *  corresponding parent edge is missing. */
+    bool verifyEdges() const;
+
+    /** Compute the depth of all nodes reachable from the root node,
+     *  and mark them as initialized. */
+    void initDepths();
 
     /** Find all children of pos in book and update parent/child pointers. */
     void setChildRefs(Position& pos);
 
-    /** Write a book node to the backup file. */
+    /** Write a book node to the backup file. The record is written by the
+     *  backup writer thread. If the backup file contains many obsolete records,
+     *  a compacted version of the file is also written. */
     void writeBackup(const BookNode& bookNode);
 
+    /** Serialize all book nodes in book file format, and all parent/child
+     *  relations in edge file format. */
+    void serialize(std::vector<BookNode::BookSerializeData>& data,
+                   std::vector<BookNode::BookSerializeData>& edges) const;
+
+    /** Checksum of the hash keys of the first "nNodes" records in "data". */
+    static U64 nodeChecksum(const BookNode::BookSerializeData* data, size_t nNodes);
+
     struct BookWeight {
         BookWeight(double wW = 0.0, double wB = 0.0) : weightWhite(wW), weightBlack(wB) {}
         BookWeight& operator+=(const BookWeight& bw) {
@@ -437,13 +811,15 @@ private:
         double weightWhite; // Weight when book player is white
         double weightBlack; // Weight when book player is black
     };
-    using WeightInfo = std::unordered_map<U64,BookWeight>;
+    using WeightInfo = std::vector<BookWeight>; // Indexed by BookNodeTable node index
 
     /** Compute book weights for all nodes in the tree. weightWhite for a node is computed as:
      *    weightWhite = sum(exp(-errB / errOtherExpConst))
      *  where the sum is taken over all descendant leaf nodes with errW <= maxErrSelf
      *  and errW,errB is the maximum path error for all nodes from this node to the leaf node.
-     *  weightBlack is computed in an analogous way. */
+     *  weightBlack is computed in an analogous way. The leaf nodes are processed
+     *  in fixed size blocks by several threads. The block sums are added in block
+     *  order, so the result does not depend on the number of threads. */
     void computeWeights(int maxErrSelf, double errOtherExpConst,
                         WeightInfo& weights);
 
@@ -470,22 +846,18 @@ private:
      * The backup file is a valid book file at all times. */
     std::string backupFile;
 
+    /** Writes to the backup file. Null if backup is disabled. */
+    std::unique_ptr<BackupWriter> backupWriter;
+
     /** All positions in the opening book. */
-    std::unordered_map<U64, std::shared_ptr<BookNode>> bookNodes;
+    BookNodeTable bookNodes;
 
-    /** Map from position hash code to all parent book position hash codes. */
-    struct H2P {
-        H2P(U64 c, U64 p) : childHash(c), parentHash(p) {}
-        bool operator==(const H2P& o) const {
-            return childHash == o.childHash && parentHash == o.parentHash;
-        }
-        struct HashFun { // Make sure all elements with same childHash end up in the same bucket
-            std::size_t operator()(const H2P& h) const { return h.childHash; }
-        };
-        U64 childHash;
-        U64 parentHash;
-    };
-    std::unordered_set<H2P, H2P::HashFun> hashToParent;
+    /** Map from position hash code to all parent book positions. */
+    ParentTable hashToParent;
+
+    /** False if hashToParent has not been computed after reading the book
+     *  from file. It is then computed when first needed. */
+    bool parentTableValid = true;
 
     BookData bookData;
 
@@ -496,29 +868,56 @@ private:
 
     /** Handle notifications when book is changed. */
     std::unique_ptr<Listener> listener;
+
+    /** Worker processes to use in extendBook(). */
+    std::vector<std::string> remoteWorkers;
+};
+
+/** Thrown by SearchWorker::analyze() if a position could not be analyzed,
+ *  but the worker can still be used to analyze other positions. */
+class WorkUnitError : public ChessParseError {
+public:
+    explicit WorkUnitError(const std::string& msg) : ChessParseError(msg) {}
+};
+
+/** Analyzes positions for the SearchScheduler. */
+class SearchWorker {
+public:
+    explicit SearchWorker(int instanceNo0) : instanceNo(instanceNo0) {}
+    virtual ~SearchWorker() {}
+
+    SearchWorker(const SearchWorker& other) = delete;
+    SearchWorker& operator=(const SearchWorker& other) = delete;
+
+    /** Analyze position and return the best move and score.
+     *  Throws WorkUnitError if this position could not be analyzed, or
+     *  another exception if the worker is unable to perform any more searches. */
+    virtual Move analyze(const std::vector<Move>& gameMoves,
+                         const std::vector<Move>& movesToSearch,
+                         int searchTime) = 0;
+
+    /** Stop search as soon as possible. */
+    virtual void abort() = 0;
+
+    int instNo() const { return instanceNo; }
+
+private:
+    const int instanceNo;
 };
 
 /** Calls Search::iterativeDeepening() to analyze a position. */
-class SearchRunner {
+class SearchRunner : public SearchWorker {
 public:
     /** Constructor. */
     SearchRunner(int instanceNo, TranspositionTable& tt);
 
-    SearchRunner(const SearchRunner& other) = delete;
-    SearchRunner& operator=(const SearchRunner& other) = delete;
-
-    /** Analyze position and return the best move and score. */
     Move analyze(const std::vector<Move>& gameMoves,
                  const std::vector<Move>& movesToSearch,
-                 int searchTime);
+                 int searchTime) override;
 
-    /** Stop search as soon as possible. */
-    void abort();
-
-    int instNo() const { return instanceNo; }
+    void abort() override;
 
 private:
-    int instanceNo;
     Evaluate::EvalHashTables et;
     KillerTable kt;
     History ht;
@@ -541,10 +940,10 @@ public:
     /** Destructor. Waits for all threads to terminate. */
     ~SearchScheduler();
 
-    /** Add a SearchRunner. */
-    void addWorker(std::unique_ptr<SearchRunner> sr);
+    /** Add a SearchWorker. */
+    void addWorker(std::unique_ptr<SearchWorker> sw);
 
-    /** Start the worker threads. Creates one thread for each SearchRunner object. */
+    /** Start the worker threads. Creates one thread for each SearchWorker object. */
     void startWorkers(Book::Listener* listener);
 
     /** Stop worker threads as soon as possible. */
@@ -553,6 +952,9 @@ public:
     /** Return true if worker threads are being aborted. */
     bool isAborting() const;
 
+    /** Return true if at least one worker is still able to perform searches. */
+    bool hasWorkers() const;
+
     struct WorkUnit {
         // Input
         int id;
@@ -564,6 +966,7 @@ public:
         // Output
         Move bestMove;         // Best move and corresponding score
         int instNo;            // Instance number that ran this WorkUnit
+        bool failed = false;   // True if no result could be computed
 
         bool operator<(const WorkUnit& other) const { return id < other.id; }
     };
@@ -582,16 +985,22 @@ public:
     void getQueueData(Book::QueueData& queueData) const;
 
 private:
-    /** Worker thread main loop. */
-    void workerLoop(SearchRunner& sr, Book::Listener* listener);
+    /** Worker thread main loop. If the worker fails, its current WorkUnit
+     *  is given to another worker and the thread terminates. If no other
+     *  worker remains, all queued WorkUnits are completed as failed. */
+    void workerLoop(SearchWorker& sw, Book::Listener* listener);
+
+    /** Move a WorkUnit to the completed queue. Caller must hold the mutex. */
+    void completeWorkUnit(const WorkUnit& wu);
 
     /** Wait for all WorkUnits to finish and then stops all threads. */
     void waitWorkers();
 
     bool stopped;
+    int nAlive;   // Number of workers still able to perform searches
     mutable std::mutex mutex;
 
-    std::vector<std::unique_ptr<SearchRunner>> workers;
+    std::vector<std::unique_ptr<SearchWorker>> workers;
     std::vector<std::unique_ptr<std::thread>> threads;
 
     std::deque<WorkUnit> pending;
@@ -609,14 +1018,15 @@ private:
 // ----------------------------------------------------------------------------
 
 inline
-BookNode::BookNode(U64 hashKey0, bool rootNode)
+BookNode::BookNode(BookNodeTable& table, U32 index, U64 hashKey0, bool rootNode)
     : hashKey(hashKey0), depth(INT_MAX),
-      searchScore(INVALID_SCORE), searchTime(0),
+      bestNonBookMove(0), searchScore(INVALID_SCORE), searchTime(0),
       negaMaxScore(INVALID_SCORE),
       expansionCostWhite(INVALID_SCORE),
       expansionCostBlack(INVALID_SCORE),
       pathErrorWhite(INVALID_SCORE),
       pathErrorBlack(INVALID_SCORE),
+      table(&table), index(index),
       state(BookNode::EMPTY) {
     if (rootNode)
         setRootNode();
@@ -627,6 +1037,11 @@ BookNode::getHashKey() const {
     return hashKey;
 }
 
+inline U32
+BookNode::getIndex() const {
+    return index;
+}
+
 inline int
 BookNode::getDepth() const {
     return depth;
@@ -659,15 +1074,14 @@ BookNode::getPathErrorBlack() const {
 
 inline void
 BookNode::serialize(BookSerializeData& bsd) const {
-    U16 move = bestNonBookMove.getCompressedMove();
-    Serializer::serialize<sizeof(bsd.data)>(bsd.data, hashKey, move, searchScore, searchTime);
+    Serializer::serialize<sizeof(bsd.data)>(bsd.data, hashKey, bestNonBookMove,
+                                            searchScore, searchTime);
 }
 
 inline void
 BookNode::deSerialize(const BookSerializeData& bsd) {
-    U16 move;
-    Serializer::deSerialize<sizeof(bsd.data)>(bsd.data, hashKey, move, searchScore, searchTime);
-    bestNonBookMove.setFromCompressed(move);
+    Serializer::deSerialize<sizeof(bsd.data)>(bsd.data, hashKey, bestNonBookMove,
+                                              searchScore, searchTime);
     state = DESERIALIZED;
 }
 
@@ -678,20 +1092,104 @@ BookNode::setRootNode() {
     pathErrorBlack = 0;
 }
 
+inline BookNode::EdgeRange<BookNode::ChildInfo>
+BookNode::getChildren() const {
+    return EdgeRange<ChildInfo>(*table, children);
+}
+
+inline BookNode::EdgeRange<BookNode::ParentInfo>
+BookNode::getParents() const {
+    return EdgeRange<ParentInfo>(*table, parents);
+}
+
+template <typename Info>
+inline Info
+BookNode::EdgeRange<Info>::iterator::operator*() const {
+    BookNode& node = const_cast<BookNodeTable*>(table)->operator[](table->edgeNode(idx));
+    return Info(table->edgeMove(idx), &node);
+}
+
+inline BookNode*
+BookNode::getChild(U16 move) const {
+    U32 lo = children.begin;
+    U32 hi = children.begin + children.size;
+    while (lo < hi) {
+        U32 mid = (lo + hi) / 2;
+        if (table->edgeMove(mid) < move)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo == children.begin + children.size || table->edgeMove(lo) != move)
+        return nullptr;
+    return &(*table)[table->edgeNode(lo)];
+}
+
 inline void
 BookNode::addChild(U16 move, BookNode* child) {
-    children.insert(std::make_pair(move, child));
+    assert(child->table == table);
+    U32 lo = children.begin;
+    U32 hi = children.begin + children.size;
+    while (lo < hi) {
+        U32 mid = (lo + hi) / 2;
+        if (table->edgeMove(mid) < move)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo == children.begin + children.size || table->edgeMove(lo) != move)
+        table->insertEdge(children, lo - children.begin, move, child->index);
+}
+
+inline void
+BookNode::addParent(U16 move, BookNode* parent, bool updDepth) {
+    assert(parent->table == table);
+    auto less = [this](U32 e, U16 move, U32 node) {
+        U16 m = table->edgeMove(e);
+        if (m != move)
+            return m < move;
+        return table->edgeNode(e) < node;
+    };
+    U32 lo = parents.begin;
+    U32 hi = parents.begin + parents.size;
+    while (lo < hi) {
+        U32 mid = (lo + hi) / 2;
+        if (less(mid, move, parent->index))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo == parents.begin + parents.size ||
+        table->edgeMove(lo) != move || table->edgeNode(lo) != parent->index)
+        table->insertEdge(parents, lo - parents.begin, move, parent->index);
+    if (updDepth)
+        updateDepth();
+}
+
+inline void
+BookNode::reserveChildren(U32 n) {
+    table->reserveEdges(children, n);
 }
 
 inline void
-BookNode::addParent(U16 move, BookNode* parent) {
-    parents.insert(ParentInfo(move, parent));
-    updateDepth();
+BookNode::reserveParents(U32 n) {
+    table->reserveEdges(parents, n);
+}
+
+inline void
+BookNode::clearEdges() {
+    children = EdgeList();
+    parents = EdgeList();
+}
+
+inline void
+BookNode::setDepth(int d) {
+    depth = d;
 }
 
 inline BookNode::State
 BookNode::getState() const {
-    return state;
+    return (State)state;
 }
 
 inline void
@@ -699,9 +1197,11 @@ BookNode::setState(State s) {
     state = s;
 }
 
-inline const Move&
+inline Move
 BookNode::getBestNonBookMove() const {
-    return bestNonBookMove;
+    Move m;
+    m.setFromCompressed(bestNonBookMove);
+    return m;
 }
 
 inline const S16
@@ -715,11 +1215,51 @@ BookNode::getSearchTime() const {
 }
 
 
+inline BookNode*
+BookNodeTable::get(U64 hashKey) const {
+    for (size_t i = hashKey & mask; ; i = (i + 1) & mask) {
+        U32 s = slots[i];
+        if (s == 0)
+            return nullptr;
+        const BookNode& node = nodes[s - 1];
+        if (node.getHashKey() == hashKey)
+            return const_cast<BookNode*>(&node);
+    }
+}
+
+inline U32
+BookNodeTable::getIndex(U64 hashKey) const {
+    for (size_t i = hashKey & mask; ; i = (i + 1) & mask) {
+        U32 s = slots[i];
+        assert(s != 0);
+        if (nodes[s - 1].getHashKey() == hashKey)
+            return s - 1;
+    }
+}
+
+template <typename Func>
+inline void
+ParentTable::forEachParent(U64 childHash, Func func) const {
+    const U32 k = key(childHash);
+    for (size_t i = k & mask; ; i = (i + 1) & mask) {
+        const Entry& e = entries[i];
+        if (e.parentIdx == 0)
+            return;
+        if (e.childKey == k)
+            func(e.parentIdx - 1);
+    }
+}
+
 inline void
 Book::setListener(std::unique_ptr<Listener> listener0) {
     listener = std::move(listener0);
 }
 
+inline void
+Book::setRemoteWorkers(const std::vector<std::string>& workerSpecs) {
+    remoteWorkers = workerSpecs;
+}
+
 } // Namespace BookBuild
 
 #endif /* BOOKBUILD_HPP_ */
@@ -0,0 +1,456 @@
+/*
+    Texel - A UCI chess engine.
+    Copyright (C) 2026  Peter Österlund, peterosterlund2@gmail.com
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * bookworker.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: petero
+ */
+
+#include "bookworker.hpp"
+#include "transpositionTable.hpp"
+#include "moveGen.hpp"
+#include "textio.hpp"
+#include "chessParseError.hpp"
+
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <cerrno>
+#include <unistd.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#endif
+
+namespace BookBuild {
+
+#if !defined(_WIN32) && defined(MSG_NOSIGNAL)
+static const int sendFlags = MSG_NOSIGNAL;
+#else
+static const int sendFlags = 0;
+#endif
+
+FdConnection::FdConnection(int inFd0, int outFd0, bool closeFds0)
+    : inFd(inFd0), outFd(outFd0), ownFds(closeFds0), outSocket(false), buf(4096) {
+#ifndef _WIN32
+    struct stat st;
+    outSocket = fstat(outFd, &st) == 0 && S_ISSOCK(st.st_mode);
+#endif
+}
+
+FdConnection::~FdConnection() {
+    closeFds();
+}
+
+void
+FdConnection::closeFds() {
+    if (!ownFds)
+        return;
+    if (inFd >= 0)
+        ::close(inFd);
+    if (outFd >= 0 && outFd != inFd)
+        ::close(outFd);
+    inFd = outFd = -1;
+}
+
+void
+FdConnection::writeLine(const std::string& line) {
+    std::string data = line + '\n';
+    const char* p = data.c_str();
+    size_t left = data.size();
+    while (left > 0) {
+#ifndef _WIN32
+        // Use send() for sockets, so that a closed connection does not raise SIGPIPE
+        auto n = outSocket ? ::send(outFd, p, left, sendFlags) : ::write(outFd, p, left);
+#else
+        auto n = ::write(outFd, p, left);
+#endif
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            throw ChessParseError("Failed to write to worker connection");
+        }
+        p += n;
+        left -= n;
+    }
+}
+
+bool
+FdConnection::readLine(std::string& line) {
+    line.clear();
+    while (true) {
+        for (size_t i = bufBegin; i < bufEnd; i++) {
+            if (buf[i] == '\n') {
+                line.append(buf.data() + bufBegin, i - bufBegin);
+                bufBegin = i + 1;
+                if (!line.empty() && line.back() == '\r')
+                    line.pop_back();
+                return true;
+            }
+        }
+        line.append(buf.data() + bufBegin, bufEnd - bufBegin);
+        bufBegin = bufEnd = 0;
+        auto n = ::read(inFd, buf.data(), buf.size());
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        bufEnd = n;
+    }
+}
+
+#ifndef _WIN32
+/** Connection to the stdin/stdout of a child process. */
+class ProcessConnection : public FdConnection {
+public:
+    ProcessConnection(int inFd, int outFd, pid_t pid0)
+        : FdConnection(inFd, outFd, true), pid(pid0) {}
+
+    /** Close the pipes and wait for the child process to terminate. */
+    ~ProcessConnection() {
+        closeFds();
+        waitpid(pid, nullptr, 0);
+    }
+
+private:
+    pid_t pid;
+};
+
+static void
+setNoDelay(int fd) {
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+#endif
+
+std::unique_ptr<WorkerConnection>
+openWorkerConnection(const std::string& spec) {
+    if (startsWith(spec, "tcp:")) {
+        size_t idx = spec.rfind(':');
+        int port;
+        if (idx <= 4 || !str2Num(spec.substr(idx + 1), port))
+            throw ChessParseError("Invalid worker specification: " + spec);
+        return connectWorker(spec.substr(4, idx - 4), port);
+    }
+    return startWorkerProcess(spec);
+}
+
+std::unique_ptr<WorkerConnection>
+startWorkerProcess(const std::string& command) {
+#ifdef _WIN32
+    throw ChessParseError("Worker processes not supported on this platform");
+#else
+    int toChild[2];
+    int fromChild[2];
+    if (pipe(toChild))
+        throw ChessParseError("Failed to create pipe");
+    if (pipe(fromChild)) {
+        ::close(toChild[0]);
+        ::close(toChild[1]);
+        throw ChessParseError("Failed to create pipe");
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        for (int fd : { toChild[0], toChild[1], fromChild[0], fromChild[1] })
+            ::close(fd);
+        throw ChessParseError("Failed to start worker: " + command);
+    }
+    if (pid == 0) {
+        dup2(toChild[0], 0);
+        dup2(fromChild[1], 1);
+        for (int fd : { toChild[0], toChild[1], fromChild[0], fromChild[1] })
+            ::close(fd);
+        execl("/bin/sh", "sh", "-c", command.c_str(), (char*)nullptr);
+        _exit(127);
+    }
+    ::close(toChild[0]);
+    ::close(fromChild[1]);
+    // Prevent later started workers from inheriting the pipes
+    fcntl(toChild[1], F_SETFD, FD_CLOEXEC);
+    fcntl(fromChild[0], F_SETFD, FD_CLOEXEC);
+    return make_unique<ProcessConnection>(fromChild[0], toChild[1], pid);
+#endif
+}
+
+std::unique_ptr<WorkerConnection>
+connectWorker(const std::string& host, int port) {
+#ifdef _WIN32
+    throw ChessParseError("Worker connections not supported on this platform");
+#else
+    addrinfo hints {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* addrs = nullptr;
+    if (getaddrinfo(host.c_str(), num2Str(port).c_str(), &hints, &addrs) != 0)
+        throw ChessParseError("Unknown worker host: " + host);
+    int fd = -1;
+    for (addrinfo* a = addrs; a; a = a->ai_next) {
+        fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (fd < 0)
+            continue;
+        if (connect(fd, a->ai_addr, a->ai_addrlen) == 0)
+            break;
+        ::close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(addrs);
+    if (fd < 0)
+        throw ChessParseError("Failed to connect to worker: " + host + ":" + num2Str(port));
+    setNoDelay(fd);
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    return make_unique<FdConnection>(fd, fd, true);
+#endif
+}
+
+// ----------------------------------------------------------------------------
+
+RemoteSearchWorker::RemoteSearchWorker(int instanceNo, std::unique_ptr<WorkerConnection> conn0)
+    : SearchWorker(instanceNo), conn(std::move(conn0)) {
+}
+
+RemoteSearchWorker::~RemoteSearchWorker() {
+    try {
+        std::lock_guard<std::mutex> L(writeMutex);
+        conn->writeLine("quit");
+    } catch (const ChessParseError&) {
+    }
+}
+
+Move
+RemoteSearchWorker::analyze(const std::vector<Move>& gameMoves,
+                            const std::vector<Move>& movesToSearch,
+                            int searchTime) {
+    std::string cmd = "search " + num2Str(searchTime);
+    for (const Move& m : gameMoves)
+        cmd += " " + TextIO::moveToUCIString(m);
+    cmd += " :";
+    for (const Move& m : movesToSearch)
+        cmd += " " + TextIO::moveToUCIString(m);
+    {
+        std::lock_guard<std::mutex> L(writeMutex);
+        conn->writeLine(cmd);
+    }
+
+    std::string reply;
+    if (!conn->readLine(reply))
+        throw ChessParseError("Connection to worker " + num2Str(instNo()) + " closed");
+    if (startsWith(reply, "error"))
+        throw WorkUnitError("Worker " + num2Str(instNo()) + ": " + reply);
+    std::vector<std::string> words;
+    splitString(reply, words);
+    int score;
+    if (words.size() != 3 || words[0] != "result" || !str2Num(words[2], score))
+        throw ChessParseError("Invalid reply from worker: " + reply);
+    Move bestMove;
+    if (words[1] != "--")
+        bestMove = TextIO::uciStringToMove(words[1]);
+    bestMove.setScore(score);
+    return bestMove;
+}
+
+void
+RemoteSearchWorker::abort() {
+    try {
+        std::lock_guard<std::mutex> L(writeMutex);
+        conn->writeLine("stop");
+    } catch (const ChessParseError&) {
+        // Connection lost. analyze() reports the error.
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+/** Convert a UCI move string to a legal move in pos. Return an empty move
+ *  if the move is not legal. */
+static Move
+getLegalMove(Position& pos, const std::string& moveStr) {
+    Move m = TextIO::uciStringToMove(moveStr);
+    MoveList moves;
+    MoveGen::pseudoLegalMoves(pos, moves);
+    MoveGen::removeIllegal(pos, moves);
+    for (int i = 0; i < moves.size; i++)
+        if (moves[i] == m)
+            return moves[i];
+    return Move();
+}
+
+bool
+BookWorker::parseSearchCommand(const std::string& cmd,
+                               std::vector<Move>& gameMoves,
+                               std::vector<Move>& movesToSearch,
+                               int& searchTime) {
+    std::vector<std::string> words;
+    splitString(cmd, words);
+    if (words.size() < 3 || words[0] != "search" || !str2Num(words[1], searchTime))
+        return false;
+    gameMoves.clear();
+    movesToSearch.clear();
+    Position pos = TextIO::readFEN(TextIO::startPosFEN);
+    UndoInfo ui;
+    size_t i = 2;
+    for ( ; i < words.size() && words[i] != ":"; i++) {
+        Move m = getLegalMove(pos, words[i]);
+        if (m.isEmpty())
+            return false;
+        gameMoves.push_back(m);
+        pos.makeMove(m, ui);
+    }
+    if (i >= words.size())
+        return false;
+    for (i++; i < words.size(); i++) {
+        Move m = getLegalMove(pos, words[i]);
+        if (m.isEmpty())
+            return false;
+        movesToSearch.push_back(m);
+    }
+    return true;
+}
+
+void
+BookWorker::run(WorkerConnection& conn, TranspositionTable& tt) {
+    SearchRunner sr(0, tt);
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<std::string> commands;
+    bool quit = false;
+
+    // Searches are run in a separate thread, so that stop commands
+    // can be handled while searching.
+    std::thread searchThread([&]() {
+        while (true) {
+            std::string cmd;
+            {
+                std::unique_lock<std::mutex> L(mutex);
+                while (!quit && commands.empty())
+                    cv.wait(L);
+                if (quit)
+                    return;
+                cmd = commands.front();
+                commands.pop_front();
+            }
+            std::vector<Move> gameMoves, movesToSearch;
+            int searchTime;
+            std::string reply;
+            if (parseSearchCommand(cmd, gameMoves, movesToSearch, searchTime)) {
+                Move m = sr.analyze(gameMoves, movesToSearch, searchTime);
+                reply = "result " + (m.isEmpty() ? std::string("--") : TextIO::moveToUCIString(m)) +
+                        " " + num2Str(m.score());
+            } else {
+                reply = "error Invalid command: " + cmd;
+            }
+            try {
+                conn.writeLine(reply);
+            } catch (const ChessParseError&) {
+                return;
+            }
+        }
+    });
+
+    std::string line;
+    while (conn.readLine(line)) {
+        if (startsWith(line, "search")) {
+            std::lock_guard<std::mutex> L(mutex);
+            commands.push_back(line);
+            cv.notify_all();
+        } else if (line == "stop") {
+            sr.abort();
+        } else if (line == "quit") {
+            break;
+        }
+    }
+    sr.abort();
+    {
+        std::lock_guard<std::mutex> L(mutex);
+        quit = true;
+        cv.notify_all();
+    }
+    searchThread.join();
+}
+
+void
+BookWorker::serve(const std::string& bindAddr, int port, int hashSizeMB, int maxConnections) {
+#ifdef _WIN32
+    throw ChessParseError("Worker connections not supported on this platform");
+#else
+    addrinfo hints {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    addrinfo* addrs = nullptr;
+    if (getaddrinfo(bindAddr.c_str(), num2Str(port).c_str(), &hints, &addrs) != 0)
+        throw ChessParseError("Unknown bind address: " + bindAddr);
+    int sock = -1;
+    for (addrinfo* a = addrs; a; a = a->ai_next) {
+        sock = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (sock < 0)
+            continue;
+        int one = 1;
+        setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(sock, a->ai_addr, a->ai_addrlen) == 0 && listen(sock, 16) == 0)
+            break;
+        ::close(sock);
+        sock = -1;
+    }
+    freeaddrinfo(addrs);
+    if (sock < 0)
+        throw ChessParseError("Failed to listen on " + bindAddr + ":" + num2Str(port));
+
+    const U64 nEntries = (U64)hashSizeMB * (1 << 20) / sizeof(TranspositionTable::TTEntry);
+    // Shared with the connection threads, which may outlive this function
+    auto nConnections = std::make_shared<std::atomic<int>>(0);
+    while (true) {
+        int fd = accept(sock, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            ::close(sock);
+            throw ChessParseError("Failed to accept connection");
+        }
+        if (*nConnections >= maxConnections) {
+            std::cerr << "Too many worker connections, rejecting new connection" << std::endl;
+            ::close(fd);
+            continue;
+        }
+        (*nConnections)++;
+        setNoDelay(fd);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        std::thread([fd,nEntries,nConnections]() {
+            try {
+                FdConnection conn(fd, fd, true);
+                TranspositionTable tt(nEntries);
+                run(conn, tt);
+            } catch (const std::exception& ex) {
+                std::cerr << "Worker connection failed: " << ex.what() << std::endl;
+            }
+            (*nConnections)--;
+        }).detach();
+    }
+#endif
+}
+
+} // Namespace BookBuild
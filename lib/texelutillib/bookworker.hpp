@@ -0,0 +1,149 @@
+/*
+    Texel - A UCI chess engine.
+    Copyright (C) 2026  Peter Österlund, peterosterlund2@gmail.com
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * bookworker.hpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: petero
+ */
+
+#ifndef BOOKWORKER_HPP_
+#define BOOKWORKER_HPP_
+
+#include "bookbuild.hpp"
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class TranspositionTable;
+
+namespace BookBuild {
+
+/** A bidirectional line based connection between the book builder and a
+ *  worker process. The protocol is text based. The book builder sends:
+ *    search searchTime gameMove1 gameMove2 ... : searchMove1 searchMove2 ...
+ *    stop
+ *    quit
+ *  where moves are in UCI format. For each search command the worker replies:
+ *    result bestMove score
+ *  where bestMove is "--" if there is no best move. If the search command is
+ *  invalid, the worker replies "error message". The stop command makes the
+ *  current and all later searches finish as soon as possible. */
+class WorkerConnection {
+public:
+    virtual ~WorkerConnection() {}
+
+    /** Send a line of text. A newline character is appended. */
+    virtual void writeLine(const std::string& line) = 0;
+
+    /** Read a line of text, without the trailing newline character.
+     *  Return false if the connection has been closed. */
+    virtual bool readLine(std::string& line) = 0;
+};
+
+/** A WorkerConnection using file descriptors, such as pipes and sockets. */
+class FdConnection : public WorkerConnection {
+public:
+    /** Constructor. If closeFds is true, the file descriptors are
+     *  closed by the destructor. */
+    FdConnection(int inFd, int outFd, bool closeFds);
+    ~FdConnection();
+
+    FdConnection(const FdConnection& other) = delete;
+    FdConnection& operator=(const FdConnection& other) = delete;
+
+    void writeLine(const std::string& line) override;
+    bool readLine(std::string& line) override;
+
+protected:
+    /** Close the file descriptors if they are owned by this object. */
+    void closeFds();
+
+private:
+    int inFd;
+    int outFd;
+    bool ownFds;
+    bool outSocket; // True if outFd is a socket
+    std::vector<char> buf;
+    size_t bufBegin = 0;
+    size_t bufEnd = 0;
+};
+
+/** Create a connection from a worker specification. The specification is either
+ *  "tcp:host:port" or a shell command that starts a worker process. */
+std::unique_ptr<WorkerConnection> openWorkerConnection(const std::string& spec);
+
+/** Start "command" using the shell and communicate using its stdin/stdout.
+ *  The caller should ignore SIGPIPE, otherwise writing to a worker process
+ *  that has terminated kills the calling process. */
+std::unique_ptr<WorkerConnection> startWorkerProcess(const std::string& command);
+
+/** Connect to a worker listening on a TCP port. */
+std::unique_ptr<WorkerConnection> connectWorker(const std::string& host, int port);
+
+
+/** A SearchWorker that sends search requests to a worker process. */
+class RemoteSearchWorker : public SearchWorker {
+public:
+    /** Constructor. */
+    RemoteSearchWorker(int instanceNo, std::unique_ptr<WorkerConnection> conn);
+
+    /** Destructor. Tells the worker process to terminate. */
+    ~RemoteSearchWorker();
+
+    Move analyze(const std::vector<Move>& gameMoves,
+                 const std::vector<Move>& movesToSearch,
+                 int searchTime) override;
+
+    void abort() override;
+
+private:
+    std::unique_ptr<WorkerConnection> conn;
+    std::mutex writeMutex;
+};
+
+
+/** The worker side of the book search protocol. */
+class BookWorker {
+public:
+    /** Handle commands from "conn" until a quit command is received or
+     *  the connection is closed. Searches are performed using "tt". */
+    static void run(WorkerConnection& conn, TranspositionTable& tt);
+
+    /** Listen for connections on a TCP port at the local address "bindAddr".
+     *  There is no authentication, so only bind to an address reachable from
+     *  trusted hosts. Each connection is handled by a separate thread, using its
+     *  own transposition table of size "hashSizeMB" megabytes. Connections beyond
+     *  "maxConnections" simultaneous connections are rejected. This function
+     *  never returns. */
+    static void serve(const std::string& bindAddr, int port, int hashSizeMB,
+                      int maxConnections);
+
+    /** Parse a search command. Return false if the command is invalid. */
+    static bool parseSearchCommand(const std::string& cmd,
+                                   std::vector<Move>& gameMoves,
+                                   std::vector<Move>& movesToSearch,
+                                   int& searchTime);
+};
+
+} // Namespace BookBuild
+
+#endif /* BOOKWORKER_HPP_ */
@@ -27,6 +27,7 @@
 #include "textio.hpp"
 #include <stdexcept>
 #include <cassert>
+#include <cctype>
 #include <unordered_map>
 #include <functional>
 
@@ -38,9 +39,14 @@ PgnToken::PgnToken(int type0, const std::string& token0)
 
 // --------------------------------------------------------------------------------
 
-PgnScanner::PgnScanner(std::istream& is0)
-    : is(is0), col0(true), eofReached(false),
-      hasReturnedChar(false), returnedChar(0) {
+PgnScanner::PgnScanner(std::istream& is0, bool mainLineOnly0)
+    : is(&is0), buf(64 * 1024), cur(nullptr), end(nullptr),
+      col0(true), eofReached(false), mainLineOnly(mainLineOnly0) {
+}
+
+PgnScanner::PgnScanner(const char* data, size_t len, bool mainLineOnly0)
+    : is(nullptr), cur(data), end(data + len),
+      col0(true), eofReached(false), mainLineOnly(mainLineOnly0) {
 }
 
 void
@@ -48,49 +54,61 @@ PgnScanner::putBack(const PgnToken& tok) {
     savedTokens.push_back(tok);
 }
 
-char
-PgnScanner::getNextChar() {
-    int c;
-    c = is.get();
-    if (eofReached || (c == EOF))
-        throw std::out_of_range("");
-    return c;
+bool
+PgnScanner::fillBuffer() {
+    if (!is || !*is)
+        return false;
+    is->read(buf.data(), buf.size());
+    size_t len = is->gcount();
+    cur = buf.data();
+    end = cur + len;
+    return len > 0;
 }
 
-char
+int
 PgnScanner::getTokenChar() {
-    if (hasReturnedChar) {
-        hasReturnedChar = false;
-        return returnedChar;
-    }
-    try {
-        while (true) {
-            char c = getNextChar();
-            if (c == '%' && col0) {
-                while (true) {
-                    char nextChar = getNextChar();
-                    if ((nextChar == '\n') || (nextChar == '\r'))
-                        break;
-                }
-                col0 = true;
-            } else {
-                col0 = ((c == '\n') || (c == '\r'));
-                return c;
+    while (true) {
+        if (cur == end && !fillBuffer()) {
+            if (eofReached)
+                return -1;
+            eofReached = true;
+            return '\n'; // Terminating whitespace simplifies the tokenizer
+        }
+        char c = *cur++;
+        if (c == '%' && col0) {
+            while (true) {
+                if (cur == end && !fillBuffer())
+                    break;
+                char nextChar = *cur++;
+                if ((nextChar == '\n') || (nextChar == '\r'))
+                    break;
             }
+            col0 = true;
+        } else {
+            col0 = ((c == '\n') || (c == '\r'));
+            return c;
         }
-    } catch (const std::out_of_range&) {
-        if (eofReached)
-            throw;
-        eofReached = true;
-        return '\n'; // Terminating whitespace simplifies the tokenizer
     }
 }
 
+template <typename Pred>
 void
-PgnScanner::returnTokenChar(char c) {
-    assert(!hasReturnedChar);
-    hasReturnedChar = true;
-    returnedChar = c;
+PgnScanner::scanWhile(Pred pred, std::string* str) {
+    while (true) {
+        if (cur == end && !fillBuffer())
+            return;
+        const char* p = cur;
+        while ((p < end) && (*p != '\n') && (*p != '\r') && pred(*p))
+            p++;
+        if (p > cur) {
+            if (str)
+                str->append(cur, p);
+            cur = p;
+            col0 = false;
+        }
+        if (p < end)
+            return;
+    }
 }
 
 PgnToken
@@ -101,110 +119,170 @@ PgnScanner::nextToken() {
         savedTokens.pop_back();
         return ret;
     }
+    return readToken(false);
+}
+
+PgnToken
+PgnScanner::nextTokenDropComments() {
+    while (savedTokens.size() > 0) {
+        PgnToken tok = nextToken();
+        if (tok.type != PgnToken::COMMENT)
+            return tok;
+    }
+    return readToken(true);
+}
 
+PgnToken
+PgnScanner::readToken(bool dropComments) {
     PgnToken ret(PgnToken::END, "");
-    try {
-        while (true) {
-            char c = getTokenChar();
-            if (isspace(c)) {
-                // Skip
-            } else if (c == '.') {
-                ret.type = PgnToken::PERIOD;
-                break;
-            } else if (c == '*') {
-                ret.type = PgnToken::ASTERISK;
-                break;
-            } else if (c == '[') {
-                ret.type = PgnToken::LEFT_BRACKET;
-                break;
-            } else if (c == ']') {
-                ret.type = PgnToken::RIGHT_BRACKET;
-                break;
-            } else if (c == '(') {
-                ret.type = PgnToken::LEFT_PAREN;
-                break;
-            } else if (c == ')') {
-                ret.type = PgnToken::RIGHT_PAREN;
-                break;
-            } else if (c == '{') {
-                ret.type = PgnToken::COMMENT;
-                std::string sb;
-                while ((c = getTokenChar()) != '}')
-                    sb += c;
-                ret.token = sb;
-                break;
-            } else if (c == ';') {
-                ret.type = PgnToken::COMMENT;
-                std::string sb;
-                while (true) {
-                    c = getTokenChar();
-                    if ((c == '\n') || (c == '\r'))
-                        break;
-                    sb += c;
-                }
-                ret.token = sb;
+    std::string* sb = &ret.token;
+    while (true) {
+        int c = getTokenChar();
+        if (c < 0) {
+            break;
+        } else if (isspace(c)) {
+            // Skip
+        } else if (c == '.') {
+            ret.type = PgnToken::PERIOD;
+            return ret;
+        } else if (c == '*') {
+            ret.type = PgnToken::ASTERISK;
+            return ret;
+        } else if (c == '[') {
+            ret.type = PgnToken::LEFT_BRACKET;
+            return ret;
+        } else if (c == ']') {
+            ret.type = PgnToken::RIGHT_BRACKET;
+            return ret;
+        } else if (c == '(') {
+            ret.type = PgnToken::LEFT_PAREN;
+            return ret;
+        } else if (c == ')') {
+            ret.type = PgnToken::RIGHT_PAREN;
+            return ret;
+        } else if (c == '{') {
+            std::string* str = dropComments ? nullptr : sb;
+            while (true) {
+                scanWhile([](char ch) { return ch != '}'; }, str);
+                c = getTokenChar();
+                if (c < 0 || c == '}')
+                    break;
+                if (str)
+                    *str += (char)c;
+            }
+            if (c < 0)
                 break;
-            } else if (c == '"') {
-                ret.type = PgnToken::STRING;
-                std::string sb;
-                while (true) {
-                    c = getTokenChar();
-                    if (c == '"') {
-                        break;
-                    } else if (c == '\\') {
-                        c = getTokenChar();
-                    }
-                    sb += c;
-                }
-                ret.token = sb;
+            if (dropComments)
+                continue;
+            ret.type = PgnToken::COMMENT;
+            return ret;
+        } else if (c == ';') {
+            std::string* str = dropComments ? nullptr : sb;
+            scanWhile([](char) { return true; }, str);
+            c = getTokenChar();
+            if (c < 0)
                 break;
-            } else if (c == '$') {
-                ret.type = PgnToken::NAG;
-                std::string sb;
-                while (true) {
+            if (dropComments)
+                continue;
+            ret.type = PgnToken::COMMENT;
+            return ret;
+        } else if (c == '"') {
+            while (true) {
+                scanWhile([](char ch) { return ch != '"' && ch != '\\'; }, sb);
+                c = getTokenChar();
+                if (c == '\\')
                     c = getTokenChar();
-                    if (!isdigit(c)) {
-                        returnTokenChar(c);
-                        break;
-                    }
-                    sb += c;
-                }
-                ret.token = sb;
+                else if (c == '"')
+                    break;
+                if (c < 0)
+                    break;
+                *sb += (char)c;
+            }
+            if (c < 0)
                 break;
-            } else { // Start of symbol or integer
-                ret.type = PgnToken::SYMBOL;
-                std::string sb;
-                sb += c;
-                bool onlyDigits = isdigit(c);
-                const std::string term = ".*[](){;\"$";
-                while (true) {
-                    c = getTokenChar();
-                    if (isspace(c) || (term.find_first_of(c) != std::string::npos)) {
-                        returnTokenChar(c);
-                        break;
-                    }
-                    sb += c;
-                    if (!isdigit(c))
-                        onlyDigits = false;
+            ret.type = PgnToken::STRING;
+            return ret;
+        } else if (c == '$') {
+            scanWhile([](char ch) { return isdigit(ch); }, sb);
+            ret.type = PgnToken::NAG;
+            return ret;
+        } else { // Start of symbol or integer
+            *sb += (char)c;
+            scanWhile([](char ch) {
+                switch (ch) {
+                case '.': case '*': case '[': case ']': case '(': case ')':
+                case '{': case ';': case '"': case '$':
+                    return false;
+                default:
+                    return !isspace(ch);
                 }
-                if (onlyDigits)
-                    ret.type = PgnToken::INTEGER;
-                ret.token = sb;
-                break;
-            }
+            }, sb);
+            bool onlyDigits = true;
+            for (char c : *sb)
+                if (!isdigit(c))
+                    onlyDigits = false;
+            ret.type = onlyDigits ? PgnToken::INTEGER : PgnToken::SYMBOL;
+            return ret;
         }
-    } catch (const std::out_of_range&) {
-        ret.type = PgnToken::END;
     }
+    ret.type = PgnToken::END;
+    ret.token.clear();
     return ret;
 }
 
-PgnToken
-PgnScanner::nextTokenDropComments() {
-    while (true) {
+bool
+PgnScanner::skipVariation() {
+    int nestLevel = 1;
+    while (!savedTokens.empty()) {
         PgnToken tok = nextToken();
-        if (tok.type != PgnToken::COMMENT)
-            return tok;
+        switch (tok.type) {
+        case PgnToken::LEFT_PAREN: nestLevel++; break;
+        case PgnToken::RIGHT_PAREN: nestLevel--; break;
+        case PgnToken::END: return false;
+        }
+        if (nestLevel == 0)
+            return true;
+    }
+    while (true) {
+        scanWhile([](char ch) {
+            switch (ch) {
+            case '(': case ')': case '{': case ';': case '"':
+                return false;
+            default:
+                return true;
+            }
+        }, nullptr);
+        int c = getTokenChar();
+        if (c < 0) {
+            return false;
+        } else if (c == '(') {
+            nestLevel++;
+        } else if (c == ')') {
+            if (--nestLevel == 0)
+                return true;
+        } else if (c == '{') {
+            while (true) {
+                scanWhile([](char ch) { return ch != '}'; }, nullptr);
+                c = getTokenChar();
+                if (c < 0 || c == '}')
+                    break;
+            }
+        } else if (c == ';') {
+            scanWhile([](char) { return true; }, nullptr);
+        } else if (c == '"') {
+            while (true) {
+                scanWhile([](char ch) { return ch != '"' && ch != '\\'; }, nullptr);
+                c = getTokenChar();
+                if (c == '\\')
+                    c = getTokenChar();
+                else if (c == '"')
+                    break;
+                if (c < 0)
+                    break;
+            }
+        }
+        if (c < 0)
+            return false;
     }
 }
 
@@ -250,19 +328,13 @@ Node::parsePgn(PgnScanner& scanner, Position pos, std::shared_ptr<Node> node) {
                 addChild(pos, node, nodeToAdd);
                 moveAdded = false;
             }
-            if (node->getParent()) {
+            if (node->getParent() && !scanner.skipVariations()) {
                 Position pos2(pos);
                 pos2.unMakeMove(node->getMove(), node->getUndoInfo());
                 parsePgn(scanner, pos2, node->getParent());
             } else {
-                int nestLevel = 1;
-                while (nestLevel > 0) {
-                    switch (scanner.nextToken().type) {
-                    case PgnToken::LEFT_PAREN: nestLevel++; break;
-                    case PgnToken::RIGHT_PAREN: nestLevel--; break;
-                    case PgnToken::END: return; // Broken PGN file. Just give up.
-                    }
-                }
+                if (!scanner.skipVariation())
+                    return; // Broken PGN file. Just give up.
             }
             break;
         case PgnToken::NAG:
@@ -588,8 +660,12 @@ GameTree::getGameTreeString(std::string& str, std::set<RangeToNode>& posToNodes)
 
 // --------------------------------------------------------------------------------
 
-PgnReader::PgnReader(std::istream& is)
-    : scanner(is) {
+PgnReader::PgnReader(std::istream& is, bool mainLineOnly)
+    : scanner(is, mainLineOnly) {
+}
+
+PgnReader::PgnReader(const char* data, size_t len, bool mainLineOnly)
+    : scanner(data, len, mainLineOnly) {
 }
 
 bool
@@ -651,3 +727,103 @@ PgnReader::readPGN(GameTree& tree) {
 
     return true;
 }
+
+// --------------------------------------------------------------------------------
+
+PgnSplitter::PgnSplitter(std::istream& is)
+    : is(is) {
+}
+
+bool
+PgnSplitter::readChunk(int maxGames, std::string& chunk, size_t maxBytes) {
+    chunk.clear();
+    int nGames = 0;
+    while (true) {
+        if (!hasLine) {
+            std::getline(is, line);
+            if (!is && line.empty())
+                break;
+            hasLine = true;
+        }
+        const bool tagLine = !inComment && isTagPair(line);
+        const bool moveLine = !inComment && !tagLine && !line.empty() && line[0] != '%' &&
+                              line.find_first_not_of(" \t\r") != std::string::npos;
+        if ((tagLine && (!prevTagLine || gameEnded)) || (moveLine && gameEnded)) {
+            if (nGames >= maxGames || (nGames > 0 && chunk.size() >= maxBytes))
+                break;
+            nGames++;
+            gameEnded = false;
+        }
+        if ((moveLine || inComment) && scanMoveText(line))
+            gameEnded = true;
+        prevTagLine = tagLine;
+        chunk += line;
+        chunk += '\n';
+        hasLine = false;
+    }
+    return !chunk.empty();
+}
+
+bool
+PgnSplitter::isTagPair(const std::string& line) {
+    const int len = line.size();
+    int i = 0;
+    if (i >= len || line[i++] != '[')
+        return false;
+    int nameBeg = i;
+    while (i < len && (isalnum((unsigned char)line[i]) || line[i] == '_'))
+        i++;
+    if (i == nameBeg || i >= len || !isspace((unsigned char)line[i]))
+        return false;
+    while (i < len && isspace((unsigned char)line[i]))
+        i++;
+    if (i >= len || line[i++] != '"')
+        return false;
+    while (i < len && line[i] != '"') {
+        if (line[i] == '\\')
+            i++;
+        i++;
+    }
+    if (i++ >= len)
+        return false;
+    while (i < len && isspace((unsigned char)line[i]))
+        i++;
+    if (i >= len || line[i++] != ']')
+        return false;
+    while (i < len && isspace((unsigned char)line[i]))
+        i++;
+    return i == len;
+}
+
+bool
+PgnSplitter::scanMoveText(const std::string& line) {
+    std::string lastToken;
+    std::string token;
+    auto endToken = [&]() {
+        if (!token.empty()) {
+            lastToken = token;
+            token.clear();
+        }
+    };
+    for (char c : line) {
+        if (inComment) {
+            if (c == '}')
+                inComment = false;
+        } else if (c == '{') {
+            endToken();
+            lastToken.clear();
+            inComment = true;
+        } else if (c == ';') {
+            break;
+        } else if (isspace((unsigned char)c)) {
+            endToken();
+        } else {
+            token += c;
+        }
+    }
+    if (inComment)
+        return false;
+    endToken();
+    return lastToken == "1-0" || lastToken == "0-1" ||
+           lastToken == "1/2-1/2" || lastToken == "*";
+}
@@ -62,9 +62,17 @@ public:
 };
 
 
+/** Splits PGN data into tokens. The data is either read in large blocks from a
+ *  stream, or scanned directly in memory, for example in a memory mapped file. */
 class PgnScanner {
 public:
-    explicit PgnScanner(std::istream& is);
+    /** Scan PGN data read from a stream.
+     *  If mainLineOnly is true, the parser skips all variations. */
+    explicit PgnScanner(std::istream& is, bool mainLineOnly = false);
+
+    /** Scan PGN data stored in memory. The data must stay valid
+     *  during the lifetime of the scanner. */
+    PgnScanner(const char* data, size_t len, bool mainLineOnly = false);
 
     void putBack(const PgnToken& tok);
 
@@ -72,16 +80,37 @@ public:
 
     PgnToken nextTokenDropComments();
 
-    char getNextChar();
-    char getTokenChar();
-    void returnTokenChar(char c);
+    /** Skip to after the RIGHT_PAREN that ends the current variation. Tokens in the
+     *  variation, including comments and nested variations, are not created.
+     *  Return false if the end of the data was reached. */
+    bool skipVariation();
+
+    /** True if variations should be skipped by the parser. */
+    bool skipVariations() const { return mainLineOnly; }
 
 private:
-    std::istream& is;
+    /** Read next token from the input data. If dropComments is true, comments
+     *  are skipped without being stored. */
+    PgnToken readToken(bool dropComments);
+
+    /** Read more data into the buffer. Return false at end of data. */
+    bool fillBuffer();
+
+    /** Return next character, or -1 at end of data. Skips lines starting with %. */
+    int getTokenChar();
+
+    /** Consume characters as long as pred(c) is true and c is not a line break.
+     *  If str is not null, the consumed characters are appended to str. */
+    template <typename Pred>
+    void scanWhile(Pred pred, std::string* str);
+
+    std::istream* is;
+    std::vector<char> buf;
+    const char* cur;    // Next character to read
+    const char* end;    // End of available data
     bool col0;
     bool eofReached;
-    bool hasReturnedChar;
-    char returnedChar;
+    bool mainLineOnly;
     std::vector<PgnToken> savedTokens;
 };
 
@@ -247,7 +276,12 @@ private:
 
 class PgnReader {
 public:
-    explicit PgnReader(std::istream& is);
+    /** Read games from a stream.
+     *  If mainLineOnly is true, variations are skipped and not stored in the game tree. */
+    explicit PgnReader(std::istream& is, bool mainLineOnly = false);
+
+    /** Read games from PGN data in memory, for example from a MappedFile. */
+    PgnReader(const char* data, size_t len, bool mainLineOnly = false);
 
     /** Read next game. Return false if no more games to read. */
     bool readPGN(GameTree& tree);
@@ -256,4 +290,36 @@ private:
     PgnScanner scanner;
 };
 
+/** Splits a PGN stream into chunks of complete games, without parsing the games.
+ *  This makes it possible to parse the games in a chunk in a separate thread.
+ *  A new game is assumed to start at a tag pair line, such as [Event "..."],
+ *  that follows a line that is not a tag pair line, or at the first non-empty
+ *  line after a game termination marker. Lines inside {} comments are ignored
+ *  when looking for the start of a game. */
+class PgnSplitter {
+public:
+    explicit PgnSplitter(std::istream& is);
+
+    /** Read up to maxGames games and store their PGN text in "chunk". Reading
+     *  also stops at the first game start after maxBytes bytes have been read.
+     *  Return false if there is no more data to read. */
+    bool readChunk(int maxGames, std::string& chunk, size_t maxBytes = 16 * 1024 * 1024);
+
+private:
+    /** Return true if "line" is a tag pair, such as [Event "name"]. */
+    static bool isTagPair(const std::string& line);
+
+    /** Update comment state for a movetext line. Return true if the last
+     *  token outside comments is a game termination marker. */
+    bool scanMoveText(const std::string& line);
+
+    std::istream& is;
+    std::string line;        // Line that starts the next game, if hasLine is true
+    bool hasLine = false;
+    bool inComment = false;  // True if inside a {} comment
+    bool prevTagLine = false;// True if previous line was a tag pair
+    bool gameEnded = true;   // True if a game termination marker has been seen
+                             // since the previous game start
+};
+
 #endif /* GAMETREE_HPP_ */
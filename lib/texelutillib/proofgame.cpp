@@ -31,6 +31,7 @@
 #include <iostream>
 #include <climits>
 #include <functional>
+#include <thread>
 
 
 bool ProofGame::staticInitDone = false;
@@ -79,7 +80,8 @@ ProofGame::staticInit() {
 }
 
 ProofGame::ProofGame(const std::string& goal, int a, int b)
-    : queue(TreeNodeCompare(nodes, a, b)) {
+    : goalFen(goal), weightA(a), weightB(b),
+      nPending(0), nQueued(0), numNodes(0), best(INT_MAX), minCost(-1) {
     goalPos = TextIO::readFEN(goal);
     validatePieceCounts(goalPos);
     for (int p = Piece::WKING; p <= Piece::BPAWN; p++)
@@ -148,101 +150,194 @@ ProofGame::validatePieceCounts(const Position& pos) {
 }
 
 int
-ProofGame::search(const std::string& initialFen, std::vector<Move>& movePath) {
+ProofGame::search(const std::string& initialFen, std::vector<Move>& movePath,
+                  int nThreads) {
     Position startPos = TextIO::readFEN(initialFen);
     validatePieceCounts(startPos);
-    addPosition(startPos, 0, true);
 
-    double t0 = currentTime();
+    nThreads = std::max(nThreads, 1);
+    nShards = nThreads;
+    shards.clear();
+    for (U32 i = 0; i < nShards; i++)
+        shards.push_back(make_unique<Shard>());
+    nPending = 0;
+    nQueued = 0;
+    numNodes = 0;
+    best = INT_MAX;
+    minCost = -1;
+
+    addPosition(startPos, 0, 0, *this);
+
+    // Each helper thread needs its own caches and assignment objects
+    std::vector<std::unique_ptr<ProofGame>> boundEvals;
+    for (int i = 1; i < nThreads; i++)
+        boundEvals.push_back(make_unique<ProofGame>(goalFen, weightA, weightB));
+
+    t0 = currentTime();
+    std::vector<std::thread> threads;
+    for (int i = 1; i < nThreads; i++) {
+        ProofGame& boundEval = *boundEvals[i-1];
+        threads.push_back(std::thread([this,i,&boundEval,&startPos,&movePath]() {
+            searchThread(i, boundEval, startPos, movePath);
+        }));
+    }
+    searchThread(0, *this, startPos, movePath);
+    for (std::thread& t : threads)
+        t.join();
+
+    double t1 = currentTime();
+    std::cout << "nodes: " << numNodes
+              << " time: " << t1 - t0 <<  std::endl;
+
+    int epCost = epMove.isEmpty() ? 0 : 1;
+    return best + epCost;
+}
+
+void
+ProofGame::searchThread(int threadNo, ProofGame& boundEval, const Position& startPos,
+                        std::vector<Move>& movePath) {
     Position pos;
-    U64 numNodes = 0;
-    int minCost = -1;
-    int best = INT_MAX;
     UndoInfo ui;
-    while (!queue.empty()) {
-        const U32 idx = queue.top();
-        queue.pop();
-        const TreeNode& tn = nodes[idx];
-        if (tn.ply + tn.bound >= best)
+    U32 nextShard = threadNo;
+    while (nPending > 0) {
+        U32 idx;
+        if (!getWork(threadNo, nextShard++, idx)) {
+            std::this_thread::yield();
             continue;
-        if (tn.ply + tn.bound > minCost) {
-            minCost = tn.ply + tn.bound;
-            std::cout << "min cost: " << minCost << " queue: " << queue.size()
-                      << " nodes:" << numNodes
-                      << " time:" << (currentTime() - t0) << std::endl;
         }
+        TreeNode tn;
+        getNode(idx, tn);
+        const int cost = tn.ply + tn.bound;
+        if (cost < best) {
+            if (cost > minCost) {
+                std::lock_guard<std::mutex> L(solutionMutex);
+                if (cost > minCost) {
+                    minCost = cost;
+                    std::cout << "min cost: " << minCost << " queue: " << nQueued
+                              << " nodes:" << numNodes
+                              << " time:" << (currentTime() - t0) << std::endl;
+                }
+            }
 
-        numNodes++;
+            numNodes++;
 
-        pos.deSerialize(tn.psd);
-        if (tn.ply < best && isSolution(pos)) {
-            getSolution(startPos, idx, movePath);
-            best = tn.ply;
-        }
+            pos.deSerialize(tn.psd);
+            if (isSolution(pos)) {
+                std::lock_guard<std::mutex> L(solutionMutex);
+                if (tn.ply < best) {
+                    getSolution(startPos, idx, movePath);
+                    best = tn.ply;
+                }
+            }
 
-        U64 blocked;
-        if (!computeBlocked(pos, blocked))
-            continue;
+            U64 blocked;
+            if (boundEval.computeBlocked(pos, blocked)) {
+                MoveList moves;
+                MoveGen::pseudoLegalMoves(pos, moves);
+                MoveGen::removeIllegal(pos, moves);
+                for (int i = 0; i < moves.size; i++) {
+                    if (((1ULL << moves[i].from()) | (1ULL << moves[i].to())) & blocked)
+                        continue;
+                    pos.makeMove(moves[i], ui);
+                    addPosition(pos, idx, tn.ply + 1, boundEval);
+                    pos.unMakeMove(moves[i], ui);
+                }
+            }
+        }
+        nPending--; // Children have been queued, so nPending can not reach 0 too early
+    }
+}
 
-#if 0
-        static int cnt = 0;
-        if (((++cnt) % 10000) == 0)
-            std::cout << "ply:" << tn.ply << " bound:" << tn.bound << " "
-                      << TextIO::toFEN(pos) << std::endl;
-#endif
+bool
+ProofGame::getWork(int threadNo, U32 nextShard, U32& idx) {
+    auto peek = [](Shard& shard, QueueEntry& e) -> bool {
+        std::lock_guard<std::mutex> L(shard.mutex);
+        if (shard.queue.empty())
+            return false;
+        e = shard.queue.top();
+        return true;
+    };
 
-        MoveList moves;
-        MoveGen::pseudoLegalMoves(pos, moves);
-        MoveGen::removeIllegal(pos, moves);
-        for (int i = 0; i < moves.size; i++) {
-            if (((1ULL << moves[i].from()) | (1ULL << moves[i].to())) & blocked)
-                continue;
-            pos.makeMove(moves[i], ui);
-            addPosition(pos, idx, false);
-            pos.unMakeMove(moves[i], ui);
-        }
+    // Take work from another shard if it is more promising than the own
+    // shard. This spreads work to all threads at the start of the search and
+    // keeps the node expansion order close to the single threaded order.
+    Shard* src = shards[threadNo].get();
+    Shard* other = shards[nextShard % nShards].get();
+    if (other != src) {
+        QueueEntry otherEntry, ownEntry;
+        if (peek(*other, otherEntry))
+            if (!peek(*src, ownEntry) || QueueEntryCompare()(ownEntry, otherEntry))
+                src = other;
     }
-    double t1 = currentTime();
-    std::cout << "nodes: " << numNodes
-              << " time: " << t1 - t0 <<  std::endl;
 
-    int epCost = epMove.isEmpty() ? 0 : 1;
-    return best + epCost;
+    std::lock_guard<std::mutex> L(src->mutex);
+    if (src->queue.empty())
+        return false;
+    idx = src->queue.top().idx;
+    src->queue.pop();
+    nQueued--;
+    return true;
 }
 
 void
-ProofGame::addPosition(const Position& pos, U32 parent, bool isRoot) {
-    const int ply = isRoot ? 0 : nodes[parent].ply + 1;
-    auto it = nodeHash.find(pos.zobristHash());
-    if ((it != nodeHash.end()) && (it->second <= ply))
-        return;
+ProofGame::addPosition(const Position& pos, U32 parent, int ply, ProofGame& boundEval) {
+    const U64 key = pos.zobristHash();
+    const U32 s = (U32)(key >> 32) % nShards;
+    Shard& shard = *shards[s];
+    {
+        std::lock_guard<std::mutex> L(shard.mutex);
+        auto it = shard.nodeHash.find(key);
+        if ((it != shard.nodeHash.end()) && (it->second <= ply))
+            return;
+    }
 
     TreeNode tn;
     pos.serialize(tn.psd);
     tn.parent = parent;
     tn.ply = ply;
-    int bound = distLowerBound(pos);
+    int bound = boundEval.distLowerBound(pos);
     if (bound < INT_MAX) {
         tn.bound = bound;
-        U32 idx = nodes.size();
-        nodes.push_back(tn);
-        nodeHash[pos.zobristHash()] = ply;
-        queue.push(idx);
+        std::lock_guard<std::mutex> L(shard.mutex);
+        auto it = shard.nodeHash.find(key);
+        if ((it != shard.nodeHash.end()) && (it->second <= ply))
+            return; // Added by other thread while computing bound
+        U32 idx = shard.nodes.size() * nShards + s;
+        shard.nodes.push_back(tn);
+        shard.nodeHash[key] = ply;
+        QueueEntry e;
+        e.weight = tn.sortWeight(weightA, weightB);
+        e.ply = tn.ply;
+        e.parent = tn.parent;
+        e.idx = idx;
+        shard.queue.push(e);
+        nPending++;
+        nQueued++;
     }
 }
 
+void
+ProofGame::getNode(U32 idx, TreeNode& tn) const {
+    Shard& shard = *shards[idx % nShards];
+    std::lock_guard<std::mutex> L(shard.mutex);
+    tn = shard.nodes[idx / nShards];
+}
+
 void
 ProofGame::getSolution(const Position& startPos, int idx, std::vector<Move>& movePath) const {
     std::function<void(int)> getMoves = [this,&movePath,&getMoves](U32 idx) {
-        const TreeNode& tn = nodes[idx];
+        TreeNode tn;
+        getNode(idx, tn);
         if (tn.ply == 0)
             return;
         getMoves(tn.parent);
         Position target;
         target.deSerialize(tn.psd);
 
+        TreeNode parent;
+        getNode(tn.parent, parent);
         Position pos;
-        pos.deSerialize(nodes[tn.parent].psd);
+        pos.deSerialize(parent.psd);
         MoveList moves;
         MoveGen::pseudoLegalMoves(pos, moves);
         MoveGen::removeIllegal(pos, moves);
@@ -261,7 +356,9 @@ ProofGame::getSolution(const Position& startPos, int idx, std::vector<Move>& mov
     getMoves(idx);
     if (!epMove.isEmpty())
         movePath.push_back(epMove);
-    std::cout << nodes[idx].ply << ": ";
+    TreeNode tn;
+    getNode(idx, tn);
+    std::cout << tn.ply << ": ";
     Position pos = startPos;
     UndoInfo ui;
     for (size_t i = 0; i < movePath.size(); i++) {
@@ -34,6 +34,9 @@
 #include <vector>
 #include <unordered_map>
 #include <queue>
+#include <mutex>
+#include <atomic>
+#include <memory>
 
 /**
  * Search for a sequence of legal moves leading from a start to an end position.
@@ -48,9 +51,12 @@ public:
     ProofGame(const std::string& goal, int a = 1, int b = 1);
 
     /** Search for shortest solution. Print solutions to standard output.
-     * Return length of shortest path found.
+     * Return length of shortest path found. If nThreads > 1, several threads
+     * are used to search the tree. Which of several equally short solutions is
+     * found is then not deterministic.
      */
-    int search(const std::string& initialFen, std::vector<Move>& movePath);
+    int search(const std::string& initialFen, std::vector<Move>& movePath,
+               int nThreads = 1);
 
     /** Return goal position. */
     const Position& getGoalPos() const;
@@ -62,8 +68,18 @@ private:
     /** Check that there are not too many pieces present. */
     static void validatePieceCounts(const Position& pos);
 
-    /** Queue a new position to be searched. */
-    void addPosition(const Position& pos, U32 parent, bool isRoot);
+    /** Search loop for one thread. "boundEval" is used to compute lower bounds. */
+    void searchThread(int threadNo, ProofGame& boundEval, const Position& startPos,
+                      std::vector<Move>& movePath);
+
+    /** Queue a new position to be searched. "boundEval" is used to compute
+     *  the lower bound for the position. */
+    void addPosition(const Position& pos, U32 parent, int ply, ProofGame& boundEval);
+
+    /** Remove the most promising node from the shard queue, or from another
+     *  shard queue if it has a more promising node. Return false if there
+     *  were no queued nodes. */
+    bool getWork(int threadNo, U32 nextShard, U32& idx);
 
     /** Return true if pos is equal to the goal position. */
     bool isSolution(const Position& pos) const;
@@ -171,6 +187,9 @@ private:
 
     static const int bigCost = 1000;
 
+    std::string goalFen; // Goal position as given to the constructor
+    int weightA;         // Scale factor for ply when ordering nodes
+    int weightB;         // Scale factor for bound when ordering nodes
     Position goalPos;
     int goalPieceCnt[Piece::nPieceTypes];
     Move epMove; // Move that sets up the EP square to get to the original goalPos
@@ -184,34 +203,61 @@ private:
         int sortWeight(int a, int b) const { return a * ply + b * bound; }
     };
 
-    // All nodes encountered so far
-    std::vector<TreeNode> nodes;
-
-    // Hash table of already seen nodes, to avoid duplicate work after transpositions
-    std::unordered_map<U64,int> nodeHash;
+    /** A queued node. Contains the node data needed to order nodes, so that
+     *  the queue can be used without accessing the node storage. */
+    struct QueueEntry {
+        int weight;
+        U16 ply;
+        U32 parent;
+        U32 idx;
+    };
 
-    class TreeNodeCompare {
+    class QueueEntryCompare {
     public:
-        TreeNodeCompare(const std::vector<TreeNode>& nodes0, int a0, int b0)
-            : nodes(nodes0), k0(a0), k1(b0) {}
-        bool operator()(int a, int b) const {
-            const TreeNode& n1 = nodes[a];
-            const TreeNode& n2 = nodes[b];
-            int min1 = n1.sortWeight(k0, k1);
-            int min2 = n2.sortWeight(k0, k1);
-            if (min1 != min2)
-                return min1 > min2;
+        bool operator()(const QueueEntry& n1, const QueueEntry& n2) const {
+            if (n1.weight != n2.weight)
+                return n1.weight > n2.weight;
             if (n1.ply != n2.ply)
                 return n1.ply < n2.ply;
             return n1.parent < n2.parent;
         }
-    private:
-        const std::vector<TreeNode>& nodes;
-        int k0, k1;
     };
 
-    // Nodes ordered by "ply+bound". Elements are indices in the nodes vector.
-    std::priority_queue<int, std::vector<int>, TreeNodeCompare> queue;
+    /** Part of the search tree. A node is stored in the shard given by its
+     *  hash key, so duplicate detection only needs to lock one shard. Node
+     *  index "idx" is stored in shard idx % nShards at position idx / nShards.
+     *  Each search thread primarily expands nodes from its own shard. */
+    struct Shard {
+        std::mutex mutex;
+
+        // All nodes encountered so far
+        std::vector<TreeNode> nodes;
+
+        // Hash table of already seen nodes, to avoid duplicate work after transpositions
+        std::unordered_map<U64,int> nodeHash;
+
+        // Nodes ordered by "a*ply+b*bound".
+        std::priority_queue<QueueEntry, std::vector<QueueEntry>, QueueEntryCompare> queue;
+    };
+    std::vector<std::unique_ptr<Shard>> shards;
+    U32 nShards = 0;
+
+    /** Get a copy of the node with index "idx". */
+    void getNode(U32 idx, TreeNode& tn) const;
+
+    // Number of queued nodes plus number of nodes being expanded
+    std::atomic<U64> nPending;
+    // Number of queued nodes, only used for progress reporting
+    std::atomic<U64> nQueued;
+    // Number of expanded nodes
+    std::atomic<U64> numNodes;
+    // Length of best solution found so far
+    std::atomic<int> best;
+    // Largest "ply+bound" expanded so far
+    std::atomic<int> minCost;
+    // Protects solution updates and progress output
+    std::mutex solutionMutex;
+    double t0 = 0;
 
     // Cache of recently used ShortestPathData objects
     static const int PathCacheSize = 1024*1024;
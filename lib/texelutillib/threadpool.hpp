@@ -31,6 +31,7 @@
 #include <mutex>
 #include <vector>
 #include <queue>
+#include <map>
 #include <functional>
 #include <exception>
 
@@ -91,7 +92,7 @@ template <typename Func>
 void ThreadPool<Result>::addTask(Func func) {
     {
         std::lock_guard<std::mutex> L(mutex);
-        tasks.push_back(std::forward<Func>(func));
+        tasks.push_back(std::move(func));
     }
     taskCv.notify_all();
 }
@@ -124,7 +125,7 @@ void ThreadPool<Result>::workerLoop(int workerNo) {
                 taskCv.wait(L);
             if (stopped)
                 return;
-            task = tasks.front();
+            task = std::move(tasks.front());
             tasks.pop_front();
             nActive++;
         }
@@ -133,7 +134,7 @@ void ThreadPool<Result>::workerLoop(int workerNo) {
             std::unique_lock<std::mutex> L(mutex);
             nActive--;
             bool empty = results.empty() && exceptions.empty();
-            results.push_back(result);
+            results.push_back(std::move(result));
             if (empty)
                 completeCv.notify_all();
         } catch (...) {
@@ -147,4 +148,56 @@ void ThreadPool<Result>::workerLoop(int workerNo) {
     }
 }
 
+/** Process a sequence of work items using nThreads worker threads.
+ *  produce(Item& item) is called in the calling thread to fill in the next item.
+ *  It returns false when there are no more items.
+ *  work(Item& item, int workerNo) is called in a worker thread to process an item.
+ *  consume(Item& item) is called in the calling thread for each processed item,
+ *  in the same order as the items were produced.
+ *  At most maxInFlight items are in progress at the same time, which bounds the
+ *  amount of memory used when processing large inputs. */
+template <typename Item, typename Produce, typename Work, typename Consume>
+void
+orderedParallelMap(int nThreads, int maxInFlight,
+                   Produce produce, Work work, Consume consume) {
+    struct Task {
+        long long seqNo = -1;
+        Item item;
+    };
+    ThreadPool<Task> pool(nThreads);
+    std::map<long long, Item> finished;
+    long long nextSeqNo = 0;
+    long long nextConsumeNo = 0;
+    int nInFlight = 0;
+    bool eof = false;
+    while (true) {
+        while (!eof && nInFlight < maxInFlight) {
+            Task t;
+            if (!produce(t.item)) {
+                eof = true;
+                break;
+            }
+            t.seqNo = nextSeqNo++;
+            pool.addTask([&work,t](int workerNo) mutable {
+                work(t.item, workerNo);
+                return std::move(t);
+            });
+            nInFlight++;
+        }
+        if (nInFlight == 0)
+            break;
+
+        Task t;
+        if (!pool.getResult(t))
+            break;
+        nInFlight--;
+        finished[t.seqNo] = std::move(t.item);
+        while (!finished.empty() && finished.begin()->first == nextConsumeNo) {
+            consume(finished.begin()->second);
+            finished.erase(finished.begin());
+            nextConsumeNo++;
+        }
+    }
+}
+
 #endif
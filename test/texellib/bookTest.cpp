@@ -26,6 +26,11 @@
 #include "book.hpp"
 #include "textio.hpp"
 #include "moveGen.hpp"
+#include "polyglot.hpp"
+#include "parameters.hpp"
+
+#include <fstream>
+#include <cstdio>
 
 #include "gtest/gtest.h"
 
@@ -72,3 +77,53 @@ TEST(BookTest, testGetAllBookMoves) {
         checkValid(pos, m);
     }
 }
+
+TEST(BookTest, testPolyglotBook) {
+    const std::string fileName = "/tmp/texel_book_test.bin";
+    Position pos = TextIO::readFEN(TextIO::startPosFEN);
+    auto writeBook = [&fileName,&pos](const std::vector<const char*>& moves) {
+        std::ofstream os(fileName, std::ios_base::out | std::ios_base::binary |
+                                   std::ios_base::trunc);
+        const U64 key = PolyglotBook::getHashKey(pos);
+        for (const char* ms : moves) {
+            PolyglotBook::PGEntry ent;
+            Move m = TextIO::stringToMove(pos, ms);
+            PolyglotBook::serialize(key, PolyglotBook::getPGMove(pos, m), 3, ent);
+            os.write((const char*)ent.data, sizeof(ent.data));
+        }
+    };
+
+    // A book file that does not exist yet is opened when it is probed
+    ::remove(fileName.c_str());
+    Parameters::instance().set("BookFile", fileName);
+    {
+        Book book(false);
+        EXPECT_EQ("", book.getAllBookMoves(pos));
+    }
+    writeBook({ "d4", "e4" });
+    {
+        Book book(false);
+        EXPECT_EQ("d4(3) e4(3) ", book.getAllBookMoves(pos));
+    }
+
+    // Setting the option again reloads a changed file
+    writeBook({ "c4" });
+    Parameters::instance().set("BookFile", fileName);
+    {
+        Book book(false);
+        EXPECT_EQ("c4(3) ", book.getAllBookMoves(pos));
+    }
+
+    writeBook({ "d4", "e4" });
+    Parameters::instance().set("BookFile", fileName);
+    Book book(false);
+    EXPECT_EQ("d4(3) e4(3) ", book.getAllBookMoves(pos));
+    Move move;
+    book.getBookMove(pos, move);
+    checkValid(pos, move);
+
+    UndoInfo ui;
+    pos.makeMove(move, ui);
+    EXPECT_EQ("", book.getAllBookMoves(pos));
+    Parameters::instance().set("BookFile", "");
+}
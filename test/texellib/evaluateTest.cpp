@@ -26,6 +26,7 @@
 #include "evaluateTest.hpp"
 #include "positionTest.hpp"
 #include "evaluate.hpp"
+#include "constants.hpp"
 #include "position.hpp"
 #include "textio.hpp"
 #include "parameters.hpp"
@@ -244,6 +245,37 @@ EvaluateTest::testEvalPos() {
     EXPECT_GT(sc2, sc1);
 }
 
+TEST(EvaluateTest, testEvalPosLazy) {
+    auto et = Evaluate::getEvalHashTables();
+    Evaluate eval(*et);
+    const int mate0 = SearchConst::MATE0;
+    Position pos = TextIO::readFEN("r1bqkbnr/pppp1ppp/2n5/4p3/4P3/5N2/PPPP1PPP/RNBQKB1R w KQkq - 2 3");
+    bool exact;
+    int score = eval.evalPosLazy(pos, -mate0, mate0, exact);
+    EXPECT_TRUE(exact);
+    EXPECT_EQ(eval.evalPos(pos), score);
+
+    // Lazy result is not stored in the evaluation hash table
+    pos = TextIO::readFEN("r1b1kbnr/pppp1ppp/2n5/4p3/4P3/5N2/PPPP1PPP/RNBQKB1R w KQkq - 0 3");
+    score = eval.evalPosLazy(pos, -mate0, 0, exact);
+    EXPECT_FALSE(exact);
+    EXPECT_GT(score, lazyEvalMargin);
+    int fullScore = eval.evalPos(pos);
+    EXPECT_LE(std::abs(fullScore - score), lazyEvalMargin);
+    EXPECT_EQ(fullScore, eval.evalPosLazy(pos, -mate0, 0, exact));
+    EXPECT_TRUE(exact);
+
+    pos = TextIO::readFEN("r1bqkbnr/pppp1ppp/2n5/4p3/4P3/5N2/PPPP1PPP/RNB1KB1R w KQkq - 0 3");
+    score = eval.evalPosLazy(pos, 0, mate0, exact);
+    EXPECT_FALSE(exact);
+    EXPECT_LT(score, -lazyEvalMargin);
+
+    // No lazy evaluation in endgames
+    pos = TextIO::readFEN("4k3/8/8/8/8/8/8/QQQ1K3 w - - 0 1");
+    eval.evalPosLazy(pos, -mate0, 0, exact);
+    EXPECT_TRUE(exact);
+}
+
 TEST(EvaluateTest, testPieceSquareEval) {
     EvaluateTest::testPieceSquareEval();
 }
@@ -56,3 +56,75 @@ TEST(HistoryTest, testGetHistScore) {
     ASSERT_EQ(2 * 49 / 4, hs.getHistScore(pos, m1));
     ASSERT_EQ(1 * 49 / 1, hs.getHistScore(pos, m2));
 }
+
+TEST(HistoryTest, testContHistory) {
+    Position pos = TextIO::readFEN(TextIO::startPosFEN);
+    UndoInfo ui;
+    Move e4 = TextIO::stringToMove(pos, "e4");
+    pos.makeMove(e4, ui);
+    Move e5 = TextIO::stringToMove(pos, "e5");
+    pos.makeMove(e5, ui);
+
+    History hs;
+    Move nf3 = TextIO::stringToMove(pos, "Nf3");
+    Move nc3 = TextIO::stringToMove(pos, "Nc3");
+    History::Context noCtx;
+    ASSERT_FALSE(hs.isCounterMove(nf3, noCtx));
+    ASSERT_EQ(-1, hs.getContHistScore(pos, nf3, noCtx));
+
+    History::Context ctx = History::getContext(pos, e5, e4);
+    ASSERT_EQ(Piece::BPAWN * 64 + E5, ctx.prev1);
+    ASSERT_EQ(Piece::WPAWN * 64 + E4, ctx.prev2);
+    ASSERT_FALSE(hs.isCounterMove(nf3, ctx));
+    ASSERT_EQ(-1, hs.getContHistScore(pos, nf3, ctx));
+
+    hs.addSuccess(pos, nf3, 1, ctx);
+    hs.addFail(pos, nc3, 1, ctx);
+    ASSERT_TRUE(hs.isCounterMove(nf3, ctx));
+    ASSERT_FALSE(hs.isCounterMove(nc3, ctx));
+    ASSERT_EQ(49, hs.getContHistScore(pos, nf3, ctx));
+    ASSERT_EQ(0, hs.getContHistScore(pos, nc3, ctx));
+    ASSERT_EQ(49, hs.getHistScore(pos, nf3));
+
+    // Continuation history depends on the previous moves
+    History::Context ctx2 = History::getContext(pos, e4, Move());
+    ASSERT_EQ(Piece::WPAWN * 64 + E4, ctx2.prev1);
+    ASSERT_EQ(-1, ctx2.prev2);
+    ASSERT_FALSE(hs.isCounterMove(nf3, ctx2));
+    ASSERT_EQ(-1, hs.getContHistScore(pos, nf3, ctx2));
+
+    // Null moves are ignored
+    Move nullMove(B1, B1, Piece::EMPTY);
+    History::Context ctx3 = History::getContext(pos, nullMove, e4);
+    ASSERT_EQ(-1, ctx3.prev1);
+    ASSERT_EQ(Piece::WPAWN * 64 + E4, ctx3.prev2);
+
+    hs.init();
+    ASSERT_FALSE(hs.isCounterMove(nf3, ctx));
+    ASSERT_EQ(-1, hs.getContHistScore(pos, nf3, ctx));
+}
+
+TEST(HistoryTest, testCaptureHistory) {
+    Position pos = TextIO::readFEN("4k3/8/8/3p1n2/4P3/2N5/8/4K3 w - - 0 1");
+    History hs;
+    Move exd5 = TextIO::stringToMove(pos, "exd5");
+    Move exf5 = TextIO::stringToMove(pos, "exf5");
+    Move nxd5 = TextIO::stringToMove(pos, "Nxd5");
+    ASSERT_EQ(0, hs.getCaptureHistScore(pos, exd5));
+
+    hs.addCaptureSuccess(pos, exd5, 1);
+    ASSERT_EQ(49, hs.getCaptureHistScore(pos, exd5));
+    ASSERT_EQ(0, hs.getCaptureHistScore(pos, exf5));
+    ASSERT_EQ(0, hs.getCaptureHistScore(pos, nxd5));
+    ASSERT_EQ(0, hs.getHistScore(pos, exd5));
+
+    hs.addCaptureFail(pos, exd5, 1);
+    ASSERT_EQ(49 / 2, hs.getCaptureHistScore(pos, exd5));
+
+    // Same piece and target square, different captured piece
+    Position pos2 = TextIO::readFEN("4k3/8/8/3n1n2/4P3/2N5/8/4K3 w - - 0 1");
+    ASSERT_EQ(0, hs.getCaptureHistScore(pos2, TextIO::stringToMove(pos2, "exd5")));
+
+    hs.init();
+    ASSERT_EQ(0, hs.getCaptureHistScore(pos, exd5));
+}
@@ -28,15 +28,25 @@
 #include "searchTest.hpp"
 #include "parallel.hpp"
 #include "clustertt.hpp"
+#include "clusterconn.hpp"
+#include "treeLogger.hpp"
 #include "position.hpp"
 #include "textio.hpp"
 #include "searchUtil.hpp"
+#include "killerTable.hpp"
+#include "moveGen.hpp"
 #include "util/logger.hpp"
 
 #include <vector>
 #include <memory>
 #include <thread>
 #include <chrono>
+#include <fstream>
+
+#ifndef _WIN32
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
 
 #include "gtest/gtest.h"
 
@@ -300,3 +310,303 @@ TEST(ParallelTest, testCommunicator) {
     root.poll(h0);
     ASSERT_EQ(2, h0.getNStopAck());
 }
+
+TEST(ParallelTest, testSPSCRing) {
+    SPSCRing<int,4> ring;
+    ASSERT_TRUE(ring.empty());
+    ASSERT_EQ(nullptr, ring.front());
+    for (int i = 0; i < 4; i++) {
+        int* p = ring.back();
+        ASSERT_NE(nullptr, p);
+        *p = i;
+        ring.push();
+    }
+    ASSERT_EQ(nullptr, ring.back());
+    ASSERT_FALSE(ring.empty());
+    ASSERT_EQ(0, *ring.front());
+    ring.pop();
+    ASSERT_NE(nullptr, ring.back());
+
+    const int nElems = 100000;
+    SPSCRing<int,8> ring2;
+    std::thread producer([&ring2]() {
+        for (int i = 0; i < nElems; i++) {
+            int* p;
+            while (!(p = ring2.back()))
+                std::this_thread::yield();
+            *p = i;
+            ring2.push();
+        }
+    });
+    int next = 0;
+    while (next < nElems) {
+        int* p = ring2.front();
+        if (!p) {
+            std::this_thread::yield();
+            continue;
+        }
+        ASSERT_EQ(next, *p);
+        ring2.pop();
+        next++;
+    }
+    producer.join();
+    ASSERT_TRUE(ring2.empty());
+}
+
+TEST(ParallelTest, testCommandOverflow) {
+    Notifier notifier0, notifier1;
+    TranspositionTable& tt = SearchTest::tt;
+    ThreadCommunicator root(nullptr, tt, notifier0, false);
+    ThreadCommunicator child(&root, tt, notifier1, false);
+
+    class Handler : public Communicator::CommandHandler {
+    public:
+        void setParam(const std::string& name, const std::string& value) override {
+            values.push_back(value);
+        }
+        void startSearch(int jobId, const SearchTreeInfo& sti,
+                         int alpha, int beta, int depth) override {
+            jobIds.push_back(jobId);
+        }
+        void stopSearch() override {
+            nStop++;
+        }
+        std::vector<std::string> values;
+        std::vector<int> jobIds;
+        int nStop = 0;
+    };
+
+    // More commands than fit in the ring buffer
+    const int nCmds = 50;
+    for (int i = 0; i < nCmds; i++)
+        root.sendSetParam("Hash", num2Str(i), true);
+    Handler h;
+    child.poll(h);
+    ASSERT_EQ(nCmds, h.values.size());
+    for (int i = 0; i < nCmds; i++)
+        ASSERT_EQ(num2Str(i), h.values[i]);
+
+    // A new start or stop command replaces earlier start and stop commands
+    SearchTreeInfo sti;
+    root.sendStartSearch(1, sti, -100, 100, 3);
+    root.sendStartSearch(2, sti, -100, 100, 3);
+    child.poll(h);
+    ASSERT_EQ(1, h.jobIds.size());
+    ASSERT_EQ(2, h.jobIds[0]);
+    root.sendStartSearch(3, sti, -100, 100, 3);
+    root.sendStopSearch();
+    child.poll(h);
+    ASSERT_EQ(1, h.jobIds.size());
+    ASSERT_EQ(1, h.nStop);
+}
+
+TEST(ParallelTest, testThreadStats) {
+    ThreadStats stats;
+    S64 nodes, tbHits;
+    stats.getTotals(nodes, tbHits);
+    ASSERT_EQ(0, nodes);
+    ASSERT_EQ(0, tbHits);
+
+    const int nThreads = 4;
+    std::vector<std::thread> threads;
+    for (int t = 1; t <= nThreads; t++) {
+        threads.emplace_back([&stats,t]() {
+            for (int i = 0; i < 1000; i++)
+                stats.add(t, t, 1);
+        });
+    }
+    for (auto& t : threads)
+        t.join();
+
+    stats.getTotals(nodes, tbHits);
+    ASSERT_EQ(1000 * (1 + 2 + 3 + 4), nodes);
+    ASSERT_EQ(1000 * nThreads, tbHits);
+
+    stats.clear();
+    stats.getTotals(nodes, tbHits);
+    ASSERT_EQ(0, nodes);
+    ASSERT_EQ(0, tbHits);
+    stats.add(2, 5, 1);
+    stats.getTotals(nodes, tbHits);
+    ASSERT_EQ(5, nodes);
+    ASSERT_EQ(1, tbHits);
+}
+
+TEST(ParallelTest, testSearchStatsTotals) {
+    TranspositionTable& tt = SearchTest::tt;
+    Notifier notifier;
+    ThreadCommunicator root(nullptr, tt, notifier, false);
+    std::vector<std::shared_ptr<WorkerThread>> children;
+    WorkerThread::createWorkers(1, &root, 3, tt, children);
+
+    KillerTable kt;
+    History ht;
+    auto et = Evaluate::getEvalHashTables();
+    Search::SearchTables st(root.getCTT(), kt, ht, *et);
+    TreeLogger treeLog;
+    Position pos = TextIO::readFEN(TextIO::startPosFEN);
+    Search sc(pos, SearchTest::nullHist, 0, st, root, treeLog);
+    class StatsListener : public Search::Listener {
+    public:
+        void notifyDepth(int depth) override {}
+        void notifyCurrMove(const Move& m, int moveNr) override {}
+        void notifyPV(int depth, int score, S64 time, S64 nodes, S64 nps,
+                      bool isMate, bool upperBound, bool lowerBound,
+                      const std::vector<Move>& pv, int multiPVIndex,
+                      S64 tbHits) override {}
+        void notifyStats(S64 nodes, S64 nps, int hashFull, S64 tbHits, S64 time) override {}
+        void notifySearchStats(const std::vector<std::string>& lines) override {
+            reports.push_back(lines);
+        }
+        std::vector<std::vector<std::string>> reports;
+    };
+    StatsListener listener;
+    sc.setListener(listener);
+    MoveList moves;
+    MoveGen::pseudoLegalMoves(pos, moves);
+    MoveGen::removeIllegal(pos, moves);
+    sc.timeLimit(-1, -1);
+    sc.iterativeDeepening(moves, 9, -1);
+
+    // Stop the helper threads the same way as EngineMainThread does
+    class Handler : public Communicator::CommandHandler {
+    public:
+        explicit Handler(Communicator& comm) : comm(comm) {}
+        void stopAck() override { comm.sendStopAck(true); }
+    private:
+        Communicator& comm;
+    };
+    Handler handler(root);
+    root.sendStopSearch();
+    root.sendStopAck(false);
+    while (true) {
+        root.poll(handler);
+        if (root.hasStopAck())
+            break;
+        notifier.wait(10);
+    }
+    sc.notifySearchStats();
+    SearchStatsCollector reported;
+    sc.getSearchStatsTotals(reported);
+    S64 helperNodes, helperTbHits;
+    root.getThreadStats().getTotals(helperNodes, helperTbHits);
+
+    // When all threads have terminated, the totals are the sums of the
+    // counters of all threads. They must already be complete after the
+    // stop command has been acknowledged.
+    children.clear();
+    SearchStatsCollector totals;
+    sc.getSearchStatsTotals(totals);
+    EXPECT_EQ(totals.getNodes(false), reported.getNodes(false));
+    EXPECT_EQ(totals.getNodes(true), reported.getNodes(true));
+    for (int c = 0; c < SearchStatsCollector::N_COUNTERS; c++) {
+        auto counter = (SearchStatsCollector::Counter)c;
+        EXPECT_EQ(totals.getCount(counter), reported.getCount(counter));
+    }
+    S64 nodes, tbHits;
+    root.getThreadStats().getTotals(nodes, tbHits);
+    EXPECT_EQ(nodes, helperNodes);
+
+    // All reports to the listener contain the complete totals
+    if (SearchStats::enabled) {
+        EXPECT_GT(totals.getNodes(false), 0);
+        std::vector<std::string> lines;
+        totals.getLines(lines);
+        ASSERT_EQ(1, listener.reports.size());
+        EXPECT_EQ(lines, listener.reports[0]);
+    } else {
+        EXPECT_EQ(0, listener.reports.size());
+    }
+}
+
+#ifndef _WIN32
+TEST(ParallelTest, testSocketConnection) {
+    const int nNodes = 3;
+    const std::string cfgFile = "/tmp/texeltest_cluster_" + num2Str(getpid()) + ".cfg";
+    {
+        std::ofstream os(cfgFile);
+        os << "# Test cluster" << std::endl;
+        for (int n = 0; n < nNodes; n++)
+            os << "unix:" << cfgFile << ".sock" << n << std::endl;
+    }
+    std::vector<std::string> addresses;
+    SocketConnection::readConfig(cfgFile, addresses);
+    ASSERT_EQ(nNodes, addresses.size());
+
+    const int bigLen = SearchConst::MAX_CLUSTER_BUF_SIZE;
+    auto bigData = [](int node, int i) -> U8 {
+        return (U8)(node * 7 + i * 13);
+    };
+
+    // Child processes send two messages to the parent and receive one message
+    std::vector<pid_t> pids;
+    for (int node = 1; node < nNodes; node++) {
+        pid_t pid = fork();
+        ASSERT_GE(pid, 0);
+        if (pid == 0) {
+            bool ok = false;
+            try {
+                std::unique_ptr<ClusterConnection> parentConn;
+                std::vector<std::unique_ptr<ClusterConnection>> childConns;
+                SocketConnection::connectNodes(addresses, node, 0, {}, parentConn, childConns);
+
+                U8 buf[8];
+                Serializer::serialize<sizeof(buf)>(buf, node, 100 + node);
+                parentConn->startSend(buf, sizeof(buf));
+                while (!parentConn->testSend())
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+                std::vector<U8> big(bigLen);
+                for (int i = 0; i < bigLen; i++)
+                    big[i] = bigData(node, i);
+                parentConn->send(&big[0], bigLen);
+
+                int len = parentConn->recv(buf, sizeof(buf));
+                int n, v;
+                Serializer::deSerialize<sizeof(buf)>(buf, n, v);
+                ok = len == sizeof(buf) && n == node && v == -1;
+            } catch (...) {
+            }
+            _exit(ok ? 0 : 1);
+        }
+        pids.push_back(pid);
+    }
+
+    std::unique_ptr<ClusterConnection> parentConn;
+    std::vector<std::unique_ptr<ClusterConnection>> childConns;
+    SocketConnection::connectNodes(addresses, 0, -1, { 1, 2 }, parentConn, childConns);
+    ASSERT_EQ(nullptr, parentConn.get());
+    ASSERT_EQ(2, childConns.size());
+
+    std::vector<U8> buf(bigLen);
+    for (int c = 0; c < 2; c++) {
+        const int node = c + 1;
+        ClusterConnection& conn = *childConns[c];
+        conn.startRecv(&buf[0], bigLen);
+        int len;
+        while (!conn.testRecv(len))
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        ASSERT_EQ(8, len);
+        int n, v;
+        Serializer::deSerialize<8>(&buf[0], n, v);
+        EXPECT_EQ(node, n);
+        EXPECT_EQ(100 + node, v);
+
+        len = conn.recv(&buf[0], bigLen);
+        ASSERT_EQ(bigLen, len);
+        for (int i = 0; i < bigLen; i++)
+            ASSERT_EQ(bigData(node, i), buf[i]);
+
+        Serializer::serialize<8>(&buf[0], node, -1);
+        conn.send(&buf[0], 8);
+    }
+
+    for (pid_t pid : pids) {
+        int status = -1;
+        waitpid(pid, &status, 0);
+        EXPECT_TRUE(WIFEXITED(status));
+        EXPECT_EQ(0, WEXITSTATUS(status));
+    }
+    ::unlink(cfgFile.c_str());
+}
+#endif
@@ -26,6 +26,8 @@
 #include "polyglot.hpp"
 #include "textio.hpp"
 
+#include <fstream>
+
 #include "gtest/gtest.h"
 
 TEST(PolyglotTest, testHashKey) {
@@ -122,3 +124,61 @@ TEST(PolyglotTest, testSerialize) {
     EXPECT_EQ(53000, move);
     EXPECT_EQ(61000, weight);
 }
+
+TEST(PolyglotTest, testBookFile) {
+    const std::string fileName = "/tmp/texel_polyglot_test.bin";
+    auto writeBook = [&fileName](const std::vector<std::pair<U64,U16>>& keysAndMoves) {
+        std::ofstream os(fileName, std::ios_base::out | std::ios_base::binary |
+                                   std::ios_base::trunc);
+        for (const auto& e : keysAndMoves) {
+            PolyglotBook::PGEntry ent;
+            PolyglotBook::serialize(e.first, e.second, e.second * 2, ent);
+            os.write((const char*)ent.data, sizeof(ent.data));
+        }
+    };
+    auto getEntries = [](const PolyglotBookFile& bf, U64 key) {
+        std::vector<std::pair<U16,U16>> ret;
+        bf.forEachEntry(key, [&ret](U16 move, U16 weight) {
+            ret.emplace_back(move, weight);
+        });
+        return ret;
+    };
+
+    // Enough entries to use the index, with runs of equal keys crossing index boundaries
+    std::vector<std::pair<U64,U16>> entries;
+    for (int i = 0; i < 1000; i++) {
+        U64 key = 10 + 3 * (i / 5);
+        entries.emplace_back(key, i % 5 + 1);
+    }
+    writeBook(entries);
+    {
+        PolyglotBookFile bf(fileName);
+        ASSERT_TRUE(bf.isValid());
+        EXPECT_EQ(1000, bf.numEntries());
+        for (int i = 0; i < 200; i++) {
+            U64 key = 10 + 3 * i;
+            auto ret = getEntries(bf, key);
+            ASSERT_EQ(5, ret.size()) << "key:" << key;
+            for (int j = 0; j < 5; j++) {
+                EXPECT_EQ(j + 1, ret[j].first);
+                EXPECT_EQ(2 * (j + 1), ret[j].second);
+            }
+            EXPECT_EQ(0, getEntries(bf, key + 1).size());
+            EXPECT_EQ(0, getEntries(bf, key - 1).size());
+        }
+        EXPECT_EQ(0, getEntries(bf, 0).size());
+        EXPECT_EQ(0, getEntries(bf, 100000).size());
+    }
+
+    // Unsorted files are rejected
+    std::swap(entries[100], entries[900]);
+    writeBook(entries);
+    {
+        PolyglotBookFile bf(fileName);
+        EXPECT_FALSE(bf.isValid());
+        EXPECT_EQ(0, getEntries(bf, 10).size());
+    }
+
+    PolyglotBookFile bf2("/tmp/texel_polyglot_test_nonexistent.bin");
+    EXPECT_FALSE(bf2.isValid());
+}
@@ -54,12 +54,12 @@ TreeLogger SearchTest::treeLog;
 Move
 SearchTest::idSearch(Search& sc, int maxDepth, int minProbeDepth) {
     MoveList moves;
-    MoveGen::pseudoLegalMoves(sc.pos, moves);
-    MoveGen::removeIllegal(sc.pos, moves);
+    MoveGen::pseudoLegalMoves(*sc.curPos, moves);
+    MoveGen::removeIllegal(*sc.curPos, moves);
     sc.scoreMoveList(moves, 0);
     sc.timeLimit(-1, -1);
     Move bestM = sc.iterativeDeepening(moves, maxDepth, -1, 1, false, minProbeDepth);
-    EXPECT_EQ(sc.pos.materialId(), PositionTest::computeMaterialId(sc.pos));
+    EXPECT_EQ(sc.curPos->materialId(), PositionTest::computeMaterialId(*sc.curPos));
     return bestM;
 }
 
@@ -245,6 +245,50 @@ SearchTest::testDrawRep() {
     EXPECT_EQ(0, score); // Draw, black can not escape from perpetual checks
 }
 
+TEST(SearchTest, testUpcomingRep) {
+    SearchTest::testUpcomingRep();
+}
+
+void
+SearchTest::testUpcomingRep() {
+    auto play = [](Position& pos, std::vector<U64>& hashList, const std::string& moves) {
+        UndoInfo ui;
+        std::vector<std::string> strMoves;
+        splitString(moves, strMoves);
+        for (const std::string& ms : strMoves) {
+            hashList.push_back(pos.zobristHash());
+            pos.makeMove(TextIO::uciStringToMove(ms), ui);
+        }
+    };
+
+    // Black can move the knight back to g8, repeating the start position
+    Position pos = TextIO::readFEN(TextIO::startPosFEN);
+    std::vector<U64> hashList;
+    play(pos, hashList, "g1f3 g8f6 f3g1");
+    int n = hashList.size();
+    EXPECT_TRUE(Search::hasUpcomingRepetition(pos, hashList, n, 0));
+    EXPECT_FALSE(Search::hasUpcomingRepetition(pos, hashList, n, 1));
+    play(pos, hashList, "f6g8");
+    EXPECT_TRUE(Search::hasUpcomingRepetition(pos, hashList, hashList.size(), 0));
+    play(pos, hashList, "e2e4");
+    EXPECT_FALSE(Search::hasUpcomingRepetition(pos, hashList, hashList.size(), 0));
+
+    // Not possible if the knight on c3 has replaced the knight on g1
+    pos = TextIO::readFEN(TextIO::startPosFEN);
+    hashList.clear();
+    play(pos, hashList, "g1f3 g8f6 b1c3");
+    EXPECT_FALSE(Search::hasUpcomingRepetition(pos, hashList, hashList.size(), 0));
+
+    // Not possible if the path is blocked
+    pos = TextIO::readFEN("4k3/8/8/8/8/8/8/R3K3 b - - 0 1");
+    hashList.clear();
+    play(pos, hashList, "e8d8 a1a5 d8e8");
+    EXPECT_TRUE(Search::hasUpcomingRepetition(pos, hashList, hashList.size(), 0));
+    pos.setPiece(A3, Piece::BPAWN);
+    hashList[hashList.size() - 3] ^= Position::getHashKey(Piece::BPAWN, A3);
+    EXPECT_FALSE(Search::hasUpcomingRepetition(pos, hashList, hashList.size(), 0));
+}
+
 TEST(SearchTest, testHashing) {
     SearchTest::testHashing();
 }
@@ -487,11 +531,11 @@ SearchTest::testSEE() {
 
     pos = TextIO::readFEN("8/3k4/5R2/8/4pP2/8/8/3K4 b - f3 0 1");
     sc.init(pos, nullHist, 0);
-    int score1 = evalWhite(sc.pos);
-    U64 h1 = sc.pos.zobristHash();
+    int score1 = evalWhite(*sc.curPos);
+    U64 h1 = sc.curPos->zobristHash();
     EXPECT_EQ(0, getSEE(sc, TextIO::stringToMove(pos, "exf3")));
-    int score2 = evalWhite(sc.pos);
-    U64 h2 = sc.pos.zobristHash();
+    int score2 = evalWhite(*sc.curPos);
+    U64 h2 = sc.curPos->zobristHash();
     EXPECT_EQ(score1, score2);
     EXPECT_EQ(h1, h2);
 }
@@ -575,12 +619,12 @@ SearchTest::testTBSearch() {
         pos = TextIO::readFEN("8/8/8/3rk3/8/8/8/KQ6 w - - 0 1"); // KQKR long mate
         sc.init(pos, nullHist, 0);
         MoveList moves;
-        MoveGen::pseudoLegalMoves(sc.pos, moves);
-        MoveGen::removeIllegal(sc.pos, moves);
+        MoveGen::pseudoLegalMoves(*sc.curPos, moves);
+        MoveGen::removeIllegal(*sc.curPos, moves);
         sc.scoreMoveList(moves, 0);
         sc.timeLimit(20000, 40000); // Should take less than 2s to generate the TB
         Move bestM = sc.iterativeDeepening(moves, -1, -1, 1, false, -1);
-        EXPECT_EQ(sc.pos.materialId(), PositionTest::computeMaterialId(sc.pos));
+        EXPECT_EQ(sc.curPos->materialId(), PositionTest::computeMaterialId(*sc.curPos));
         EXPECT_EQ(mate0 - 33 * 2, bestM.score());
         TBTest::initTB(gtbDefaultPath, gtbDefaultCacheMB, rtbDefaultPath);
         tt.clear();
@@ -599,3 +643,69 @@ SearchTest::testFortress() {
     EXPECT_EQ(TextIO::moveToUCIString(bestM), "c2a4");
     EXPECT_GT(bestM.score(), -600);
 }
+
+TEST(SearchTest, testSearchStats) {
+    SearchTest::testSearchStats();
+}
+
+void
+SearchTest::testSearchStats() {
+    using SSC = SearchStatsCollector;
+    SSC s;
+    s.incNode(1, false);
+    s.incNode(2, true);
+    s.incNode(100, true);
+    s.inc(SSC::FAIL_HIGH, 3);
+    s.inc(SSC::FAIL_HIGH, 3);
+    s.inc(SSC::FAIL_HIGH_FIRST, 3);
+    s.inc(SSC::LMP, -2);
+    s.inc(SSC::TT_CUTOFF, 1000);
+    EXPECT_EQ(3, s.getNodes(false));
+    EXPECT_EQ(2, s.getNodes(true));
+    EXPECT_EQ(1, s.getPlyNodes(2));
+    EXPECT_EQ(1, s.getPlyNodes(SSC::MAX_PLY - 1));
+    EXPECT_EQ(2, s.getCount(SSC::FAIL_HIGH, 3));
+    EXPECT_EQ(2, s.getCount(SSC::FAIL_HIGH));
+    EXPECT_EQ(1, s.getCount(SSC::LMP, 0));
+    EXPECT_EQ(1, s.getCount(SSC::TT_CUTOFF, SSC::MAX_DEPTH - 1));
+
+    std::vector<std::string> lines;
+    s.getLines(lines);
+    ASSERT_EQ(2 + SSC::N_COUNTERS, (int)lines.size());
+    EXPECT_EQ("nodes 3 qnodes 2 qshare 66.7% failhigh 2 firstmove 50.0%", lines[0]);
+    EXPECT_EQ("failhigh 2 d3:2", lines[2 + SSC::FAIL_HIGH]);
+    EXPECT_EQ("razor 0", lines[2 + SSC::RAZOR]);
+
+    SearchStatsTotals sst;
+    sst.clear();
+    U64 gen = sst.getGeneration();
+    sst.add(s, gen);
+    EXPECT_EQ(0, s.getNodes(false));
+    s.incNode(1, false);
+    sst.add(s, gen);
+    SSC totals;
+    sst.get(totals);
+    EXPECT_EQ(4, totals.getNodes(false));
+    EXPECT_EQ(2, totals.getCount(SSC::FAIL_HIGH));
+
+    // Counts from an earlier generation are discarded
+    sst.clear();
+    s.incNode(1, false);
+    sst.add(s, gen);
+    EXPECT_EQ(0, s.getNodes(false));
+    sst.get(totals);
+    EXPECT_EQ(0, totals.getNodes(false));
+
+    if (SearchStats::enabled) {
+        Position pos = TextIO::readFEN(TextIO::startPosFEN);
+        Search sc(pos, nullHist, 0, st, comm, treeLog);
+        idSearch(sc, 8);
+        sc.getSearchStatsTotals(totals);
+        EXPECT_GT(totals.getNodes(false), 0);
+        EXPECT_GT(totals.getNodes(true), 0);
+        EXPECT_GT(totals.getCount(SSC::FAIL_HIGH), 0);
+        EXPECT_GT(totals.getCount(SSC::TT_CUTOFF), 0);
+        EXPECT_GT(totals.getCount(SSC::NULL_MOVE_TRY), 0);
+        EXPECT_LE(totals.getCount(SSC::FAIL_HIGH_FIRST), totals.getCount(SSC::FAIL_HIGH));
+    }
+}
@@ -44,6 +44,7 @@ public:
     static void testNegaScout();
     static void testDraw50();
     static void testDrawRep();
+    static void testUpcomingRep();
     static void testHashing();
     static void testLMP();
     static void testCheckEvasion();
@@ -53,6 +54,7 @@ public:
     static void testScoreMoveList();
     static void testTBSearch();
     static void testFortress();
+    static void testSearchStats();
 
 private:
     static int getSEE(Search& sc, const Move& m);
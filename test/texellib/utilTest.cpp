@@ -26,9 +26,12 @@
 #include "util/util.hpp"
 #include "util/timeUtil.hpp"
 #include "util/histogram.hpp"
+#include "util/mappedFile.hpp"
 
 #include <iostream>
+#include <fstream>
 #include <memory>
+#include <cstdio>
 
 #include "gtest/gtest.h"
 
@@ -179,3 +182,34 @@ TEST(UtilTest, testFloorLog2) {
         EXPECT_EQ(i, lg);
     }
 }
+
+TEST(UtilTest, testMappedFile) {
+    std::string fileName = "/tmp/texel_mappedfile_test";
+    std::string contents;
+    for (int i = 0; i < 10000; i++)
+        contents += num2Str(i) + '\n';
+    {
+        std::ofstream os(fileName, std::ios::binary);
+        os << contents;
+    }
+    {
+        MappedFile mf(fileName);
+        EXPECT_TRUE(mf.isOpen());
+        ASSERT_EQ(contents.size(), mf.size());
+        EXPECT_EQ(contents, std::string(mf.data(), mf.size()));
+    }
+    {
+        std::ofstream os(fileName, std::ios::binary);
+    }
+    {
+        MappedFile mf(fileName);
+        EXPECT_TRUE(mf.isOpen());
+        EXPECT_EQ(0, mf.size());
+    }
+    std::remove(fileName.c_str());
+    {
+        MappedFile mf(fileName);
+        EXPECT_FALSE(mf.isOpen());
+        EXPECT_EQ(0, mf.size());
+    }
+}
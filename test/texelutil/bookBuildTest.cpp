@@ -25,7 +25,12 @@
 
 #include "bookBuildTest.hpp"
 #include "bookbuild.hpp"
+#include "bookworker.hpp"
+#include "polyglot.hpp"
 #include "textio.hpp"
+#include "util/random.hpp"
+
+#include <unistd.h>
 
 #include "gtest/gtest.h"
 
@@ -37,13 +42,11 @@ TEST(BookBuildTest, testBookNode) {
 
 void
 BookBuildTest::testBookNode() {
+    BookNodeTable tbl;
     BookData bd(100, 200, 50);
-    {
-        BookNode bn(1234);
-        EXPECT_EQ(INT_MAX, bn.getDepth());
-    }
+    EXPECT_EQ(INT_MAX, tbl.add(1234)->getDepth());
 
-    auto bn(std::make_shared<BookNode>(12345678, true));
+    BookNode* bn = tbl.add(12345678, true);
     EXPECT_EQ(12345678, bn->getHashKey());
     EXPECT_EQ(0, bn->getDepth());
     EXPECT_EQ(BookNode::EMPTY, bn->getState());
@@ -69,28 +72,29 @@ BookBuildTest::testBookNode() {
     {
         BookNode::BookSerializeData bsd;
         bn->serialize(bsd);
-        BookNode bn2(0);
-        bn2.deSerialize(bsd);
-        EXPECT_EQ(12345678, bn2.getHashKey());
-        EXPECT_EQ(0, bn2.getChildren().size());
-        EXPECT_EQ(0, bn2.getParents().size());
-        EXPECT_EQ(BookNode::DESERIALIZED, bn2.getState());
-        EXPECT_EQ(d4, bn2.getBestNonBookMove());
-        EXPECT_EQ(17, bn2.getSearchScore());
-        EXPECT_EQ(4711, bn2.getSearchTime());
+        BookNode* bn2 = tbl.add(0);
+        bn2->deSerialize(bsd);
+        EXPECT_EQ(12345678, bn2->getHashKey());
+        EXPECT_EQ(0, bn2->getChildren().size());
+        EXPECT_EQ(0, bn2->getParents().size());
+        EXPECT_EQ(BookNode::DESERIALIZED, bn2->getState());
+        EXPECT_EQ(d4, bn2->getBestNonBookMove());
+        EXPECT_EQ(17, bn2->getSearchScore());
+        EXPECT_EQ(4711, bn2->getSearchTime());
     }
 
-    auto child(std::make_shared<BookNode>(22222222, false));
+    BookNode* child = tbl.add(22222222, false);
     U16 e4c = e4.getCompressedMove();
-    bn->addChild(e4c, child.get());
-    child->addParent(e4c, bn.get());
+    bn->addChild(e4c, child);
+    child->addParent(e4c, bn);
 
     ASSERT_EQ(1, bn->getChildren().size());
     ASSERT_EQ(0, bn->getParents().size());
     ASSERT_EQ(0, child->getChildren().size());
     ASSERT_EQ(1, child->getParents().size());
-    ASSERT_EQ(child.get(), bn->getChildren().find(e4c)->second);
-    ASSERT_EQ(bn.get(), child->getParents().lower_bound(BookNode::ParentInfo(e4c))->parent);
+    ASSERT_EQ(child, bn->getChild(e4c));
+    ASSERT_EQ(bn, child->getParents()[0].parent);
+    ASSERT_EQ(e4c, child->getParents()[0].compressedMove);
     ASSERT_EQ(0, bn->getDepth());
     ASSERT_EQ(1, child->getDepth());
 
@@ -100,8 +104,8 @@ BookBuildTest::testBookNode() {
     ASSERT_EQ(20, bn->getNegaMaxScore());
     ASSERT_EQ(100, bn->getExpansionCostWhite());
     ASSERT_EQ(100, bn->getExpansionCostBlack());
-    ASSERT_EQ(100, bn->getExpansionCost(bd, child.get(), true));
-    ASSERT_EQ(100, bn->getExpansionCost(bd, child.get(), false));
+    ASSERT_EQ(100, bn->getExpansionCost(bd, child, true));
+    ASSERT_EQ(100, bn->getExpansionCost(bd, child, false));
     ASSERT_EQ(0, bn->getPathErrorWhite());
     ASSERT_EQ(0, bn->getPathErrorBlack());
     ASSERT_EQ(0, child->getPathErrorWhite());
@@ -111,28 +115,30 @@ BookBuildTest::testBookNode() {
     ASSERT_EQ(17, bn->getNegaMaxScore());
     ASSERT_EQ(0, bn->getExpansionCostWhite());
     ASSERT_EQ(0, bn->getExpansionCostBlack());
-    ASSERT_EQ(300, bn->getExpansionCost(bd, child.get(), true));
-    ASSERT_EQ(150, bn->getExpansionCost(bd, child.get(), false));
+    ASSERT_EQ(300, bn->getExpansionCost(bd, child, true));
+    ASSERT_EQ(150, bn->getExpansionCost(bd, child, false));
     ASSERT_EQ(0, bn->getPathErrorWhite());
     ASSERT_EQ(0, bn->getPathErrorBlack());
     ASSERT_EQ(1, child->getPathErrorWhite());
     ASSERT_EQ(0, child->getPathErrorBlack());
 
-    auto child2(std::make_shared<BookNode>(33333333, false));
+    BookNode* child2 = tbl.add(33333333, false);
     U16 e5c = e5.getCompressedMove();
-    child->addChild(e5c, child2.get());
-    child2->addParent(e5c, child.get());
+    child->addChild(e5c, child2);
+    child2->addParent(e5c, child);
 
     ASSERT_EQ(1, bn->getChildren().size());
     ASSERT_EQ(0, bn->getParents().size());
     ASSERT_EQ(1, child->getChildren().size());
     ASSERT_EQ(1, child->getParents().size());
-    ASSERT_EQ(child.get(), bn->getChildren().find(e4c)->second);
-    ASSERT_EQ(bn.get(), child->getParents().lower_bound(BookNode::ParentInfo(e4c))->parent);
+    ASSERT_EQ(child, bn->getChild(e4c));
+    ASSERT_EQ(bn, child->getParents()[0].parent);
+    ASSERT_EQ(e4c, child->getParents()[0].compressedMove);
     ASSERT_EQ(0, child2->getChildren().size());
     ASSERT_EQ(1, child2->getParents().size());
-    ASSERT_EQ(child2.get(), child->getChildren().find(e5c)->second);
-    ASSERT_EQ(child.get(), child2->getParents().lower_bound(BookNode::ParentInfo(e5c))->parent);
+    ASSERT_EQ(child2, child->getChild(e5c));
+    ASSERT_EQ(child, child2->getParents()[0].parent);
+    ASSERT_EQ(e5c, child2->getParents()[0].compressedMove);
     ASSERT_EQ(0, bn->getDepth());
     ASSERT_EQ(1, child->getDepth());
     ASSERT_EQ(2, child2->getDepth());
@@ -142,8 +148,8 @@ BookBuildTest::testBookNode() {
     ASSERT_EQ(17, child2->getNegaMaxScore());
     ASSERT_EQ(0, child2->getExpansionCostWhite());
     ASSERT_EQ(0, child2->getExpansionCostBlack());
-    ASSERT_EQ(150, child->getExpansionCost(bd, child2.get(), true));
-    ASSERT_EQ(300, child->getExpansionCost(bd, child2.get(), false));
+    ASSERT_EQ(150, child->getExpansionCost(bd, child2, true));
+    ASSERT_EQ(300, child->getExpansionCost(bd, child2, false));
 
     ASSERT_EQ(-16, child->getNegaMaxScore());
     ASSERT_EQ(0, child->getExpansionCostWhite());
@@ -152,8 +158,8 @@ BookBuildTest::testBookNode() {
     ASSERT_EQ(17, bn->getNegaMaxScore());
     ASSERT_EQ(0, bn->getExpansionCostWhite());
     ASSERT_EQ(0, bn->getExpansionCostBlack());
-    ASSERT_EQ(300, bn->getExpansionCost(bd, child.get(), true));
-    ASSERT_EQ(150, bn->getExpansionCost(bd, child.get(), false));
+    ASSERT_EQ(300, bn->getExpansionCost(bd, child, true));
+    ASSERT_EQ(150, bn->getExpansionCost(bd, child, false));
 
     ASSERT_EQ(0, bn->getPathErrorWhite());
     ASSERT_EQ(0, bn->getPathErrorBlack());
@@ -170,8 +176,8 @@ BookBuildTest::testBookNode() {
     ASSERT_EQ(-10, child->getNegaMaxScore());
     ASSERT_EQ(100, child->getExpansionCostWhite());
     ASSERT_EQ(100, child->getExpansionCostBlack());
-    ASSERT_EQ(100, child->getExpansionCost(bd, child2.get(), true));
-    ASSERT_EQ(100, child->getExpansionCost(bd, child2.get(), false));
+    ASSERT_EQ(100, child->getExpansionCost(bd, child2, true));
+    ASSERT_EQ(100, child->getExpansionCost(bd, child2, false));
 
     ASSERT_EQ(17, bn->getNegaMaxScore());
     ASSERT_EQ(0, bn->getExpansionCostWhite());
@@ -185,12 +191,12 @@ BookBuildTest::testBookNode() {
     ASSERT_EQ(0, child2->getExpansionCostBlack());
     ASSERT_EQ(100, child->getExpansionCostWhite());
     ASSERT_EQ(100, child->getExpansionCostBlack());
-    ASSERT_EQ(100, child->getExpansionCost(bd, child2.get(), true));
-    ASSERT_EQ(100, child->getExpansionCost(bd, child2.get(), false));
+    ASSERT_EQ(100, child->getExpansionCost(bd, child2, true));
+    ASSERT_EQ(100, child->getExpansionCost(bd, child2, false));
     ASSERT_EQ(200, bn->getExpansionCostWhite());
     ASSERT_EQ(200, bn->getExpansionCostBlack());
-    ASSERT_EQ(200, bn->getExpansionCost(bd, child.get(), true));
-    ASSERT_EQ(200, bn->getExpansionCost(bd, child.get(), false));
+    ASSERT_EQ(200, bn->getExpansionCost(bd, child, true));
+    ASSERT_EQ(200, bn->getExpansionCost(bd, child, false));
 
     child->setSearchResult(bd, c5, -18, 10000);
     ASSERT_EQ(17, bn->getNegaMaxScore());
@@ -259,27 +265,94 @@ BookBuildTest::testBookNode() {
     ASSERT_EQ(50200, bn->getExpansionCostBlack());
 }
 
+TEST(BookBuildTest, testNodeTables) {
+    BookBuildTest::testNodeTables();
+}
+
+void
+BookBuildTest::testNodeTables() {
+    BookNodeTable nodes;
+    EXPECT_EQ(0, nodes.size());
+    EXPECT_EQ(nullptr, nodes.get(1));
+
+    const int N = 1000;
+    std::vector<BookNode*> ptrs;
+    for (int i = 0; i < N; i++) {
+        U64 hashKey = hashU64(i) & ~0xffULL; // Many colliding low bits
+        BookNode* node = nodes.add(hashKey, i == 0);
+        ASSERT_NE(nullptr, node);
+        EXPECT_EQ(hashKey, node->getHashKey());
+        ptrs.push_back(node);
+    }
+    EXPECT_EQ(N, nodes.size());
+    EXPECT_EQ(0, ptrs[0]->getDepth());
+    for (int i = 0; i < N; i++) {
+        U64 hashKey = hashU64(i) & ~0xffULL;
+        EXPECT_EQ(ptrs[i], nodes.get(hashKey)); // Nodes don't move when the table grows
+        EXPECT_EQ(i, nodes.getIndex(hashKey));
+        EXPECT_EQ(ptrs[i], &nodes[i]);
+        EXPECT_EQ(nullptr, nodes.get(hashKey + 1));
+    }
+    int cnt = 0;
+    for (const BookNode& node : nodes)
+        EXPECT_EQ(ptrs[cnt++], &node);
+    EXPECT_EQ(N, cnt);
+    nodes.clear();
+    EXPECT_EQ(0, nodes.size());
+    EXPECT_EQ(nullptr, nodes.get(hashU64(1) & ~0xffULL));
+
+    ParentTable parents;
+    auto getParents = [&parents](U64 childHash) {
+        std::vector<U32> ret;
+        parents.forEachParent(childHash, [&ret](U32 idx) { ret.push_back(idx); });
+        std::sort(ret.begin(), ret.end());
+        return ret;
+    };
+    EXPECT_EQ(std::vector<U32>{}, getParents(17));
+    for (int i = 0; i < N; i++) {
+        U64 childHash = hashU64(i / 3);
+        parents.add(childHash, i);
+        parents.add(childHash, i); // Duplicate, ignored
+    }
+    for (int i = 0; i < N / 3; i++) {
+        std::vector<U32> expected { (U32)(i*3), (U32)(i*3+1), (U32)(i*3+2) };
+        EXPECT_EQ(expected, getParents(hashU64(i)));
+    }
+    for (int i = 0; i < N / 3; i += 2)
+        parents.remove(hashU64(i), i*3+1);
+    parents.remove(hashU64(1), 0); // Not present, ignored
+    for (int i = 0; i < N / 3; i++) {
+        std::vector<U32> expected { (U32)(i*3), (U32)(i*3+2) };
+        if (i % 2 != 0)
+            expected.insert(expected.begin() + 1, i*3+1);
+        EXPECT_EQ(expected, getParents(hashU64(i)));
+    }
+    parents.clear();
+    EXPECT_EQ(std::vector<U32>{}, getParents(hashU64(0)));
+}
+
 TEST(BookBuildTest, testShortestDepth) {
     BookBuildTest::testShortestDepth();
 }
 
 void
 BookBuildTest::testShortestDepth() {
-    auto n1(std::make_shared<BookNode>(1, true));
-    auto n2(std::make_shared<BookNode>(2, false));
-    auto n3(std::make_shared<BookNode>(3, false));
-    auto n4(std::make_shared<BookNode>(4, false));
+    BookNodeTable tbl;
+    BookNode* n1 = tbl.add(1, true);
+    BookNode* n2 = tbl.add(2, false);
+    BookNode* n3 = tbl.add(3, false);
+    BookNode* n4 = tbl.add(4, false);
     Move m(0, 0, Piece::EMPTY);
     U16 mc = m.getCompressedMove();
 
-    n1->addChild(mc, n2.get());
-    n2->addParent(mc, n1.get());
+    n1->addChild(mc, n2);
+    n2->addParent(mc, n1);
 
-    n2->addChild(mc, n3.get());
-    n3->addParent(mc, n2.get());
+    n2->addChild(mc, n3);
+    n3->addParent(mc, n2);
 
-    n3->addChild(mc, n4.get());
-    n4->addParent(mc, n3.get());
+    n3->addChild(mc, n4);
+    n4->addParent(mc, n3);
 
     EXPECT_EQ(0, n1->getDepth());
     EXPECT_EQ(1, n2->getDepth());
@@ -288,8 +361,8 @@ BookBuildTest::testShortestDepth() {
 
     Move m2(1, 1, Piece::EMPTY);
     U16 m2c = m2.getCompressedMove();
-    n1->addChild(m2c, n4.get());
-    n4->addParent(m2c, n1.get());
+    n1->addChild(m2c, n4);
+    n4->addParent(m2c, n1);
 
     EXPECT_EQ(0, n1->getDepth());
     EXPECT_EQ(1, n2->getDepth());
@@ -303,37 +376,38 @@ TEST(BookBuildTest, testBookNodeDAG) {
 
 void
 BookBuildTest::testBookNodeDAG() {
+    BookNodeTable tbl;
     BookData bd(100, 200, 50);
-    auto n1(std::make_shared<BookNode>(1, true));
-    auto n2(std::make_shared<BookNode>(2, false));
-    auto n3(std::make_shared<BookNode>(3, false));
-    auto n4(std::make_shared<BookNode>(4, false));
-    auto n5(std::make_shared<BookNode>(5, false));
-    auto n6(std::make_shared<BookNode>(6, false));
+    BookNode* n1 = tbl.add(1, true);
+    BookNode* n2 = tbl.add(2, false);
+    BookNode* n3 = tbl.add(3, false);
+    BookNode* n4 = tbl.add(4, false);
+    BookNode* n5 = tbl.add(5, false);
+    BookNode* n6 = tbl.add(6, false);
 
     U16 m = TextIO::uciStringToMove("e2e4").getCompressedMove();
-    n1->addChild(m, n2.get());
-    n2->addParent(m, n1.get());
+    n1->addChild(m, n2);
+    n2->addParent(m, n1);
 
     m = TextIO::uciStringToMove("g8f6").getCompressedMove();
-    n2->addChild(m, n3.get());
-    n3->addParent(m, n2.get());
+    n2->addChild(m, n3);
+    n3->addParent(m, n2);
 
     m = TextIO::uciStringToMove("d2d4").getCompressedMove();
-    n3->addChild(m, n4.get());
-    n4->addParent(m, n3.get());
+    n3->addChild(m, n4);
+    n4->addParent(m, n3);
 
     m = TextIO::uciStringToMove("d2d4").getCompressedMove();
-    n1->addChild(m, n5.get());
-    n5->addParent(m, n1.get());
+    n1->addChild(m, n5);
+    n5->addParent(m, n1);
 
     m = TextIO::uciStringToMove("g8f6").getCompressedMove();
-    n5->addChild(m, n6.get());
-    n6->addParent(m, n5.get());
+    n5->addChild(m, n6);
+    n6->addParent(m, n5);
 
     m = TextIO::uciStringToMove("e2e4").getCompressedMove();
-    n6->addChild(m, n4.get());
-    n4->addParent(m, n6.get());
+    n6->addChild(m, n4);
+    n4->addParent(m, n6);
 
     Move nm(0, 0, Piece::EMPTY);
     n1->setSearchResult(bd, nm, 10, 10000);
@@ -660,3 +734,509 @@ BookBuildTest::testSelector() {
         EXPECT_EQ(9, book.bookNodes.size());
     }
 }
+
+TEST(BookBuildTest, testReadWriteFile) {
+    BookBuildTest::testReadWriteFile();
+}
+
+void
+BookBuildTest::testReadWriteFile() {
+    auto system = [](const std::string& cmd) {
+        int ret = ::system(cmd.c_str());
+        ASSERT_EQ(0, ret);
+    };
+    std::string tmpDir = "/tmp/booktest";
+    system("mkdir -p " + tmpDir);
+    system("rm -f " + tmpDir + "/* 2>/dev/null");
+
+    // Create a book containing transpositions
+    Book book("");
+    auto addLine = [&book](const std::string& moves) {
+        Position pos = TextIO::readFEN(TextIO::startPosFEN);
+        std::vector<std::string> moveVec;
+        splitString(moves, moveVec);
+        for (const std::string& ms : moveVec) {
+            Move m = TextIO::stringToMove(pos, ms);
+            UndoInfo ui;
+            ASSERT_NE(nullptr, book.getBookNode(pos.bookHash()));
+            Position tmp(pos);
+            tmp.makeMove(m, ui);
+            if (!book.getBookNode(tmp.bookHash())) {
+                std::vector<U64> toSearch;
+                book.addPosToBook(pos, m, toSearch);
+            }
+            pos.makeMove(m, ui);
+        }
+    };
+    addLine("e4 e5 Nf3 Nc6 Bb5");
+    addLine("Nf3 Nc6 e4 e5");
+    addLine("d4 d5 c4 e6 Nc3");
+    addLine("c4 e6 d4 d5");
+    const std::string bookFile = tmpDir + "/book.bin";
+    book.writeToFile(bookFile);
+
+    // The book file only contains node records, so older versions can read it
+    {
+        std::ifstream is(bookFile, std::ios_base::binary | std::ios_base::ate);
+        EXPECT_EQ(book.bookNodes.size() * 16, (size_t)is.tellg());
+    }
+
+    // Same file without the edge file
+    const std::string oldFile = tmpDir + "/book_old.bin";
+    system("cp " + bookFile + " " + oldFile);
+
+    auto checkSame = [&book](Book& book2) {
+        ASSERT_EQ(book.bookNodes.size(), book2.bookNodes.size());
+        for (const BookNode& n1 : book.bookNodes) {
+            const BookNode* n2 = book2.getBookNode(n1.getHashKey());
+            ASSERT_NE(nullptr, n2);
+            EXPECT_EQ(n1.getDepth(), n2->getDepth());
+            EXPECT_EQ(BookNode::INITIALIZED, n2->getState());
+            ASSERT_EQ(n1.getChildren().size(), n2->getChildren().size());
+            for (size_t i = 0; i < n1.getChildren().size(); i++) {
+                EXPECT_EQ(n1.getChildren()[i].first, n2->getChildren()[i].first);
+                EXPECT_EQ(n1.getChildren()[i].second->getHashKey(),
+                          n2->getChildren()[i].second->getHashKey());
+            }
+            ASSERT_EQ(n1.getParents().size(), n2->getParents().size());
+            for (size_t i = 0; i < n1.getParents().size(); i++) {
+                EXPECT_EQ(n1.getParents()[i].compressedMove, n2->getParents()[i].compressedMove);
+                EXPECT_EQ(n1.getParents()[i].parent->getHashKey(),
+                          n2->getParents()[i].parent->getHashKey());
+            }
+        }
+    };
+
+    Book book2("");
+    book2.readFromFile(bookFile);
+    EXPECT_FALSE(book2.parentTableValid);
+    checkSame(book2);
+
+    Book book3("");
+    book3.readFromFile(oldFile);
+    EXPECT_TRUE(book3.parentTableValid);
+    checkSame(book3);
+
+    // Edges that do not match the move generator are ignored
+    const size_t recSize = sizeof(BookNode::BookSerializeData);
+    auto readData = [](const std::string& fileName) {
+        std::ifstream is(fileName, std::ios_base::binary);
+        return std::vector<char>(std::istreambuf_iterator<char>(is),
+                                 std::istreambuf_iterator<char>());
+    };
+    auto writeData = [](const std::string& fileName, const std::vector<char>& data) {
+        std::ofstream os(fileName, std::ios_base::binary);
+        os.write(data.data(), data.size());
+    };
+    {
+        const std::string badFile = tmpDir + "/book_bad.bin";
+        system("cp " + bookFile + " " + badFile);
+        std::vector<char> edges = readData(Book::edgeFileName(bookFile));
+        for (size_t r = 2; r < edges.size() / recSize; r++)
+            edges[r * recSize + 8] ^= 0x15; // Corrupt the move of each edge
+        writeData(Book::edgeFileName(badFile), edges);
+        Book book5("");
+        book5.readFromFile(badFile);
+        EXPECT_TRUE(book5.parentTableValid);
+        checkSame(book5);
+    }
+
+    // An edge file not matching the book file is ignored
+    {
+        const std::string swapFile = tmpDir + "/book_swap.bin";
+        std::vector<char> data = readData(bookFile);
+        std::swap_ranges(data.begin() + recSize, data.begin() + 2 * recSize,
+                         data.begin() + 2 * recSize);
+        writeData(swapFile, data);
+        system("cp " + Book::edgeFileName(bookFile) + " " + Book::edgeFileName(swapFile));
+        Book book5("");
+        book5.readFromFile(swapFile);
+        EXPECT_TRUE(book5.parentTableValid);
+        checkSame(book5);
+    }
+
+    // Adding a position connecting to two parents requires the hashToParent table
+    for (Book* b : { &book, &book2, &book3 }) {
+        Position pos = TextIO::readFEN(TextIO::startPosFEN);
+        for (const char* ms : { "e4", "e5", "Nf3", "Nc6" }) {
+            UndoInfo ui;
+            pos.makeMove(TextIO::stringToMove(pos, ms), ui);
+        }
+        std::vector<U64> toSearch;
+        b->addPosToBook(pos, TextIO::stringToMove(pos, "Bc4"), toSearch);
+        EXPECT_TRUE(b->parentTableValid);
+    }
+    checkSame(book2);
+    checkSame(book3);
+
+    // Nodes appended after the edge section are linked using move generation
+    const std::string backupFile = tmpDir + "/backup";
+    Book book4(backupFile);
+    book4.readFromFile(bookFile);
+    {
+        // The backup file has an edge file too
+        Book book6("");
+        book6.readFromFile(backupFile);
+        EXPECT_FALSE(book6.parentTableValid);
+        EXPECT_EQ(book4.bookNodes.size(), book6.bookNodes.size());
+    }
+    {
+        Position pos = TextIO::readFEN(TextIO::startPosFEN);
+        for (const char* ms : { "e4", "e5", "Nf3", "Nc6" }) {
+            UndoInfo ui;
+            pos.makeMove(TextIO::stringToMove(pos, ms), ui);
+        }
+        std::vector<U64> toSearch;
+        book4.addPosToBook(pos, TextIO::stringToMove(pos, "Bc4"), toSearch);
+    }
+    book4.flushBackup();
+    Book book5("");
+    book5.readFromFile(backupFile);
+    EXPECT_TRUE(book5.parentTableValid);
+    checkSame(book5);
+}
+
+TEST(BookBuildTest, testBackupWriter) {
+    BookBuildTest::testBackupWriter();
+}
+
+void
+BookBuildTest::testBackupWriter() {
+    auto system = [](const std::string& cmd) {
+        int ret = ::system(cmd.c_str());
+        ASSERT_EQ(0, ret);
+    };
+    std::string tmpDir = "/tmp/booktest";
+    system("mkdir -p " + tmpDir);
+    system("rm -f " + tmpDir + "/* 2>/dev/null");
+    const std::string fileName = tmpDir + "/journal";
+    auto fileSize = [&fileName]() -> long {
+        std::ifstream is(fileName, std::ios_base::binary | std::ios_base::ate);
+        return is ? (long)is.tellg() : -1;
+    };
+    auto record = [](U64 hashKey) {
+        BookNodeTable tbl;
+        BookNode::BookSerializeData bsd;
+        tbl.add(hashKey)->serialize(bsd);
+        return bsd;
+    };
+
+    {
+        BackupWriter bw(fileName);
+        bw.setFlushParams(1000, 100000, false);
+        for (int i = 0; i < 10; i++)
+            bw.append(record(i + 1));
+        EXPECT_EQ(10, bw.getNumAppended());
+        bw.flush();
+        EXPECT_EQ(10 * 16, fileSize());
+
+        // Size threshold
+        bw.setFlushParams(5, 100000, true);
+        for (int i = 0; i < 5; i++)
+            bw.append(record(i + 1));
+        for (int i = 0; i < 100 && fileSize() != 15 * 16; i++)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        EXPECT_EQ(15 * 16, fileSize());
+
+        // Time threshold
+        bw.setFlushParams(1000, 10, false);
+        bw.append(record(17));
+        for (int i = 0; i < 100 && fileSize() != 16 * 16; i++)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        EXPECT_EQ(16 * 16, fileSize());
+
+        // Replace, then append to the new file
+        bw.setFlushParams(1000, 100000, false);
+        bw.append(record(18));
+        bw.replace({ record(1), record(2) }, {});
+        EXPECT_EQ(0, bw.getNumAppended());
+        bw.append(record(3));
+        EXPECT_EQ(1, bw.getNumAppended());
+        bw.flush();
+        EXPECT_EQ(3 * 16, fileSize());
+
+        bw.append(record(4));
+    }
+    // Pending records are written by the destructor
+    EXPECT_EQ(4 * 16, fileSize());
+
+    {
+        // Compaction keeps the last record for each key at the position of
+        // the first record, and does not modify the edge file
+        auto timeRecord = [](U64 hashKey, U32 searchTime) {
+            BookNode::BookSerializeData bsd;
+            Serializer::serialize<sizeof(bsd.data)>(bsd.data, hashKey, (U16)0,
+                                                    (S16)0, searchTime);
+            return bsd;
+        };
+        auto readRecords = [&fileName]() {
+            std::vector<std::pair<U64,U32>> ret;
+            std::ifstream is(fileName, std::ios_base::binary);
+            BookNode::BookSerializeData bsd;
+            while (is.read((char*)bsd.data, sizeof(bsd.data))) {
+                U64 hashKey;
+                U16 move;
+                S16 score;
+                U32 searchTime;
+                Serializer::deSerialize<sizeof(bsd.data)>(bsd.data, hashKey, move,
+                                                          score, searchTime);
+                ret.emplace_back(hashKey, searchTime);
+            }
+            return ret;
+        };
+        const std::string edgeName = Book::edgeFileName(fileName);
+        BackupWriter bw(fileName);
+        bw.setFlushParams(1000, 100000, false);
+        bw.replace({ timeRecord(1, 1), timeRecord(2, 2), timeRecord(3, 3) },
+                   { timeRecord(BookNode::EDGE_SECTION_KEY, 0) });
+        bw.append(timeRecord(2, 5));
+        bw.append(timeRecord(4, 4));
+        bw.append(timeRecord(2, 7));
+        bw.append(timeRecord(1, 8));
+        EXPECT_EQ(4, bw.getNumAppended());
+        bw.compact();
+        EXPECT_EQ(0, bw.getNumAppended());
+        bw.append(timeRecord(5, 5));
+        bw.flush();
+        std::vector<std::pair<U64,U32>> expected { {1,8}, {2,7}, {3,3}, {4,4}, {5,5} };
+        EXPECT_EQ(expected, readRecords());
+        std::ifstream is(edgeName, std::ios_base::binary | std::ios_base::ate);
+        EXPECT_EQ(16, (long)is.tellg());
+    }
+
+    {
+        // The backup file is a valid book file after flushBackup()
+        Book book(fileName);
+        book.setBackupParams(100000, 100000, false);
+        Position pos = TextIO::readFEN(TextIO::startPosFEN);
+        for (const char* ms : { "e4", "e5", "Nf3" }) {
+            Move m = TextIO::stringToMove(pos, ms);
+            std::vector<U64> toSearch;
+            book.addPosToBook(pos, m, toSearch);
+            UndoInfo ui;
+            pos.makeMove(m, ui);
+        }
+        book.flushBackup();
+        Book book2("");
+        book2.readFromFile(fileName);
+        EXPECT_EQ(4, book2.bookNodes.size());
+        EXPECT_TRUE(book2.getBookNode(pos.bookHash()));
+    }
+}
+
+TEST(BookBuildTest, testRemoteWorker) {
+    BookBuildTest::testRemoteWorker();
+}
+
+void
+BookBuildTest::testRemoteWorker() {
+    int toWorker[2], fromWorker[2];
+    ASSERT_EQ(0, pipe(toWorker));
+    ASSERT_EQ(0, pipe(fromWorker));
+    std::thread worker([&]() {
+        FdConnection conn(toWorker[0], fromWorker[1], true);
+        TranspositionTable tt(1024*1024);
+        BookWorker::run(conn, tt);
+    });
+    {
+        RemoteSearchWorker rw(3, make_unique<FdConnection>(fromWorker[0], toWorker[1], true));
+        EXPECT_EQ(3, rw.instNo());
+
+        auto toMoves = [](const std::string& moves, Position& pos) {
+            std::vector<Move> ret;
+            std::vector<std::string> moveVec;
+            splitString(moves, moveVec);
+            for (const std::string& ms : moveVec) {
+                Move m = TextIO::stringToMove(pos, ms);
+                ret.push_back(m);
+                UndoInfo ui;
+                pos.makeMove(m, ui);
+            }
+            return ret;
+        };
+
+        // Mate in one, only searching some of the legal moves
+        Position pos = TextIO::readFEN(TextIO::startPosFEN);
+        std::vector<Move> gameMoves = toMoves("e4 e5 Bc4 Nc6 Qh5 Nf6", pos);
+        Position tmp(pos);
+        std::vector<Move> movesToSearch = toMoves("Qxf7", tmp);
+        tmp = pos;
+        movesToSearch.push_back(toMoves("a3", tmp)[0]);
+        Move m = rw.analyze(gameMoves, movesToSearch, 100);
+        EXPECT_EQ("Qxf7#", TextIO::moveToString(pos, m, false));
+        EXPECT_EQ(SearchConst::MATE0 - 2, m.score());
+
+        tmp = pos;
+        movesToSearch = toMoves("a3", tmp);
+        m = rw.analyze(gameMoves, movesToSearch, 10);
+        EXPECT_EQ("a3", TextIO::moveToString(pos, m, false));
+
+        // Game over positions are handled without searching
+        pos = TextIO::readFEN(TextIO::startPosFEN);
+        gameMoves = toMoves("f3 e5 g4 Qh4", pos);
+        m = rw.analyze(gameMoves, {}, 100);
+        EXPECT_TRUE(m.isEmpty());
+        EXPECT_EQ(-SearchConst::MATE0 + 1, m.score());
+
+        // An invalid search command only fails that search
+        EXPECT_THROW(rw.analyze({ TextIO::uciStringToMove("e2e5") }, {}, 10), WorkUnitError);
+        pos = TextIO::readFEN(TextIO::startPosFEN);
+        tmp = pos;
+        movesToSearch = toMoves("d4", tmp);
+        m = rw.analyze({}, movesToSearch, 10);
+        EXPECT_EQ("d4", TextIO::moveToString(pos, m, false));
+
+        // Searches are fast after abort
+        pos = TextIO::readFEN(TextIO::startPosFEN);
+        rw.abort();
+        tmp = pos;
+        movesToSearch = toMoves("e4", tmp);
+        m = rw.analyze({}, movesToSearch, 1000000);
+        EXPECT_EQ("e4", TextIO::moveToString(pos, m, false));
+    }
+    worker.join();
+
+    std::vector<Move> gameMoves, movesToSearch;
+    int searchTime;
+    EXPECT_TRUE(BookWorker::parseSearchCommand("search 10 e2e4 e7e5 : g1f3 d2d4",
+                                               gameMoves, movesToSearch, searchTime));
+    EXPECT_EQ(10, searchTime);
+    EXPECT_EQ(2, gameMoves.size());
+    EXPECT_EQ(2, movesToSearch.size());
+    EXPECT_TRUE(BookWorker::parseSearchCommand("search 5 :",
+                                               gameMoves, movesToSearch, searchTime));
+    EXPECT_EQ(0, gameMoves.size());
+    EXPECT_EQ(0, movesToSearch.size());
+    EXPECT_FALSE(BookWorker::parseSearchCommand("search 10 e2e5 :",
+                                                gameMoves, movesToSearch, searchTime));
+    EXPECT_FALSE(BookWorker::parseSearchCommand("search 10 e2e4 e7e5",
+                                                gameMoves, movesToSearch, searchTime));
+    EXPECT_FALSE(BookWorker::parseSearchCommand("search 10 e2e4 : e2e4",
+                                                gameMoves, movesToSearch, searchTime));
+}
+
+TEST(BookBuildTest, testSearchScheduler) {
+    BookBuildTest::testSearchScheduler();
+}
+
+void
+BookBuildTest::testSearchScheduler() {
+    /** Fails every search. Fails permanently after "nOk" WorkUnitErrors. */
+    class FailingWorker : public SearchWorker {
+    public:
+        FailingWorker(int instanceNo, int nOk) : SearchWorker(instanceNo), nOk(nOk) {}
+        Move analyze(const std::vector<Move>& gameMoves,
+                     const std::vector<Move>& movesToSearch,
+                     int searchTime) override {
+            if (nOk-- > 0)
+                throw WorkUnitError("Invalid position");
+            throw ChessParseError("Connection closed");
+        }
+        void abort() override {}
+    private:
+        int nOk;
+    };
+
+    auto makeWorkUnit = [](int id) {
+        SearchScheduler::WorkUnit wu;
+        wu.id = id;
+        wu.hashKey = id;
+        wu.searchTime = 10;
+        return wu;
+    };
+
+    SearchScheduler scheduler;
+    scheduler.addWorker(make_unique<FailingWorker>(0, 1));
+    scheduler.startWorkers(nullptr);
+    EXPECT_TRUE(scheduler.hasWorkers());
+
+    // A WorkUnitError only fails the current work unit
+    SearchScheduler::WorkUnit wu;
+    scheduler.addWorkUnit(makeWorkUnit(0));
+    scheduler.getResult(wu);
+    EXPECT_EQ(0, wu.id);
+    EXPECT_TRUE(wu.failed);
+    EXPECT_TRUE(scheduler.hasWorkers());
+
+    // When the last worker fails, queued work units are completed as failed
+    scheduler.addWorkUnit(makeWorkUnit(1));
+    scheduler.addWorkUnit(makeWorkUnit(2));
+    std::set<int> ids;
+    for (int i = 0; i < 2; i++) {
+        scheduler.getResult(wu);
+        EXPECT_TRUE(wu.failed);
+        ids.insert(wu.id);
+    }
+    EXPECT_EQ((std::set<int>{1, 2}), ids);
+    EXPECT_FALSE(scheduler.hasWorkers());
+
+    scheduler.addWorkUnit(makeWorkUnit(3));
+    scheduler.getResult(wu);
+    EXPECT_EQ(3, wu.id);
+    EXPECT_TRUE(wu.failed);
+}
+
+TEST(BookBuildTest, testPolyglotExporter) {
+    BookBuildTest::testPolyglotExporter();
+}
+
+void
+BookBuildTest::testPolyglotExporter() {
+    auto system = [](const std::string& cmd) {
+        int ret = ::system(cmd.c_str());
+        ASSERT_EQ(0, ret);
+    };
+    std::string tmpDir = "/tmp/booktest";
+    system("mkdir -p " + tmpDir);
+    system("rm -f " + tmpDir + "/* 2>/dev/null");
+    auto readFile = [](const std::string& fileName) {
+        std::ifstream is(fileName, std::ios_base::binary);
+        return std::string(std::istreambuf_iterator<char>(is),
+                           std::istreambuf_iterator<char>());
+    };
+
+    const int nKeys = 50;
+    auto addMoves = [nKeys](PolyglotExporter& pe) {
+        Random rnd(17);
+        for (int i = 0; i < 1000; i++) {
+            U64 hash = rnd.nextInt(nKeys) * 0x9e3779b97f4a7c15ULL;
+            U16 move = rnd.nextInt(8) + 1;
+            pe.addMove(hash, move, rnd.nextInt(100));
+        }
+        pe.addMove(1, 1, 2.0);
+        pe.addMove(1, 2, 1.0);
+        pe.addMove(1, 1, 2.0);
+    };
+
+    const std::string file1 = tmpDir + "/book1.bin";
+    const std::string file2 = tmpDir + "/book2.bin";
+    {
+        PolyglotExporter pe(file1);
+        addMoves(pe);
+        pe.write();
+        EXPECT_EQ(0, pe.getNumRuns());
+    }
+    {
+        PolyglotExporter pe(file2, 37);
+        addMoves(pe);
+        pe.write();
+        EXPECT_EQ(28, pe.getNumRuns());
+    }
+    std::string data1 = readFile(file1);
+    EXPECT_FALSE(data1.empty());
+    EXPECT_EQ(data1, readFile(file2));
+    EXPECT_NE(0, ::system(("ls " + tmpDir + "/*.tmp >/dev/null 2>&1").c_str()));
+
+    PolyglotBookFile pbf(file2);
+    EXPECT_TRUE(pbf.isValid());
+    EXPECT_EQ(data1.size() / 16, pbf.numEntries());
+    std::vector<std::pair<U16,U16>> entries;
+    pbf.forEachEntry(1, [&entries](U16 move, U16 weight) {
+        entries.push_back(std::make_pair(move, weight));
+    });
+    ASSERT_EQ(2, entries.size());
+    EXPECT_EQ(1, entries[0].first);
+    EXPECT_EQ(0xffff, entries[0].second);
+    EXPECT_EQ(2, entries[1].first);
+    EXPECT_EQ(0xffff / 4, entries[1].second);
+}
@@ -29,11 +29,17 @@
 class BookBuildTest {
 public:
     static void testBookNode();
+    static void testNodeTables();
     static void testShortestDepth();
     static void testBookNodeDAG();
     static void testAddPosToBook();
     static void testAddPosToBookConnectToChild();
     static void testSelector();
+    static void testReadWriteFile();
+    static void testBackupWriter();
+    static void testRemoteWorker();
+    static void testSearchScheduler();
+    static void testPolyglotExporter();
 };
 
 #endif /* BOOKBUILDTEST_HPP_ */
@@ -191,3 +191,152 @@ e4 e5 Nf3 Nc6 Bb5 (Bc4 Bc5 c3) (Nc3 Nf6) a6 Ba4
     });
     ASSERT_EQ("1:e4 1:e5 2:Nf3 2:Nc6 3:Bb5 3:a6 4:Ba4 3:Bc4 3:Bc5 4:c3 3:Nc3 3:Nf6", result);
 }
+
+TEST(GameTreeTest, testPgnSplitter) {
+    std::string pgn = R"raw([Event "a"]
+[Result "1-0"]
+
+e4 e5 1-0
+
+[Event "b"]
+[Result "0-1"]
+
+d4 d5
+c4 0-1
+[Event "c"]
+[Result "*"]
+
+Nf3 *
+)raw";
+    auto nGames = [](const std::string& chunk) -> int {
+        std::stringstream is(chunk);
+        PgnReader reader(is);
+        GameTree gt;
+        int n = 0;
+        while (reader.readPGN(gt))
+            n++;
+        return n;
+    };
+
+    std::stringstream is(pgn);
+    PgnSplitter splitter(is);
+    std::string chunk;
+    ASSERT_TRUE(splitter.readChunk(2, chunk));
+    ASSERT_EQ(2, nGames(chunk));
+    ASSERT_EQ(0, chunk.find("[Event \"a\"]"));
+    ASSERT_NE(std::string::npos, chunk.find("c4 0-1"));
+    ASSERT_TRUE(splitter.readChunk(2, chunk));
+    ASSERT_EQ(1, nGames(chunk));
+    ASSERT_EQ(0, chunk.find("[Event \"c\"]"));
+    ASSERT_FALSE(splitter.readChunk(2, chunk));
+
+    std::stringstream is2(pgn);
+    PgnSplitter splitter2(is2);
+    std::string all;
+    int nChunks = 0;
+    while (splitter2.readChunk(1, chunk)) {
+        ASSERT_EQ(1, nGames(chunk));
+        all += chunk;
+        nChunks++;
+    }
+    ASSERT_EQ(3, nChunks);
+    ASSERT_EQ(pgn, all);
+
+    { // Tag-like lines inside multi-line comments must not start a new game
+        std::string pgn = R"raw([Event "a"]
+[Result "1-0"]
+
+1. e4 {
+[%clk 0:01:00] } e5 {wrapped
+[%clk 0:00:59]
+} 2. Nf3 1-0
+
+[Event "b"]
+[Result "0-1"]
+
+1. d4 {
+[Event "x"]
+[%clk 0:01:00] } d5 0-1
+)raw";
+        std::stringstream is(pgn);
+        PgnSplitter splitter(is);
+        int nChunks = 0;
+        std::string all;
+        while (splitter.readChunk(1, chunk)) {
+            ASSERT_EQ(1, nGames(chunk));
+            all += chunk;
+            nChunks++;
+        }
+        ASSERT_EQ(2, nChunks);
+        ASSERT_EQ(pgn, all);
+    }
+    { // Games without tag pairs, split by game termination markers and chunk size
+        std::string pgn = "1. e4 e5 1-0\n1. d4 d5\n2. c4 0-1\n1. Nf3 *\n";
+        std::stringstream is(pgn);
+        PgnSplitter splitter(is);
+        ASSERT_TRUE(splitter.readChunk(2, chunk));
+        ASSERT_EQ("1. e4 e5 1-0\n1. d4 d5\n2. c4 0-1\n", chunk);
+        ASSERT_TRUE(splitter.readChunk(100, chunk, 1));
+        ASSERT_EQ("1. Nf3 *\n", chunk);
+        ASSERT_FALSE(splitter.readChunk(2, chunk));
+
+        std::stringstream is2(pgn);
+        PgnSplitter splitter2(is2);
+        ASSERT_TRUE(splitter2.readChunk(100, chunk, 10));
+        ASSERT_EQ("1. e4 e5 1-0\n", chunk);
+        ASSERT_TRUE(splitter2.readChunk(100, chunk, 10));
+        ASSERT_EQ("1. d4 d5\n2. c4 0-1\n", chunk);
+    }
+}
+
+TEST(GameTreeTest, testPgnScanner) {
+    std::string pgn = R"raw([Event "a \"quoted\" name"]
+[Result "1-0"]
+% Escaped line ( { "
+e4 {comment (with) "special" chars} e5 $1 Nf3!? ; line comment (
+Nc6 (Nf6 {x)} (d6 d4) Bc4 {"(}) 12. Bb5 1-0
+
+[Event "b"]
+[Result "*"]
+
+d4 {unterminated
+)raw";
+    auto getTokens = [](PgnScanner& sc) -> std::string {
+        std::string ret;
+        while (true) {
+            PgnToken tok = sc.nextToken();
+            ret += num2Str(tok.type) + ":" + tok.token + "|";
+            if (tok.type == PgnToken::END)
+                break;
+        }
+        return ret;
+    };
+    std::stringstream is(pgn);
+    PgnScanner sc1(is);
+    std::string tokens = getTokens(sc1);
+    ASSERT_EQ("4:|9:Event|0:a \"quoted\" name|5:|4:|9:Result|0:1-0|5:|"
+              "9:e4|10:comment (with) \"special\" chars|9:e5|8:1|9:Nf3!?|10: line comment (|"
+              "9:Nc6|6:|9:Nf6|10:x)|6:|9:d6|9:d4|7:|9:Bc4|10:\"(|7:|1:12|2:|9:Bb5|9:1-0|"
+              "4:|9:Event|0:b|5:|4:|9:Result|0:*|5:|9:d4|11:|", tokens);
+    PgnScanner sc2(pgn.data(), pgn.size());
+    ASSERT_EQ(tokens, getTokens(sc2));
+
+    auto getGames = [](PgnReader& reader) -> std::string {
+        std::string ret;
+        GameTree gt;
+        std::string str;
+        std::set<GameTree::RangeToNode> posToNodes;
+        while (reader.readPGN(gt)) {
+            gt.getGameTreeString(str, posToNodes);
+            ret += str + "|";
+        }
+        return ret;
+    };
+    std::stringstream is3(pgn);
+    PgnReader reader3(is3);
+    ASSERT_EQ("e4 e5 Nf3 Nc6 (Nf6 Bc4) (d6 d4) Bb5|d4|", getGames(reader3));
+    PgnReader reader4(pgn.data(), pgn.size());
+    ASSERT_EQ("e4 e5 Nf3 Nc6 (Nf6 Bc4) (d6 d4) Bb5|d4|", getGames(reader4));
+    PgnReader reader5(pgn.data(), pgn.size(), true);
+    ASSERT_EQ("e4 e5 Nf3 Nc6 Bb5|d4|", getGames(reader5));
+}
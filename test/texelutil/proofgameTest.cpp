@@ -686,6 +686,27 @@ ProofGameTest::testSearch() {
         ASSERT_EQ("b1a3", TextIO::moveToUCIString(movePath[2]));
         ASSERT_EQ("f8g7", TextIO::moveToUCIString(movePath[3]));
     }
+    for (int nThreads = 2; nThreads <= 4; nThreads++) {
+        {
+            ProofGame ps("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w - - 0 1");
+            std::vector<Move> movePath;
+            int best = ps.search(TextIO::startPosFEN, movePath, nThreads);
+            ASSERT_EQ(16, best);
+            ASSERT_EQ(16, movePath.size());
+        }
+        {
+            ProofGame ps("rnbqk1nr/ppppppbp/6p1/8/P7/N7/1PPPPPPP/R1BQKBNR w KQkq - 0 1");
+            std::vector<Move> movePath;
+            int best = ps.search(TextIO::startPosFEN, movePath, nThreads);
+            ASSERT_EQ(4, best);
+            ASSERT_EQ(4, movePath.size());
+            Position pos = TextIO::readFEN(TextIO::startPosFEN);
+            UndoInfo ui;
+            for (const Move& m : movePath)
+                pos.makeMove(m, ui);
+            ASSERT_TRUE(ps.isSolution(pos));
+        }
+    }
 }
 
 TEST(ProofGameTest, testEnPassant) {
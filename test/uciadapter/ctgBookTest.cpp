@@ -0,0 +1,44 @@
+/*
+    Texel - A UCI chess engine.
+    Copyright (C) 2026  Peter Österlund, peterosterlund2@gmail.com
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * ctgBookTest.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: petero
+ */
+
+#include "ctgbook.hpp"
+#include "textio.hpp"
+
+#include "gtest/gtest.h"
+
+
+TEST(CtgBookTest, testTooManyPieces) {
+    // No book files exist, so no position is in the book
+    CtgBook book("/nonexistent/book.ctg", false, false);
+    Move m;
+    Position pos = TextIO::readFEN(TextIO::startPosFEN);
+    EXPECT_FALSE(book.getBookMove(pos, m));
+
+    // The encoding of this position does not fit in the CTG format
+    pos = TextIO::readFEN("krrrrrrr/rrrrrrrr/rrrrrrrr/rrrrrrrr/RRRRRRRR/RRRRRRRR/RRRRRRRR/RRRRRRRK w - - 0 1");
+    EXPECT_FALSE(book.getBookMove(pos, m));
+    pos = TextIO::readFEN("KRRRRRRR/RRRRRRRR/RRRRRRRR/RRRRRRRR/rrrrrrrr/rrrrrrrr/rrrrrrrr/rrrrrrrk b - - 0 1");
+    EXPECT_FALSE(book.getBookMove(pos, m));
+}